@@ -20,6 +20,7 @@
 #include "tbc_extension_timeseriesdata.h"
 #include "tbc_extension_clientattributes.h"
 #include "tbc_extension_sharedattributes.h"
+#include "tbc_extension_schema.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -45,6 +45,23 @@ typedef struct tbce_clientattributes* tbce_clientattributes_handle_t;
  */
 typedef tbcmh_value_t* (*tbce_clientattribute_on_get_t)(void *context);
 
+/**
+ * @brief  Callback of getting scalar value of the device's client-side attribute
+ *
+ * Notes:
+ * - If you call tbce_clientattributes_register_scalar(),
+ *    this callback will be called when you update client-side attribute to the server
+ * - Don't call TBCMH API in this callback!
+ * - value is on the stack of caller, nothing is allocated or freed
+ *
+ * @param context           context param 
+ * @param value             fill current value of a client-side attribute into it
+ *
+ * @return 0/ESP_OK     on success
+ *         -1/ESP_FAIL  on failure
+ */
+typedef tbc_err_t (*tbce_clientattribute_on_get_scalar_t)(void *context, tbcmh_scalar_t *value);
+
 /**
  * @brief  callback of setting value of the device's client-side attribute.
  * Only for initilizing client-side attribute
@@ -126,6 +143,28 @@ tbc_err_t tbce_clientattributes_register_with_set(
                                 tbce_clientattribute_on_get_t on_get,
                                 tbce_clientattribute_on_set_t on_set);
 
+/**
+ * @brief Register a client-side attribute with a scalar getter to TBCE client-side attributes
+ *
+ * Notes:
+ * - It may be called before the MQTT connection is established
+ *
+ * @param clientattributes  TBCE client-side attributes handle
+ * @param key               name of a client-side attribute
+ * @param context       
+ * @param on_get_scalar     Callback of getting scalar value of the device's client-side attribute
+ * @param on_set            Callback of setting value of the device's client-side attribute.
+ *                          It may be NULL.
+ * 
+ * @return  0/ESP_OK on success
+ *         -1/ESP_FAIL on failure
+ */
+tbc_err_t tbce_clientattributes_register_scalar(
+                                tbce_clientattributes_handle_t clientattributes,
+                                const char *key, void *context,
+                                tbce_clientattribute_on_get_scalar_t on_get_scalar,
+                                tbce_clientattribute_on_set_t on_set);
+
 /**
  * @brief Unregister a client-side attribute from TBCE client-side attributes
  *
@@ -195,6 +234,65 @@ tbc_err_t tbce_clientattributes_update(
                                 tbcmh_handle_t client,
                                 int count, /*const char *key,*/...);
 
+/**
+ * @brief Mark a client-side attribute as changed locally, it is published by tbce_clientattributes_flush()
+ *
+ * Notes:
+ * - It may be called before the MQTT connection is established
+ * - Call it after the value returned by on_get()/on_get_scalar() is changed
+ *
+ * @param clientattributes      TBCE client-side attributes handle
+ * @param key                   name of a client-side attribute. NULL for all client-side attributes,
+ *                              e.g. to check all of them by tbce_clientattributes_flush()
+ *
+ * @return  0/ESP_OK on success
+ *         -1/ESP_FAIL on error
+ */
+tbc_err_t tbce_clientattributes_mark_dirty(
+                                tbce_clientattributes_handle_t clientattributes,
+                                const char *key);
+
+/**
+ * @brief Set the window of coalescing changes for tbce_clientattributes_flush()
+ *
+ * Notes:
+ * - It may be called before the MQTT connection is established
+ * - Changes are held until window_ms elapses since the first of them, then they are published together
+ *
+ * @param clientattributes      TBCE client-side attributes handle
+ * @param window_ms             window in milliseconds, 0 to publish changes at the next flush
+ *
+ * @return  0/ESP_OK on success
+ *         -1/ESP_FAIL on error
+ */
+tbc_err_t tbce_clientattributes_set_coalesce(
+                                tbce_clientattributes_handle_t clientattributes,
+                                uint32_t window_ms);
+
+/**
+ * @brief Publish client-side attributes which are marked dirty and changed since they were last published
+ *
+ * Notes:
+ * - It should be called after the MQTT connection is established,
+ *   e.g. periodically in the same loop as tbcmh_run()
+ * - Only values whose fingerprints differ from the last published ones are published,
+ *   all in one message. Nothing is published if none is changed.
+ * - Values published by tbce_clientattributes_update() and received by
+ *   tbce_clientattributes_initialize() are remembered too
+ * - Changes stay dirty if the message fails to be published, and are retried next time
+ * - A queued message(TBCMH_PUBLISH_QUEUED) counts as published. If the TX queue drops
+ *   a message of client-side attributes later, all values are published again
+ *
+ * @param clientattributes      TBCE client-side attributes handle
+ * @param client                ThingsBoard Client MQTT Helper handle
+ *
+ * @return  0/ESP_OK on success, or nothing to publish
+ *         -1/ESP_FAIL on error
+ */
+tbc_err_t tbce_clientattributes_flush(
+                                tbce_clientattributes_handle_t clientattributes,
+                                tbcmh_handle_t client);
+
 #ifdef __cplusplus
 }
 #endif //__cplusplus
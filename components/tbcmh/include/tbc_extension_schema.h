@@ -0,0 +1,116 @@
+// Copyright 2022 liangzhuzhi2020@gmail.com, https://github.com/liang-zhu-zi/esp32-thingsboard-mqtt-client
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// This file is part of the ThingsBoard Client Extension (TBCE) API.
+
+#ifndef _TBC_EXTENSION_SCHEMA_H_
+#define _TBC_EXTENSION_SCHEMA_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "tbc_utils.h"
+#include "tbc_mqtt_helper.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * C types of schema fields
+ */
+#define TBCE_SCHEMA_CTYPE_INT     int64_t
+#define TBCE_SCHEMA_CTYPE_FLOAT   double
+#define TBCE_SCHEMA_CTYPE_BOOL    bool
+#define TBCE_SCHEMA_CTYPE_STRING  const char *
+
+#define _TBCE_SCHEMA_MEMBER(type, member, key)   TBCE_SCHEMA_CTYPE_##type member;
+#define _TBCE_SCHEMA_FIELD(type, member, key)    \
+     { key, offsetof(_tbce_schema_struct_t, member), TBCMH_TX_FIELD_##type, NULL, 0 },
+
+/**
+ * @brief Define a fixed telemetry/client-side attributes schema at compile time
+ *
+ * Notes:
+ * - FIELDS is an X-macro list of X(type, member, key):
+ *      type is INT(int64_t), FLOAT(double), BOOL(bool) or STRING(const char *),
+ *      key is a string literal which needn't to be escaped
+ * - It generates:
+ *      name_t                                                struct of all fields
+ *      tbc_err_t name_add(client, const name_t *data)        add all fields to the message
+ *                                                            begun by tbcmh_tx_begin()
+ *      int name_upload(client, const name_t *data, qos, retain)  publish as telemetry
+ *      int name_update(client, const name_t *data, qos, retain)  publish as client-side attributes
+ * - They are JSON only, and fail if payload_type is TBC_TRANSPORT_PAYLOAD_TYPE_PROTOBUF
+ * - Key fragments such as `"temperature":` are serialized once by tbcmh_tx_register_fields()
+ *   at the first use, then the encoder copies them as they are. It looks up & escapes no key
+ *   and allocates nothing for each field
+ * - Example:
+ *      #define ENV_FIELDS(X)                       \
+ *          X(FLOAT, temperature, "temperature")    \
+ *          X(INT,   rssi,        "rssi")           \
+ *          X(BOOL,  alarm,       "alarm")
+ *      TBCE_SCHEMA_DEFINE(env, ENV_FIELDS)
+ *
+ *      env_t env = {.temperature = 25.5, .rssi = -60, .alarm = false};
+ *      env_upload(client, &env, 1, 0);  // {"temperature":25.5,"rssi":-60,"alarm":false}
+ */
+#define TBCE_SCHEMA_DEFINE(name, FIELDS)                                                  \
+     typedef struct {                                                                    \
+          FIELDS(_TBCE_SCHEMA_MEMBER)                                                    \
+     } name##_t;                                                                         \
+                                                                                         \
+     static inline tbc_err_t name##_add(tbcmh_handle_t client, const name##_t *data)     \
+     {                                                                                   \
+          typedef name##_t _tbce_schema_struct_t;                                        \
+          static tbcmh_tx_field_t fields[] = { FIELDS(_TBCE_SCHEMA_FIELD) };             \
+          int count = (int)(sizeof(fields) / sizeof(fields[0]));                         \
+          if (tbcmh_tx_register_fields(fields, count) != ESP_OK) {                       \
+               return ESP_FAIL;                                                          \
+          }                                                                              \
+          return tbcmh_tx_add_fields(client, fields, count, data);                       \
+     }                                                                                   \
+                                                                                         \
+     static inline int name##_publish(tbcmh_handle_t client, tbcmh_tx_type_t type,       \
+                                      const name##_t *data, int qos, int retain)         \
+     {                                                                                   \
+          if (tbcmh_tx_begin(client, type) != ESP_OK) {                                  \
+               return -1;                                                                \
+          }                                                                              \
+          if (name##_add(client, data) != ESP_OK) {                                      \
+               tbcmh_tx_abort(client);                                                   \
+               return -1;                                                                \
+          }                                                                              \
+          return tbcmh_tx_commit(client, qos, retain);                                   \
+     }                                                                                   \
+                                                                                         \
+     static inline int name##_upload(tbcmh_handle_t client, const name##_t *data,        \
+                                     int qos, int retain)                                \
+     {                                                                                   \
+          return name##_publish(client, TBCMH_TX_TELEMETRY, data, qos, retain);          \
+     }                                                                                   \
+                                                                                         \
+     static inline int name##_update(tbcmh_handle_t client, const name##_t *data,        \
+                                     int qos, int retain)                                \
+     {                                                                                   \
+          return name##_publish(client, TBCMH_TX_ATTRIBUTES, data, qos, retain);         \
+     }
+
+#ifdef __cplusplus
+}
+#endif //__cplusplus
+
+#endif
@@ -29,6 +29,16 @@ extern "C" {
  */
 typedef struct tbce_timeseriesdata* tbce_timeseriesdata_handle_t;
 
+/**
+ * TBCE Time-series upload group handle, see tbce_timeseriesdata_group_create()
+ */
+typedef struct tbce_timeseriesgroup* tbce_timeseriesgroup_handle_t;
+
+/**
+ * TBCE Time-series columnar sample buffer handle, see tbce_timeseriesbuffer_create()
+ */
+typedef struct tbce_timeseriesbuffer* tbce_timeseriesbuffer_handle_t;
+
 /**
  * @brief  Callback of getting value of a time-series axis
  *
@@ -45,6 +55,124 @@ typedef struct tbce_timeseriesdata* tbce_timeseriesdata_handle_t;
  */
 typedef tbcmh_value_t* (*tbce_timeseriesaxis_on_get_t)(void *context);
 
+/**
+ * @brief  Callback of getting scalar value of a time-series axis
+ *
+ * Notes:
+ * - If you call tbce_timeseriesdata_register_scalar(), this callback will be called
+ *      when you upload time-series data
+ * - Don't call TBCMH API in this callback!
+ * - value is on the stack of caller, nothing is allocated or freed
+ *
+ * @param context           context param 
+ * @param value             fill current value of a time-series axis into it
+ *
+ * @return 0/ESP_OK     on success
+ *         -1/ESP_FAIL  on failure
+ */
+typedef tbc_err_t (*tbce_timeseriesaxis_on_get_scalar_t)(void *context, tbcmh_scalar_t *value);
+
+/**
+ * Change-of-value filter of a time-series axis, see tbce_timeseriesdata_set_filter()
+ *
+ * A numeric value is sent when it differs from the last sent value by more than
+ *      max(abs_deadband, rel_deadband * |last sent value|),
+ * or by anything at all when both deadbands are 0.
+ * Bool & string values are sent when they are changed.
+ */
+typedef struct
+{
+     double abs_deadband;     /*!< absolute deadband, 0 for no absolute deadband */
+     double rel_deadband;     /*!< relative deadband, e.g. 0.01 for 1% of the last sent value. 0 for none */
+     uint32_t max_silence_ms; /*!< heartbeat: the value is sent anyway if it isn't sent for such a long time. 0 for never */
+} tbce_timeseriesaxis_filter_t;
+
+/**
+ * Statistics of windowed aggregation, see tbce_timeseriesdata_register_aggregate()
+ */
+typedef enum
+{
+     TBCE_TIMESERIESAGGR_MIN   = 0x01, /*!< "<key>_min",   minimum of samples in the window */
+     TBCE_TIMESERIESAGGR_MAX   = 0x02, /*!< "<key>_max",   maximum of samples in the window */
+     TBCE_TIMESERIESAGGR_MEAN  = 0x04, /*!< "<key>_mean",  arithmetic mean of samples in the window */
+     TBCE_TIMESERIESAGGR_RMS   = 0x08, /*!< "<key>_rms",   root mean square of samples in the window */
+     TBCE_TIMESERIESAGGR_COUNT = 0x10  /*!< "<key>_count", count of samples in the window */
+} tbce_timeseriesaggr_stat_t;
+
+/**
+ * Windowed aggregation of a time-series axis, see tbce_timeseriesdata_register_aggregate()
+ */
+typedef struct
+{
+     uint32_t window_ms;      /*!< length of tumbling window, in milliseconds */
+     uint32_t stats;          /*!< statistics to publish, bitmask of tbce_timeseriesaggr_stat_t */
+} tbce_timeseriesaggr_config_t;
+
+/**
+ * Adaptive sampling of a periodic axis, see tbce_timeseriesdata_set_adaptive()
+ *
+ * Under uplink pressure the period is doubled and the deadbands of the filter
+ * are widened once per pressure level above the priority of the axis.
+ */
+typedef struct
+{
+     uint32_t min_period_ms;  /*!< period when the uplink is healthy, must not be 0 */
+     uint32_t max_period_ms;  /*!< upper limit of stretched period, 0 for min_period_ms */
+     double max_deadband_scale; /*!< upper limit of the factor of widened deadbands, 1 or 0 to keep deadbands */
+     uint8_t priority;        /*!< 0 for the lowest priority, which is degraded first. Axes are degraded at pressure level > priority */
+} tbce_timeseriesaxis_adaptive_t;
+
+/**
+ * Thresholds of uplink pressure, see tbce_timeseriesdata_set_adaptive_config()
+ *
+ * Pressure level rises once per control step while any signal reaches its threshold,
+ * and falls once per recover_ms while all signals are below half of their thresholds.
+ * A threshold of 0 disables its signal.
+ */
+typedef struct
+{
+     int outbox_high_size;     /*!< size of MQTT outbox in bytes, default 8192 */
+     uint32_t ack_latency_high_ms; /*!< publish-ACK latency, default 2000 */
+     int event_queue_high_percent; /*!< high-water mark of the helper queue in percent of its capacity, default 50 */
+     int txqueue_high_count;   /*!< count of messages in priority TX queue, default 16 */
+     uint32_t recover_ms;      /*!< time of healthy uplink before pressure level falls, default 5000 */
+} tbce_timeseriesdata_adaptive_config_t;
+
+/**
+ * Statistics of periodic sampling, see tbce_timeseriesdata_get_stats()
+ */
+typedef struct
+{
+     uint32_t sample_count;   /*!< count of deadlines served by tbce_timeseriesdata_run() */
+     uint32_t publish_count;  /*!< count of messages published by tbce_timeseriesdata_run() */
+     uint32_t missed_count;   /*!< count of deadlines skipped because tbce_timeseriesdata_run() was too late */
+     int64_t last_drift_us;   /*!< latency of the last served deadline, in microseconds */
+     int64_t max_drift_us;    /*!< maximum latency of served deadlines, in microseconds */
+     int64_t avg_drift_us;    /*!< average latency of served deadlines, in microseconds */
+     int pressure_level;      /*!< current uplink pressure level of adaptive sampling, 0 when healthy */
+} tbce_timeseriesdata_stats_t;
+
+/**
+ * C type of a column of the columnar sample buffer
+ */
+typedef enum
+{
+     TBCE_TIMESERIESBUFFER_FLOAT = 0, /*!< float */
+     TBCE_TIMESERIESBUFFER_INT,       /*!< int32_t */
+     TBCE_TIMESERIESBUFFER_BOOL       /*!< bool */
+} tbce_timeseriesbuffer_type_t;
+
+/**
+ * Column of the columnar sample buffer, see tbce_timeseriesbuffer_create()
+ */
+typedef struct
+{
+     const char *key;                    /*!< telemetry key */
+     tbce_timeseriesbuffer_type_t type;  /*!< C type of the column */
+     int decimals;                       /*!< decimals of a float column, -1 for the shortest */
+     uint32_t field_number;              /*!< field number in proto schema for tbce_timeseriesbuffer_upload_proto(), 0 to skip it */
+} tbce_timeseriesbuffer_column_t;
+
 /**
  * @brief   Creates TBCE Time-series data handle
  *
@@ -84,6 +212,162 @@ tbc_err_t tbce_timeseriesdata_register(tbce_timeseriesdata_handle_t tsdata,
                                         void *context,
                                         tbce_timeseriesaxis_on_get_t on_get);
 
+/**
+ * @brief Register a time axis with a scalar getter to TBCE Time-series data set
+ *
+ * Notes:
+ * - It may be called before the MQTT connection is established
+ *
+ * @param tsdata        TBCE Time-series data handle
+ * @param key           name of a Time-series axis
+ * @param context       
+ * @param on_get_scalar Callback of getting scalar value of a time-series axis
+ * 
+ * @return  0/ESP_OK on success
+ *         -1/ESP_FAIL on failure
+ */
+tbc_err_t tbce_timeseriesdata_register_scalar(tbce_timeseriesdata_handle_t tsdata,
+                                        const char *key,
+                                        void *context,
+                                        tbce_timeseriesaxis_on_get_scalar_t on_get_scalar);
+
+/**
+ * @brief Register a time axis of windowed aggregation to TBCE Time-series data set
+ *
+ * Notes:
+ * - It may be called before the MQTT connection is established
+ * - Raw samples are pushed by tbce_timeseriesdata_push(), then statistics of each
+ *   tumbling window are published by tbce_timeseriesdata_run() automatically,
+ *   stamped with "ts" of the end of the window
+ * - Memory is constant, it doesn't depend on count of samples in a window
+ * - The axis isn't sent by tbce_timeseriesdata_upload()
+ *
+ * @param tsdata        TBCE Time-series data handle
+ * @param key           name of a Time-series axis
+ * @param config        window & statistics
+ * 
+ * @return  0/ESP_OK on success
+ *         -1/ESP_FAIL on failure
+ */
+tbc_err_t tbce_timeseriesdata_register_aggregate(tbce_timeseriesdata_handle_t tsdata,
+                                        const char *key,
+                                        const tbce_timeseriesaggr_config_t *config);
+
+/**
+ * @brief Push a raw sample to a time axis of windowed aggregation
+ *
+ * Notes:
+ * - It only takes a short spinlock to find the axis, so it may be called from a high-rate sampling task
+ * - Only one task should push samples to the same axis
+ * - It is safe against tbce_timeseriesdata_register_*() & tbce_timeseriesdata_unregister()
+ *   in another task, but not against tbce_timeseriesdata_destroy()
+ *
+ * @param tsdata        TBCE Time-series data handle
+ * @param key           name of a Time-series axis registered by tbce_timeseriesdata_register_aggregate()
+ * @param value         raw sample
+ * 
+ * @return  0/ESP_OK on success
+ *         -1/ESP_FAIL on failure
+ */
+tbc_err_t tbce_timeseriesdata_push(tbce_timeseriesdata_handle_t tsdata,
+                                        const char *key, double value);
+
+/**
+ * @brief Set fixed decimals of float values of a time-series axis
+ *
+ * Notes:
+ * - It may be called before the MQTT connection is established
+ * - By default(-1), float values are written as the shortest decimal that
+ *   is parsed back to the same double
+ *
+ * @param tsdata        TBCE Time-series data handle
+ * @param key           name of a Time-series axis
+ * @param decimals      count of decimals, 0~9. -1 for the shortest decimal.
+ * 
+ * @return  0/ESP_OK on success
+ *         -1/ESP_FAIL on failure
+ */
+tbc_err_t tbce_timeseriesdata_set_decimals(tbce_timeseriesdata_handle_t tsdata,
+                                        const char *key, int decimals);
+
+/**
+ * @brief Set change-of-value filter of a time-series axis
+ *
+ * Notes:
+ * - It may be called before the MQTT connection is established
+ * - Call it just after tbce_timeseriesdata_register()/tbce_timeseriesdata_register_scalar()
+ * - By default(filter is NULL), the axis is sent in every tbce_timeseriesdata_upload()
+ * - The last sent value is remembered only after the publish is successful
+ * - A message queued by the TX queue(TBCMH_PUBLISH_QUEUED) counts as sent. If the queue drops it later,
+ *   the last sent values are forgotten and the next upload sends them again
+ *
+ * @param tsdata        TBCE Time-series data handle
+ * @param key           name of a Time-series axis
+ * @param filter        change-of-value filter. NULL to remove the filter.
+ * 
+ * @return  0/ESP_OK on success
+ *         -1/ESP_FAIL on failure
+ */
+tbc_err_t tbce_timeseriesdata_set_filter(tbce_timeseriesdata_handle_t tsdata,
+                                        const char *key,
+                                        const tbce_timeseriesaxis_filter_t *filter);
+
+/**
+ * @brief Set sampling period of a time-series axis
+ *
+ * Notes:
+ * - It may be called before the MQTT connection is established
+ * - Call it just after tbce_timeseriesdata_register()/tbce_timeseriesdata_register_scalar()
+ * - The axis is sampled and published by tbce_timeseriesdata_run() once per period.
+ *   Deadlines are aligned to the creation of tsdata, so axes whose deadlines
+ *   coincide are published in one message.
+ * - Use multiples of a common period (e.g. 1s, 5s, 60s) for fewer, fuller messages
+ *
+ * @param tsdata        TBCE Time-series data handle
+ * @param key           name of a Time-series axis
+ * @param period_ms     sampling period in milliseconds. 0 to stop periodic sampling.
+ * 
+ * @return  0/ESP_OK on success
+ *         -1/ESP_FAIL on failure
+ */
+tbc_err_t tbce_timeseriesdata_set_period(tbce_timeseriesdata_handle_t tsdata,
+                                        const char *key, uint32_t period_ms);
+
+/**
+ * @brief Set adaptive sampling of a time-series axis
+ *
+ * Notes:
+ * - It may be called before the MQTT connection is established
+ * - Call it just after tbce_timeseriesdata_register()/tbce_timeseriesdata_register_scalar().
+ *   It replaces tbce_timeseriesdata_set_period(), the axis is sampled every min_period_ms
+ *   while the uplink is healthy.
+ * - tbce_timeseriesdata_run() watches MQTT outbox size, publish-ACK latency, the helper queue
+ *   and the priority TX queue (see tbcmh_get_link_stats()), stretches periods and widens
+ *   deadbands of low-priority axes under pressure, and restores them when the uplink recovers
+ *
+ * @param tsdata        TBCE Time-series data handle
+ * @param key           name of a Time-series axis
+ * @param adaptive      min/max period & priority. NULL to disable adaptive sampling and keep the current period.
+ * 
+ * @return  0/ESP_OK on success
+ *         -1/ESP_FAIL on failure
+ */
+tbc_err_t tbce_timeseriesdata_set_adaptive(tbce_timeseriesdata_handle_t tsdata,
+                                        const char *key,
+                                        const tbce_timeseriesaxis_adaptive_t *adaptive);
+
+/**
+ * @brief Set thresholds of uplink pressure for adaptive sampling
+ *
+ * @param tsdata        TBCE Time-series data handle
+ * @param config        thresholds. NULL to restore defaults.
+ * 
+ * @return  0/ESP_OK on success
+ *         -1/ESP_FAIL on failure
+ */
+tbc_err_t tbce_timeseriesdata_set_adaptive_config(tbce_timeseriesdata_handle_t tsdata,
+                                        const tbce_timeseriesdata_adaptive_config_t *config);
+
 /**
  * @brief Unregister a time-series axis from TBCE Time-series data set
  *
@@ -104,6 +388,8 @@ tbc_err_t tbce_timeseriesdata_unregister(tbce_timeseriesdata_handle_t tsdata,
  *
  * Notes:
  * - It should be called after the MQTT connection is established
+ * - Axes that are filtered out by tbce_timeseriesdata_set_filter() are skipped.
+ *   Nothing is published if all axes are skipped.
  *
  * @param tsdata     TBCE Time-series data
  * @param client     ThingsBoard Client MQTT Helper handle
@@ -118,6 +404,235 @@ tbc_err_t tbce_timeseriesdata_upload(tbce_timeseriesdata_handle_t tsdata,
                                         tbcmh_handle_t client,
                                         int count, /*const char *key,*/ ...);
 
+/**
+ * @brief Create an upload group of some Time-series axes
+ *
+ * Notes:
+ * - It may be called before the MQTT connection is established
+ * - Axes are resolved once into a contiguous array, and their keys are serialized once.
+ *   tbce_timeseriesdata_upload_group() costs only the value formatting.
+ * - Axes of windowed aggregation can't be in a group
+ * - An axis which is unregistered later is skipped by tbce_timeseriesdata_upload_group()
+ * - The group is destroyed by tbce_timeseriesdata_group_destroy() or tbce_timeseriesdata_destroy()
+ *
+ * @param tsdata     TBCE Time-series data
+ * @param keys       names of some Time-series axes
+ * @param count      count of keys
+ *
+ * @return  tbce_timeseriesgroup_handle_t if successfully created, NULL on error
+ */
+tbce_timeseriesgroup_handle_t tbce_timeseriesdata_group_create(tbce_timeseriesdata_handle_t tsdata,
+                                        const char *keys[], int count);
+
+/**
+ * @brief Destroy an upload group
+ *
+ * Notes:
+ * - A group which isn't created by tsdata is left untouched
+ *
+ * @param tsdata     TBCE Time-series data
+ * @param group      upload group created by tbce_timeseriesdata_group_create()
+ */
+void tbce_timeseriesdata_group_destroy(tbce_timeseriesdata_handle_t tsdata,
+                                        tbce_timeseriesgroup_handle_t group);
+
+/**
+ * @brief Publish the Time-series axes of an upload group to the server
+ *
+ * Notes:
+ * - It should be called after the MQTT connection is established
+ * - Same as tbce_timeseriesdata_upload(), axes that are filtered out are skipped,
+ *   and nothing is published if all axes are skipped.
+ *
+ * @param tsdata     TBCE Time-series data
+ * @param client     ThingsBoard Client MQTT Helper handle
+ * @param group      upload group created by tbce_timeseriesdata_group_create()
+ *
+ * @return  0/ESP_OK on success
+ *         -1/ESP_FAIL on error
+ */
+tbc_err_t tbce_timeseriesdata_upload_group(tbce_timeseriesdata_handle_t tsdata,
+                                        tbcmh_handle_t client,
+                                        tbce_timeseriesgroup_handle_t group);
+
+/**
+ * @brief Publish due periodic axes & closed windows of aggregation axes to the server
+ *
+ * Notes:
+ * - It should be called periodically after the MQTT connection is established,
+ *   e.g. in the same loop as tbcmh_run(). Deadlines are served and windows are closed in it.
+ * - Periodic axes whose deadlines are reached are published in one message.
+ *   A deadline is served once its value is published, it is retried in the next call on failure.
+ *   Statistics of each closed window are published in their own message, stamped with
+ *   "ts" of the end of the window
+ * - Periodic axes are filtered by tbce_timeseriesdata_set_filter() too
+ * - Nothing is published for a window without any sample
+ * - If statistics of a closed window fail to be published, they are published again in the next call.
+ *   Until then, samples of the following windows are merged into one window
+ *
+ * @param tsdata     TBCE Time-series data
+ * @param client     ThingsBoard Client MQTT Helper handle
+ *
+ * @return  0/ESP_OK on success
+ *         -1/ESP_FAIL on error, e.g. TX buffer can't begin or a publish fails
+ */
+tbc_err_t tbce_timeseriesdata_run(tbce_timeseriesdata_handle_t tsdata,
+                                        tbcmh_handle_t client);
+
+/**
+ * @brief Get statistics of periodic sampling, e.g. scheduling drift
+ *
+ * @param tsdata     TBCE Time-series data
+ * @param stats      filled with statistics
+ *
+ * @return  0/ESP_OK on success
+ *         -1/ESP_FAIL on error
+ */
+tbc_err_t tbce_timeseriesdata_get_stats(tbce_timeseriesdata_handle_t tsdata,
+                                        tbce_timeseriesdata_stats_t *stats);
+
+/**
+ * @brief Create a columnar sample buffer for high-rate multi-axis capture
+ *
+ * Notes:
+ * - It may be called before the MQTT connection is established
+ * - Each column is a contiguous typed array, plus a timestamp column. A sample is captured
+ *   with plain stores, nothing is allocated, no cJSON object is created:
+ *      float *ax = tbce_timeseriesbuffer_float_column(buffer, 0);  // once
+ *      ...
+ *      int row = tbce_timeseriesbuffer_begin_row(buffer, ts);
+ *      if (row >= 0) {
+ *          ax[row] = 0.98f;
+ *          ...
+ *          tbce_timeseriesbuffer_end_row(buffer);
+ *      }
+ * - It is a lock-free ring of one producer and one consumer: rows may be captured in an ISR or a task,
+ *   while they are uploaded in another task. A row is dropped if the buffer is full.
+ *
+ * @param columns        columns, keys are copied
+ * @param column_count   count of columns
+ * @param capacity       max count of rows, it is rounded up to a power of 2
+ *
+ * @return  tbce_timeseriesbuffer_handle_t if successfully created, NULL on error
+ */
+tbce_timeseriesbuffer_handle_t tbce_timeseriesbuffer_create(const tbce_timeseriesbuffer_column_t *columns,
+                                        int column_count, int capacity);
+
+/**
+ * @brief Destroy a columnar sample buffer. Rows which aren't uploaded are dropped.
+ *
+ * @param buffer     columnar sample buffer
+ */
+void tbce_timeseriesbuffer_destroy(tbce_timeseriesbuffer_handle_t buffer);
+
+/**
+ * @brief Get the array of a float column
+ *
+ * @param buffer     columnar sample buffer
+ * @param column     index of column
+ *
+ * @return  array of column, NULL if the column isn't TBCE_TIMESERIESBUFFER_FLOAT
+ */
+float *tbce_timeseriesbuffer_float_column(tbce_timeseriesbuffer_handle_t buffer, int column);
+
+/**
+ * @brief Get the array of an int column
+ *
+ * @param buffer     columnar sample buffer
+ * @param column     index of column
+ *
+ * @return  array of column, NULL if the column isn't TBCE_TIMESERIESBUFFER_INT
+ */
+int32_t *tbce_timeseriesbuffer_int_column(tbce_timeseriesbuffer_handle_t buffer, int column);
+
+/**
+ * @brief Get the array of a bool column
+ *
+ * @param buffer     columnar sample buffer
+ * @param column     index of column
+ *
+ * @return  array of column, NULL if the column isn't TBCE_TIMESERIESBUFFER_BOOL
+ */
+bool *tbce_timeseriesbuffer_bool_column(tbce_timeseriesbuffer_handle_t buffer, int column);
+
+/**
+ * @brief Begin a row, i.e. a sample of all columns
+ *
+ * Notes:
+ * - It may be called in an ISR, only by the one producer
+ * - Store values of the row into columns at the returned index, then call tbce_timeseriesbuffer_end_row()
+ *
+ * @param buffer     columnar sample buffer
+ * @param ts         unix timestamp in milliseconds, e.g. tbcmh_timesync_now_ms() in a task
+ *
+ * @return  index of the row in columns
+ *          -1 if the buffer is full, and the row is dropped
+ */
+int tbce_timeseriesbuffer_begin_row(tbce_timeseriesbuffer_handle_t buffer, int64_t ts);
+
+/**
+ * @brief End the row begun by tbce_timeseriesbuffer_begin_row(), it may be uploaded since now
+ *
+ * @param buffer     columnar sample buffer
+ */
+void tbce_timeseriesbuffer_end_row(tbce_timeseriesbuffer_handle_t buffer);
+
+/**
+ * @brief Get count of rows which aren't uploaded
+ *
+ * @param buffer     columnar sample buffer
+ *
+ * @return count of rows
+ */
+int tbce_timeseriesbuffer_get_count(tbce_timeseriesbuffer_handle_t buffer);
+
+/**
+ * @brief Get count of rows dropped because the buffer was full
+ *
+ * @param buffer     columnar sample buffer
+ *
+ * @return count of dropped rows
+ */
+uint32_t tbce_timeseriesbuffer_get_dropped(tbce_timeseriesbuffer_handle_t buffer);
+
+/**
+ * @brief Publish rows as batched telemetry with timestamps
+ *
+ * Notes:
+ * - It should be called after the MQTT connection is established, only by the one consumer
+ * - Columns are walked sequentially into the TX buffer:
+ *      '[{"ts":1451649600512,"values":{"ax":0.98,"ay":0.02}}, {"ts":1451649600522,"values":{...}}]'
+ *   A batch is split into several messages if it doesn't fit in the TX buffer.
+ * - Rows are released after they are published. Rows which fail to publish are kept.
+ *
+ * @param buffer     columnar sample buffer
+ * @param client     ThingsBoard Client MQTT Helper handle
+ * @param max_rows   max count of rows to publish, 0 for all
+ *
+ * @return  count of published rows
+ *         -1/ESP_FAIL on error
+ */
+int tbce_timeseriesbuffer_upload(tbce_timeseriesbuffer_handle_t buffer,
+                                        tbcmh_handle_t client, int max_rows);
+
+/**
+ * @brief Publish rows as protobuf telemetry, one message per row
+ *
+ * Notes:
+ * - It should be called after the MQTT connection is established, only by the one consumer
+ * - Columns are encoded by their field_number of the telemetry proto schema of the device profile.
+ *   The schema has no timestamp, so the server stamps each row when it arrives.
+ *
+ * @param buffer     columnar sample buffer
+ * @param client     ThingsBoard Client MQTT Helper handle
+ * @param max_rows   max count of rows to publish, 0 for all
+ *
+ * @return  count of published rows
+ *         -1/ESP_FAIL on error
+ */
+int tbce_timeseriesbuffer_upload_proto(tbce_timeseriesbuffer_handle_t buffer,
+                                        tbcmh_handle_t client, int max_rows);
+
 #ifdef __cplusplus
 }
 #endif //__cplusplus
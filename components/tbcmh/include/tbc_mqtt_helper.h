@@ -17,6 +17,7 @@
 #ifndef _TBC_MQTT_HELPER_H_
 #define _TBC_MQTT_HELPER_H_
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -31,6 +32,17 @@ extern "C" {
 
 //==== Data type ==============================================================
 
+/**
+ * Returned by publish functions instead of message_id when the message is queued by
+ * the priority TX queue or TBCMH_RATELIMIT_WAIT, i.e. it isn't sent yet.
+ * MQTT message_id is 1~65535, so it never conflicts with one.
+ *
+ * A publisher which remembers what it has sent, e.g. a change-of-value filter, counts a queued
+ * message as sent. If the queue drops it later, tbcmh_txqueue_get_lost_count() of its type grows,
+ * then the publisher forgets what it has sent and sends the current values again.
+ */
+#define TBCMH_PUBLISH_QUEUED (0x10000)
+
 /**
  * ThingsBoard MQTT Client Helper handle
  */
@@ -41,6 +53,16 @@ typedef struct tbcmh_client *tbcmh_handle_t;
  */
 typedef cJSON tbcmh_value_t;
 
+/**
+ * ThingsBoard MQTT Client Helper interned key, see tbcmh_key_intern()
+ */
+typedef const char *tbcmh_key_t;
+
+/**
+ * ThingsBoard MQTT Client Helper local mirror of a device attribute, see tbcmh_attributemirror_add()
+ */
+typedef struct tbcmh_attributemirror *tbcmh_attributemirror_handle_t;
+
 /**
  * ThingsBoard MQTT Client Helper rpc params
  */
@@ -108,6 +130,223 @@ typedef enum
   TBCMH_OTAUPDATE_TYPE_SW      /*!< S/W OTA update */
 } tbcmh_otaupdate_type_t;
 
+/**
+ * ThingsBoard MQTT Client Helper TX type of streaming JSON writer
+ */
+typedef enum
+{
+  TBCMH_TX_TELEMETRY = 0, /*!< publish to 'v1/devices/me/telemetry' */
+  TBCMH_TX_ATTRIBUTES     /*!< publish to 'v1/devices/me/attributes' */
+} tbcmh_tx_type_t;
+
+/**
+ * ThingsBoard MQTT Client Helper value type of a precomputed TX field
+ */
+typedef enum
+{
+  TBCMH_TX_FIELD_INT = 0, /*!< int64_t */
+  TBCMH_TX_FIELD_FLOAT,   /*!< double */
+  TBCMH_TX_FIELD_BOOL,    /*!< bool */
+  TBCMH_TX_FIELD_STRING   /*!< const char *, NULL is written as null */
+} tbcmh_tx_field_type_t;
+
+/**
+ * ThingsBoard MQTT Client Helper precomputed TX field, it describes a member of a C struct.
+ * It is usually generated by TBCE_SCHEMA_DEFINE() in tbc_extension_schema.h
+ */
+typedef struct
+{
+  const char *key;             /*!< key, it isn't escaped */
+  size_t offset;               /*!< offset of the member in struct */
+  tbcmh_tx_field_type_t type;  /*!< type of the member */
+  const char *fragment;        /*!< serialized key `"key":`, filled by tbcmh_tx_register_fields() */
+  int fragment_len;            /*!< length of fragment */
+} tbcmh_tx_field_t;
+
+/**
+ * ThingsBoard MQTT Client Helper type of a scalar value
+ */
+typedef enum
+{
+  TBCMH_SCALAR_NULL = 0, /*!< null */
+  TBCMH_SCALAR_INT,      /*!< int_value */
+  TBCMH_SCALAR_FLOAT,    /*!< float_value */
+  TBCMH_SCALAR_BOOL,     /*!< bool_value */
+  TBCMH_SCALAR_STRING    /*!< string.ptr & string.len, it needn't to be null-terminated */
+} tbcmh_scalar_type_t;
+
+/**
+ * ThingsBoard MQTT Client Helper scalar value, a tagged value that lives on the stack.
+ * It is serialized without any allocation.
+ */
+typedef struct
+{
+  tbcmh_scalar_type_t type;     /*!< type of value */
+  union {
+    int64_t int_value;          /*!< TBCMH_SCALAR_INT */
+    double float_value;         /*!< TBCMH_SCALAR_FLOAT */
+    bool bool_value;            /*!< TBCMH_SCALAR_BOOL */
+    struct {
+      const char *ptr;          /*!< string view, it is still owned by caller */
+      int len;                  /*!< length of string */
+    } string;                   /*!< TBCMH_SCALAR_STRING */
+  } value;                      /*!< value */
+} tbcmh_scalar_t;
+
+/**
+ * ThingsBoard MQTT Client Helper precomputed column of a TX row, see tbcmh_tx_add_row()
+ */
+typedef struct
+{
+  const char *fragment;        /*!< serialized key `"key":`, see tbcmh_tx_serialize_key() */
+  int fragment_len;            /*!< length of fragment */
+  int decimals;                /*!< decimals of a float value, -1 for the shortest */
+} tbcmh_tx_column_t;
+
+/**
+ * ThingsBoard MQTT Client Helper type of a streamed JSON event
+ */
+typedef enum
+{
+  TBCMH_JSON_EVENT_OBJECT_BEGIN = 0, /*!< '{' */
+  TBCMH_JSON_EVENT_OBJECT_END,       /*!< '}' */
+  TBCMH_JSON_EVENT_ARRAY_BEGIN,      /*!< '[' */
+  TBCMH_JSON_EVENT_ARRAY_END,        /*!< ']' */
+  TBCMH_JSON_EVENT_STRING,           /*!< string & string_len, maybe a chunk of a long string */
+  TBCMH_JSON_EVENT_NUMBER,           /*!< number */
+  TBCMH_JSON_EVENT_BOOL,             /*!< boolean */
+  TBCMH_JSON_EVENT_NULL              /*!< null */
+} tbcmh_json_event_type_t;
+
+/**
+ * ThingsBoard MQTT Client Helper streamed JSON event.
+ * Large payloads are parsed fragment by fragment, and are delivered as a sequence of events.
+ * All pointers are valid only inside the callback.
+ */
+typedef struct
+{
+  tbcmh_json_event_type_t type; /*!< type of event */
+  int depth;                    /*!< 0 for the top-level object, 1 for its members, 2 for their members... */
+  const char *key;              /*!< key of this member, NULL for array elements and *_END events */
+  const char *top_key;          /*!< key of the top-level member which this event belongs to */
+  int index;                    /*!< index of this element in array, -1 for object members */
+  const char *string;           /*!< TBCMH_JSON_EVENT_STRING, unescaped & '\0' terminated */
+  int string_len;               /*!< TBCMH_JSON_EVENT_STRING, length of string */
+  bool is_partial;              /*!< TBCMH_JSON_EVENT_STRING, more chunks of this string follow */
+  double number;                /*!< TBCMH_JSON_EVENT_NUMBER */
+  bool boolean;                 /*!< TBCMH_JSON_EVENT_BOOL */
+} tbcmh_json_event_t;
+
+/**
+ * ThingsBoard MQTT Client Helper config of telemetry batch.
+ * A batch is flushed as soon as one of the thresholds is reached.
+ */
+typedef struct
+{
+  int max_payload_size;  /*!< a batch is split into publishes of at most this size, 0 for 16KB */
+  int flush_size;        /*!< flush when payload reaches this size, 0 for max_payload_size */
+  int flush_count;       /*!< flush when count of samples reaches it, 0 for no limit */
+  int flush_age_ms;      /*!< flush when the oldest sample is older than it, 0 for no limit */
+  int qos;               /*!< qos of batch publishes, 0 or 1 */
+} tbcmh_telemetry_batch_config_t;
+
+/**
+ * ThingsBoard MQTT Client Helper statistics of telemetry batch
+ */
+typedef struct
+{
+  uint32_t sample_count;   /*!< count of published samples */
+  uint32_t publish_count;  /*!< count of published batches */
+  uint32_t split_count;    /*!< count of batches flushed early because of max_payload_size */
+  uint32_t dropped_count;  /*!< count of samples which are too big, or don't fit in a batch which isn't published yet */
+  float last_fill_ratio;   /*!< payload size / max_payload_size of the last published batch */
+  float avg_fill_ratio;    /*!< average fill ratio of all published batches */
+} tbcmh_telemetry_batch_stats_t;
+
+/**
+ * ThingsBoard MQTT Client Helper config of telemetry store-and-forward log
+ */
+typedef struct
+{
+  const char *path;        /*!< append-only log file, e.g. "/spiffs/telemetry.log". Read cursor is saved in "<path>.cur",
+                                "<path>.tmp" is used while compacting */
+  int max_size;            /*!< max size of unsent telemetry in log file, new telemetry is dropped when it is full.
+                                Space of sent telemetry is reclaimed by compacting. 0 for 64KB */
+  int replay_size;         /*!< max payload size of a replay publish, 0 for 4KB */
+  int replay_interval_ms;  /*!< min interval between replay publishes, 0 for 100ms */
+  int sync_interval_ms;    /*!< max interval between fsync() of appended telemetry, 0 for 1000ms.
+                                Telemetry appended within it may be lost on a power loss */
+} tbcmh_telemetry_store_config_t;
+
+/**
+ * ThingsBoard MQTT Client Helper config of attributes snapshot for warm start
+ */
+typedef struct
+{
+  const char *path;        /*!< snapshot file, e.g. "/spiffs/attributes.json". It is written via "<path>.tmp" */
+  int save_interval_ms;    /*!< min interval between saves of changes, 0 for 10s */
+  int max_keys;            /*!< max count of saved keys of each scope, 0 for 64 */
+} tbcmh_attributemirror_store_config_t;
+
+/**
+ * ThingsBoard MQTT Client Helper class of publish messages, each class has its own rate limit
+ */
+typedef enum
+{
+  TBCMH_RATELIMIT_ALL = 0,     /*!< all publish messages, e.g. "messages" limit of ThingsBoard */
+  TBCMH_RATELIMIT_TELEMETRY,   /*!< telemetry, e.g. "telemetryMessages" limit of ThingsBoard */
+  TBCMH_RATELIMIT_ATTRIBUTES,  /*!< client-side attributes & attributes requests */
+  TBCMH_RATELIMIT_RPC,         /*!< server-side RPC responses & client-side RPC requests */
+  TBCMH_RATELIMIT_OTA          /*!< F/W OTA chunk requests */
+} tbcmh_ratelimit_class_t;
+
+/**
+ * ThingsBoard MQTT Client Helper policy when the rate limit is reached
+ */
+typedef enum
+{
+  TBCMH_RATELIMIT_FAIL_FAST = 0, /*!< publish fails immediately. Telemetry is kept by the store-and-forward log if it is opened */
+  TBCMH_RATELIMIT_WAIT           /*!< publish message is queued & sent by tbcmh_run() when the budget is refilled,
+                                      it is dropped after max_wait_ms */
+} tbcmh_ratelimit_policy_t;
+
+/**
+ * ThingsBoard MQTT Client Helper config of priority TX queue.
+ * Priority classes: control(RPC, attributes requests...) > OTA > client-side attributes > telemetry
+ */
+typedef struct
+{
+  int max_size;         /*!< max total size of queued payloads, 0 for 16KB */
+  int max_drain_count;  /*!< max count of queued messages sent per tbcmh_run(), 0 for 16 */
+  int weights[4];       /*!< messages per round of control, OTA, attributes & telemetry. 0 for 8, 4, 2, 1 */
+} tbcmh_txqueue_config_t;
+
+/**
+ * ThingsBoard MQTT Client Helper status of the device clock aligned to the server clock
+ */
+typedef struct
+{
+  bool is_synced;          /*!< at least one sample of the server clock is taken */
+  int64_t offset_ms;       /*!< server time - device system time(gettimeofday()) */
+  double drift_ppm;        /*!< drift of the device clock, positive if the server clock is faster */
+  uint32_t rtt_ms;         /*!< round trip time of the last sample, 0 for a local reference, e.g. SNTP */
+  uint32_t age_ms;         /*!< time since the last sample */
+  uint32_t sync_count;     /*!< count of accepted samples */
+} tbcmh_timesync_status_t;
+
+/**
+ * ThingsBoard MQTT Client Helper statistics of uplink pressure, see tbcmh_get_link_stats()
+ */
+typedef struct
+{
+  int outbox_size;             /*!< size of messages in MQTT outbox waiting to be sent or ACKed, in bytes */
+  uint32_t ack_latency_ms;     /*!< publish-ACK latency: the max of its moving average and the age of the oldest publish waiting for ACK */
+  int txqueue_count;           /*!< count of messages in priority TX queue */
+  int event_queue_count;       /*!< count of events waiting in the helper queue, i.e. not yet handled by tbcmh_run() */
+  int event_queue_high_water;  /*!< high-water mark of the helper queue since last call */
+  int event_queue_size;        /*!< capacity of the helper queue */
+} tbcmh_link_stats_t;
+
 //==== Callback ===============================================================
 
 /**
@@ -146,6 +385,13 @@ typedef void (*tbcmh_on_disconnected_t)(tbcmh_handle_t client, void *context);
  * - If you call tbcmh_attributes_subscribe() or tbcmh_attributes_subscribe_of_array(), 
  *   this callback will be called when you receive shared attributes updates 
  * - Parse and deal received json object in this callback
+ * - The received json object is lent to this callback, and released after it returns.
+ *   Don't modify, detach or delete any item of it, cJSON_Duplicate() what you keep
+ * - Keys are matched case-sensitively, as ThingsBoard stores them: a subscription of "Fw_Version"
+ *   doesn't match "fw_version". Use exact keys, and look members up with tbcmh_key_get_item()
+ *   or a case-sensitive lookup such as cJSON_GetObjectItemCaseSensitive()
+ * - object only contains the subscribed keys of all subscriptions, other members of the update
+ *   are skipped without parsing. It contains all members if any subscription has no key
  *
  * @param client    ThingsBoard MQTT Client Helper handle. client param of tbcmh_attributes_subscribe()
  *                    or tbcmh_attributes_subscribe_of_array()
@@ -161,6 +407,29 @@ typedef int  (*tbcmh_attributes_on_update_t)(
                                 void *context,
                                 const cJSON *object);
 
+/**
+ * @brief  Callback of each JSON event of "Shared Attributes Update"
+ * from ThingsBoard IoT platform
+ *
+ * Notes:
+ * - If you call tbcmh_attributes_subscribe_stream(), this callback will be called
+ *   for each event of subscribed shared attributes, as fragments of payload arrive
+ * - No cJSON tree is built. Peak memory is bounded by nesting depth, not by payload size
+ * - The top-level object itself (depth 0) isn't delivered
+ *
+ * @param client    ThingsBoard MQTT Client Helper handle. client param of tbcmh_attributes_subscribe_stream()
+ * @param context   context param
+ * @param event     JSON event, event->top_key is the shared attribute which it belongs to
+ *
+ * @return 2 if tbcmh_disconnect() or tbcmh_destroy() is called inside in this callback
+ *         1 if tbcmh_attributes_unsubscribe() is called inside in this callback
+ *         0 on otherwise
+ */
+typedef int  (*tbcmh_attributes_on_stream_t)(
+                                tbcmh_handle_t client,
+                                void *context,
+                                const tbcmh_json_event_t *event);
+
 /**
  * @brief  Callback when "Client-side Attributes & Shared Attributes Response" is received 
  * from ThingsBoard IoT platform
@@ -170,6 +439,8 @@ typedef int  (*tbcmh_attributes_on_update_t)(
  *   or tbcmh_sharedattributes_request(), this callback will be called
  *   when you receive client-side_attributes & shared attributes response
  * - Parse and deal received json object in this callback
+ * - The received json object is lent to this callback, and released after it returns.
+ *   Don't modify, detach or delete any item of it, cJSON_Duplicate() what you keep
  *
  * @param client            ThingsBoard MQTT Client Helper handle. client param of tbcmh_attributes_request()
  *                              or tbcmh_clientattributes_request() or tbcmh_sharedattributes_request()
@@ -213,6 +484,8 @@ typedef tbc_err_t (*tbcmh_attributes_on_timeout_t)(
  * - If you call tbcmh_serverrpc_subscribe(), this callback will be called
  *   when you receive server-side RPC 
  * - Parse and deal received rpc_params in this callback
+ * - The received json object is lent to this callback, and released after it returns.
+ *   Don't modify, detach or delete any item of it, cJSON_Duplicate() what you keep
  * - Free return value(rpc_results) by caller/(this library)!
  *
  * @param client     ThingsBoard MQTT Client Helper handle. client param of tbcmh_serverrpc_subscribe()
@@ -232,6 +505,32 @@ typedef tbcmh_rpc_results_t *(*tbcmh_serverrpc_on_request_t)(
                                 const char *method,
                                 const tbcmh_rpc_params_t *rpc_params);
 
+/**
+ * @brief  Callback of each JSON event of params of "Server-side RPC Request"
+ * from ThingsBoard IoT platform
+ *
+ * Notes:
+ * - If you call tbcmh_serverrpc_subscribe_stream(), this callback will be called
+ *   for each event of rpc params, as fragments of payload arrive.
+ *   Then on_request() is called with NULL rpc_params.
+ * - rpc params itself is at depth 1, its members are at depth 2
+ * - Don't call tbcmh_disconnect() or tbcmh_destroy() inside it!
+ *
+ * @param client     ThingsBoard MQTT Client Helper handle. client param of tbcmh_serverrpc_subscribe_stream()
+ * @param context    context param
+ * @param request_id
+ * @param method     rpc method name
+ * @param event      JSON event of rpc params
+ *
+ * @return 0/ESP_OK on success
+ *         -1/ESP_FAIL to drop this request, on_request() isn't called
+ */
+typedef tbc_err_t (*tbcmh_serverrpc_on_params_t)(
+                                tbcmh_handle_t client,
+                                void *context, uint32_t request_id,
+                                const char *method,
+                                const tbcmh_json_event_t *event);
+
 /**
  * @brief  Callback when two-way "Client-side RPC Response" is received 
  * from ThingsBoard IoT platform
@@ -240,6 +539,8 @@ typedef tbcmh_rpc_results_t *(*tbcmh_serverrpc_on_request_t)(
  * - If you call tbcmh_twoway_clientrpc_request(), this callback will be called
  *   when you receive client-side RPC response
  * - Parse and deal received rpc_results in this callback
+ * - The received json object is lent to this callback, and released after it returns.
+ *   Don't modify, detach or delete any item of it, cJSON_Duplicate() what you keep
  *
  * @param client    ThingsBoard MQTT Client Helper handle. client param of 
  *                      tbcmh_twoway_clientrpc_request()
@@ -431,6 +732,21 @@ void tbcmh_disconnect(tbcmh_handle_t client);
  */
 bool tbcmh_is_connected(tbcmh_handle_t client);
 
+/**
+ * @brief Get statistics of uplink pressure, e.g. to slow down sampling when the uplink degrades
+ *
+ * Notes:
+ * - Publish-ACK latency is measured for QoS 1/2 messages
+ * - Outbox size is 0 if esp-mqtt doesn't report it (before ESP-IDF v4.4)
+ *
+ * @param client    ThingsBoard MQTT Client Helper handle
+ * @param stats     statistics output. High-water mark of the helper queue is reset after it is read.
+ *
+ * @return  0/ESP_OK on success
+ *         -1/ESP_FAIL on failure
+ */
+tbc_err_t tbcmh_get_link_stats(tbcmh_handle_t client, tbcmh_link_stats_t *stats);
+
 /**
  * @brief Has it events in event queue?
  *
@@ -467,6 +783,7 @@ void tbcmh_run(tbcmh_handle_t client);
  * @param retain     ratain flag
  *
  * @return message_id of the publish message (for QoS 0 message_id will always be zero) on success.
+ *         TBCMH_PUBLISH_QUEUED if it is queued
  *         0 if cannot publish
  *        -1/ESP_FAIL on error
  */
@@ -490,6 +807,7 @@ int tbcmh_telemetry_upload(tbcmh_handle_t client,
  * @param retain     ratain flag
  *
  * @return message_id of the publish message (for QoS 0 message_id will always be zero) on success.
+ *         TBCMH_PUBLISH_QUEUED if it is queued
  *         0 if cannot publish
  *        -1/ESP_FAIL on error
  */
@@ -498,6 +816,113 @@ int tbcmh_telemetry_upload_ex(tbcmh_handle_t client,
                                 int qos/*= 1*/,
                                 int retain/*= 0*/);
 
+/**
+ * @brief Config the telemetry batch
+ *
+ * Notes:
+ * - Pending samples are flushed before the new config takes effect
+ * - Without calling it, a batch is only flushed when it reaches 16KB or tbcmh_telemetry_batch_flush() is called
+ *
+ * @param client     ThingsBoard MQTT Client Helper handle
+ * @param config     thresholds of flushing, NULL for defaults
+ *
+ * @return 0/ESP_OK on success
+ *        -1/ESP_FAIL on failure
+ */
+tbc_err_t tbcmh_telemetry_batch_config(tbcmh_handle_t client,
+                                const tbcmh_telemetry_batch_config_t *config);
+
+/**
+ * @brief Add a timestamped telemetry sample to the batch
+ *
+ * Notes:
+ * - It should be called after the MQTT connection is established
+ * - Samples are published together in one message:
+ *      Topic: 'v1/devices/me/telemetry'
+ *      Data:  '[{"ts":1451649600512,"values":{"key1":"value1","key2":true}}, {"ts":1451649601512,"values":{...}}]'
+ * - A sample that doesn't fit in max_payload_size flushes the batch, and starts a new one
+ * - Samples are kept until they are published. While offline, they are appended to the
+ *   store-and-forward log if it is opened, otherwise they are published after reconnecting.
+ *   A sample is dropped if it doesn't fit in the kept batch
+ *
+ * @param client     ThingsBoard MQTT Client Helper handle
+ * @param ts         unix timestamp in milliseconds, 0 for now, see tbcmh_timesync_now_ms()
+ * @param values     cJSON object of the sample. It is still owned by caller
+ *
+ * @return 0/ESP_OK on success
+ *        -1/ESP_FAIL on failure, e.g. the sample is bigger than max_payload_size
+ */
+tbc_err_t tbcmh_telemetry_batch_add(tbcmh_handle_t client,
+                                int64_t ts,
+                                const tbcmh_value_t *values);
+
+/**
+ * @brief Publish pending samples of the batch now
+ *
+ * @param client     ThingsBoard MQTT Client Helper handle
+ *
+ * @return message_id of the publish message (for QoS 0 message_id will always be zero) on success.
+ *         TBCMH_PUBLISH_QUEUED if it is queued
+ *         0 if there is no pending sample
+ *        -1/ESP_FAIL on error or offline, the samples are kept
+ */
+int tbcmh_telemetry_batch_flush(tbcmh_handle_t client);
+
+/**
+ * @brief Get statistics of the telemetry batch, e.g. fill ratio of published batches
+ *
+ * @param client     ThingsBoard MQTT Client Helper handle
+ * @param stats      statistics output
+ *
+ * @return 0/ESP_OK on success
+ *        -1/ESP_FAIL on failure
+ */
+tbc_err_t tbcmh_telemetry_batch_get_stats(tbcmh_handle_t client,
+                                tbcmh_telemetry_batch_stats_t *stats);
+
+/**
+ * @brief Open the store-and-forward log of telemetry
+ *
+ * Notes:
+ * - Telemetry which is published while offline or fails to publish is appended to the log,
+ *   instead of being lost. Telemetry without "ts" is stamped with the current time,
+ *   each element of an array is stamped on its own.
+ *   Telemetry waiting in the priority TX queue is moved to the log when it is disconnected.
+ * - The log is replayed after the MQTT connection is established, with paced & batched publishes of QoS 1.
+ *   Until it is drained, new telemetry is appended to the log too, to keep the order.
+ * - The read cursor is saved after each PUBACK, so nothing is resent after an ACK, even after reboot.
+ *   Only a power loss while compacting may resend acknowledged telemetry.
+ * - When the log file reaches max_size, unsent telemetry is copied to a new log file, and the old one is removed.
+ * - The log file is kept open until it is drained or closed. Appended telemetry is synced to flash
+ *   in batches, at most every sync_interval_ms.
+ * - The log is a file, e.g. on SPIFFS/LittleFS. Mount the file system before calling it.
+ * - It only works in JSON payload mode
+ *
+ * @param client     ThingsBoard MQTT Client Helper handle
+ * @param config     config of the log
+ *
+ * @return 0/ESP_OK on success
+ *        -1/ESP_FAIL on failure
+ */
+tbc_err_t tbcmh_telemetry_store_open(tbcmh_handle_t client,
+                                const tbcmh_telemetry_store_config_t *config);
+
+/**
+ * @brief Close the store-and-forward log of telemetry. Unsent telemetry is kept in the log file.
+ *
+ * @param client     ThingsBoard MQTT Client Helper handle
+ */
+void tbcmh_telemetry_store_close(tbcmh_handle_t client);
+
+/**
+ * @brief Get size of unsent telemetry in the store-and-forward log
+ *
+ * @param client     ThingsBoard MQTT Client Helper handle
+ *
+ * @return size of unsent telemetry in bytes, 0 if the log is drained or isn't opened
+ */
+int tbcmh_telemetry_store_get_pending(tbcmh_handle_t client);
+
 //==== Publish client-side device attributes to the server=====================
 /**
  * @brief Client to send a 'Attributes' publish message to ThingsBoard platform
@@ -515,6 +940,7 @@ int tbcmh_telemetry_upload_ex(tbcmh_handle_t client,
  * @param retain        ratain flag
  *
  * @return message_id of the subscribe message on success
+ *         TBCMH_PUBLISH_QUEUED if it is queued
  *         0 if cannot publish
  *        -1 if error
  */
@@ -539,6 +965,7 @@ int tbcmh_attributes_update(tbcmh_handle_t client,
  * @param retain        ratain flag
  *
  * @return message_id of the subscribe message on success
+ *         TBCMH_PUBLISH_QUEUED if it is queued
  *         0 if cannot publish
  *        -1 if error
  */
@@ -547,105 +974,736 @@ int tbcmh_attributes_update_ex(tbcmh_handle_t client,
                                 int qos/*= 1*/,
                                 int retain/*= 0*/);
 
-//==== Subscribe to shared device attribute updates from the server============
-
+//==== Streaming JSON writer of telemetry & client-side attributes ============
 /**
- * @brief Subscribe to shared device attribute updates from the server
+ * @brief Begin a telemetry or client-side attributes message in the reusable TX buffer
  *
  * Notes:
- * - It may be called before the MQTT connection is established
+ * - It should be called after the MQTT connection is established
+ * - Key/value pairs are written into TX buffer directly, no cJSON object is created
+ * - It takes the client lock, tbcmh_tx_commit() or tbcmh_tx_abort() MUST be called
+ *   in the same task after it returns 0/ESP_OK
+ * - Get all values before it: the lock blocks the MQTT event handler and the other tasks,
+ *   so nothing slow or blocking (sensor reads, other tbcmh_*() publishers) may run until commit
+ * - It fails if payload_type is TBC_TRANSPORT_PAYLOAD_TYPE_PROTOBUF, so do tbcmh_tx_begin_ts(),
+ *   tbcmh_tx_begin_batch(), the schema encoders and the other JSON publishers.
+ *   Use tbcmh_tx_begin_proto() instead
+ * - Example:
+ *      tbcmh_tx_begin(client, TBCMH_TX_TELEMETRY);
+ *      tbcmh_tx_add_float(client, "temperature", 25.5);
+ *      tbcmh_tx_add_bool(client, "alarm", false);
+ *      tbcmh_tx_commit(client, 1, 0);  // {"temperature":25.5,"alarm":false}
  *
- * @param client        ThingsBoard MQTT Client Helper handle
- * @param context
- * @param on_update     calllback of shared device attributes update
- * @param count         count of keys
- * @param keys          keys of shared device attributes
- * 
- * @return subscribe_id on success
+ * @param client    ThingsBoard MQTT Client Helper handle
+ * @param type      TBCMH_TX_TELEMETRY or TBCMH_TX_ATTRIBUTES
+ *
+ * @return  0/ESP_OK on success
  *         -1/ESP_FAIL on failure
  */
-int tbcmh_attributes_subscribe(tbcmh_handle_t client,
-                                void *context,
-                                tbcmh_attributes_on_update_t on_update,
-                                int count,
-                                /*const char *key,*/...);
+tbc_err_t tbcmh_tx_begin(tbcmh_handle_t client, tbcmh_tx_type_t type);
 
 /**
- * @brief Subscribe to shared device attribute updates from the server
+ * @brief Begin a timestamped telemetry message in the reusable TX buffer
  *
  * Notes:
- * - It may be called before the MQTT connection is established
+ * - Same as tbcmh_tx_begin(client, TBCMH_TX_TELEMETRY), but key/value pairs are wrapped with "ts"
+ * - Example:
+ *      tbcmh_tx_begin_ts(client, 0);
+ *      tbcmh_tx_add_float(client, "temperature", 25.5);
+ *      tbcmh_tx_commit(client, 1, 0);  // {"ts":1451649600512,"values":{"temperature":25.5}}
  *
- * @param client        ThingsBoard MQTT Client Helper handle
- * @param context
- * @param on_update     calllback of shared device attributes update
- * @param count         count of keys
- * @param keys          array of shared device attributes
- * 
- * @return subscribe_id on success
+ * @param client    ThingsBoard MQTT Client Helper handle
+ * @param ts        unix timestamp in milliseconds, 0 for now, see tbcmh_timesync_now_ms()
+ *
+ * @return  0/ESP_OK on success
  *         -1/ESP_FAIL on failure
  */
-int tbcmh_attributes_subscribe_of_array(
-                                tbcmh_handle_t client,
-                                void *context,
-                                tbcmh_attributes_on_update_t on_update,
-                                int count, const char *keys[]);
+tbc_err_t tbcmh_tx_begin_ts(tbcmh_handle_t client, int64_t ts);
 
 /**
- * @brief Unsubscribe to shared device attribute updates from the server
+ * @brief Begin a batch of timestamped telemetry rows in the reusable TX buffer
  *
  * Notes:
- * - It may be called before the MQTT connection is established
+ * - Rows are added by tbcmh_tx_add_row() only, and published by tbcmh_tx_commit() as
+ *   '[{"ts":1451649600512,"values":{"key1":1.5,"key2":true}}, {"ts":1451649600522,"values":{...}}]'
+ * - Same as tbcmh_tx_begin(), tbcmh_tx_commit() or tbcmh_tx_abort() MUST be called
+ *   in the same task after it returns 0/ESP_OK
  *
- * @param client        ThingsBoard MQTT Client Helper handle
- * @param subscribe_id  suscribe id
- * 
- * @return 0/ESP_OK on success
+ * @param client    ThingsBoard MQTT Client Helper handle
+ *
+ * @return  0/ESP_OK on success
  *         -1/ESP_FAIL on failure
  */
-tbc_err_t tbcmh_attributes_unsubscribe(
-                                tbcmh_handle_t client,
-                                int subscribe_id);
+tbc_err_t tbcmh_tx_begin_batch(tbcmh_handle_t client);
 
-//==== Request client-side or shared device attributes from the server ========
 /**
- * @brief Request client-side or shared device attributes from the server
+ * @brief Add a timestamped row to the batch begun by tbcmh_tx_begin_batch()
  *
- * Notes:
- * - It should be called after the MQTT connection is established
+ * @param client    ThingsBoard MQTT Client Helper handle
+ * @param ts        unix timestamp in milliseconds
+ * @param columns   precomputed columns
+ * @param values    values of the row, one per column
+ * @param count     count of columns
  *
- * @param client        ThingsBoard MQTT Client Helper handle
- * @param context
- * @param on_response   calllback of device attributes response
- * @param on_timeout    calllback of device attributes timeout event
- * @param client_keys   client_keys, like "abc, efg, xyz"
- * @param shared_keys   shared_keys, like "abc, efg, xyz"
- * 
- * @return 0/ESP_OK on successful
- *         -1/ESP_FAIL on otherwise
+ * @return  0/ESP_OK on success
+ *         -1/ESP_FAIL on failure, e.g. TX buffer is full. The batch is unchanged.
  */
-tbc_err_t tbcmh_attributes_request(
-                                tbcmh_handle_t client,
-                                void *context,
-                                tbcmh_attributes_on_response_t on_response,
-                                tbcmh_attributes_on_timeout_t on_timeout,
-                                const char *client_keys,
-                                const char *shared_keys);
+tbc_err_t tbcmh_tx_add_row(tbcmh_handle_t client, int64_t ts, const tbcmh_tx_column_t *columns,
+                           const tbcmh_scalar_t *values, int count);
 
 /**
- * @brief Request client-side device attributes from the server
+ * @brief Add a string key/value pair to the message begun by tbcmh_tx_begin()
  *
- * Notes:
- * - It should be called after the MQTT connection is established
+ * @param client    ThingsBoard MQTT Client Helper handle
+ * @param key       key
+ * @param value     string value, it is escaped. NULL is written as null
  *
- * @param client        ThingsBoard MQTT Client Helper handle
- * @param context
- * @param on_response   calllback of device attributes response
- * @param on_timeout    calllback of device attributes timeout event
- * @param client_keys   client_keys, like "abc, efg, xyz"
- * 
- * @return 0/ESP_OK on successful
- *         -1/ESP_FAIL on otherwise
+ * @return  0/ESP_OK on success
+ *         -1/ESP_FAIL on failure, e.g. TX buffer is full. The message is unchanged.
+ */
+tbc_err_t tbcmh_tx_add_string(tbcmh_handle_t client, const char *key, const char *value);
+
+/**
+ * @brief Add an integer key/value pair to the message begun by tbcmh_tx_begin()
+ *
+ * @param client    ThingsBoard MQTT Client Helper handle
+ * @param key       key
+ * @param value     integer value
+ *
+ * @return  0/ESP_OK on success
+ *         -1/ESP_FAIL on failure, e.g. TX buffer is full. The message is unchanged.
+ */
+tbc_err_t tbcmh_tx_add_int(tbcmh_handle_t client, const char *key, int64_t value);
+
+/**
+ * @brief Add a floating-point key/value pair to the message begun by tbcmh_tx_begin()
+ *
+ * Notes:
+ * - NaN and infinity are written as null, like cJSON does
+ * - It is written as the shortest decimal that is parsed back to the same double,
+ *   e.g. 25.5, 0.30000000000000004, -0, 1e-7, 1.5e300. For about 0.1% of doubles it is a few digits longer
+ *
+ * @param client    ThingsBoard MQTT Client Helper handle
+ * @param key       key
+ * @param value     floating-point value
+ *
+ * @return  0/ESP_OK on success
+ *         -1/ESP_FAIL on failure, e.g. TX buffer is full. The message is unchanged.
+ */
+tbc_err_t tbcmh_tx_add_float(tbcmh_handle_t client, const char *key, double value);
+
+/**
+ * @brief Add a floating-point key/value pair rounded to fixed decimals
+ *
+ * Notes:
+ * - NaN and infinity are written as null, like cJSON does
+ * - Trailing zeros are removed, e.g. 25.4996 with 2 decimals is written as 25.5
+ * - decimals out of 0~9 or too big value is written as tbcmh_tx_add_float() does
+ *
+ * @param client    ThingsBoard MQTT Client Helper handle
+ * @param key       key
+ * @param value     floating-point value
+ * @param decimals  count of decimals, 0~9
+ *
+ * @return  0/ESP_OK on success
+ *         -1/ESP_FAIL on failure, e.g. TX buffer is full. The message is unchanged.
+ */
+tbc_err_t tbcmh_tx_add_float_fixed(tbcmh_handle_t client, const char *key,
+                                   double value, int decimals);
+
+/**
+ * @brief Add a boolean key/value pair to the message begun by tbcmh_tx_begin()
+ *
+ * @param client    ThingsBoard MQTT Client Helper handle
+ * @param key       key
+ * @param value     boolean value
+ *
+ * @return  0/ESP_OK on success
+ *         -1/ESP_FAIL on failure, e.g. TX buffer is full. The message is unchanged.
+ */
+tbc_err_t tbcmh_tx_add_bool(tbcmh_handle_t client, const char *key, bool value);
+
+/**
+ * @brief Add a cJSON key/value pair to the message begun by tbcmh_tx_begin()
+ *
+ * Notes:
+ * - Value is still owned by caller
+ *
+ * @param client    ThingsBoard MQTT Client Helper handle
+ * @param key       key
+ * @param value     cJSON value: string, number, bool, null, raw, object or array
+ *
+ * @return  0/ESP_OK on success
+ *         -1/ESP_FAIL on failure, e.g. TX buffer is full. The message is unchanged.
+ */
+tbc_err_t tbcmh_tx_add_value(tbcmh_handle_t client, const char *key, const tbcmh_value_t *value);
+
+/**
+ * @brief Add a scalar key/value pair to the message begun by tbcmh_tx_begin()
+ *
+ * @param client    ThingsBoard MQTT Client Helper handle
+ * @param key       key
+ * @param value     scalar value, it is still owned by caller
+ *
+ * @return  0/ESP_OK on success
+ *         -1/ESP_FAIL on failure, e.g. TX buffer is full. The message is unchanged.
+ */
+tbc_err_t tbcmh_tx_add_scalar(tbcmh_handle_t client, const char *key, const tbcmh_scalar_t *value);
+
+/**
+ * @brief Serialize a key into a key fragment, i.e. quoted & escaped key and ':'
+ *
+ * Notes:
+ * - Serialize a key once, then use tbcmh_tx_add_scalar_fragment() or tbcmh_tx_add_value_fragment()
+ *   to add its values repeatedly
+ * - e.g. temperature is serialized to "temperature":
+ *
+ * @param key       key
+ * @param fragment  buffer of key fragment, it isn't null-terminated
+ * @param size      size of buffer
+ *
+ * @return length of key fragment on success
+ *         -1/ESP_FAIL on failure, e.g. buffer is too small
+ */
+int tbcmh_tx_serialize_key(const char *key, char *fragment, int size);
+
+/**
+ * @brief Add a scalar value with a key fragment to the message begun by tbcmh_tx_begin()
+ *
+ * Notes:
+ * - The key isn't escaped again, it is the cheapest way to add a key/value pair
+ *
+ * @param client        ThingsBoard MQTT Client Helper handle
+ * @param fragment      key fragment serialized by tbcmh_tx_serialize_key()
+ * @param fragment_len  length of key fragment
+ * @param value         scalar value, it is still owned by caller
+ * @param decimals      fixed decimals of float value, 0~9. -1 for the shortest decimal.
+ *
+ * @return  0/ESP_OK on success
+ *         -1/ESP_FAIL on failure, e.g. TX buffer is full. The message is unchanged.
+ */
+tbc_err_t tbcmh_tx_add_scalar_fragment(tbcmh_handle_t client, const char *fragment, int fragment_len,
+                                       const tbcmh_scalar_t *value, int decimals);
+
+/**
+ * @brief Add a JSON value with a key fragment to the message begun by tbcmh_tx_begin()
+ *
+ * Notes:
+ * - The key isn't escaped again, same as tbcmh_tx_add_scalar_fragment()
+ *
+ * @param client        ThingsBoard MQTT Client Helper handle
+ * @param fragment      key fragment serialized by tbcmh_tx_serialize_key()
+ * @param fragment_len  length of key fragment
+ * @param value         value, it is still owned by caller
+ * @param decimals      fixed decimals of number value, 0~9. -1 for the shortest decimal.
+ *
+ * @return  0/ESP_OK on success
+ *         -1/ESP_FAIL on failure, e.g. TX buffer is full. The message is unchanged.
+ */
+tbc_err_t tbcmh_tx_add_value_fragment(tbcmh_handle_t client, const char *fragment, int fragment_len,
+                                      const tbcmh_value_t *value, int decimals);
+
+/**
+ * @brief Serialize the keys of fields into key fragments once
+ *
+ * Notes:
+ * - Each key is serialized like tbcmh_tx_serialize_key(), so a key with a quote or a backslash
+ *   still makes valid JSON
+ * - It does nothing if the fields are already registered, so it may be called before each use.
+ *   It is safe to call it from several tasks at the same time
+ * - The fragments are kept as long as the program runs, fields is usually a static table
+ * - It is usually called by the encoder generated by TBCE_SCHEMA_DEFINE()
+ *
+ * @param fields    fields, their fragment & fragment_len are filled
+ * @param count     count of fields
+ *
+ * @return  0/ESP_OK on success
+ *         -1/ESP_FAIL on failure, e.g. a key is NULL or no memory
+ */
+tbc_err_t tbcmh_tx_register_fields(tbcmh_tx_field_t *fields, int count);
+
+/**
+ * @brief Add members of a C struct to the message begun by tbcmh_tx_begin()
+ *
+ * Notes:
+ * - Key fragments are copied as they are, no key is looked up or escaped.
+ *   The fields MUST be registered by tbcmh_tx_register_fields()
+ * - It does nothing if count is 0
+ * - It is usually called by the encoder generated by TBCE_SCHEMA_DEFINE()
+ *
+ * @param client    ThingsBoard MQTT Client Helper handle
+ * @param fields    precomputed fields
+ * @param count     count of fields
+ * @param data      address of the struct
+ *
+ * @return  0/ESP_OK on success
+ *         -1/ESP_FAIL on failure, e.g. TX buffer is full. The message is unchanged.
+ */
+tbc_err_t tbcmh_tx_add_fields(tbcmh_handle_t client, const tbcmh_tx_field_t *fields,
+                              int count, const void *data);
+
+/**
+ * @brief Publish the message begun by tbcmh_tx_begin(), then release the client lock
+ *
+ * @param client     ThingsBoard MQTT Client Helper handle
+ * @param qos        qos of publish message, 0 or 1
+ * @param retain     ratain flag
+ *
+ * @return message_id of the publish message (for QoS 0 message_id will always be zero) on success.
+ *         TBCMH_PUBLISH_QUEUED if it is queued
+ *         0 if cannot publish
+ *        -1/ESP_FAIL on error or no key/value pair is added
+ */
+int tbcmh_tx_commit(tbcmh_handle_t client, int qos/*= 1*/, int retain/*= 0*/);
+
+/**
+ * @brief Drop the message begun by tbcmh_tx_begin(), then release the client lock
+ *
+ * @param client     ThingsBoard MQTT Client Helper handle
+ */
+void tbcmh_tx_abort(tbcmh_handle_t client);
+
+/**
+ * @brief Begin a protobuf telemetry or client-side attributes message in the reusable TX buffer
+ *
+ * Notes:
+ * - It is for a device profile whose transport payload type is Protobuf
+ * - Fields are encoded by field number of the telemetry/attributes proto schema
+ *   of the device profile, no .proto file is compiled
+ * - Same as tbcmh_tx_begin(), tbcmh_tx_commit() or tbcmh_tx_abort() MUST be called
+ *   in the same task after it returns 0/ESP_OK
+ * - Example:
+ *      // message SensorDataReading { optional double temperature = 1; optional int32 humidity = 2; }
+ *      tbcmh_tx_begin_proto(client, TBCMH_TX_TELEMETRY);
+ *      tbcmh_tx_add_proto_double(client, 1, 25.5);
+ *      tbcmh_tx_add_proto_int(client, 2, 60);
+ *      tbcmh_tx_commit(client, 1, 0);
+ *
+ * @param client    ThingsBoard MQTT Client Helper handle
+ * @param type      TBCMH_TX_TELEMETRY or TBCMH_TX_ATTRIBUTES
+ *
+ * @return  0/ESP_OK on success
+ *         -1/ESP_FAIL on failure
+ */
+tbc_err_t tbcmh_tx_begin_proto(tbcmh_handle_t client, tbcmh_tx_type_t type);
+
+/**
+ * @brief Add an int32/int64/uint32/uint64/enum field to the message begun by tbcmh_tx_begin_proto()
+ *
+ * @param client        ThingsBoard MQTT Client Helper handle
+ * @param field_number  field number in proto schema
+ * @param value         integer value
+ *
+ * @return  0/ESP_OK on success
+ *         -1/ESP_FAIL on failure, e.g. TX buffer is full. The message is unchanged.
+ */
+tbc_err_t tbcmh_tx_add_proto_int(tbcmh_handle_t client, uint32_t field_number, int64_t value);
+
+/**
+ * @brief Add a double field to the message begun by tbcmh_tx_begin_proto()
+ *
+ * @param client        ThingsBoard MQTT Client Helper handle
+ * @param field_number  field number in proto schema
+ * @param value         double value
+ *
+ * @return  0/ESP_OK on success
+ *         -1/ESP_FAIL on failure, e.g. TX buffer is full. The message is unchanged.
+ */
+tbc_err_t tbcmh_tx_add_proto_double(tbcmh_handle_t client, uint32_t field_number, double value);
+
+/**
+ * @brief Add a float field to the message begun by tbcmh_tx_begin_proto()
+ *
+ * @param client        ThingsBoard MQTT Client Helper handle
+ * @param field_number  field number in proto schema
+ * @param value         float value
+ *
+ * @return  0/ESP_OK on success
+ *         -1/ESP_FAIL on failure, e.g. TX buffer is full. The message is unchanged.
+ */
+tbc_err_t tbcmh_tx_add_proto_float(tbcmh_handle_t client, uint32_t field_number, float value);
+
+/**
+ * @brief Add a bool field to the message begun by tbcmh_tx_begin_proto()
+ *
+ * @param client        ThingsBoard MQTT Client Helper handle
+ * @param field_number  field number in proto schema
+ * @param value         boolean value
+ *
+ * @return  0/ESP_OK on success
+ *         -1/ESP_FAIL on failure, e.g. TX buffer is full. The message is unchanged.
+ */
+tbc_err_t tbcmh_tx_add_proto_bool(tbcmh_handle_t client, uint32_t field_number, bool value);
+
+/**
+ * @brief Add a string field to the message begun by tbcmh_tx_begin_proto()
+ *
+ * @param client        ThingsBoard MQTT Client Helper handle
+ * @param field_number  field number in proto schema
+ * @param value         string value
+ *
+ * @return  0/ESP_OK on success
+ *         -1/ESP_FAIL on failure, e.g. TX buffer is full. The message is unchanged.
+ */
+tbc_err_t tbcmh_tx_add_proto_string(tbcmh_handle_t client, uint32_t field_number, const char *value);
+
+//==== Rate limit & priority of publish messages ==============================
+/**
+ * @brief Set the rate limit of a class of publish messages
+ *
+ * Notes:
+ * - It may be called before the MQTT connection is established
+ * - Every publish message is charged to TBCMH_RATELIMIT_ALL and its own class,
+ *   e.g. telemetry, attributes, RPC responses, OTA chunk requests
+ * - By default, there is no rate limit
+ * - TBCMH_RATELIMIT_WAIT doesn't block the caller, the message waits in TX queue even if
+ *   it isn't enabled by tbcmh_txqueue_config()
+ *
+ * @param client        ThingsBoard MQTT Client Helper handle
+ * @param cls           class of publish messages
+ * @param limits        ThingsBoard format, "<capacity>:<seconds>,...", e.g. "10:1,300:60" is
+ *                      at most 10 messages per second and 300 messages per minute.
+ *                      NULL or "" for unlimited.
+ * @param policy        what to do when the rate limit is reached
+ * @param max_wait_ms   max waiting time for TBCMH_RATELIMIT_WAIT
+ *
+ * @return  0/ESP_OK on success
+ *         -1/ESP_FAIL on failure, e.g. limits is invalid
+ */
+tbc_err_t tbcmh_ratelimit_config(tbcmh_handle_t client, tbcmh_ratelimit_class_t cls,
+                                 const char *limits, tbcmh_ratelimit_policy_t policy,
+                                 uint32_t max_wait_ms);
+
+/**
+ * @brief Get count of publish messages rejected by the rate limit of a class
+ *
+ * @param client        ThingsBoard MQTT Client Helper handle
+ * @param cls           class of publish messages
+ *
+ * @return count of rejected publish messages
+ */
+uint32_t tbcmh_ratelimit_get_rejected(tbcmh_handle_t client, tbcmh_ratelimit_class_t cls);
+
+/**
+ * @brief Request the rate limits advertised by the server, and apply them
+ *
+ * Notes:
+ * - It should be called after the MQTT connection is established
+ * - It sends a "getSessionLimits" client-side RPC request. "rateLimits.messages" of the response
+ *   is applied to TBCMH_RATELIMIT_ALL, "rateLimits.telemetryMessages" to TBCMH_RATELIMIT_TELEMETRY
+ *
+ * @param client        ThingsBoard MQTT Client Helper handle
+ * @param policy        what to do when the rate limit is reached
+ * @param max_wait_ms   max waiting time for TBCMH_RATELIMIT_WAIT
+ *
+ * @return  0/ESP_OK on success
+ *         -1/ESP_FAIL on failure
+ */
+tbc_err_t tbcmh_ratelimit_request_session_limits(tbcmh_handle_t client,
+                                 tbcmh_ratelimit_policy_t policy, uint32_t max_wait_ms);
+
+/**
+ * @brief Enable or disable the priority TX queue in front of every publish
+ *
+ * Notes:
+ * - It may be called before the MQTT connection is established
+ * - By default, it is disabled and every message is published immediately
+ * - If it is enabled, a message is published immediately when no message of the same or
+ *   higher priority is waiting and the rate limit allows it. Otherwise it is queued and
+ *   the publish function returns 0. tbcmh_run() drains queued messages in priority order:
+ *   each class sends at most its weight of messages per round, so bulk data isn't starved.
+ *   A class which has no token of its rate limit waits alone, the other classes keep draining.
+ * - Rate limits don't wait(TBCMH_RATELIMIT_WAIT) when it is enabled, messages are queued instead
+ * - A message is dropped when the queue is full. Telemetry is kept by the store-and-forward
+ *   log if it is opened.
+ *
+ * @param client        ThingsBoard MQTT Client Helper handle
+ * @param config        config of priority TX queue, NULL to disable it. Queued messages are dropped.
+ *
+ * @return  0/ESP_OK on success
+ *         -1/ESP_FAIL on failure
+ */
+tbc_err_t tbcmh_txqueue_config(tbcmh_handle_t client, const tbcmh_txqueue_config_t *config);
+
+/**
+ * @brief Get count of messages in the priority TX queue
+ *
+ * @param client        ThingsBoard MQTT Client Helper handle
+ *
+ * @return count of queued messages
+ */
+int tbcmh_txqueue_get_count(tbcmh_handle_t client);
+
+/**
+ * @brief Get count of queued messages which are dropped without being sent
+ *
+ * Notes:
+ * - A queued message is dropped if it isn't sent in max_wait_ms of TBCMH_RATELIMIT_WAIT,
+ *   or the priority TX queue is disabled
+ * - It only grows. A publisher compares it with the value it saw last time, see TBCMH_PUBLISH_QUEUED
+ *
+ * @param client        ThingsBoard MQTT Client Helper handle
+ * @param type          TBCMH_TX_TELEMETRY or TBCMH_TX_ATTRIBUTES
+ *
+ * @return count of lost messages of type
+ */
+uint32_t tbcmh_txqueue_get_lost_count(tbcmh_handle_t client, tbcmh_tx_type_t type);
+
+//==== Device clock aligned to the server clock ===============================
+/**
+ * @brief Request the current time of the server, to align the device clock to it
+ *
+ * Notes:
+ * - It should be called after the MQTT connection is established
+ * - It sends a client-side RPC request, e.g. "getCurrentTime". The response is
+ *   {"currentTime":1664603253888}, {"time":1664603253888} or 1664603253888, in unix milliseconds.
+ *   It is answered by the rule chain of the server.
+ * - Half of the round trip time is compensated. A sample with a long round trip time is dropped.
+ * - With samples at least 1 minute apart, the drift of the device clock is estimated, too.
+ *   Estimation restarts if the server clock is stepped by more than 1 second.
+ *
+ * @param client        ThingsBoard MQTT Client Helper handle
+ * @param method        client-side RPC method, NULL for "getCurrentTime"
+ * @param interval_ms   interval of resync in tbcmh_run(), 0 for only once
+ *
+ * @return  0/ESP_OK on success
+ *         -1/ESP_FAIL on failure
+ */
+tbc_err_t tbcmh_timesync_request(tbcmh_handle_t client, const char *method, uint32_t interval_ms);
+
+/**
+ * @brief Add a sample of the server clock from another source, e.g. SNTP
+ *
+ * Notes:
+ * - It may be called before the MQTT connection is established
+ * - e.g. call it with 0 in the callback of sntp_set_time_sync_notification_cb()
+ *
+ * @param client        ThingsBoard MQTT Client Helper handle
+ * @param unix_ms       current unix time in milliseconds, 0 for the system time(gettimeofday())
+ *
+ * @return  0/ESP_OK on success
+ *         -1/ESP_FAIL on failure
+ */
+tbc_err_t tbcmh_timesync_set_reference(tbcmh_handle_t client, int64_t unix_ms);
+
+/**
+ * @brief Get the current server time in unix milliseconds
+ *
+ * Notes:
+ * - It is cheap: the monotonic timer plus offset & drift, no syscall. It may be called in any task.
+ * - It returns the system time(gettimeofday()) until the first sample is taken
+ * - It is used when telemetry is stamped with ts of 0, e.g. tbcmh_telemetry_batch_add(),
+ *   tbcmh_tx_begin_ts() & the store-and-forward log
+ *
+ * @param client        ThingsBoard MQTT Client Helper handle
+ *
+ * @return current server time in unix milliseconds
+ */
+int64_t tbcmh_timesync_now_ms(tbcmh_handle_t client);
+
+/**
+ * @brief Get status of the device clock aligned to the server clock
+ *
+ * @param client        ThingsBoard MQTT Client Helper handle
+ * @param status        status output
+ *
+ * @return  0/ESP_OK on success
+ *         -1/ESP_FAIL on failure
+ */
+tbc_err_t tbcmh_timesync_get_status(tbcmh_handle_t client, tbcmh_timesync_status_t *status);
+
+//==== Interned keys shared by helper and extensions ==========================
+/**
+ * @brief Intern a key, i.e. get the only copy of it shared by helper and extensions
+ *
+ * Notes:
+ * - Two interned keys are equal if and only if their pointers are equal
+ * - Each call must be paired with a tbcmh_key_release()
+ *
+ * @param key   '\0' terminated key
+ *
+ * @return interned key on success
+ *         NULL on failure
+ */
+tbcmh_key_t tbcmh_key_intern(const char *key);
+
+/**
+ * @brief Find an interned key. Reference count is unchanged.
+ *
+ * @param key   key, it needn't be '\0' terminated
+ * @param len   length of key
+ *
+ * @return interned key if it is interned
+ *         NULL otherwise
+ */
+tbcmh_key_t tbcmh_key_find(const char *key, int len);
+
+/**
+ * @brief Release an interned key. It is freed when no one holds it.
+ *
+ * @param key   interned key returned by tbcmh_key_intern()
+ */
+void tbcmh_key_release(tbcmh_key_t key);
+
+/**
+ * @brief Get hash of an interned key, e.g. to index a table by interned keys
+ *
+ * @param key   interned key returned by tbcmh_key_intern()
+ *
+ * @return FNV-1a hash of key, 0 if key is NULL
+ */
+uint32_t tbcmh_key_hash(tbcmh_key_t key);
+
+/**
+ * @brief Get name of a member of an object as an interned key
+ *
+ * Notes:
+ * - Members of received attributes are named by interned keys already, no lookup is done.
+ *   Any other name is looked up, incl. a constant string added by cJSON_AddItemToObjectCS()
+ *
+ * @param item   member of an object
+ *
+ * @return interned key if its name is interned
+ *         NULL otherwise
+ */
+tbcmh_key_t tbcmh_key_of_item(const cJSON *item);
+
+/**
+ * @brief Get a member of an object by interned key. Case sensitive, unlike cJSON_GetObjectItem().
+ *
+ * @param object   object, e.g. received attributes
+ * @param key      interned key
+ *
+ * @return member on success
+ *         NULL if it is not found
+ */
+cJSON *tbcmh_key_get_item(const cJSON *object, tbcmh_key_t key);
+
+//==== Subscribe to shared device attribute updates from the server============
+
+/**
+ * @brief Subscribe to shared device attribute updates from the server
+ *
+ * Notes:
+ * - It may be called before the MQTT connection is established
+ *
+ * @param client        ThingsBoard MQTT Client Helper handle
+ * @param context
+ * @param on_update     calllback of shared device attributes update
+ * @param count         count of keys, 0 for all shared attributes
+ * @param keys          keys of shared device attributes, case sensitive
+ * 
+ * @return subscribe_id on success
+ *         -1/ESP_FAIL on failure
+ */
+int tbcmh_attributes_subscribe(tbcmh_handle_t client,
+                                void *context,
+                                tbcmh_attributes_on_update_t on_update,
+                                int count,
+                                /*const char *key,*/...);
+
+/**
+ * @brief Subscribe to shared device attribute updates from the server
+ *
+ * Notes:
+ * - It may be called before the MQTT connection is established
+ *
+ * @param client        ThingsBoard MQTT Client Helper handle
+ * @param context
+ * @param on_update     calllback of shared device attributes update
+ * @param count         count of keys, 0 for all shared attributes
+ * @param keys          array of shared device attributes, case sensitive
+ * 
+ * @return subscribe_id on success
+ *         -1/ESP_FAIL on failure
+ */
+int tbcmh_attributes_subscribe_of_array(
+                                tbcmh_handle_t client,
+                                void *context,
+                                tbcmh_attributes_on_update_t on_update,
+                                int count, const char *keys[]);
+
+/**
+ * @brief Subscribe to shared device attribute updates from the server, as JSON events
+ *
+ * Notes:
+ * - It may be called before the MQTT connection is established
+ * - It is for very large shared attributes, e.g. config blobs of tens of KB.
+ *   Large payloads are parsed fragment by fragment, they are never merged in memory
+ *
+ * @param client        ThingsBoard MQTT Client Helper handle
+ * @param context
+ * @param on_stream     calllback of each JSON event of shared device attributes update
+ * @param count         count of keys, 0 for all shared attributes
+ * @param keys          array of shared device attributes, case sensitive
+ * 
+ * @return subscribe_id on success
+ *         -1/ESP_FAIL on failure
+ */
+int tbcmh_attributes_subscribe_stream(
+                                tbcmh_handle_t client,
+                                void *context,
+                                tbcmh_attributes_on_stream_t on_stream,
+                                int count, const char *keys[]);
+
+/**
+ * @brief Unsubscribe to shared device attribute updates from the server
+ *
+ * Notes:
+ * - It may be called before the MQTT connection is established
+ *
+ * @param client        ThingsBoard MQTT Client Helper handle
+ * @param subscribe_id  suscribe id
+ * 
+ * @return 0/ESP_OK on success
+ *         -1/ESP_FAIL on failure
+ */
+tbc_err_t tbcmh_attributes_unsubscribe(
+                                tbcmh_handle_t client,
+                                int subscribe_id);
+
+//==== Request client-side or shared device attributes from the server ========
+/**
+ * @brief Request client-side or shared device attributes from the server
+ *
+ * Notes:
+ * - It should be called after the MQTT connection is established
+ * - Requests of the helper's modules and of on_connected() are combined into one request,
+ *   which is sent after on_connected() returns. Requests with the same callbacks & context
+ *   are answered once, and each requester gets its own keys only.
+ *
+ * @param client        ThingsBoard MQTT Client Helper handle
+ * @param context
+ * @param on_response   calllback of device attributes response
+ * @param on_timeout    calllback of device attributes timeout event
+ * @param client_keys   client_keys, like "abc, efg, xyz"
+ * @param shared_keys   shared_keys, like "abc, efg, xyz"
+ * 
+ * @return 0/ESP_OK on successful
+ *         -1/ESP_FAIL on otherwise
+ */
+tbc_err_t tbcmh_attributes_request(
+                                tbcmh_handle_t client,
+                                void *context,
+                                tbcmh_attributes_on_response_t on_response,
+                                tbcmh_attributes_on_timeout_t on_timeout,
+                                const char *client_keys,
+                                const char *shared_keys);
+
+/**
+ * @brief Request client-side device attributes from the server
+ *
+ * Notes:
+ * - It should be called after the MQTT connection is established
+ *
+ * @param client        ThingsBoard MQTT Client Helper handle
+ * @param context
+ * @param on_response   calllback of device attributes response
+ * @param on_timeout    calllback of device attributes timeout event
+ * @param client_keys   client_keys, like "abc, efg, xyz"
+ * 
+ * @return 0/ESP_OK on successful
+ *         -1/ESP_FAIL on otherwise
  */
 tbc_err_t tbcmh_clientattributes_request(
                                 tbcmh_handle_t client,
@@ -677,6 +1735,173 @@ tbc_err_t tbcmh_sharedattributes_request(
                                 tbcmh_attributes_on_timeout_t on_timeout,
                                 int count, /*const char *key,*/...);
 
+//==== Local mirror of device attributes ======================================
+/**
+ * @brief Mirror a device attribute locally
+ *
+ * Notes:
+ * - It may be called before the MQTT connection is established
+ * - A shared attribute is kept up to date by subscribing to it.
+ *   Both shared and client-side attributes are updated by any attributes response,
+ *   e.g. of tbcmh_attributes_request()
+ * - Only scalar values are mirrored. A string longer than max_string_len is not mirrored.
+ * - Getters read the mirror in any task without lock, callback or network traffic
+ *
+ * @param client            ThingsBoard MQTT Client Helper handle
+ * @param key               name of attribute
+ * @param is_shared         true for shared attribute, false for client-side attribute
+ * @param max_string_len    capacity of string value, 0 if it isn't a string
+ *
+ * @return mirror handle on success, it is valid until tbcmh_attributemirror_remove()/tbcmh_destroy()
+ *         NULL on failure
+ */
+tbcmh_attributemirror_handle_t tbcmh_attributemirror_add(tbcmh_handle_t client,
+                                const char *key, bool is_shared, int max_string_len);
+
+/**
+ * @brief Remove a local mirror of a device attribute
+ *
+ * Notes:
+ * - Don't read it in other tasks meanwhile
+ *
+ * @param client    ThingsBoard MQTT Client Helper handle
+ * @param mirror    mirror handle returned by tbcmh_attributemirror_add()
+ *
+ * @return 0/ESP_OK on successful
+ *         -1/ESP_FAIL on otherwise
+ */
+tbc_err_t tbcmh_attributemirror_remove(tbcmh_handle_t client, tbcmh_attributemirror_handle_t mirror);
+
+/**
+ * @brief Find a local mirror of a device attribute by key. Look it up once, and keep the handle in hot code paths.
+ *
+ * @param client    ThingsBoard MQTT Client Helper handle
+ * @param key       name of attribute
+ * @param is_shared true for shared attribute, false for client-side attribute
+ *
+ * @return mirror handle if it is mirrored
+ *         NULL otherwise
+ */
+tbcmh_attributemirror_handle_t tbcmh_attributemirror_find(tbcmh_handle_t client,
+                                const char *key, bool is_shared);
+
+/**
+ * @brief Get version of a local mirror, i.e. count of received values. Lock-free.
+ *
+ * @param mirror    mirror handle
+ *
+ * @return version, 0 if no value is received yet
+ */
+uint32_t tbcmh_attributemirror_get_version(tbcmh_attributemirror_handle_t mirror);
+
+/**
+ * @brief Get value of a local mirror as integer. Lock-free.
+ *
+ * Notes:
+ * - A float value is truncated, a bool value is 0 or 1
+ *
+ * @param mirror    mirror handle
+ * @param value     value output
+ * @param version   version of value output, see tbcmh_attributemirror_get_version(). It may be NULL.
+ *
+ * @return 0/ESP_OK on successful
+ *         -1/ESP_FAIL if no value is received yet or it isn't a number or bool
+ */
+tbc_err_t tbcmh_attributemirror_get_int(tbcmh_attributemirror_handle_t mirror,
+                                int64_t *value, uint32_t *version);
+
+/**
+ * @brief Get value of a local mirror as float. Lock-free.
+ *
+ * @param mirror    mirror handle
+ * @param value     value output
+ * @param version   version of value output. It may be NULL.
+ *
+ * @return 0/ESP_OK on successful
+ *         -1/ESP_FAIL if no value is received yet or it isn't a number or bool
+ */
+tbc_err_t tbcmh_attributemirror_get_float(tbcmh_attributemirror_handle_t mirror,
+                                double *value, uint32_t *version);
+
+/**
+ * @brief Get value of a local mirror as bool. Lock-free.
+ *
+ * Notes:
+ * - A number is true if it isn't 0
+ *
+ * @param mirror    mirror handle
+ * @param value     value output
+ * @param version   version of value output. It may be NULL.
+ *
+ * @return 0/ESP_OK on successful
+ *         -1/ESP_FAIL if no value is received yet or it isn't a number or bool
+ */
+tbc_err_t tbcmh_attributemirror_get_bool(tbcmh_attributemirror_handle_t mirror,
+                                bool *value, uint32_t *version);
+
+/**
+ * @brief Get value of a local mirror as string. Lock-free.
+ *
+ * @param mirror    mirror handle
+ * @param buffer    '\0' terminated string output
+ * @param size      size of buffer
+ * @param version   version of value output. It may be NULL.
+ *
+ * @return 0/ESP_OK on successful
+ *         -1/ESP_FAIL if no value is received yet, it isn't a string or buffer is too small
+ */
+tbc_err_t tbcmh_attributemirror_get_string(tbcmh_attributemirror_handle_t mirror,
+                                char *buffer, int size, uint32_t *version);
+
+/**
+ * @brief Check whether value of a local mirror is restored from snapshot, i.e. it isn't received in this run yet. Lock-free.
+ *
+ * @param mirror    mirror handle
+ *
+ * @return true if it is restored from snapshot
+ */
+bool tbcmh_attributemirror_is_restored(tbcmh_attributemirror_handle_t mirror);
+
+/**
+ * @brief Open the snapshot of attributes, which is persisted for warm start
+ *
+ * Notes:
+ * - Call it after tbcmh_create() and before tbcmh_connect(). Mount the file system before calling it.
+ * - Mirrors start with the last known values at once, see tbcmh_attributemirror_is_restored().
+ * - All client-side attributes which are published or received are saved. They are owned by the device,
+ *   so those in snapshot are answered by the snapshot instead of being fetched, e.g. by tbcmh_attributes_request().
+ *   Shared attributes may be changed while offline, they are always fetched. Only mirrored ones are saved.
+ * - Changes are saved at most once per save_interval_ms, and in tbcmh_attributemirror_store_close()/tbcmh_destroy().
+ *
+ * @param client     ThingsBoard MQTT Client Helper handle
+ * @param config     config of the snapshot
+ *
+ * @return 0/ESP_OK on success
+ *        -1/ESP_FAIL on failure
+ */
+tbc_err_t tbcmh_attributemirror_store_open(tbcmh_handle_t client,
+                                const tbcmh_attributemirror_store_config_t *config);
+
+/**
+ * @brief Save changes & close the snapshot of attributes
+ *
+ * @param client     ThingsBoard MQTT Client Helper handle
+ */
+void tbcmh_attributemirror_store_close(tbcmh_handle_t client);
+
+/**
+ * @brief Get age of the snapshot restored by tbcmh_attributemirror_store_open()
+ *
+ * Notes:
+ * - It is measured by tbcmh_timesync_now_ms(), so it is unknown until the clock is set
+ *
+ * @param client     ThingsBoard MQTT Client Helper handle
+ *
+ * @return age in milliseconds
+ *         -1 if no snapshot is restored or the clock isn't set
+ */
+int64_t tbcmh_attributemirror_get_snapshot_age(tbcmh_handle_t client);
+
 //==== Server-side RPC ========================================================
 
 /**
@@ -699,6 +1924,31 @@ tbc_err_t tbcmh_serverrpc_subscribe(
                                 void *context,
                                 tbcmh_serverrpc_on_request_t on_request);
 
+/**
+ * @brief Subscribe to server-side RPC from the server, params are delivered as JSON events
+ *
+ * Notes:
+ * - It may be called before the MQTT connection is established
+ * - It is for very large rpc params, e.g. large arrays.
+ *   Large payloads are parsed fragment by fragment, they are never merged in memory
+ * - "method" must precede "params" in payload of a large request, as ThingsBoard sends it
+ *
+ * @param client        ThingsBoard MQTT Client Helper handle
+ * @param method        RPC method name
+ * @param context
+ * @param on_params     calllback of each JSON event of rpc params
+ * @param on_request    calllback of server-side RPC request, it is called with NULL rpc_params after all params events
+ * 
+ * @return  0/ESP_OK on success
+ *         -1/ESP_FAIL on failure
+ */
+tbc_err_t tbcmh_serverrpc_subscribe_stream(
+                                tbcmh_handle_t client,
+                                const char *method,
+                                void *context,
+                                tbcmh_serverrpc_on_params_t on_params,
+                                tbcmh_serverrpc_on_request_t on_request);
+
 /**
  * @brief Subscribe to server-side RPC from the server
  *
@@ -159,6 +159,7 @@ extern "C" {
 //         fw_title, fw_version, fw_size, fw_checksum, fw_checksum_algorithm,
 //         sw_title, sw_version, sw_size, sw_checksum, sw_checksum_algorithm
 #define TB_MQTT_TOPIC_FW_REQUEST_PATTERN        "v2/fw/request/%u/chunk/%u"   //publish, ${requestId}, ${chunkId}
+#define TB_MQTT_TOPIC_FW_REQUEST_PREFIX         "v2/fw/request/"              //publish
 #define TB_MQTT_TOPIC_FW_RESPONSE_PATTERN       "v2/fw/response/%u/chunk/"    //receive, ${requestId}
 #define TB_MQTT_TOPIC_FW_RESPONSE_PREFIX        "v2/fw/response/"             //receive, ${requestId}, ${chunkId}
 #define TB_MQTT_TOPIC_FW_RESPONSE_SUBSCRIBE     "v2/fw/response/+/chunk/+"    //subsribe
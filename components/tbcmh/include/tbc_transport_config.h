@@ -155,6 +155,18 @@ typedef struct tbc_transport_authentication_config
     //void     *ds_data;                /*!< Carrier of handle for digital signature parameters, digital signature peripheral is available in some Espressif devices. */
 } tbc_transport_authentication_config_t;
 
+/**
+ * ThingsBoard Client transport payload type.
+ * 
+ * It MUST be same as 'Transport payload type' of the device profile in ThingsBoard.
+ * 
+ */
+typedef enum tbc_transport_payload_type
+{
+  TBC_TRANSPORT_PAYLOAD_TYPE_JSON = 0,   /*!< JSON */
+  TBC_TRANSPORT_PAYLOAD_TYPE_PROTOBUF    /*!< Protobuf. RPC request & response use the default proto schemas of device profile */
+} tbc_transport_payload_type_t;
+
 /**
  * ThingsBoard Client transport client-authentication (TLS/DTLS) configuration.
  * 
@@ -169,6 +181,7 @@ typedef struct tbc_transport_config
   tbc_transport_authentication_config_t authentication; /*!< Client authentication for mutual authentication using TLS */
 
   bool log_rxtx_package; /*!< print Rx/Tx MQTT package */
+  tbc_transport_payload_type_t payload_type; /*!< JSON or protobuf, default is JSON */
 } tbc_transport_config_t;
 
 /**
@@ -180,6 +193,7 @@ typedef struct
   const char *uri;             /*!< Complete MQTT broker URI */
   const char *access_token;    /*!< Access Token */
   const bool log_rxtx_package; /*!< print Rx/Tx MQTT package */
+  const tbc_transport_payload_type_t payload_type; /*!< JSON or protobuf, default is JSON */
 } tbc_transport_config_esay_t;
 
 /**
@@ -45,6 +45,7 @@ extern "C" {
 // #define TBCM_ERR_NOT_FINISHED        0x10C   /*!< There are items remained to retrieve */
 
 #define TBC_MALLOC   malloc
+#define TBC_REALLOC  realloc
 #define TBC_FREE     free
 
 typedef int tbc_err_t;
@@ -19,6 +19,7 @@
 #include <stdbool.h>
 
 #include "esp_err.h"
+#include "esp_timer.h"
 #include "sys/queue.h"
 
 #include "tbc_mqtt_helper.h"
@@ -30,11 +31,21 @@
  */
 typedef struct clientattribute
 {
-     char *key; /*!< Key */
+     tbcmh_key_t key; /*!< Interned key */
      void *context;                         /*!< Context of getting/setting value*/
      tbce_clientattribute_on_get_t on_get; /*!< Callback of getting value from context */
+     tbce_clientattribute_on_get_scalar_t on_get_scalar; /*!< Callback of getting scalar value from context */
      tbce_clientattribute_on_set_t on_set; /*!< Callback of setting value to context */
 
+     bool dirty;                            /*!< true if it is changed locally and not published yet */
+     bool has_last;                         /*!< true if last_fingerprint is valid */
+     uint64_t last_fingerprint;             /*!< fingerprint of the last published value */
+     bool sampled;                          /*!< true if sampled_value/sampled_json is got, but not written to TX buffer yet */
+     tbcmh_scalar_t sampled_value;          /*!< value got by on_get_scalar */
+     cJSON *sampled_json;                   /*!< value got by on_get, NULL if it is a scalar */
+     bool pending;                          /*!< true if pending_fingerprint is in the message which is not published yet */
+     uint64_t pending_fingerprint;          /*!< fingerprint of the value in the message which is not published yet */
+
      LIST_ENTRY(clientattribute) entry;
 } clientattribute_t;
 
@@ -46,19 +57,101 @@ typedef LIST_HEAD(tbce_clientattribute_list, clientattribute) clientattribute_li
 typedef struct tbce_clientattributes
 {
      clientattribute_list_t clientattribute_list; /*!< client-attribute list */
+
+     uint32_t coalesce_ms;                  /*!< window of coalescing changes before they are flushed, 0 for none */
+     bool has_dirty;                        /*!< true if any client-side attribute is dirty */
+     int64_t dirty_since_us;                /*!< esp_timer_get_time() of the first unflushed change */
+     uint32_t lost_count;                   /*!< tbcmh_txqueue_get_lost_count() of attributes seen by the last flush */
 } tbce_clientattributes_t;
 
 #define MAX_KEYS_LEN (256)
 
+#define FINGERPRINT_BASIS (14695981039346656037ull)  /*!< FNV-1a 64-bit offset basis */
+#define FINGERPRINT_PRIME (1099511628211ull)         /*!< FNV-1a 64-bit prime */
+
 const static char *TAG = "clientattribute";
 
+static uint64_t _fingerprint_mix(uint64_t hash, const void *data, int len)
+{
+     const uint8_t *bytes = (const uint8_t *)data;
+     int i;
+     for (i = 0; i < len; i++) {
+          hash ^= bytes[i];
+          hash *= FINGERPRINT_PRIME;
+     }
+     return hash;
+}
+
+// Fingerprint of a JSON value. A number is hashed as double, so that a scalar
+// and a cJSON value which are serialized alike have the same fingerprint.
+static uint64_t _fingerprint_of_value(uint64_t hash, const cJSON *value)
+{
+     uint8_t type = (uint8_t)(value->type & 0xFF);
+     hash = _fingerprint_mix(hash, &type, sizeof(type));
+     switch (type) {
+     case cJSON_Number:
+          return _fingerprint_mix(hash, &value->valuedouble, sizeof(value->valuedouble));
+     case cJSON_String:
+     case cJSON_Raw:
+          return value->valuestring ? _fingerprint_mix(hash, value->valuestring, strlen(value->valuestring) + 1) : hash;
+     case cJSON_Array:
+     case cJSON_Object:
+     {
+          const cJSON *child = NULL;
+          cJSON_ArrayForEach(child, value) {
+               if (type == cJSON_Object && child->string) {
+                    hash = _fingerprint_mix(hash, child->string, strlen(child->string) + 1);
+               }
+               hash = _fingerprint_of_value(hash, child);
+          }
+          return _fingerprint_mix(hash, &type, sizeof(type)); // end of container
+     }
+     default:
+          return hash; // cJSON_False, cJSON_True & cJSON_NULL
+     }
+}
+
+static uint64_t _fingerprint_of_scalar(const tbcmh_scalar_t *value)
+{
+     uint64_t hash = FINGERPRINT_BASIS;
+     uint8_t type;
+     double number;
+     switch (value->type) {
+     case TBCMH_SCALAR_INT:
+     case TBCMH_SCALAR_FLOAT:
+          type = cJSON_Number;
+          number = (value->type == TBCMH_SCALAR_INT) ? (double)value->value.int_value
+                                                      : value->value.float_value;
+          hash = _fingerprint_mix(hash, &type, sizeof(type));
+          return _fingerprint_mix(hash, &number, sizeof(number));
+     case TBCMH_SCALAR_BOOL:
+          type = value->value.bool_value ? cJSON_True : cJSON_False;
+          return _fingerprint_mix(hash, &type, sizeof(type));
+     case TBCMH_SCALAR_STRING:
+     {
+          type = cJSON_String;
+          const char nul = '\0';
+          hash = _fingerprint_mix(hash, &type, sizeof(type));
+          hash = _fingerprint_mix(hash, value->value.string.ptr, value->value.string.len);
+          return _fingerprint_mix(hash, &nul, sizeof(nul));
+     }
+     default:
+          type = cJSON_NULL;
+          return _fingerprint_mix(hash, &type, sizeof(type));
+     }
+}
+
 static clientattribute_t *_clientattribute_create(
                                             const char *key, void *context,
                                             tbce_clientattribute_on_get_t on_get,
+                                            tbce_clientattribute_on_get_scalar_t on_get_scalar,
                                             tbce_clientattribute_on_set_t on_set)
 {
     TBC_CHECK_PTR_WITH_RETURN_VALUE(key, NULL);
-    TBC_CHECK_PTR_WITH_RETURN_VALUE(on_get, NULL);
+    if (!on_get && !on_get_scalar) {
+        TBC_LOGE("on_get and on_get_scalar are both NULL! key=%s", key);
+        return NULL;
+    }
     
     clientattribute_t *clientattribute = TBC_MALLOC(sizeof(clientattribute_t));
     if (!clientattribute) {
@@ -67,12 +160,10 @@ static clientattribute_t *_clientattribute_create(
     }
 
     memset(clientattribute, 0x00, sizeof(clientattribute_t));
-    clientattribute->key = TBC_MALLOC(strlen(key)+1);
-    if (clientattribute->key) {
-        strcpy(clientattribute->key, key);
-    }
+    clientattribute->key = tbcmh_key_intern(key);
     clientattribute->context = context;
     clientattribute->on_get = on_get;
+    clientattribute->on_get_scalar = on_get_scalar;
     clientattribute->on_set = on_set;
     return clientattribute;
 }
@@ -82,7 +173,7 @@ static tbc_err_t _clientattribute_destroy(clientattribute_t *clientattribute)
 {
     TBC_CHECK_PTR_WITH_RETURN_VALUE(clientattribute, ESP_FAIL);
 
-    TBC_FREE(clientattribute->key);
+    tbcmh_key_release(clientattribute->key);
     TBC_FREE(clientattribute);
     return ESP_OK;
 }
@@ -90,10 +181,12 @@ static tbc_err_t _clientattribute_destroy(clientattribute_t *clientattribute)
 static tbc_err_t _clientattribute_register(tbce_clientattributes_handle_t clientattributes,
                                                   const char *key, void *context,
                                                   tbce_clientattribute_on_get_t on_get,
+                                                  tbce_clientattribute_on_get_scalar_t on_get_scalar,
                                                   tbce_clientattribute_on_set_t on_set)
 {
      // Create clientattribute
-     clientattribute_t *clientattribute = _clientattribute_create(key, context, on_get, on_set);
+     clientattribute_t *clientattribute = _clientattribute_create(key, context,
+                                                                  on_get, on_get_scalar, on_set);
      if (!clientattribute) {
           TBC_LOGE("Init clientattribute failure! key=%s. %s()", key, __FUNCTION__);
           return ESP_FAIL;
@@ -154,7 +247,7 @@ tbc_err_t tbce_clientattributes_register_with_set(tbce_clientattributes_handle_t
                                         tbce_clientattribute_on_set_t on_set)
 {
      TBC_CHECK_PTR_WITH_RETURN_VALUE(on_set, ESP_FAIL);
-     return _clientattribute_register(clientattributes, key, context, on_get, on_set);
+     return _clientattribute_register(clientattributes, key, context, on_get, NULL, on_set);
 }
 
 tbc_err_t tbce_clientattributes_register(tbce_clientattributes_handle_t clientattributes,
@@ -162,7 +255,17 @@ tbc_err_t tbce_clientattributes_register(tbce_clientattributes_handle_t clientat
                                          tbce_clientattribute_on_get_t on_get)
 {
      TBC_CHECK_PTR_WITH_RETURN_VALUE(clientattributes, ESP_FAIL);
-     return _clientattribute_register(clientattributes, key, context, on_get, NULL);
+     return _clientattribute_register(clientattributes, key, context, on_get, NULL, NULL);
+}
+
+tbc_err_t tbce_clientattributes_register_scalar(tbce_clientattributes_handle_t clientattributes,
+                                         const char *key, void *context,
+                                         tbce_clientattribute_on_get_scalar_t on_get_scalar,
+                                         tbce_clientattribute_on_set_t on_set)
+{
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(clientattributes, ESP_FAIL);
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(on_get_scalar, ESP_FAIL);
+     return _clientattribute_register(clientattributes, key, context, NULL, on_get_scalar, on_set);
 }
 
 tbc_err_t tbce_clientattributes_unregister(tbce_clientattributes_handle_t clientattributes,
@@ -172,9 +275,10 @@ tbc_err_t tbce_clientattributes_unregister(tbce_clientattributes_handle_t client
      TBC_CHECK_PTR_WITH_RETURN_VALUE(key, ESP_FAIL);
 
      // Search item
+     tbcmh_key_t interned = tbcmh_key_find(key, strlen(key));
      clientattribute_t *clientattribute = NULL, *next;;
      LIST_FOREACH_SAFE(clientattribute, &clientattributes->clientattribute_list, entry, next) {
-          if (clientattribute && strcmp(clientattribute->key, key)==0) {
+          if (clientattribute && interned && clientattribute->key == interned) {
              // Remove from list and destroy
              LIST_REMOVE(clientattribute, entry);
              _clientattribute_destroy(clientattribute);
@@ -196,9 +300,10 @@ bool tbce_clientattributes_is_contained(tbce_clientattributes_handle_t clientatt
      TBC_CHECK_PTR_WITH_RETURN_VALUE(key, false);
 
      // Search item
+     tbcmh_key_t interned = tbcmh_key_find(key, strlen(key));
      clientattribute_t *clientattribute = NULL, *next;;
      LIST_FOREACH_SAFE(clientattribute, &clientattributes->clientattribute_list, entry, next) {
-          if (clientattribute && strcmp(clientattribute->key, key)==0) {
+          if (clientattribute && interned && clientattribute->key == interned) {
              return true;
           }
      }
@@ -225,8 +330,11 @@ static void _tbce_clientattributes_on_initialized(tbcmh_handle_t client,
      tbc_err_t result = 0;
      LIST_FOREACH_SAFE(clientattribute, &clientattributes->clientattribute_list, entry, next) {
           if (clientattribute && clientattribute->key && clientattribute->on_set) {
-               cJSON *value = cJSON_GetObjectItem(object, clientattribute->key);
+               cJSON *value = tbcmh_key_get_item(object, clientattribute->key);
                if (value) {
+                   // the server holds this value already, it needn't be published again
+                   clientattribute->last_fingerprint = _fingerprint_of_value(FINGERPRINT_BASIS, value);
+                   clientattribute->has_last = true;
                    result = clientattribute->on_set(clientattribute->context, value);
                    if (result == 2) { // called tbcmh_disconnect()/tbcmh_destroy() inside on_set()
                         break;
@@ -297,6 +405,128 @@ tbc_err_t tbce_clientattributes_initialize(
     return ESP_OK;
 }
 
+/*!< Get value of clientattribute by its callback. It is called before tbcmh_tx_begin(),
+     so user callbacks never run in client->_lock.
+     Returns 1 if it is got, 0 if it is unchanged and only_changed is true, -1 on failure */
+static int _clientattribute_sample(clientattribute_t *clientattribute, bool only_changed)
+{
+     uint64_t fingerprint;
+     if (clientattribute->sampled || clientattribute->pending) {
+          return 0; // duplicated key
+     }
+     if (clientattribute->on_get_scalar) {
+          // scalar lives in clientattribute, nothing is allocated
+          tbcmh_scalar_t value = {.type = TBCMH_SCALAR_NULL};
+          if (clientattribute->on_get_scalar(clientattribute->context, &value) != ESP_OK) {
+               TBC_LOGW("Unable to get value! key=%s", clientattribute->key);
+               return -1;
+          }
+          fingerprint = _fingerprint_of_scalar(&value);
+          if (only_changed && clientattribute->has_last && clientattribute->last_fingerprint == fingerprint) {
+               return 0;
+          }
+          clientattribute->sampled_value = value;
+          clientattribute->sampled_json = NULL;
+     } else {
+          cJSON *value = clientattribute->on_get(clientattribute->context);
+          if (!value) {
+               TBC_LOGW("value is NULL! key=%s", clientattribute->key);
+               return -1;
+          }
+          fingerprint = _fingerprint_of_value(FINGERPRINT_BASIS, value);
+          if (only_changed && clientattribute->has_last && clientattribute->last_fingerprint == fingerprint) {
+               cJSON_Delete(value);
+               return 0;
+          }
+          clientattribute->sampled_json = value;
+     }
+
+     clientattribute->sampled = true;
+     clientattribute->pending_fingerprint = fingerprint;
+     return 1;
+}
+
+/*!< Add the sampled value of clientattribute to TX buffer. Returns true if it is added */
+static bool _clientattribute_write(tbcmh_handle_t client, clientattribute_t *clientattribute)
+{
+     if (!clientattribute->sampled) {
+          return false;
+     }
+     clientattribute->sampled = false;
+
+     tbc_err_t err;
+     if (clientattribute->sampled_json) {
+          err = tbcmh_tx_add_value(client, clientattribute->key, clientattribute->sampled_json);
+          cJSON_Delete(clientattribute->sampled_json);
+          clientattribute->sampled_json = NULL;
+     } else {
+          err = tbcmh_tx_add_scalar(client, clientattribute->key, &clientattribute->sampled_value);
+     }
+     if (err != ESP_OK) {
+          return false;
+     }
+
+     clientattribute->pending = true;
+     return true;
+}
+
+/*!< Remember the published values once the message is committed. msg_id is -1 on failure.
+     A queued message counts as published, see TBCMH_PUBLISH_QUEUED.
+     It also drops the sampled values which are not written */
+static void _clientattributes_on_committed(tbce_clientattributes_handle_t clientattributes, int msg_id)
+{
+     clientattribute_t *clientattribute = NULL;
+     LIST_FOREACH(clientattribute, &clientattributes->clientattribute_list, entry) {
+          if (clientattribute->sampled_json) {
+               cJSON_Delete(clientattribute->sampled_json);
+               clientattribute->sampled_json = NULL;
+          }
+          clientattribute->sampled = false;
+          if (!clientattribute->pending) {
+               continue;
+          }
+          clientattribute->pending = false;
+          if (msg_id > -1) {
+               clientattribute->last_fingerprint = clientattribute->pending_fingerprint;
+               clientattribute->has_last = true;
+               clientattribute->dirty = false;
+          }
+     }
+}
+
+/*!< Write the sampled values into TX buffer and publish them.
+     Returns msg_id, or -1 on failure */
+static int _clientattributes_publish(tbce_clientattributes_handle_t clientattributes,
+                                     tbcmh_handle_t client)
+{
+     // write key/value pairs into TX buffer directly, no cJSON object tree
+     if (tbcmh_tx_begin(client, TBCMH_TX_ATTRIBUTES) != ESP_OK) {
+          TBC_LOGE("Unable to begin TX buffer! %s()", __FUNCTION__);
+          _clientattributes_on_committed(clientattributes, -1);
+          return -1;
+     }
+
+     int added = 0;
+     clientattribute_t *clientattribute = NULL;
+     LIST_FOREACH(clientattribute, &clientattributes->clientattribute_list, entry) {
+          if (_clientattribute_write(client, clientattribute)) {
+               added++;
+          }
+     }
+     if (added == 0) {
+          tbcmh_tx_abort(client);
+          _clientattributes_on_committed(clientattributes, -1);
+          return -1;
+     }
+
+     // send package...
+     int msg_id = tbcmh_tx_commit(client, 1/*qos*/, 0/*retain*/);
+
+     // remember the published values
+     _clientattributes_on_committed(clientattributes, msg_id);
+     return msg_id;
+}
+
 tbc_err_t tbce_clientattributes_update(tbce_clientattributes_handle_t clientattributes,
                                     tbcmh_handle_t client,
                                     int count, /*const char *key,*/ ...)
@@ -308,45 +538,138 @@ tbc_err_t tbce_clientattributes_update(tbce_clientattributes_handle_t clientattr
           return ESP_FAIL;
      }
 
+     // get values first, user callbacks don't run in TX buffer
      int i;
+     int sampled = 0;
      va_list ap;
      va_start(ap, count);
-     cJSON_bool result = false;
-     cJSON *object = cJSON_CreateObject(); // create json object
-     for (i=0; object && i<count; i++) {
+     for (i=0; i<count; i++) {
           const char *key = va_arg(ap, const char*);
 
           // Search item
+          tbcmh_key_t interned = tbcmh_key_find(key, strlen(key));
           clientattribute_t *clientattribute = NULL;
           LIST_FOREACH(clientattribute, &clientattributes->clientattribute_list, entry) {
-               if (clientattribute && strcmp(clientattribute->key, key)==0) {
+               if (clientattribute && interned && clientattribute->key == interned) {
                     break;
                }
           }
 
-          /// Add clientattribute to package
-          if (clientattribute && clientattribute->on_get) {
-                // add item to json object
-                cJSON *value = clientattribute->on_get(clientattribute->context);
-                if (value) {
-                    result |= cJSON_AddItemToObject(object, clientattribute->key, value);
-                } else {
-                    TBC_LOGW("value is NULL! key=%s", clientattribute->key);                    
-                }
+          /// Get value of clientattribute
+          if (clientattribute) {
+               if (_clientattribute_sample(clientattribute, false) > 0) {
+                    sampled++;
+               }
           } else {
                TBC_LOGW("Unable to find&send client-side attribute:%s! %s()", key, __FUNCTION__);
           }
      }
      va_end(ap);
 
+     if (sampled == 0) {
+          return ESP_FAIL;
+     }
+
      // send package...
+     int msg_id = _clientattributes_publish(clientattributes, client);
+     return (msg_id > -1) ? ESP_OK : ESP_FAIL;
+}
+
+tbc_err_t tbce_clientattributes_mark_dirty(tbce_clientattributes_handle_t clientattributes,
+                                    const char *key)
+{
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(clientattributes, ESP_FAIL);
+
+     // Search item, NULL for all
+     tbcmh_key_t interned = key ? tbcmh_key_find(key, strlen(key)) : NULL;
+     bool is_found = false;
+     clientattribute_t *clientattribute = NULL;
+     LIST_FOREACH(clientattribute, &clientattributes->clientattribute_list, entry) {
+          if (!key || (interned && clientattribute->key == interned)) {
+               clientattribute->dirty = true;
+               is_found = true;
+          }
+     }
+     if (!is_found) {
+          if (key) {
+               TBC_LOGW("Unable to find client-side attribute:%s! %s()", key, __FUNCTION__);
+          }
+          return key ? ESP_FAIL : ESP_OK;
+     }
+
+     if (!clientattributes->has_dirty) {
+          clientattributes->has_dirty = true;
+          clientattributes->dirty_since_us = esp_timer_get_time();
+     }
+     return ESP_OK;
+}
+
+tbc_err_t tbce_clientattributes_set_coalesce(tbce_clientattributes_handle_t clientattributes,
+                                    uint32_t window_ms)
+{
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(clientattributes, ESP_FAIL);
+
+     clientattributes->coalesce_ms = window_ms;
+     return ESP_OK;
+}
+
+tbc_err_t tbce_clientattributes_flush(tbce_clientattributes_handle_t clientattributes,
+                                    tbcmh_handle_t client)
+{
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(clientattributes, ESP_FAIL);
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(client, ESP_FAIL);
+
+     // A queued message is dropped by the TX queue, forget the published values & publish them again
+     uint32_t lost_count = tbcmh_txqueue_get_lost_count(client, TBCMH_TX_ATTRIBUTES);
+     if (lost_count != clientattributes->lost_count) {
+          clientattributes->lost_count = lost_count;
+          clientattribute_t *clientattribute = NULL;
+          LIST_FOREACH(clientattribute, &clientattributes->clientattribute_list, entry) {
+               clientattribute->has_last = false;
+          }
+          tbce_clientattributes_mark_dirty(clientattributes, NULL);
+     }
+
+     if (!clientattributes->has_dirty) {
+          return ESP_OK; // nothing is changed
+     }
+     if (clientattributes->coalesce_ms > 0
+         && esp_timer_get_time() - clientattributes->dirty_since_us < (int64_t)clientattributes->coalesce_ms * 1000) {
+          return ESP_OK; // wait for more changes in the window
+     }
+
+     // get changed values first, user callbacks don't run in TX buffer
+     int added = 0;
+     clientattribute_t *clientattribute = NULL;
+     LIST_FOREACH(clientattribute, &clientattributes->clientattribute_list, entry) {
+          if (!clientattribute->dirty) {
+               continue;
+          }
+          int result = _clientattribute_sample(clientattribute, true);
+          if (result > 0) {
+               added++;
+          } else if (result == 0) {
+               clientattribute->dirty = false; // unchanged
+          }
+     }
+
+     // nothing is changed, skip the whole publish
      int msg_id = -1;
-     if (result) {
-         msg_id = tbcmh_attributes_update_ex(client, object, 1/*qos*/, 0/*retain*/);
+     if (added > 0) {
+          msg_id = _clientattributes_publish(clientattributes, client);
      }
-     cJSON_Delete(object); // delete json object
 
-     return (msg_id > -1) ? ESP_OK : ESP_FAIL;
+     // the failed ones stay dirty, and are retried in the next window
+     clientattributes->has_dirty = false;
+     LIST_FOREACH(clientattribute, &clientattributes->clientattribute_list, entry) {
+          if (clientattribute->dirty) {
+               clientattributes->has_dirty = true;
+               clientattributes->dirty_since_us = esp_timer_get_time();
+               break;
+          }
+     }
+
+     return (added == 0 || msg_id > -1) ? ESP_OK : ESP_FAIL;
 }
 
 #if 0
@@ -32,15 +32,18 @@ typedef struct sharedattribute
 {
     int subscribe_id;                     /*!< Default is -1 before it's subscribed */
 
-    char *key;                            /*!< Key */
+    tbcmh_key_t key;                      /*!< Interned key */
     void *context;                        /*!< Context of getting/setting value*/
     tbce_sharedattribute_on_set_t on_set; /*!< Callback of setting value to context */
 
     LIST_ENTRY(sharedattribute) entry;
+    LIST_ENTRY(sharedattribute) index_entry; /*!< entry in key index, see sharedattribute_index */
 } sharedattribute_t;
 
 typedef LIST_HEAD(tbce_sharedattribute_list, sharedattribute) sharedattribute_list_t;
 
+#define SHAREDATTRIBUTES_BUCKETS (16) /*!< hash buckets of key index, must be power of 2 */
+
 /**
  * Shared attribute set
  */
@@ -49,8 +52,12 @@ typedef struct tbce_sharedattributes
      tbcmh_handle_t client; /*!< ThingsBoard MQTT Client Helper. Default is NULL before it's subscribed */
 
      sharedattribute_list_t sharedattribute_list; /*!< shared-attribute list */
+     sharedattribute_list_t sharedattribute_index[SHAREDATTRIBUTES_BUCKETS]; /*!< shared attributes indexed by hash of key */
 } tbce_sharedattributes_t;
 
+#define _SHAREDATTRIBUTES_BUCKET(sharedattributes, key) \
+     (&(sharedattributes)->sharedattribute_index[tbcmh_key_hash(key) & (SHAREDATTRIBUTES_BUCKETS - 1)])
+
 #define MAX_KEYS_LEN (256)
 
 static int _tbce_sharedattributes_on_update(tbcmh_handle_t client, void *context, const cJSON *object);
@@ -73,11 +80,7 @@ static sharedattribute_t *_sharedattribute_create(
 
      memset(sharedattribute, 0x00, sizeof(sharedattribute_t));
      sharedattribute->subscribe_id = -1;
-     sharedattribute->key = TBC_MALLOC(strlen(key) + 1);
-     if (sharedattribute->key)
-     {
-          strcpy(sharedattribute->key, key);
-     }
+     sharedattribute->key = tbcmh_key_intern(key);
      sharedattribute->context = context;
      sharedattribute->on_set = on_set;
      return sharedattribute;
@@ -88,7 +91,7 @@ static tbc_err_t _sharedattribute_destroy(sharedattribute_t *sharedattribute)
 {
      TBC_CHECK_PTR_WITH_RETURN_VALUE(sharedattribute, ESP_FAIL);
 
-     TBC_FREE(sharedattribute->key);
+     tbcmh_key_release(sharedattribute->key);
      TBC_FREE(sharedattribute);
      return ESP_OK;
 }
@@ -123,6 +126,7 @@ void tbce_sharedattributes_destroy(tbce_sharedattributes_handle_t sharedattribut
      }
      // list destroy
      memset(&sharedattributes->sharedattribute_list, 0x00, sizeof(sharedattributes->sharedattribute_list));
+     memset(sharedattributes->sharedattribute_index, 0x00, sizeof(sharedattributes->sharedattribute_index));
 }
 
 tbc_err_t tbce_sharedattributes_register(tbce_sharedattributes_handle_t sharedattributes,
@@ -160,6 +164,9 @@ tbc_err_t tbce_sharedattributes_register(tbce_sharedattributes_handle_t sharedat
                LIST_INSERT_AFTER(last, sharedattribute, entry);
           }
      }
+     if (sharedattribute->key) {
+          LIST_INSERT_HEAD(_SHAREDATTRIBUTES_BUCKET(sharedattributes, sharedattribute->key), sharedattribute, index_entry);
+     }
 
      return ESP_OK;
 }
@@ -172,13 +179,15 @@ tbc_err_t tbce_sharedattributes_unregister(tbce_sharedattributes_handle_t shared
      TBC_CHECK_PTR_WITH_RETURN_VALUE(key, ESP_FAIL);
 
      // Search item
+     tbcmh_key_t interned = tbcmh_key_find(key, strlen(key));
      sharedattribute_t *sharedattribute = NULL, *next;
      LIST_FOREACH_SAFE(sharedattribute, &sharedattributes->sharedattribute_list, entry, next)
      {
-          if (sharedattribute && strcmp(sharedattribute->key, key) == 0)
+          if (sharedattribute && interned && sharedattribute->key == interned)
           {
-               // Remove form list
+               // Remove form list & key index
                LIST_REMOVE(sharedattribute, entry);
+               LIST_REMOVE(sharedattribute, index_entry);
                _sharedattribute_destroy(sharedattribute);
                break;
           }
@@ -283,25 +292,27 @@ static int _tbce_sharedattributes_on_update(tbcmh_handle_t client, void *context
      TBC_CHECK_PTR_WITH_RETURN_VALUE(context, 0);
      TBC_CHECK_PTR_WITH_RETURN_VALUE(object, 0);
 
-     // foreach itme to set value of sharedattribute in lock/unlodk.  Don't call tbcmh's funciton in set value callback!
-     sharedattribute_t *sharedattribute = NULL, *next;
+     // foreach member to set value of sharedattribute in lock/unlodk.  Don't call tbcmh's funciton in set value callback!
+     // Members are named by interned keys, each member is looked up in key index once
      tbc_err_t result = 0;
-     LIST_FOREACH_SAFE(sharedattribute, &sharedattributes->sharedattribute_list, entry, next) {
-          if (sharedattribute) {
+     cJSON *value = NULL;
+     cJSON_ArrayForEach(value, object) {
+          tbcmh_key_t key = tbcmh_key_of_item(value);
+          if (!key) {
+               continue;
+          }
+          sharedattribute_t *sharedattribute = NULL, *next;
+          LIST_FOREACH_SAFE(sharedattribute, _SHAREDATTRIBUTES_BUCKET(sharedattributes, key), index_entry, next) {
                if ((sharedattribute->subscribe_id>=0) &&
-                    sharedattribute->key &&
-                    sharedattribute->on_set &&
-                    cJSON_HasObjectItem(object, sharedattribute->key))
+                    sharedattribute->key == key &&
+                    sharedattribute->on_set)
                {
-                    cJSON *value = cJSON_GetObjectItem(object, sharedattribute->key);
-                    if (value) {
-                         result = sharedattribute->on_set( sharedattribute->context, value);
-                         if (result == 2) { // called tbcmh_disconnect()/tbcmh_destroy() inside on_set()
-                              break;
-                         }
-                         if (result == 1) { // called tbce_sharedattributes_unregister() inside on_set()
-                              break;
-                         }
+                    result = sharedattribute->on_set( sharedattribute->context, value);
+                    if (result == 2) { // called tbcmh_disconnect()/tbcmh_destroy() inside on_set()
+                         return 2;
+                    }
+                    if (result == 1) { // called tbce_sharedattributes_unregister() inside on_set()
+                         return 1;
                     }
                }
           }
@@ -15,57 +15,268 @@
 // This file is part of the ThingsBoard Client Extension (TBCE) API.
 
 #include <string.h>
+#include <math.h>
+#include <stdatomic.h>
 #include <sys/queue.h>
 
 #include "esp_log.h"
 #include "esp_err.h"
 #include "esp_system.h"
+#include "esp_timer.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 
 #include "tbc_mqtt_helper.h"
 #include "tbc_extension_timeseriesdata.h"
 
+/**
+ * Value of a time-series axis, which is compared by change-of-value filter
+ */
+typedef struct timeseriesaxis_sample
+{
+     tbcmh_scalar_type_t type;            /*!< type of value, TBCMH_SCALAR_NULL if it can't be compared */
+     double number;                       /*!< TBCMH_SCALAR_FLOAT & TBCMH_SCALAR_BOOL */
+     int64_t integer;                     /*!< TBCMH_SCALAR_INT, it is compared exactly */
+     uint64_t hash;                       /*!< TBCMH_SCALAR_STRING, 64-bit FNV-1a hash of the string */
+     int len;                             /*!< TBCMH_SCALAR_STRING, length of the string */
+} timeseriesaxis_sample_t;
+
+#define TIMESERIESAGGR_STAT_MAX   (5)
+
+/**
+ * Streaming statistics of a window
+ */
+typedef struct timeseriesaggr_bank
+{
+     atomic_int busy;                     /*!< count of pushers which are writing this bank */
+     uint32_t count;                      /*!< count of samples */
+     double min;                          /*!< minimum of samples */
+     double max;                          /*!< maximum of samples */
+     double sum;                          /*!< sum of samples */
+     double sum_sq;                       /*!< sum of squares of samples */
+} timeseriesaggr_bank_t;
+
+/**
+ * Windowed aggregation of a time-series axis.
+ * The pusher writes bank[active], tbce_timeseriesdata_run() flips active and reads the other bank.
+ */
+typedef struct timeseriesaggr
+{
+     tbce_timeseriesaggr_config_t config; /*!< window & statistics */
+     tbcmh_key_t stat_keys[TIMESERIESAGGR_STAT_MAX]; /*!< interned "<key>_min", "<key>_max", ... */
+     atomic_int active;                   /*!< index of bank written by the pusher */
+     timeseriesaggr_bank_t bank[2];       /*!< double banks */
+     int64_t window_start_us;             /*!< esp_timer_get_time() of start of current window */
+     timeseriesaggr_bank_t *closed;       /*!< closed bank waiting to be published, NULL if none */
+     int64_t closed_end_us;               /*!< esp_timer_get_time() of end of the closed window */
+} timeseriesaggr_t;
+
 /**
  * Time-series axis
  */
 typedef struct timeseriesaxis
 {
-     char *key;                           /*!< Key */
+     tbcmh_key_t key;                     /*!< Interned key */
      void *context;                       /*!< Context of getting/setting value*/
      tbce_timeseriesaxis_on_get_t on_get; /*!< Callback of getting value from context */
+     tbce_timeseriesaxis_on_get_scalar_t on_get_scalar; /*!< Callback of getting scalar value from context */
+     timeseriesaggr_t *aggr;              /*!< windowed aggregation, NULL if it isn't an aggregation axis */
+     uint32_t period_ms;                  /*!< sampling period, 0 if it isn't sampled by tbce_timeseriesdata_run() */
+     int64_t next_due_us;                 /*!< esp_timer_get_time() of next deadline of periodic sampling */
+     int decimals;                        /*!< fixed decimals of float value, -1 for the shortest */
+     bool adaptive;                       /*!< true if period & deadbands are adjusted by uplink pressure */
+     tbce_timeseriesaxis_adaptive_t adaptive_config; /*!< min/max period & priority of adaptive sampling */
+     double deadband_scale;               /*!< factor of deadbands of the filter, 1 when the uplink is healthy */
+
+     bool filtered;                       /*!< true if change-of-value filter is set */
+     tbce_timeseriesaxis_filter_t filter; /*!< change-of-value filter */
+     bool has_last;                       /*!< true if last_sample is valid */
+     timeseriesaxis_sample_t last_sample; /*!< last sent value */
+     int64_t last_sent_us;                /*!< esp_timer_get_time() of last sent value */
+     bool sampled;                        /*!< true if sampled_value/sampled_json is got, but not written to TX buffer yet */
+     tbcmh_scalar_t sampled_value;        /*!< value got by on_get_scalar */
+     cJSON *sampled_json;                 /*!< value got by on_get, NULL if it is a scalar */
+     bool pending;                        /*!< true if pending_sample is in the message which is not published yet */
+     timeseriesaxis_sample_t pending_sample; /*!< value in the message which is not published yet */
      LIST_ENTRY(timeseriesaxis) entry;
 } timeseriesaxis_t;
 
 typedef LIST_HEAD(tbce_timeseriesaxis_list, timeseriesaxis) timeseriesaxis_list_t;
 
+/**
+ * Resolved axis of an upload group
+ */
+typedef struct timeseriesgroupitem
+{
+     timeseriesaxis_t *tsaxis;            /*!< resolved axis, NULL if it is unregistered */
+     const char *fragment;                /*!< serialized key fragment, i.e. "key": */
+     int fragment_len;                    /*!< length of fragment */
+} timeseriesgroupitem_t;
+
+/**
+ * Upload group, see tbce_timeseriesdata_group_create()
+ */
+typedef struct tbce_timeseriesgroup
+{
+     int count;                           /*!< count of items */
+     timeseriesgroupitem_t *items;        /*!< contiguous array of resolved axes */
+     char *fragments;                     /*!< all key fragments in one buffer */
+     LIST_ENTRY(tbce_timeseriesgroup) entry;
+} tbce_timeseriesgroup_t;
+
+typedef LIST_HEAD(tbce_timeseriesgroup_list, tbce_timeseriesgroup) timeseriesgroup_list_t;
+
+#define TIMESERIESDATA_ADAPTIVE_STEP_MS    (1000)  /*!< interval of control step of adaptive sampling */
+#define TIMESERIESDATA_ADAPTIVE_LEVEL_MAX  (8)     /*!< maximum pressure level */
+
 /**
  * Time-series data
  */
 typedef struct tbce_timeseriesdata
 {
+     portMUX_TYPE spinlock;               /*!< guards timeseriesaxis_list against tbce_timeseriesdata_push() */
      timeseriesaxis_list_t timeseriesaxis_list; /*!< time-series data list */
+     timeseriesgroup_list_t timeseriesgroup_list; /*!< upload groups */
+
+     int64_t epoch_us;                    /*!< esp_timer_get_time() of creating, deadlines of periodic axes are aligned to it */
+     int64_t drift_sum_us;                /*!< sum of drift, for stats.avg_drift_us */
+     tbce_timeseriesdata_stats_t stats;   /*!< statistics of periodic sampling */
+
+     tbce_timeseriesdata_adaptive_config_t adaptive_config; /*!< thresholds of uplink pressure */
+     int adaptive_count;                  /*!< count of adaptive axes, the controller is idle if it is 0 */
+     int64_t adaptive_next_us;            /*!< esp_timer_get_time() of next control step */
+     int64_t adaptive_healthy_us;         /*!< esp_timer_get_time() since when the uplink is healthy, 0 if it isn't */
+     uint32_t lost_count;                 /*!< tbcmh_txqueue_get_lost_count() of telemetry seen by the last upload */
 } tbce_timeseriesdata_t;
 
+/**
+ * Column of columnar sample buffer
+ */
+typedef struct timeseriesbuffercolumn
+{
+     tbce_timeseriesbuffer_type_t type;   /*!< C type of data */
+     void *data;                          /*!< contiguous array of capacity elements */
+     uint32_t field_number;               /*!< field number in proto schema, 0 to skip it */
+} timeseriesbuffercolumn_t;
+
+/**
+ * Columnar sample buffer, a ring of one producer and one consumer
+ */
+typedef struct tbce_timeseriesbuffer
+{
+     int column_count;                    /*!< count of columns */
+     uint32_t capacity;                   /*!< max count of rows, a power of 2 */
+     atomic_uint head;                    /*!< count of rows ended by the producer */
+     atomic_uint tail;                    /*!< count of rows released by the consumer */
+     atomic_uint dropped;                 /*!< count of rows dropped because it is full */
+     int64_t *ts;                         /*!< timestamp column */
+     timeseriesbuffercolumn_t *columns;   /*!< value columns */
+     tbcmh_tx_column_t *tx_columns;       /*!< serialized keys & decimals of columns */
+     tbcmh_scalar_t *row;                 /*!< values of the row being serialized */
+     char *fragments;                     /*!< all key fragments in one buffer */
+} tbce_timeseriesbuffer_t;
+
 const static char *TAG = "extension_timeseriesdata";
 
+static const char *_timeseriesaggr_suffixes[TIMESERIESAGGR_STAT_MAX] = {
+     "_min", "_max", "_mean", "_rms", "_count"
+};
+
+static void _timeseriesaggr_bank_reset(timeseriesaggr_bank_t *bank)
+{
+     bank->count = 0;
+     bank->min = 0;
+     bank->max = 0;
+     bank->sum = 0;
+     bank->sum_sq = 0;
+}
+
+/*!< Wait for the pushers leaving the bank. A pusher may have a lower priority, so it sleeps */
+static void _timeseriesaggr_bank_wait(timeseriesaggr_bank_t *bank)
+{
+     while (atomic_load(&bank->busy) > 0) {
+          vTaskDelay(1);
+     }
+}
+
+static timeseriesaggr_t *_timeseriesaggr_create(const char *key,
+                                                const tbce_timeseriesaggr_config_t *config)
+{
+    if (config->window_ms == 0 || (config->stats & ((1 << TIMESERIESAGGR_STAT_MAX) - 1)) == 0) {
+        TBC_LOGE("window_ms(%u) or stats(0x%x) is error! key=%s",
+                 config->window_ms, config->stats, key);
+        return NULL;
+    }
+
+    timeseriesaggr_t *aggr = TBC_MALLOC(sizeof(timeseriesaggr_t));
+    if (!aggr) {
+        TBC_LOGE("Unable to malloc memeory!");
+        return NULL;
+    }
+
+    memset(aggr, 0x00, sizeof(timeseriesaggr_t));
+    aggr->config = *config;
+    int i;
+    for (i=0; i<TIMESERIESAGGR_STAT_MAX; i++) {
+        if (config->stats & (1 << i)) {
+            char stat_key[128];
+            snprintf(stat_key, sizeof(stat_key), "%s%s", key, _timeseriesaggr_suffixes[i]);
+            aggr->stat_keys[i] = tbcmh_key_intern(stat_key);
+        }
+    }
+    atomic_init(&aggr->active, 0);
+    atomic_init(&aggr->bank[0].busy, 0);
+    atomic_init(&aggr->bank[1].busy, 0);
+    aggr->window_start_us = esp_timer_get_time();
+    return aggr;
+}
+
+static void _timeseriesaggr_destroy(timeseriesaggr_t *aggr)
+{
+    TBC_CHECK_PTR(aggr);
+
+    int i;
+    for (i=0; i<TIMESERIESAGGR_STAT_MAX; i++) {
+        tbcmh_key_release(aggr->stat_keys[i]);
+    }
+    TBC_FREE(aggr);
+}
+
 static timeseriesaxis_t *_timeseriesaxis_create(const char *key, void *context,
-                                                 tbce_timeseriesaxis_on_get_t on_get)
+                                                 tbce_timeseriesaxis_on_get_t on_get,
+                                                 tbce_timeseriesaxis_on_get_scalar_t on_get_scalar,
+                                                 const tbce_timeseriesaggr_config_t *aggr_config)
 {
     TBC_CHECK_PTR_WITH_RETURN_VALUE(key, NULL);
-    TBC_CHECK_PTR_WITH_RETURN_VALUE(on_get, NULL);
+    if (!on_get && !on_get_scalar && !aggr_config) {
+        TBC_LOGE("on_get and on_get_scalar are both NULL! key=%s", key);
+        return NULL;
+    }
+
+    timeseriesaggr_t *aggr = NULL;
+    if (aggr_config) {
+        aggr = _timeseriesaggr_create(key, aggr_config);
+        if (!aggr) {
+            return NULL;
+        }
+    }
     
     timeseriesaxis_t *tsaxis = TBC_MALLOC(sizeof(timeseriesaxis_t));
     if (!tsaxis) {
         TBC_LOGE("Unable to malloc memeory!");
+        _timeseriesaggr_destroy(aggr);
         return NULL;
     }
 
     memset(tsaxis, 0x00, sizeof(timeseriesaxis_t));
-    tsaxis->key = TBC_MALLOC(strlen(key)+1);
-    if (tsaxis->key) {
-        strcpy(tsaxis->key, key);
-    }
+    tsaxis->key = tbcmh_key_intern(key);
     tsaxis->context = context;
     tsaxis->on_get = on_get;
+    tsaxis->on_get_scalar = on_get_scalar;
+    tsaxis->aggr = aggr;
+    tsaxis->decimals = -1;
+    tsaxis->deadband_scale = 1;
     return tsaxis;
 }
 
@@ -74,7 +285,10 @@ static void _timeseriesaxis_destroy(timeseriesaxis_t *tsaxis)
 {
     TBC_CHECK_PTR(tsaxis);
 
-    TBC_FREE(tsaxis->key);
+    if (tsaxis->aggr) {
+        _timeseriesaggr_destroy(tsaxis->aggr);
+    }
+    tbcmh_key_release(tsaxis->key);
     TBC_FREE(tsaxis);
 }
 
@@ -87,6 +301,9 @@ tbce_timeseriesdata_handle_t tbce_timeseriesdata_create(void)
     }
 
     memset(tsdata, 0x00, sizeof(tbce_timeseriesdata_t));
+    portMUX_INITIALIZE(&tsdata->spinlock);
+    tsdata->epoch_us = esp_timer_get_time();
+    tbce_timeseriesdata_set_adaptive_config(tsdata, NULL);
     // list create
     // memset(&tsdata->timeseriesaxis_list, 0x00, sizeof(tsdata->timeseriesaxis_list)); //tsdata->timeseriesaxis_list = LIST_HEAD_INITIALIZER(tsdata->timeseriesaxis_list);
 
@@ -97,6 +314,16 @@ void tbce_timeseriesdata_destroy(tbce_timeseriesdata_handle_t tsdata)
 {
     TBC_CHECK_PTR(tsdata);
 
+    // groups empty - remove all groups in timeseriesgroup_list
+    tbce_timeseriesgroup_t *group = NULL, *next_group;
+    LIST_FOREACH_SAFE(group, &tsdata->timeseriesgroup_list, entry, next_group) {
+         LIST_REMOVE(group, entry);
+         TBC_FREE(group->items);
+         TBC_FREE(group->fragments);
+         TBC_FREE(group);
+    }
+    memset(&tsdata->timeseriesgroup_list, 0x00, sizeof(tsdata->timeseriesgroup_list));
+
     // items empty - remove all item in timeseriesaxis_list
     timeseriesaxis_t *tsaxis = NULL, *next;
     LIST_FOREACH_SAFE(tsaxis, &tsdata->timeseriesaxis_list, entry, next) {
@@ -108,22 +335,25 @@ void tbce_timeseriesdata_destroy(tbce_timeseriesdata_handle_t tsdata)
     memset(&tsdata->timeseriesaxis_list, 0x00, sizeof(tsdata->timeseriesaxis_list));
 }
 
-tbc_err_t tbce_timeseriesdata_register(tbce_timeseriesdata_handle_t tsdata,
+static tbc_err_t _timeseriesdata_register(tbce_timeseriesdata_handle_t tsdata,
                                           const char *key,
                                           void *context,
-                                          tbce_timeseriesaxis_on_get_t on_get)
+                                          tbce_timeseriesaxis_on_get_t on_get,
+                                          tbce_timeseriesaxis_on_get_scalar_t on_get_scalar,
+                                          const tbce_timeseriesaggr_config_t *aggr_config)
 {
      TBC_CHECK_PTR_WITH_RETURN_VALUE(tsdata, ESP_FAIL);
 
      // Create tsdata
-     timeseriesaxis_t *tsaxis = _timeseriesaxis_create(key, context, on_get);
+     timeseriesaxis_t *tsaxis = _timeseriesaxis_create(key, context, on_get, on_get_scalar, aggr_config);
      if (!tsaxis) {
           TBC_LOGE("Init tsaxis failure! key=%s. %s()", key, __FUNCTION__);
           return ESP_FAIL;
      }
 
-     // Insert tsaxis to list
+     // Insert tsaxis to list, a pusher may be walking it
      timeseriesaxis_t *it, *last = NULL;
+     taskENTER_CRITICAL(&tsdata->spinlock);
      if (LIST_FIRST(&tsdata->timeseriesaxis_list) == NULL) {
           // Insert head
           LIST_INSERT_HEAD(&tsdata->timeseriesaxis_list, tsaxis, entry);
@@ -137,10 +367,269 @@ tbc_err_t tbce_timeseriesdata_register(tbce_timeseriesdata_handle_t tsdata,
                LIST_INSERT_AFTER(last, tsaxis, entry);
           }
      }
+     taskEXIT_CRITICAL(&tsdata->spinlock);
 
      return ESP_OK;
 }
 
+tbc_err_t tbce_timeseriesdata_register(tbce_timeseriesdata_handle_t tsdata,
+                                          const char *key,
+                                          void *context,
+                                          tbce_timeseriesaxis_on_get_t on_get)
+{
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(on_get, ESP_FAIL);
+     return _timeseriesdata_register(tsdata, key, context, on_get, NULL, NULL);
+}
+
+tbc_err_t tbce_timeseriesdata_register_scalar(tbce_timeseriesdata_handle_t tsdata,
+                                          const char *key,
+                                          void *context,
+                                          tbce_timeseriesaxis_on_get_scalar_t on_get_scalar)
+{
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(on_get_scalar, ESP_FAIL);
+     return _timeseriesdata_register(tsdata, key, context, NULL, on_get_scalar, NULL);
+}
+
+tbc_err_t tbce_timeseriesdata_register_aggregate(tbce_timeseriesdata_handle_t tsdata,
+                                          const char *key,
+                                          const tbce_timeseriesaggr_config_t *config)
+{
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(config, ESP_FAIL);
+     return _timeseriesdata_register(tsdata, key, NULL, NULL, NULL, config);
+}
+
+tbc_err_t tbce_timeseriesdata_push(tbce_timeseriesdata_handle_t tsdata,
+                                   const char *key, double value)
+{
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(tsdata, ESP_FAIL);
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(key, ESP_FAIL);
+
+     // Search item and enter its active bank in the spinlock, so the axis isn't unregistered meanwhile.
+     // Don't use tbcmh_key_find(), it takes another spinlock.
+     timeseriesaxis_t *tsaxis = NULL;
+     timeseriesaggr_bank_t *bank = NULL;
+     taskENTER_CRITICAL(&tsdata->spinlock);
+     LIST_FOREACH(tsaxis, &tsdata->timeseriesaxis_list, entry) {
+          if (tsaxis && strcmp(tsaxis->key, key) == 0) {
+               break;
+          }
+     }
+     if (tsaxis && tsaxis->aggr) {
+          // re-check the active bank in case it is flipped by tbce_timeseriesdata_run()
+          timeseriesaggr_t *aggr = tsaxis->aggr;
+          int active;
+          do {
+               active = atomic_load(&aggr->active);
+               bank = &aggr->bank[active];
+               atomic_fetch_add(&bank->busy, 1);
+               if (atomic_load(&aggr->active) == active) {
+                    break;
+               }
+               atomic_fetch_sub(&bank->busy, 1);
+          } while (1);
+     }
+     taskEXIT_CRITICAL(&tsdata->spinlock);
+     if (!bank) {
+          TBC_LOGW("Unable to find aggregation axis:%s! %s()", key, __FUNCTION__);
+          return ESP_FAIL;
+     }
+
+     if (bank->count == 0 || value < bank->min) {
+          bank->min = value;
+     }
+     if (bank->count == 0 || value > bank->max) {
+          bank->max = value;
+     }
+     bank->sum += value;
+     bank->sum_sq += value * value;
+     bank->count++;
+
+     atomic_fetch_sub(&bank->busy, 1);
+     return ESP_OK;
+}
+
+tbc_err_t tbce_timeseriesdata_set_decimals(tbce_timeseriesdata_handle_t tsdata,
+                                          const char *key, int decimals)
+{
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(tsdata, ESP_FAIL);
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(key, ESP_FAIL);
+     if (decimals < -1 || decimals > 9) {
+          TBC_LOGE("decimals(%d) is error! %s()", decimals, __FUNCTION__);
+          return ESP_FAIL;
+     }
+
+     // Search item
+     tbcmh_key_t interned = tbcmh_key_find(key, strlen(key));
+     timeseriesaxis_t *tsaxis = NULL;
+     LIST_FOREACH(tsaxis, &tsdata->timeseriesaxis_list, entry) {
+          if (tsaxis && interned && tsaxis->key == interned) {
+               tsaxis->decimals = decimals;
+               return ESP_OK;
+          }
+     }
+
+     TBC_LOGW("Unable to find time-series axis:%s! %s()", key, __FUNCTION__);
+     return ESP_FAIL;
+}
+
+tbc_err_t tbce_timeseriesdata_set_filter(tbce_timeseriesdata_handle_t tsdata,
+                                          const char *key,
+                                          const tbce_timeseriesaxis_filter_t *filter)
+{
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(tsdata, ESP_FAIL);
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(key, ESP_FAIL);
+     if (filter && (filter->abs_deadband < 0 || filter->rel_deadband < 0)) {
+          TBC_LOGE("deadband(%f, %f) is error! %s()",
+                   filter->abs_deadband, filter->rel_deadband, __FUNCTION__);
+          return ESP_FAIL;
+     }
+
+     // Search item
+     tbcmh_key_t interned = tbcmh_key_find(key, strlen(key));
+     timeseriesaxis_t *tsaxis = NULL;
+     LIST_FOREACH(tsaxis, &tsdata->timeseriesaxis_list, entry) {
+          if (tsaxis && interned && tsaxis->key == interned) {
+               if (filter) {
+                    tsaxis->filtered = true;
+                    tsaxis->filter = *filter;
+               } else {
+                    tsaxis->filtered = false;
+                    memset(&tsaxis->filter, 0x00, sizeof(tsaxis->filter));
+               }
+               tsaxis->has_last = false; // the next value is always sent
+               return ESP_OK;
+          }
+     }
+
+     TBC_LOGW("Unable to find time-series axis:%s! %s()", key, __FUNCTION__);
+     return ESP_FAIL;
+}
+
+/*!< Set sampling period, its first deadline is the next multiple of period since epoch */
+static void _timeseriesaxis_set_period(tbce_timeseriesdata_handle_t tsdata,
+                                       timeseriesaxis_t *tsaxis, uint32_t period_ms, int64_t now_us)
+{
+     tsaxis->period_ms = period_ms;
+     if (period_ms > 0) {
+          int64_t period_us = (int64_t)period_ms * 1000;
+          tsaxis->next_due_us = tsdata->epoch_us
+                              + ((now_us - tsdata->epoch_us) / period_us + 1) * period_us;
+     }
+}
+
+/*!< Apply pressure level to an adaptive axis: double period & deadbands
+     once per level above its priority, within its limits */
+static void _timeseriesaxis_adapt(tbce_timeseriesdata_handle_t tsdata,
+                                  timeseriesaxis_t *tsaxis, int64_t now_us)
+{
+     const tbce_timeseriesaxis_adaptive_t *adaptive = &tsaxis->adaptive_config;
+     int steps = tsdata->stats.pressure_level - adaptive->priority;
+     uint64_t period_ms = adaptive->min_period_ms;
+     double scale = 1;
+     for (; steps > 0; steps--) {
+          period_ms <<= 1;
+          scale *= 2;
+     }
+     if (period_ms > adaptive->max_period_ms) {
+          period_ms = adaptive->max_period_ms;
+     }
+     if (scale > adaptive->max_deadband_scale) {
+          scale = adaptive->max_deadband_scale;
+     }
+     tsaxis->deadband_scale = scale;
+     if (period_ms != tsaxis->period_ms) {
+          _timeseriesaxis_set_period(tsdata, tsaxis, (uint32_t)period_ms, now_us);
+     }
+}
+
+tbc_err_t tbce_timeseriesdata_set_period(tbce_timeseriesdata_handle_t tsdata,
+                                          const char *key, uint32_t period_ms)
+{
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(tsdata, ESP_FAIL);
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(key, ESP_FAIL);
+
+     // Search item
+     tbcmh_key_t interned = tbcmh_key_find(key, strlen(key));
+     timeseriesaxis_t *tsaxis = NULL;
+     LIST_FOREACH(tsaxis, &tsdata->timeseriesaxis_list, entry) {
+          if (tsaxis && interned && tsaxis->key == interned) {
+               if (tsaxis->aggr) {
+                    TBC_LOGE("Aggregation axis:%s has its own window! %s()", key, __FUNCTION__);
+                    return ESP_FAIL;
+               }
+               _timeseriesaxis_set_period(tsdata, tsaxis, period_ms, esp_timer_get_time());
+               return ESP_OK;
+          }
+     }
+
+     TBC_LOGW("Unable to find time-series axis:%s! %s()", key, __FUNCTION__);
+     return ESP_FAIL;
+}
+
+tbc_err_t tbce_timeseriesdata_set_adaptive(tbce_timeseriesdata_handle_t tsdata,
+                                          const char *key,
+                                          const tbce_timeseriesaxis_adaptive_t *adaptive)
+{
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(tsdata, ESP_FAIL);
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(key, ESP_FAIL);
+     if (adaptive && adaptive->min_period_ms == 0) {
+          TBC_LOGE("min_period_ms is 0! key=%s. %s()", key, __FUNCTION__);
+          return ESP_FAIL;
+     }
+
+     // Search item
+     tbcmh_key_t interned = tbcmh_key_find(key, strlen(key));
+     timeseriesaxis_t *tsaxis = NULL;
+     LIST_FOREACH(tsaxis, &tsdata->timeseriesaxis_list, entry) {
+          if (tsaxis && interned && tsaxis->key == interned) {
+               if (tsaxis->aggr) {
+                    TBC_LOGE("Aggregation axis:%s has its own window! %s()", key, __FUNCTION__);
+                    return ESP_FAIL;
+               }
+               if (tsaxis->adaptive) {
+                    tsdata->adaptive_count--;
+               }
+               tsaxis->deadband_scale = 1;
+               tsaxis->adaptive = (adaptive != NULL);
+               if (!adaptive) {
+                    return ESP_OK;
+               }
+
+               tsaxis->adaptive_config = *adaptive;
+               if (tsaxis->adaptive_config.max_period_ms < adaptive->min_period_ms) {
+                    tsaxis->adaptive_config.max_period_ms = adaptive->min_period_ms;
+               }
+               if (tsaxis->adaptive_config.max_deadband_scale < 1) {
+                    tsaxis->adaptive_config.max_deadband_scale = 1;
+               }
+               tsdata->adaptive_count++;
+               tsaxis->period_ms = 0; // re-align deadline
+               _timeseriesaxis_adapt(tsdata, tsaxis, esp_timer_get_time());
+               return ESP_OK;
+          }
+     }
+
+     TBC_LOGW("Unable to find time-series axis:%s! %s()", key, __FUNCTION__);
+     return ESP_FAIL;
+}
+
+tbc_err_t tbce_timeseriesdata_set_adaptive_config(tbce_timeseriesdata_handle_t tsdata,
+                                          const tbce_timeseriesdata_adaptive_config_t *config)
+{
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(tsdata, ESP_FAIL);
+
+     if (config) {
+          tsdata->adaptive_config = *config;
+     } else {
+          tsdata->adaptive_config.outbox_high_size = 8192;
+          tsdata->adaptive_config.ack_latency_high_ms = 2000;
+          tsdata->adaptive_config.event_queue_high_percent = 50;
+          tsdata->adaptive_config.txqueue_high_count = 16;
+          tsdata->adaptive_config.recover_ms = 5000;
+     }
+     return ESP_OK;
+}
+
 tbc_err_t tbce_timeseriesdata_unregister(tbce_timeseriesdata_handle_t tsdata,
                                     const char *key)
 {
@@ -148,11 +637,30 @@ tbc_err_t tbce_timeseriesdata_unregister(tbce_timeseriesdata_handle_t tsdata,
      TBC_CHECK_PTR_WITH_RETURN_VALUE(key, ESP_FAIL);
 
      // Search item
+     tbcmh_key_t interned = tbcmh_key_find(key, strlen(key));
      timeseriesaxis_t *tsaxis = NULL, *next;
      LIST_FOREACH_SAFE(tsaxis, &tsdata->timeseriesaxis_list, entry, next) {
-          if (tsaxis && strcmp(tsaxis->key, key)==0) {
-             // Remove from list and destroy
+          if (tsaxis && interned && tsaxis->key == interned) {
+             // Remove from groups & list, then destroy
+             tbce_timeseriesgroup_t *group = NULL;
+             LIST_FOREACH(group, &tsdata->timeseriesgroup_list, entry) {
+                  int i;
+                  for (i=0; i<group->count; i++) {
+                       if (group->items[i].tsaxis == tsaxis) {
+                            group->items[i].tsaxis = NULL;
+                       }
+                  }
+             }
+             if (tsaxis->adaptive) {
+                  tsdata->adaptive_count--;
+             }
+             taskENTER_CRITICAL(&tsdata->spinlock);
              LIST_REMOVE(tsaxis, entry);
+             taskEXIT_CRITICAL(&tsdata->spinlock);
+             if (tsaxis->aggr) {
+                  _timeseriesaggr_bank_wait(&tsaxis->aggr->bank[0]);
+                  _timeseriesaggr_bank_wait(&tsaxis->aggr->bank[1]);
+             }
              _timeseriesaxis_destroy(tsaxis);
              break;
           }
@@ -166,6 +674,244 @@ tbc_err_t tbce_timeseriesdata_unregister(tbce_timeseriesdata_handle_t tsdata,
      return ESP_OK;
 }
 
+static uint64_t _timeseriesaxis_hash(const char *str, int len)
+{
+     uint64_t hash = 14695981039346656037ull;
+     int i;
+     for (i=0; i<len; i++) {
+          hash ^= (uint8_t)str[i];
+          hash *= 1099511628211ull;
+     }
+     return hash;
+}
+
+static void _timeseriesaxis_sample_from_scalar(timeseriesaxis_sample_t *sample,
+                                               const tbcmh_scalar_t *value)
+{
+     memset(sample, 0x00, sizeof(timeseriesaxis_sample_t));
+     sample->type = value->type;
+     switch (value->type) {
+     case TBCMH_SCALAR_INT:
+          sample->integer = value->value.int_value;
+          break;
+     case TBCMH_SCALAR_FLOAT:
+          sample->number = value->value.float_value;
+          break;
+     case TBCMH_SCALAR_BOOL:
+          sample->number = value->value.bool_value ? 1 : 0;
+          break;
+     case TBCMH_SCALAR_STRING:
+          sample->hash = _timeseriesaxis_hash(value->value.string.ptr, value->value.string.len);
+          sample->len = value->value.string.len;
+          break;
+     case TBCMH_SCALAR_NULL:
+     default:
+          sample->type = TBCMH_SCALAR_NULL;
+          break;
+     }
+}
+
+static void _timeseriesaxis_sample_from_value(timeseriesaxis_sample_t *sample,
+                                              const cJSON *value)
+{
+     memset(sample, 0x00, sizeof(timeseriesaxis_sample_t));
+     if (cJSON_IsNumber(value)) {
+          sample->type = TBCMH_SCALAR_FLOAT;
+          sample->number = value->valuedouble;
+     } else if (cJSON_IsBool(value)) {
+          sample->type = TBCMH_SCALAR_BOOL;
+          sample->number = cJSON_IsTrue(value) ? 1 : 0;
+     } else if (cJSON_IsString(value) && value->valuestring) {
+          sample->type = TBCMH_SCALAR_STRING;
+          sample->len = strlen(value->valuestring);
+          sample->hash = _timeseriesaxis_hash(value->valuestring, sample->len);
+     } else {
+          sample->type = TBCMH_SCALAR_NULL; // object, array or null: it is always sent
+     }
+}
+
+/*!< Deadband of a numeric value around the last sent value */
+static double _timeseriesaxis_deadband(timeseriesaxis_t *tsaxis, double last)
+{
+     double deadband = tsaxis->filter.rel_deadband * fabs(last);
+     if (deadband < tsaxis->filter.abs_deadband) {
+          deadband = tsaxis->filter.abs_deadband;
+     }
+     return deadband * tsaxis->deadband_scale; // widened under uplink pressure
+}
+
+/*!< Returns true if the value should be sent, otherwise it is filtered out */
+static bool _timeseriesaxis_is_changed(timeseriesaxis_t *tsaxis,
+                                       const timeseriesaxis_sample_t *sample,
+                                       int64_t now_us)
+{
+     if (!tsaxis->filtered || !tsaxis->has_last) {
+          return true;
+     }
+     if (sample->type == TBCMH_SCALAR_NULL || sample->type != tsaxis->last_sample.type) {
+          return true;
+     }
+     if (tsaxis->filter.max_silence_ms > 0
+         && now_us - tsaxis->last_sent_us >= (int64_t)tsaxis->filter.max_silence_ms * 1000) {
+          return true; // heartbeat
+     }
+
+     switch (sample->type) {
+     case TBCMH_SCALAR_INT:
+     {
+          // compared as int64_t, a double loses precision above 2^53
+          int64_t last = tsaxis->last_sample.integer;
+          if (sample->integer == last) {
+               return false;
+          }
+          uint64_t delta = (sample->integer > last) ? (uint64_t)sample->integer - (uint64_t)last
+                                                    : (uint64_t)last - (uint64_t)sample->integer;
+          double deadband = _timeseriesaxis_deadband(tsaxis, (double)last);
+          return (deadband > 0) ? ((double)delta > deadband) : true;
+     }
+     case TBCMH_SCALAR_FLOAT:
+     {
+          double last = tsaxis->last_sample.number;
+          double delta = fabs(sample->number - last);
+          double deadband = _timeseriesaxis_deadband(tsaxis, last);
+          if (isnan(delta)) {
+               return !(isnan(sample->number) && isnan(last));
+          }
+          return (deadband > 0) ? (delta > deadband) : (delta != 0);
+     }
+     case TBCMH_SCALAR_BOOL:
+          return sample->number != tsaxis->last_sample.number;
+     case TBCMH_SCALAR_STRING:
+          return sample->len != tsaxis->last_sample.len || sample->hash != tsaxis->last_sample.hash;
+     default:
+          return true;
+     }
+}
+
+/*!< Get value of tsaxis by its callback, returns true if it is changed.
+     It is called before tbcmh_tx_begin(), so user callbacks never run in client->_lock */
+static bool _timeseriesaxis_sample(timeseriesaxis_t *tsaxis, int64_t now_us)
+{
+     timeseriesaxis_sample_t sample;
+
+     if (tsaxis->sampled || tsaxis->pending) {
+          return false; // duplicated key
+     }
+     if (tsaxis->on_get_scalar) {
+          // scalar lives in tsaxis, nothing is allocated
+          tbcmh_scalar_t value = {.type = TBCMH_SCALAR_NULL};
+          if (tsaxis->on_get_scalar(tsaxis->context, &value) != ESP_OK) {
+               TBC_LOGW("Unable to get value! key=%s", tsaxis->key);
+               return false;
+          }
+          _timeseriesaxis_sample_from_scalar(&sample, &value);
+          if (!_timeseriesaxis_is_changed(tsaxis, &sample, now_us)) {
+               return false;
+          }
+          tsaxis->sampled_value = value;
+          tsaxis->sampled_json = NULL;
+     } else if (tsaxis->on_get) {
+          cJSON *value = tsaxis->on_get(tsaxis->context);
+          if (!value) {
+               TBC_LOGW("value is NULL! key=%s", tsaxis->key);
+               return false;
+          }
+          _timeseriesaxis_sample_from_value(&sample, value);
+          if (!_timeseriesaxis_is_changed(tsaxis, &sample, now_us)) {
+               cJSON_Delete(value);
+               return false;
+          }
+          tsaxis->sampled_json = value;
+     } else {
+          return false;
+     }
+
+     tsaxis->sampled = true;
+     tsaxis->pending_sample = sample;
+     return true;
+}
+
+/*!< Add the sampled value of tsaxis to TX buffer. Returns true if it is added.
+     fragment: serialized key fragment, NULL to serialize tsaxis->key */
+static bool _timeseriesaxis_write(tbcmh_handle_t client, timeseriesaxis_t *tsaxis,
+                                  const char *fragment, int fragment_len)
+{
+     if (!tsaxis->sampled) {
+          return false;
+     }
+     tsaxis->sampled = false;
+
+     tbc_err_t err;
+     if (tsaxis->sampled_json) {
+          cJSON *value = tsaxis->sampled_json;
+          if (fragment) {
+               err = tbcmh_tx_add_value_fragment(client, fragment, fragment_len, value, tsaxis->decimals);
+          } else if (cJSON_IsNumber(value) && tsaxis->decimals >= 0) {
+               err = tbcmh_tx_add_float_fixed(client, tsaxis->key,
+                                              value->valuedouble, tsaxis->decimals);
+          } else {
+               err = tbcmh_tx_add_value(client, tsaxis->key, value);
+          }
+          cJSON_Delete(value);
+          tsaxis->sampled_json = NULL;
+     } else {
+          tbcmh_scalar_t *value = &tsaxis->sampled_value;
+          if (fragment) {
+               err = tbcmh_tx_add_scalar_fragment(client, fragment, fragment_len, value, tsaxis->decimals);
+          } else if (value->type == TBCMH_SCALAR_FLOAT && tsaxis->decimals >= 0) {
+               err = tbcmh_tx_add_float_fixed(client, tsaxis->key,
+                                              value->value.float_value, tsaxis->decimals);
+          } else {
+               err = tbcmh_tx_add_scalar(client, tsaxis->key, value);
+          }
+     }
+     if (err != ESP_OK) {
+          return false;
+     }
+
+     tsaxis->pending = true;
+     return true;
+}
+
+/*!< Remember the last sent values after the message is committed, msg_id is -1 on failure.
+     TBCMH_PUBLISH_QUEUED counts as sent, see _timeseriesdata_check_lost().
+     It also drops the sampled values which are not written */
+static void _timeseriesdata_on_committed(tbce_timeseriesdata_handle_t tsdata,
+                                         int msg_id, int64_t now_us)
+{
+     timeseriesaxis_t *tsaxis = NULL;
+     LIST_FOREACH(tsaxis, &tsdata->timeseriesaxis_list, entry) {
+          if (tsaxis->pending && msg_id > -1) {
+               tsaxis->has_last = true;
+               tsaxis->last_sample = tsaxis->pending_sample;
+               tsaxis->last_sent_us = now_us;
+          }
+          tsaxis->pending = false;
+          if (tsaxis->sampled_json) {
+               cJSON_Delete(tsaxis->sampled_json);
+               tsaxis->sampled_json = NULL;
+          }
+          tsaxis->sampled = false;
+     }
+}
+
+/*!< A queued message is dropped by the TX queue, forget the last sent values,
+     so the change-of-value filter doesn't suppress the unchanged values which the server never receives */
+static void _timeseriesdata_check_lost(tbce_timeseriesdata_handle_t tsdata,
+                                       tbcmh_handle_t client)
+{
+     uint32_t lost_count = tbcmh_txqueue_get_lost_count(client, TBCMH_TX_TELEMETRY);
+     if (lost_count == tsdata->lost_count) {
+          return;
+     }
+
+     tsdata->lost_count = lost_count;
+     timeseriesaxis_t *tsaxis = NULL;
+     LIST_FOREACH(tsaxis, &tsdata->timeseriesaxis_list, entry) {
+          tsaxis->has_last = false;
+     }
+}
+
 tbc_err_t tbce_timeseriesdata_upload(tbce_timeseriesdata_handle_t tsdata,
                                       tbcmh_handle_t client,
                                       int count, /*const char *key,*/...)
@@ -177,44 +923,804 @@ tbc_err_t tbce_timeseriesdata_upload(tbce_timeseriesdata_handle_t tsdata,
           return ESP_FAIL;
      }
 
+     _timeseriesdata_check_lost(tsdata, client);
+
+     // get values first, user callbacks don't run in TX buffer
      int i;
+     int sampled = 0;
+     int64_t now_us = esp_timer_get_time();
      va_list ap;
      va_start(ap, count);
-     cJSON_bool result = false;
-     cJSON *object = cJSON_CreateObject(); // create json object
-     for (i=0; object && i<count; i++) {
+     for (i=0; i<count; i++) {
           const char *key = va_arg(ap, const char*);
 
           // Search item
+          tbcmh_key_t interned = tbcmh_key_find(key, strlen(key));
           timeseriesaxis_t *tsaxis = NULL;
           LIST_FOREACH(tsaxis, &tsdata->timeseriesaxis_list, entry) {
-               if (tsaxis && strcmp(tsaxis->key, key)==0) {
+               if (tsaxis && interned && tsaxis->key == interned) {
                     break;
                }
           }
 
-          /// Add tsaxis to package
-          if (tsaxis && tsaxis->on_get) {
-                // add item to json object
-                cJSON *value = tsaxis->on_get(tsaxis->context);
-                if (value) {
-                    result |= cJSON_AddItemToObject(object, tsaxis->key, value);
-                } else {
-                    TBC_LOGW("value is NULL! key=%s", tsaxis->key);                    
-                }
+          /// Get value of tsaxis
+          if (tsaxis && (tsaxis->on_get_scalar || tsaxis->on_get)) {
+               if (_timeseriesaxis_sample(tsaxis, now_us)) {
+                    sampled++;
+               }
+          } else if (tsaxis && tsaxis->aggr) {
+               TBC_LOGW("Aggregation axis:%s is sent by tbce_timeseriesdata_run()! %s()", key, __FUNCTION__);
           } else {
                TBC_LOGW("Unable to find&send time-series axis:%s! %s()", key, __FUNCTION__);
           }
      }
      va_end(ap);
 
+     // nothing is changed, skip the whole publish
+     if (sampled == 0) {
+          return ESP_OK;
+     }
+
+     // write key/value pairs into TX buffer directly, no cJSON object tree
+     if (tbcmh_tx_begin(client, TBCMH_TX_TELEMETRY) != ESP_OK) {
+          TBC_LOGE("Unable to begin TX buffer! %s()", __FUNCTION__);
+          _timeseriesdata_on_committed(tsdata, -1, now_us);
+          return ESP_FAIL;
+     }
+     int added = 0;
+     timeseriesaxis_t *tsaxis = NULL;
+     LIST_FOREACH(tsaxis, &tsdata->timeseriesaxis_list, entry) {
+          if (_timeseriesaxis_write(client, tsaxis, NULL, 0)) {
+               added++;
+          }
+     }
+     if (added == 0) {
+          tbcmh_tx_abort(client);
+          _timeseriesdata_on_committed(tsdata, -1, now_us);
+          return ESP_FAIL;
+     }
+
      // send package...
-     int msg_id = -1;
-     if (result) {
-         msg_id = tbcmh_telemetry_upload_ex(client, object, 1/*qos*/, 0/*retain*/);
+     int msg_id = tbcmh_tx_commit(client, 1/*qos*/, 0/*retain*/);
+
+     // remember the last sent values
+     _timeseriesdata_on_committed(tsdata, msg_id, now_us);
+
+     return (msg_id > -1) ? ESP_OK : ESP_FAIL;
+}
+
+tbce_timeseriesgroup_handle_t tbce_timeseriesdata_group_create(tbce_timeseriesdata_handle_t tsdata,
+                                                                const char *keys[], int count)
+{
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(tsdata, NULL);
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(keys, NULL);
+     if (count <= 0) {
+          TBC_LOGE("count(%d) is error! %s()", count, __FUNCTION__);
+          return NULL;
+     }
+
+     // Resolve axes once
+     int i, max_key_len = 0;
+     timeseriesaxis_t **tsaxes = TBC_MALLOC(sizeof(timeseriesaxis_t *) * count);
+     if (!tsaxes) {
+          TBC_LOGE("Unable to malloc memeory!");
+          return NULL;
      }
-     cJSON_Delete(object); // delete json object
+     for (i=0; i<count; i++) {
+          tbcmh_key_t interned = keys[i] ? tbcmh_key_find(keys[i], strlen(keys[i])) : NULL;
+          timeseriesaxis_t *tsaxis = NULL;
+          LIST_FOREACH(tsaxis, &tsdata->timeseriesaxis_list, entry) {
+               if (tsaxis && interned && tsaxis->key == interned) {
+                    break;
+               }
+          }
+          if (!tsaxis || tsaxis->aggr) {
+               TBC_LOGE("Unable to find time-series axis:%s, or it is an aggregation axis! %s()",
+                        keys[i] ? keys[i] : "(null)", __FUNCTION__);
+               TBC_FREE(tsaxes);
+               return NULL;
+          }
+          tsaxes[i] = tsaxis;
+          if (strlen(tsaxis->key) > max_key_len) {
+               max_key_len = strlen(tsaxis->key);
+          }
+     }
+
+     // Serialize key fragments: at most 6 bytes per char(\u00XX), quotes and ':'
+     int fragment_size = max_key_len * 6 + 3;
+     char *fragment = TBC_MALLOC(fragment_size);
+     tbce_timeseriesgroup_t *group = TBC_MALLOC(sizeof(tbce_timeseriesgroup_t));
+     timeseriesgroupitem_t *items = TBC_MALLOC(sizeof(timeseriesgroupitem_t) * count);
+     int *fragment_lens = TBC_MALLOC(sizeof(int) * count);
+     char *fragments = NULL;
+     int total_len = 0;
+     if (fragment && group && items && fragment_lens) {
+          for (i=0; i<count && total_len>=0; i++) {
+               fragment_lens[i] = tbcmh_tx_serialize_key(tsaxes[i]->key, fragment, fragment_size);
+               total_len = (fragment_lens[i] < 0) ? -1 : total_len + fragment_lens[i];
+          }
+          fragments = (total_len > 0) ? TBC_MALLOC(total_len) : NULL;
+     }
+     if (!fragments) {
+          TBC_LOGE("Unable to malloc memeory!");
+          TBC_FREE(tsaxes);
+          TBC_FIELD_FREE(fragment);
+          TBC_FIELD_FREE(group);
+          TBC_FIELD_FREE(items);
+          TBC_FIELD_FREE(fragment_lens);
+          return NULL;
+     }
+
+     int offset = 0;
+     for (i=0; i<count; i++) {
+          tbcmh_tx_serialize_key(tsaxes[i]->key, fragments + offset, fragment_lens[i]);
+          items[i].tsaxis = tsaxes[i];
+          items[i].fragment = fragments + offset;
+          items[i].fragment_len = fragment_lens[i];
+          offset += fragment_lens[i];
+     }
+     TBC_FREE(tsaxes);
+     TBC_FREE(fragment);
+     TBC_FREE(fragment_lens);
+
+     memset(group, 0x00, sizeof(tbce_timeseriesgroup_t));
+     group->count = count;
+     group->items = items;
+     group->fragments = fragments;
+     LIST_INSERT_HEAD(&tsdata->timeseriesgroup_list, group, entry);
+     return group;
+}
+
+void tbce_timeseriesdata_group_destroy(tbce_timeseriesdata_handle_t tsdata,
+                                       tbce_timeseriesgroup_handle_t group)
+{
+     TBC_CHECK_PTR(tsdata);
+     TBC_CHECK_PTR(group);
+
+     // the group must be created by this tsdata, otherwise LIST_REMOVE() breaks another list
+     tbce_timeseriesgroup_t *it = NULL;
+     LIST_FOREACH(it, &tsdata->timeseriesgroup_list, entry) {
+          if (it == group) {
+               break;
+          }
+     }
+     if (!it) {
+          TBC_LOGE("The group isn't created by this timeseriesdata! %s()", __FUNCTION__);
+          return;
+     }
+
+     LIST_REMOVE(group, entry);
+     TBC_FREE(group->items);
+     TBC_FREE(group->fragments);
+     TBC_FREE(group);
+}
+
+tbc_err_t tbce_timeseriesdata_upload_group(tbce_timeseriesdata_handle_t tsdata,
+                                           tbcmh_handle_t client,
+                                           tbce_timeseriesgroup_handle_t group)
+{
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(tsdata, ESP_FAIL);
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(client, ESP_FAIL);
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(group, ESP_FAIL);
+
+     _timeseriesdata_check_lost(tsdata, client);
+
+     // get values of the resolved axes first, no lookup, user callbacks don't run in TX buffer
+     int i;
+     int sampled = 0;
+     int64_t now_us = esp_timer_get_time();
+     for (i=0; i<group->count; i++) {
+          timeseriesgroupitem_t *item = &group->items[i];
+          if (item->tsaxis && _timeseriesaxis_sample(item->tsaxis, now_us)) {
+               sampled++;
+          }
+     }
+
+     // nothing is changed, skip the whole publish
+     if (sampled == 0) {
+          return ESP_OK;
+     }
+
+     // write key/value pairs into TX buffer directly, no cJSON object tree
+     if (tbcmh_tx_begin(client, TBCMH_TX_TELEMETRY) != ESP_OK) {
+          TBC_LOGE("Unable to begin TX buffer! %s()", __FUNCTION__);
+          _timeseriesdata_on_committed(tsdata, -1, now_us);
+          return ESP_FAIL;
+     }
+     int added = 0;
+     for (i=0; i<group->count; i++) {
+          timeseriesgroupitem_t *item = &group->items[i];
+          if (item->tsaxis && _timeseriesaxis_write(client, item->tsaxis,
+                                                    item->fragment, item->fragment_len)) {
+               added++;
+          }
+     }
+     if (added == 0) {
+          tbcmh_tx_abort(client);
+          _timeseriesdata_on_committed(tsdata, -1, now_us);
+          return ESP_FAIL;
+     }
+
+     // send package...
+     int msg_id = tbcmh_tx_commit(client, 1/*qos*/, 0/*retain*/);
+
+     // remember the last sent values
+     _timeseriesdata_on_committed(tsdata, msg_id, now_us);
 
      return (msg_id > -1) ? ESP_OK : ESP_FAIL;
 }
 
+static void _timeseriesaggr_add_stat(tbcmh_handle_t client, timeseriesaxis_t *tsaxis,
+                                     int index, double value)
+{
+     tbcmh_key_t key = tsaxis->aggr->stat_keys[index];
+     if (!key) {
+          return;
+     }
+     if (tsaxis->decimals >= 0) {
+          tbcmh_tx_add_float_fixed(client, key, value, tsaxis->decimals);
+     } else {
+          tbcmh_tx_add_float(client, key, value);
+     }
+}
+
+/*!< Close the window of aggregation axis if it is expired.
+     Returns true if the closed bank has samples, then it is published by _timeseriesaggr_publish() */
+static bool _timeseriesaggr_close(timeseriesaxis_t *tsaxis, int64_t now_us)
+{
+     timeseriesaggr_t *aggr = tsaxis->aggr;
+     int64_t window_us = (int64_t)aggr->config.window_ms * 1000;
+     if (now_us - aggr->window_start_us < window_us) {
+          return false;
+     }
+     if (aggr->closed) {
+          // the last closed bank isn't published yet, it is retried in this run.
+          // The pusher keeps writing the active bank, so this window is merged into the next one.
+          aggr->window_start_us += ((now_us - aggr->window_start_us) / window_us) * window_us;
+          return false;
+     }
+
+     // close the window: flip the banks, then wait for the pusher leaving the old one
+     int closed = atomic_load(&aggr->active);
+     atomic_store(&aggr->active, 1 - closed);
+     timeseriesaggr_bank_t *bank = &aggr->bank[closed];
+     _timeseriesaggr_bank_wait(bank);
+     // tumbling window, aligned to the first window
+     aggr->window_start_us += ((now_us - aggr->window_start_us) / window_us) * window_us;
+
+     if (bank->count == 0) {
+          return false;
+     }
+     aggr->closed = bank;
+     aggr->closed_end_us = aggr->window_start_us;
+     return true;
+}
+
+/*!< Publish statistics of the closed bank stamped with the end of its window, and reset the bank.
+     On failure the closed bank is kept, and it is published again in the next run.
+     Returns msg_id, or -1 on failure */
+static int _timeseriesaggr_publish(tbcmh_handle_t client, timeseriesaxis_t *tsaxis, int64_t now_us)
+{
+     timeseriesaggr_t *aggr = tsaxis->aggr;
+     timeseriesaggr_bank_t *bank = aggr->closed;
+
+     int64_t ts = tbcmh_timesync_now_ms(client) - (now_us - aggr->closed_end_us) / 1000;
+     int msg_id = -1;
+     if (tbcmh_tx_begin_ts(client, ts) == ESP_OK) {
+          _timeseriesaggr_add_stat(client, tsaxis, 0, bank->min);
+          _timeseriesaggr_add_stat(client, tsaxis, 1, bank->max);
+          _timeseriesaggr_add_stat(client, tsaxis, 2, bank->sum / bank->count);
+          _timeseriesaggr_add_stat(client, tsaxis, 3, sqrt(bank->sum_sq / bank->count));
+          if (aggr->stat_keys[4]) {
+               tbcmh_tx_add_int(client, aggr->stat_keys[4], bank->count);
+          }
+          msg_id = tbcmh_tx_commit(client, 1/*qos*/, 0/*retain*/);
+     } else {
+          TBC_LOGE("Unable to begin TX buffer! %s()", __FUNCTION__);
+     }
+     if (msg_id > -1) {
+          _timeseriesaggr_bank_reset(bank);
+          aggr->closed = NULL;
+     }
+     return msg_id;
+}
+
+/*!< Serve the reached deadline of periodic axis, and move to its next deadline */
+static void _timeseriesaxis_advance(tbce_timeseriesdata_handle_t tsdata,
+                                    timeseriesaxis_t *tsaxis, int64_t now_us)
+{
+     // drift: how late the latest deadline is served, earlier deadlines are missed
+     int64_t period_us = (int64_t)tsaxis->period_ms * 1000;
+     int64_t late_us = now_us - tsaxis->next_due_us;
+     int64_t drift_us = late_us % period_us;
+     tbce_timeseriesdata_stats_t *stats = &tsdata->stats;
+     stats->last_drift_us = drift_us;
+     if (drift_us > stats->max_drift_us) {
+          stats->max_drift_us = drift_us;
+     }
+     tsdata->drift_sum_us += drift_us;
+     stats->sample_count++;
+     stats->avg_drift_us = tsdata->drift_sum_us / stats->sample_count;
+     stats->missed_count += late_us / period_us;
+
+     // next deadline is aligned to the epoch, so deadlines of different periods coincide
+     tsaxis->next_due_us = tsdata->epoch_us
+                         + ((now_us - tsdata->epoch_us) / period_us + 1) * period_us;
+}
+
+/*!< Sample periodic axis if its deadline is reached. Returns true if it is sampled.
+     A sampled deadline is served after its value is published, otherwise it is retried */
+static bool _timeseriesaxis_run(tbce_timeseriesdata_handle_t tsdata,
+                                timeseriesaxis_t *tsaxis, int64_t now_us)
+{
+     if (now_us < tsaxis->next_due_us) {
+          return false;
+     }
+     if (_timeseriesaxis_sample(tsaxis, now_us)) {
+          return true;
+     }
+
+     _timeseriesaxis_advance(tsdata, tsaxis, now_us); // nothing to send, e.g. it is filtered out
+     return false;
+}
+
+/*!< Returns true if any signal of uplink pressure reaches its threshold (scale=1),
+     or half of its threshold (scale=2) */
+static bool _timeseriesdata_is_pressed(const tbce_timeseriesdata_adaptive_config_t *config,
+                                       const tbcmh_link_stats_t *link, int scale)
+{
+     if (config->outbox_high_size > 0
+         && link->outbox_size * scale >= config->outbox_high_size) {
+          return true;
+     }
+     if (config->ack_latency_high_ms > 0
+         && (uint64_t)link->ack_latency_ms * scale >= config->ack_latency_high_ms) {
+          return true;
+     }
+     if (config->event_queue_high_percent > 0 && link->event_queue_size > 0
+         && link->event_queue_high_water * 100 * scale
+                >= config->event_queue_high_percent * link->event_queue_size) {
+          return true;
+     }
+     if (config->txqueue_high_count > 0
+         && link->txqueue_count * scale >= config->txqueue_high_count) {
+          return true;
+     }
+     return false;
+}
+
+/*!< Control step of adaptive sampling: update pressure level by link statistics,
+     then stretch periods & widen deadbands of adaptive axes by it */
+static void _timeseriesdata_adapt(tbce_timeseriesdata_handle_t tsdata, tbcmh_handle_t client,
+                                  int64_t now_us)
+{
+     if (tsdata->adaptive_count <= 0 || now_us < tsdata->adaptive_next_us) {
+          return;
+     }
+     tsdata->adaptive_next_us = now_us + (int64_t)TIMESERIESDATA_ADAPTIVE_STEP_MS * 1000;
+
+     tbcmh_link_stats_t link;
+     if (tbcmh_get_link_stats(client, &link) != ESP_OK) {
+          return;
+     }
+
+     // hysteresis: rise at the threshold, fall only after a while below half of it
+     int level = tsdata->stats.pressure_level;
+     const tbce_timeseriesdata_adaptive_config_t *config = &tsdata->adaptive_config;
+     if (_timeseriesdata_is_pressed(config, &link, 1)) {
+          tsdata->adaptive_healthy_us = 0;
+          if (level < TIMESERIESDATA_ADAPTIVE_LEVEL_MAX) {
+               level++;
+          }
+     } else if (_timeseriesdata_is_pressed(config, &link, 2)) {
+          tsdata->adaptive_healthy_us = 0;
+     } else if (level > 0) {
+          if (tsdata->adaptive_healthy_us == 0) {
+               tsdata->adaptive_healthy_us = now_us;
+          } else if (now_us - tsdata->adaptive_healthy_us >= (int64_t)config->recover_ms * 1000) {
+               tsdata->adaptive_healthy_us = now_us;
+               level--;
+          }
+     }
+     if (level == tsdata->stats.pressure_level) {
+          return;
+     }
+     TBC_LOGI("Uplink pressure level %d -> %d", tsdata->stats.pressure_level, level);
+     tsdata->stats.pressure_level = level;
+
+     timeseriesaxis_t *tsaxis = NULL;
+     LIST_FOREACH(tsaxis, &tsdata->timeseriesaxis_list, entry) {
+          if (tsaxis->adaptive) {
+               _timeseriesaxis_adapt(tsdata, tsaxis, now_us);
+          }
+     }
+}
+
+tbc_err_t tbce_timeseriesdata_run(tbce_timeseriesdata_handle_t tsdata,
+                                  tbcmh_handle_t client)
+{
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(tsdata, ESP_FAIL);
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(client, ESP_FAIL);
+
+     // close windows & sample due axes first, user callbacks don't run in TX buffer
+     int sampled = 0;
+     int64_t now_us = esp_timer_get_time();
+     _timeseriesdata_check_lost(tsdata, client);
+     _timeseriesdata_adapt(tsdata, client, now_us);
+     timeseriesaxis_t *tsaxis = NULL;
+     LIST_FOREACH(tsaxis, &tsdata->timeseriesaxis_list, entry) {
+          if (tsaxis->aggr) {
+               _timeseriesaggr_close(tsaxis, now_us);
+          } else if (tsaxis->period_ms > 0) {
+               sampled += _timeseriesaxis_run(tsdata, tsaxis, now_us) ? 1 : 0;
+          }
+     }
+
+     // statistics of each window are stamped with the end of the window
+     tbc_err_t result = ESP_OK;
+     LIST_FOREACH(tsaxis, &tsdata->timeseriesaxis_list, entry) {
+          if (tsaxis->aggr && tsaxis->aggr->closed) {
+               if (_timeseriesaggr_publish(client, tsaxis, now_us) > -1) {
+                    tsdata->stats.publish_count++;
+               } else {
+                    result = ESP_FAIL;
+               }
+          }
+     }
+     if (sampled == 0) {
+          return result;
+     }
+
+     // write key/value pairs into TX buffer directly.
+     // On failure, deadlines of sampled axes aren't served, they are sampled again in the next run.
+     if (tbcmh_tx_begin(client, TBCMH_TX_TELEMETRY) != ESP_OK) {
+          TBC_LOGE("Unable to begin TX buffer! %s()", __FUNCTION__);
+          _timeseriesdata_on_committed(tsdata, -1, now_us);
+          return ESP_FAIL;
+     }
+     int added = 0;
+     LIST_FOREACH(tsaxis, &tsdata->timeseriesaxis_list, entry) {
+          if (_timeseriesaxis_write(client, tsaxis, NULL, 0)) {
+               added++;
+          }
+     }
+     // nothing is written, skip the whole publish
+     if (added == 0) {
+          tbcmh_tx_abort(client);
+          _timeseriesdata_on_committed(tsdata, -1, now_us);
+          return ESP_FAIL;
+     }
+
+     // send package...
+     int msg_id = tbcmh_tx_commit(client, 1/*qos*/, 0/*retain*/);
+     if (msg_id > -1) {
+          tsdata->stats.publish_count++;
+          LIST_FOREACH(tsaxis, &tsdata->timeseriesaxis_list, entry) {
+               if (tsaxis->pending && !tsaxis->aggr && tsaxis->period_ms > 0
+                   && now_us >= tsaxis->next_due_us) {
+                    _timeseriesaxis_advance(tsdata, tsaxis, now_us);
+               }
+          }
+     }
+
+     // remember the last sent values
+     _timeseriesdata_on_committed(tsdata, msg_id, now_us);
+
+     return (msg_id > -1) ? result : ESP_FAIL;
+}
+
+tbc_err_t tbce_timeseriesdata_get_stats(tbce_timeseriesdata_handle_t tsdata,
+                                        tbce_timeseriesdata_stats_t *stats)
+{
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(tsdata, ESP_FAIL);
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(stats, ESP_FAIL);
+
+     *stats = tsdata->stats;
+     return ESP_OK;
+}
+
+//==== Columnar sample buffer ======================================================
+
+static int _timeseriesbuffer_type_size(tbce_timeseriesbuffer_type_t type)
+{
+     switch (type) {
+     case TBCE_TIMESERIESBUFFER_FLOAT: return sizeof(float);
+     case TBCE_TIMESERIESBUFFER_INT:   return sizeof(int32_t);
+     case TBCE_TIMESERIESBUFFER_BOOL:  return sizeof(bool);
+     default:                          return 0;
+     }
+}
+
+tbce_timeseriesbuffer_handle_t tbce_timeseriesbuffer_create(const tbce_timeseriesbuffer_column_t *columns,
+                                                            int column_count, int capacity)
+{
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(columns, NULL);
+     if (column_count <= 0 || capacity <= 0) {
+          TBC_LOGE("column_count(%d) or capacity(%d) is error! %s()", column_count, capacity, __FUNCTION__);
+          return NULL;
+     }
+
+     int i, total_len = 0;
+     for (i=0; i<column_count; i++) {
+          if (!columns[i].key || _timeseriesbuffer_type_size(columns[i].type) == 0) {
+               TBC_LOGE("columns[%d] is error! %s()", i, __FUNCTION__);
+               return NULL;
+          }
+          // at most 6 bytes per char(\u00XX), quotes and ':'
+          total_len += strlen(columns[i].key) * 6 + 3;
+     }
+
+     tbce_timeseriesbuffer_t *buffer = TBC_MALLOC(sizeof(tbce_timeseriesbuffer_t));
+     if (!buffer) {
+          TBC_LOGE("Unable to malloc memeory!");
+          return NULL;
+     }
+     memset(buffer, 0x00, sizeof(tbce_timeseriesbuffer_t));
+     buffer->column_count = column_count;
+     buffer->capacity = 1;
+     while (buffer->capacity < capacity) {
+          buffer->capacity <<= 1;
+     }
+     atomic_init(&buffer->head, 0);
+     atomic_init(&buffer->tail, 0);
+     atomic_init(&buffer->dropped, 0);
+
+     buffer->ts = TBC_MALLOC(sizeof(int64_t) * buffer->capacity);
+     buffer->columns = TBC_MALLOC(sizeof(timeseriesbuffercolumn_t) * column_count);
+     buffer->tx_columns = TBC_MALLOC(sizeof(tbcmh_tx_column_t) * column_count);
+     buffer->row = TBC_MALLOC(sizeof(tbcmh_scalar_t) * column_count);
+     buffer->fragments = TBC_MALLOC(total_len);
+     bool result = buffer->ts && buffer->columns && buffer->tx_columns && buffer->row && buffer->fragments;
+     if (buffer->columns) {
+          memset(buffer->columns, 0x00, sizeof(timeseriesbuffercolumn_t) * column_count);
+     }
+
+     int offset = 0;
+     for (i=0; result && i<column_count; i++) {
+          timeseriesbuffercolumn_t *column = &buffer->columns[i];
+          column->type = columns[i].type;
+          column->field_number = columns[i].field_number;
+          column->data = TBC_MALLOC(_timeseriesbuffer_type_size(column->type) * buffer->capacity);
+          int len = tbcmh_tx_serialize_key(columns[i].key, buffer->fragments + offset, total_len - offset);
+          result = column->data && (len > 0);
+
+          buffer->tx_columns[i].fragment = buffer->fragments + offset;
+          buffer->tx_columns[i].fragment_len = len;
+          buffer->tx_columns[i].decimals = columns[i].decimals;
+          offset += (len > 0) ? len : 0;
+     }
+     if (!result) {
+          TBC_LOGE("Unable to malloc memeory!");
+          tbce_timeseriesbuffer_destroy(buffer);
+          return NULL;
+     }
+     return buffer;
+}
+
+void tbce_timeseriesbuffer_destroy(tbce_timeseriesbuffer_handle_t buffer)
+{
+     TBC_CHECK_PTR(buffer);
+
+     int i;
+     for (i=0; buffer->columns && i<buffer->column_count; i++) {
+          TBC_FIELD_FREE(buffer->columns[i].data);
+     }
+     TBC_FIELD_FREE(buffer->ts);
+     TBC_FIELD_FREE(buffer->columns);
+     TBC_FIELD_FREE(buffer->tx_columns);
+     TBC_FIELD_FREE(buffer->row);
+     TBC_FIELD_FREE(buffer->fragments);
+     TBC_FREE(buffer);
+}
+
+static void *_timeseriesbuffer_column(tbce_timeseriesbuffer_handle_t buffer, int column,
+                                      tbce_timeseriesbuffer_type_t type)
+{
+     if (!buffer || column < 0 || column >= buffer->column_count
+         || buffer->columns[column].type != type) {
+          TBC_LOGE("column(%d) isn't a column of type(%d)!", column, type);
+          return NULL;
+     }
+     return buffer->columns[column].data;
+}
+
+float *tbce_timeseriesbuffer_float_column(tbce_timeseriesbuffer_handle_t buffer, int column)
+{
+     return _timeseriesbuffer_column(buffer, column, TBCE_TIMESERIESBUFFER_FLOAT);
+}
+
+int32_t *tbce_timeseriesbuffer_int_column(tbce_timeseriesbuffer_handle_t buffer, int column)
+{
+     return _timeseriesbuffer_column(buffer, column, TBCE_TIMESERIESBUFFER_INT);
+}
+
+bool *tbce_timeseriesbuffer_bool_column(tbce_timeseriesbuffer_handle_t buffer, int column)
+{
+     return _timeseriesbuffer_column(buffer, column, TBCE_TIMESERIESBUFFER_BOOL);
+}
+
+// It may be called in an ISR, no log & no lock
+int tbce_timeseriesbuffer_begin_row(tbce_timeseriesbuffer_handle_t buffer, int64_t ts)
+{
+     if (!buffer) {
+          return -1;
+     }
+
+     // head is written by the producer only, tail is released by the consumer
+     unsigned int head = atomic_load_explicit(&buffer->head, memory_order_relaxed);
+     unsigned int tail = atomic_load_explicit(&buffer->tail, memory_order_acquire);
+     if (head - tail >= buffer->capacity) {
+          atomic_fetch_add_explicit(&buffer->dropped, 1, memory_order_relaxed);
+          return -1;
+     }
+     int row = head & (buffer->capacity - 1);
+     buffer->ts[row] = ts;
+     return row;
+}
+
+void tbce_timeseriesbuffer_end_row(tbce_timeseriesbuffer_handle_t buffer)
+{
+     if (!buffer) {
+          return;
+     }
+
+     // values stored into columns are visible before the row
+     unsigned int head = atomic_load_explicit(&buffer->head, memory_order_relaxed);
+     atomic_store_explicit(&buffer->head, head + 1, memory_order_release);
+}
+
+int tbce_timeseriesbuffer_get_count(tbce_timeseriesbuffer_handle_t buffer)
+{
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(buffer, 0);
+
+     return atomic_load(&buffer->head) - atomic_load(&buffer->tail);
+}
+
+uint32_t tbce_timeseriesbuffer_get_dropped(tbce_timeseriesbuffer_handle_t buffer)
+{
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(buffer, 0);
+
+     return atomic_load(&buffer->dropped);
+}
+
+// Rows [tail, tail + count) to publish, count is limited by max_rows
+static unsigned int _timeseriesbuffer_pending(tbce_timeseriesbuffer_handle_t buffer, int max_rows,
+                                              unsigned int *tail)
+{
+     *tail = atomic_load_explicit(&buffer->tail, memory_order_relaxed);
+     unsigned int count = atomic_load_explicit(&buffer->head, memory_order_acquire) - *tail;
+     if (max_rows > 0 && count > (unsigned int)max_rows) {
+          count = max_rows;
+     }
+     return count;
+}
+
+// Walk the columns of a row into buffer->row
+static void _timeseriesbuffer_load_row(tbce_timeseriesbuffer_handle_t buffer, int row)
+{
+     int i;
+     for (i=0; i<buffer->column_count; i++) {
+          const timeseriesbuffercolumn_t *column = &buffer->columns[i];
+          tbcmh_scalar_t *value = &buffer->row[i];
+          switch (column->type) {
+          case TBCE_TIMESERIESBUFFER_FLOAT:
+               value->type = TBCMH_SCALAR_FLOAT;
+               value->value.float_value = ((const float *)column->data)[row];
+               break;
+          case TBCE_TIMESERIESBUFFER_INT:
+               value->type = TBCMH_SCALAR_INT;
+               value->value.int_value = ((const int32_t *)column->data)[row];
+               break;
+          case TBCE_TIMESERIESBUFFER_BOOL:
+          default:
+               value->type = TBCMH_SCALAR_BOOL;
+               value->value.bool_value = ((const bool *)column->data)[row];
+               break;
+          }
+     }
+}
+
+int tbce_timeseriesbuffer_upload(tbce_timeseriesbuffer_handle_t buffer,
+                                 tbcmh_handle_t client, int max_rows)
+{
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(buffer, ESP_FAIL);
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(client, ESP_FAIL);
+
+     unsigned int tail;
+     unsigned int count = _timeseriesbuffer_pending(buffer, max_rows, &tail);
+     unsigned int i = 0, batched = 0;
+     int published = 0;
+     bool is_begun = false;
+     while (i < count) {
+          if (!is_begun) {
+               if (tbcmh_tx_begin_batch(client) != ESP_OK) {
+                    break;
+               }
+               is_begun = true;
+               batched = 0;
+          }
+
+          int row = (tail + i) & (buffer->capacity - 1);
+          _timeseriesbuffer_load_row(buffer, row);
+          if (tbcmh_tx_add_row(client, buffer->ts[row], buffer->tx_columns,
+                               buffer->row, buffer->column_count) == ESP_OK) {
+               batched++;
+               i++;
+               if (i < count) {
+                    continue;
+               }
+          } else if (batched == 0) {
+               // a row that doesn't fit in an empty TX buffer is dropped
+               TBC_LOGW("Row is bigger than TX buffer, it is dropped! %s()", __FUNCTION__);
+               atomic_fetch_add(&buffer->dropped, 1);
+               tbcmh_tx_abort(client);
+               is_begun = false;
+               i++;
+               atomic_store_explicit(&buffer->tail, tail + i, memory_order_release);
+               continue;
+          }
+
+          // TX buffer is full, or all rows are added. Rows are kept if it fails to publish
+          int msg_id = tbcmh_tx_commit(client, 1/*qos*/, 0/*retain*/);
+          is_begun = false;
+          if (msg_id < 0) {
+               i -= batched;
+               break;
+          }
+          published += batched;
+          atomic_store_explicit(&buffer->tail, tail + i, memory_order_release);
+     }
+
+     return (published > 0 || i >= count) ? published : ESP_FAIL;
+}
+
+int tbce_timeseriesbuffer_upload_proto(tbce_timeseriesbuffer_handle_t buffer,
+                                       tbcmh_handle_t client, int max_rows)
+{
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(buffer, ESP_FAIL);
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(client, ESP_FAIL);
+
+     unsigned int tail;
+     unsigned int count = _timeseriesbuffer_pending(buffer, max_rows, &tail);
+     unsigned int i;
+     for (i=0; i<count; i++) {
+          int row = (tail + i) & (buffer->capacity - 1);
+          if (tbcmh_tx_begin_proto(client, TBCMH_TX_TELEMETRY) != ESP_OK) {
+               break;
+          }
+
+          tbc_err_t result = ESP_OK;
+          int j;
+          for (j=0; result == ESP_OK && j<buffer->column_count; j++) {
+               const timeseriesbuffercolumn_t *column = &buffer->columns[j];
+               if (column->field_number == 0) {
+                    continue;
+               }
+               switch (column->type) {
+               case TBCE_TIMESERIESBUFFER_FLOAT:
+                    result = tbcmh_tx_add_proto_float(client, column->field_number,
+                                                      ((const float *)column->data)[row]);
+                    break;
+               case TBCE_TIMESERIESBUFFER_INT:
+                    result = tbcmh_tx_add_proto_int(client, column->field_number,
+                                                    ((const int32_t *)column->data)[row]);
+                    break;
+               case TBCE_TIMESERIESBUFFER_BOOL:
+               default:
+                    result = tbcmh_tx_add_proto_bool(client, column->field_number,
+                                                     ((const bool *)column->data)[row]);
+                    break;
+               }
+          }
+          if (result != ESP_OK) {
+               tbcmh_tx_abort(client);
+               break;
+          }
+          if (tbcmh_tx_commit(client, 1/*qos*/, 0/*retain*/) < 0) {
+               break;
+          }
+          atomic_store_explicit(&buffer->tail, tail + i + 1, memory_order_release);
+     }
+
+     return (i > 0 || count == 0) ? (int)i : ESP_FAIL;
+}
@@ -0,0 +1,832 @@
+// Copyright 2022 liangzhuzhi2020@gmail.com, https://github.com/liang-zhu-zi/esp32-thingsboard-mqtt-client
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// This file is called by tbc_mqtt_helper.c/.h.
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+
+#include "esp_err.h"
+#include "esp_timer.h"
+
+#include "tbc_mqtt_helper_internal.h"
+
+const static char *TAG = "attributes_mirror";
+
+// Writers hold it, so that a reader on the same core never spins on a preempted writer.
+// Readers don't take it.
+static portMUX_TYPE _attributemirror_spinlock = portMUX_INITIALIZER_UNLOCKED;
+
+//==== Local mirror of device attributes ========================================
+void _tbcmh_attributemirror_on_create(tbcmh_handle_t client)
+{
+    // This function is in semaphore/client->_lock!!!
+    TBC_CHECK_PTR(client);
+
+    memset(&client->attributemirror_list, 0x00, sizeof(client->attributemirror_list));
+    memset(&client->attributemirrorstore, 0x00, sizeof(client->attributemirrorstore));
+}
+
+static void _attributemirror_destroy(attributemirror_t *mirror)
+{
+    tbcmh_key_release(mirror->key);
+    TBC_FIELD_FREE(mirror->string);
+    TBC_FREE(mirror);
+}
+
+void _tbcmh_attributemirror_on_destroy(tbcmh_handle_t client)
+{
+    // This function is in semaphore/client->_lock!!!
+    TBC_CHECK_PTR(client);
+
+    // save changes of the last seconds
+    tbcmh_attributemirror_store_close(client);
+
+    // subscriptions are destroyed by _tbcmh_attributessubscribe_on_destroy()
+    attributemirror_t *mirror = NULL, *next;
+    LIST_FOREACH_SAFE(mirror, &client->attributemirror_list, entry, next) {
+         LIST_REMOVE(mirror, entry);
+         _attributemirror_destroy(mirror);
+    }
+    memset(&client->attributemirror_list, 0x00, sizeof(client->attributemirror_list));
+}
+
+// Write a received value to mirror. This function is in client->_lock!!!
+static void _attributemirror_set(attributemirror_t *mirror, const cJSON *value, bool is_restored)
+{
+    tbcmh_scalar_type_t type;
+    int string_len = 0;
+    if (cJSON_IsNumber(value)) {
+        double number = value->valuedouble;
+        type = (number == trunc(number) && fabs(number) < 9.2e18) ? TBCMH_SCALAR_INT : TBCMH_SCALAR_FLOAT;
+    } else if (cJSON_IsBool(value)) {
+        type = TBCMH_SCALAR_BOOL;
+    } else if (cJSON_IsString(value) && value->valuestring) {
+        type = TBCMH_SCALAR_STRING;
+        string_len = strlen(value->valuestring);
+        if (string_len > mirror->max_string_len) {
+            TBC_LOGW("String of attribute:%s is too long (%d>%d) to be mirrored! %s()",
+                     mirror->key, string_len, mirror->max_string_len, __FUNCTION__);
+            return;
+        }
+    } else {
+        TBC_LOGW("Attribute:%s is not a scalar, it can't be mirrored! %s()", mirror->key, __FUNCTION__);
+        return;
+    }
+
+    taskENTER_CRITICAL(&_attributemirror_spinlock);
+    unsigned int seq = atomic_load_explicit(&mirror->seq, memory_order_relaxed);
+    atomic_store_explicit(&mirror->seq, seq + 1, memory_order_relaxed); // odd: being written
+    atomic_thread_fence(memory_order_release);
+    mirror->type = type;
+    mirror->is_restored = is_restored;
+    switch (type) {
+    case TBCMH_SCALAR_INT:
+        mirror->int_value = (int64_t)value->valuedouble;
+        mirror->float_value = value->valuedouble;
+        break;
+    case TBCMH_SCALAR_FLOAT:
+        mirror->float_value = value->valuedouble;
+        break;
+    case TBCMH_SCALAR_BOOL:
+        mirror->bool_value = cJSON_IsTrue(value);
+        break;
+    default: // TBCMH_SCALAR_STRING
+        memcpy(mirror->string, value->valuestring, string_len + 1);
+        mirror->string_len = string_len;
+        break;
+    }
+    atomic_store_explicit(&mirror->seq, seq + 2, memory_order_release);
+    taskEXIT_CRITICAL(&_attributemirror_spinlock);
+}
+
+//==== Snapshot of attributes for warm start ====================================
+
+#define _ATTRIBUTEMIRRORSTORE_MIN_TS  (1577836800000LL) // 2020-01-01, the clock isn't set before it
+
+// Unix ms of the server clock, 0 if the clock isn't set yet
+static int64_t _attributemirrorstore_now_ms(tbcmh_handle_t client)
+{
+    int64_t now = tbcmh_timesync_now_ms(client);
+    return (now >= _ATTRIBUTEMIRRORSTORE_MIN_TS) ? now : 0;
+}
+
+static cJSON *_attributemirrorstore_get(const cJSON *scope, const char *key, int key_len)
+{
+    cJSON *item = NULL;
+    cJSON_ArrayForEach(item, scope) {
+        if (item->string && strncmp(item->string, key, key_len) == 0 && item->string[key_len] == '\0') {
+            return item;
+        }
+    }
+    return NULL;
+}
+
+// Remember the last known value of key. This function is in client->_lock!!!
+static void _attributemirrorstore_put(attributemirrorstore_t *store, bool is_shared,
+                                      const char *key, const cJSON *value)
+{
+    cJSON *scope = is_shared ? store->shared_attributes : store->client_attributes;
+    cJSON *item = _attributemirrorstore_get(scope, key, strlen(key));
+    if (item && cJSON_Compare(item, value, true)) {
+        return;
+    }
+    int max_keys = (store->config.max_keys > 0) ? store->config.max_keys : TBCMH_ATTRIBUTEMIRROR_STORE_MAX_KEYS;
+    if (!item && cJSON_GetArraySize(scope) >= max_keys) {
+        TBC_LOGW("Snapshot of attributes is full(%d), attribute:%s isn't saved! %s()", max_keys, key, __FUNCTION__);
+        return;
+    }
+
+    cJSON *copy = cJSON_Duplicate(value, true);
+    if (!copy) {
+        TBC_LOGE("Unable to malloc memeory! %s()", __FUNCTION__);
+        return;
+    }
+    // the key is copied, so that it lives longer than the interned key
+    if (item) {
+        cJSON_ReplaceItemInObjectCaseSensitive(scope, key, copy);
+    } else {
+        cJSON_AddItemToObject(scope, key, copy);
+    }
+    store->is_dirty = true;
+}
+
+// Restore mirror from snapshot, unless a value is received already. This function is in client->_lock!!!
+static void _attributemirrorstore_restore(attributemirrorstore_t *store, attributemirror_t *mirror)
+{
+    if (!store->is_opened || atomic_load_explicit(&mirror->seq, memory_order_relaxed) > 0) {
+        return;
+    }
+    cJSON *scope = mirror->is_shared ? store->shared_attributes : store->client_attributes;
+    const cJSON *value = _attributemirrorstore_get(scope, mirror->key, strlen(mirror->key));
+    if (value) {
+        _attributemirror_set(mirror, value, true);
+    }
+}
+
+static cJSON *_attributemirrorstore_load(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (size <= 0 || size > TBCMH_ATTRIBUTEMIRROR_STORE_MAX_SIZE) {
+        TBC_LOGW("Size(%ld) of %s is invalid!", size, path);
+        fclose(file);
+        return NULL;
+    }
+
+    char *buffer = TBC_MALLOC(size);
+    if (!buffer) {
+        TBC_LOGE("Unable to malloc memeory! %s()", __FUNCTION__);
+        fclose(file);
+        return NULL;
+    }
+    bool result = (fread(buffer, size, 1, file) == 1);
+    fclose(file);
+    cJSON *object = result ? cJSON_ParseWithLength(buffer, size) : NULL;
+    TBC_FREE(buffer);
+    if (!cJSON_IsObject(object)) {
+        TBC_LOGW("%s isn't a snapshot of attributes!", path);
+        cJSON_Delete(object);
+        return NULL;
+    }
+    return object;
+}
+
+// Write "<path>.tmp", then replace snapshot file by it. This function is in client->_lock!!!
+static bool _attributemirrorstore_save(tbcmh_handle_t client)
+{
+    attributemirrorstore_t *store = &client->attributemirrorstore;
+    store->last_save_time = esp_timer_get_time();
+
+    cJSON *object = cJSON_CreateObject();
+    if (!object) {
+        TBC_LOGE("Unable to malloc memeory! %s()", __FUNCTION__);
+        return false;
+    }
+    cJSON_AddNumberToObject(object, "ts", (double)_attributemirrorstore_now_ms(client));
+    cJSON_AddItemReferenceToObject(object, "client", store->client_attributes);
+    cJSON_AddItemReferenceToObject(object, "shared", store->shared_attributes);
+    char *pack = cJSON_PrintUnformatted(object);
+    cJSON_Delete(object); // references only
+    if (!pack) {
+        TBC_LOGE("Unable to malloc memeory! %s()", __FUNCTION__);
+        return false;
+    }
+
+    bool result = false;
+    FILE *file = fopen(store->temp_path, "wb");
+    if (file) {
+        size_t len = strlen(pack);
+        result = (fwrite(pack, 1, len, file) == len);
+        result = (fflush(file) == 0) && (fsync(fileno(file)) == 0) && result;
+        result = (fclose(file) == 0) && result;
+    }
+    cJSON_free(pack);
+
+    // SPIFFS & FAT don't rename over an existing file. The old snapshot is removed
+    // after the new one is complete, and "<path>.tmp" is loaded if a power loss happens between.
+    if (result) {
+        remove(store->path);
+        result = (rename(store->temp_path, store->path) == 0);
+    }
+    if (!result) {
+        TBC_LOGE("Unable to save snapshot of attributes to %s!", store->path);
+        return false;
+    }
+    store->is_dirty = false;
+    return true;
+}
+
+//==== Updates of mirrors =======================================================
+
+// Update mirrors of scope by members of object. This function is in client->_lock!!!
+static void _attributemirror_update(tbcmh_handle_t client, const cJSON *object, bool is_shared)
+{
+    if (!object) {
+        return;
+    }
+
+    // Members are named by interned keys, matched by pointer
+    attributemirrorstore_t *store = &client->attributemirrorstore;
+    const cJSON *item = NULL;
+    cJSON_ArrayForEach(item, object) {
+        tbcmh_key_t key = tbcmh_key_of_item(item);
+        bool is_mirrored = false;
+        attributemirror_t *mirror = NULL;
+        LIST_FOREACH(mirror, &client->attributemirror_list, entry) {
+            if (key && mirror->key == key && mirror->is_shared == is_shared) {
+                _attributemirror_set(mirror, item, false);
+                is_mirrored = true;
+            }
+        }
+
+        // All client-side attributes are saved, they needn't be fetched in the next run.
+        // Shared attributes may be changed while offline, only mirrored ones are saved for warm start.
+        if (store->is_opened && item->string && (!is_shared || is_mirrored)) {
+            _attributemirrorstore_put(store, is_shared, item->string, item);
+        }
+    }
+}
+
+// on shared attributes pushed by the server
+static int _attributemirror_on_update(tbcmh_handle_t client, void *context, const cJSON *object)
+{
+    attributemirror_t *mirror = (attributemirror_t *)context;
+    const cJSON *value = tbcmh_key_get_item(object, mirror->key);
+    if (value) {
+        _attributemirror_set(mirror, value, false);
+        if (client->attributemirrorstore.is_opened) {
+            _attributemirrorstore_put(&client->attributemirrorstore, true, mirror->key, value);
+        }
+    }
+    return 0;
+}
+
+// on attributes response, whoever requests it
+void _tbcmh_attributemirror_on_response(tbcmh_handle_t client,
+                                        const cJSON *client_attributes,
+                                        const cJSON *shared_attributes)
+{
+    // This function is in semaphore/client->_lock!!!
+    TBC_CHECK_PTR(client);
+
+    if (LIST_EMPTY(&client->attributemirror_list) && !client->attributemirrorstore.is_opened) {
+        return;
+    }
+    _attributemirror_update(client, client_attributes, false);
+    _attributemirror_update(client, shared_attributes, true);
+}
+
+// on client-side attributes published by the device
+void _tbcmh_attributemirror_on_publish(tbcmh_handle_t client, const cJSON *object)
+{
+    // This function is in semaphore/client->_lock!!!
+    TBC_CHECK_PTR(client);
+
+    if (LIST_EMPTY(&client->attributemirror_list) && !client->attributemirrorstore.is_opened) {
+        return;
+    }
+    _attributemirror_update(client, object, false);
+}
+
+void _tbcmh_attributemirror_on_publish_payload(tbcmh_handle_t client, const char *payload, int len)
+{
+    // This function is in semaphore/client->_lock!!!
+    TBC_CHECK_PTR(client);
+    TBC_CHECK_PTR(payload);
+
+    // Parse it back only if someone cares
+    if (LIST_EMPTY(&client->attributemirror_list) && !client->attributemirrorstore.is_opened) {
+        return;
+    }
+    cJSON *object = cJSON_ParseWithLength(payload, len);
+    if (cJSON_IsObject(object)) {
+        _attributemirror_update(client, object, false);
+    }
+    cJSON_Delete(object);
+}
+
+void _tbcmh_attributemirror_on_run(tbcmh_handle_t client)
+{
+    TBC_CHECK_PTR(client);
+
+    attributemirrorstore_t *store = &client->attributemirrorstore;
+    if (!store->is_opened || !store->is_dirty) {
+        return;
+    }
+
+    // Take semaphore
+    if (xSemaphoreTakeRecursive(client->_lock, (TickType_t)0xFFFFF) != pdTRUE) {
+         TBC_LOGE("Unable to take semaphore! %s()", __FUNCTION__);
+         return;
+    }
+
+    // Changes are coalesced to save flash
+    int interval = (store->config.save_interval_ms > 0) ? store->config.save_interval_ms
+                                                        : TBCMH_ATTRIBUTEMIRROR_STORE_SAVE_INTERVAL;
+    if (store->is_opened && store->is_dirty
+        && esp_timer_get_time() - store->last_save_time >= (int64_t)interval * 1000) {
+        _attributemirrorstore_save(client);
+    }
+
+    // Give semaphore
+    xSemaphoreGiveRecursive(client->_lock);
+}
+
+// Split client_keys into the keys restored from snapshot and the keys to fetch.
+// return count of restored keys. If it is >0, *fetch_keys & *restored are to be freed by caller.
+int _tbcmh_attributemirror_restore_keys(tbcmh_handle_t client, const char *client_keys,
+                                        char **fetch_keys, cJSON **restored)
+{
+    // This function is in semaphore/client->_lock!!!
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(client, 0);
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(fetch_keys, 0);
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(restored, 0);
+
+    *fetch_keys = NULL;
+    *restored = NULL;
+    attributemirrorstore_t *store = &client->attributemirrorstore;
+    if (!client_keys || !store->is_opened || !cJSON_GetArraySize(store->client_attributes)) {
+        return 0;
+    }
+
+    char *keys = TBC_MALLOC(strlen(client_keys) + 1);
+    cJSON *values = cJSON_CreateObject();
+    if (!keys || !values) {
+        TBC_LOGE("Unable to malloc memeory! %s()", __FUNCTION__);
+        TBC_FIELD_FREE(keys);
+        cJSON_Delete(values);
+        return 0;
+    }
+
+    int count = 0;
+    int len = 0;
+    const char *begin = client_keys;
+    while (*begin) {
+        const char *end = strchr(begin, ',');
+        if (!end) {
+            end = begin + strlen(begin);
+        }
+        const char *key = begin;
+        int key_len = end - begin;
+        while (key_len > 0 && key[0] == ' ') {
+            key++;
+            key_len--;
+        }
+        while (key_len > 0 && key[key_len - 1] == ' ') {
+            key_len--;
+        }
+
+        const cJSON *value = (key_len > 0) ? _attributemirrorstore_get(store->client_attributes, key, key_len) : NULL;
+        if (value) {
+            cJSON *copy = cJSON_Duplicate(value, true);
+            if (copy) {
+                cJSON_AddItemToObject(values, value->string, copy);
+                count++;
+            }
+        } else if (key_len > 0) {
+            if (len > 0) {
+                keys[len++] = ',';
+            }
+            memcpy(keys + len, key, key_len);
+            len += key_len;
+        }
+        begin = *end ? end + 1 : end;
+    }
+    keys[len] = '\0';
+
+    if (count == 0) {
+        TBC_FREE(keys);
+        cJSON_Delete(values);
+        return 0;
+    }
+    *fetch_keys = keys;
+    *restored = values;
+    return count;
+}
+
+tbcmh_attributemirror_handle_t tbcmh_attributemirror_add(tbcmh_handle_t client,
+                                        const char *key, bool is_shared, int max_string_len)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(client, NULL);
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(key, NULL);
+
+    attributemirror_t *mirror = TBC_MALLOC(sizeof(attributemirror_t));
+    if (!mirror) {
+        TBC_LOGE("Unable to malloc memeory! %s()", __FUNCTION__);
+        return NULL;
+    }
+    memset(mirror, 0x00, sizeof(attributemirror_t));
+    atomic_init(&mirror->seq, 0);
+    mirror->key = tbcmh_key_intern(key);
+    mirror->is_shared = is_shared;
+    mirror->subscribe_id = -1;
+    mirror->type = TBCMH_SCALAR_NULL;
+    mirror->max_string_len = (max_string_len > 0) ? max_string_len : 0;
+    mirror->string = TBC_MALLOC(mirror->max_string_len + 1);
+    if (!mirror->key || !mirror->string) {
+        TBC_LOGE("Unable to malloc memeory! %s()", __FUNCTION__);
+        _attributemirror_destroy(mirror);
+        return NULL;
+    }
+    mirror->string[0] = '\0';
+
+    // Take semaphore
+    if (xSemaphoreTakeRecursive(client->_lock, (TickType_t)0xFFFFF) != pdTRUE) {
+         TBC_LOGE("Unable to take semaphore! %s()", __FUNCTION__);
+         _attributemirror_destroy(mirror);
+         return NULL;
+    }
+
+    // the last known value is available at once
+    _attributemirrorstore_restore(&client->attributemirrorstore, mirror);
+
+    // shared attributes are kept up to date by subscription
+    if (is_shared) {
+        mirror->subscribe_id = tbcmh_attributes_subscribe_of_array(client, mirror,
+                                        _attributemirror_on_update, 1, &mirror->key);
+        if (mirror->subscribe_id < 0) {
+            xSemaphoreGiveRecursive(client->_lock);
+            TBC_LOGE("Unable to subscribe attribute:%s! %s()", key, __FUNCTION__);
+            _attributemirror_destroy(mirror);
+            return NULL;
+        }
+    }
+    LIST_INSERT_HEAD(&client->attributemirror_list, mirror, entry);
+
+    // Give semaphore
+    xSemaphoreGiveRecursive(client->_lock);
+    return mirror;
+}
+
+tbc_err_t tbcmh_attributemirror_remove(tbcmh_handle_t client, tbcmh_attributemirror_handle_t mirror)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(client, ESP_FAIL);
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(mirror, ESP_FAIL);
+
+    // Take semaphore
+    if (xSemaphoreTakeRecursive(client->_lock, (TickType_t)0xFFFFF) != pdTRUE) {
+         TBC_LOGE("Unable to take semaphore! %s()", __FUNCTION__);
+         return ESP_FAIL;
+    }
+
+    attributemirror_t *it = NULL;
+    LIST_FOREACH(it, &client->attributemirror_list, entry) {
+        if (it == mirror) {
+            break;
+        }
+    }
+    if (!it) {
+        xSemaphoreGiveRecursive(client->_lock);
+        TBC_LOGW("Unable to find attribute mirror! %s()", __FUNCTION__);
+        return ESP_FAIL;
+    }
+
+    if (mirror->subscribe_id >= 0) {
+        tbcmh_attributes_unsubscribe(client, mirror->subscribe_id);
+    }
+    LIST_REMOVE(mirror, entry);
+
+    // Give semaphore
+    xSemaphoreGiveRecursive(client->_lock);
+
+    _attributemirror_destroy(mirror);
+    return ESP_OK;
+}
+
+tbcmh_attributemirror_handle_t tbcmh_attributemirror_find(tbcmh_handle_t client,
+                                        const char *key, bool is_shared)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(client, NULL);
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(key, NULL);
+
+    tbcmh_key_t interned = tbcmh_key_find(key, strlen(key));
+    if (!interned) {
+        return NULL;
+    }
+
+    // Take semaphore
+    if (xSemaphoreTakeRecursive(client->_lock, (TickType_t)0xFFFFF) != pdTRUE) {
+         TBC_LOGE("Unable to take semaphore! %s()", __FUNCTION__);
+         return NULL;
+    }
+
+    attributemirror_t *mirror = NULL;
+    LIST_FOREACH(mirror, &client->attributemirror_list, entry) {
+        if (mirror->key == interned && mirror->is_shared == is_shared) {
+            break;
+        }
+    }
+
+    // Give semaphore
+    xSemaphoreGiveRecursive(client->_lock);
+    return mirror;
+}
+
+/**
+ * Consistent copy of a mirror, read without lock
+ */
+typedef struct attributemirror_snapshot
+{
+    unsigned int seq;
+    tbcmh_scalar_type_t type;
+    int64_t int_value;
+    double float_value;
+    bool bool_value;
+    int string_len;
+    bool is_restored;
+} attributemirror_snapshot_t;
+
+// Read mirror without lock. String is copied into buffer if it fits. Returns version.
+static uint32_t _attributemirror_read(tbcmh_attributemirror_handle_t mirror,
+                                      attributemirror_snapshot_t *snapshot,
+                                      char *buffer, int size)
+{
+    unsigned int seq;
+    do {
+        seq = atomic_load_explicit(&mirror->seq, memory_order_acquire);
+        if (seq & 1) {
+            continue; // being written on the other core, it is short
+        }
+        snapshot->type = mirror->type;
+        snapshot->int_value = mirror->int_value;
+        snapshot->float_value = mirror->float_value;
+        snapshot->bool_value = mirror->bool_value;
+        snapshot->string_len = mirror->string_len;
+        snapshot->is_restored = mirror->is_restored;
+        if (buffer && snapshot->type == TBCMH_SCALAR_STRING && snapshot->string_len < size) {
+            memcpy(buffer, mirror->string, snapshot->string_len);
+            buffer[snapshot->string_len] = '\0';
+        }
+        atomic_thread_fence(memory_order_acquire);
+    } while ((seq & 1) || seq != atomic_load_explicit(&mirror->seq, memory_order_relaxed));
+
+    snapshot->seq = seq;
+    return seq / 2;
+}
+
+uint32_t tbcmh_attributemirror_get_version(tbcmh_attributemirror_handle_t mirror)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(mirror, 0);
+    return atomic_load_explicit(&mirror->seq, memory_order_acquire) / 2;
+}
+
+bool tbcmh_attributemirror_is_restored(tbcmh_attributemirror_handle_t mirror)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(mirror, false);
+
+    attributemirror_snapshot_t snapshot;
+    _attributemirror_read(mirror, &snapshot, NULL, 0);
+    return snapshot.type != TBCMH_SCALAR_NULL && snapshot.is_restored;
+}
+
+tbc_err_t tbcmh_attributemirror_get_int(tbcmh_attributemirror_handle_t mirror,
+                                        int64_t *value, uint32_t *version)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(mirror, ESP_FAIL);
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(value, ESP_FAIL);
+
+    attributemirror_snapshot_t snapshot;
+    uint32_t ver = _attributemirror_read(mirror, &snapshot, NULL, 0);
+    switch (snapshot.type) {
+    case TBCMH_SCALAR_INT:   *value = snapshot.int_value; break;
+    case TBCMH_SCALAR_FLOAT: *value = (int64_t)snapshot.float_value; break;
+    case TBCMH_SCALAR_BOOL:  *value = snapshot.bool_value ? 1 : 0; break;
+    default:                 return ESP_FAIL;
+    }
+    if (version) {
+        *version = ver;
+    }
+    return ESP_OK;
+}
+
+tbc_err_t tbcmh_attributemirror_get_float(tbcmh_attributemirror_handle_t mirror,
+                                        double *value, uint32_t *version)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(mirror, ESP_FAIL);
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(value, ESP_FAIL);
+
+    attributemirror_snapshot_t snapshot;
+    uint32_t ver = _attributemirror_read(mirror, &snapshot, NULL, 0);
+    switch (snapshot.type) {
+    case TBCMH_SCALAR_INT:
+    case TBCMH_SCALAR_FLOAT: *value = snapshot.float_value; break;
+    case TBCMH_SCALAR_BOOL:  *value = snapshot.bool_value ? 1 : 0; break;
+    default:                 return ESP_FAIL;
+    }
+    if (version) {
+        *version = ver;
+    }
+    return ESP_OK;
+}
+
+tbc_err_t tbcmh_attributemirror_get_bool(tbcmh_attributemirror_handle_t mirror,
+                                        bool *value, uint32_t *version)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(mirror, ESP_FAIL);
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(value, ESP_FAIL);
+
+    attributemirror_snapshot_t snapshot;
+    uint32_t ver = _attributemirror_read(mirror, &snapshot, NULL, 0);
+    switch (snapshot.type) {
+    case TBCMH_SCALAR_INT:
+    case TBCMH_SCALAR_FLOAT: *value = (snapshot.float_value != 0); break;
+    case TBCMH_SCALAR_BOOL:  *value = snapshot.bool_value; break;
+    default:                 return ESP_FAIL;
+    }
+    if (version) {
+        *version = ver;
+    }
+    return ESP_OK;
+}
+
+tbc_err_t tbcmh_attributemirror_get_string(tbcmh_attributemirror_handle_t mirror,
+                                        char *buffer, int size, uint32_t *version)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(mirror, ESP_FAIL);
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(buffer, ESP_FAIL);
+
+    attributemirror_snapshot_t snapshot;
+    uint32_t ver = _attributemirror_read(mirror, &snapshot, buffer, size);
+    if (snapshot.type != TBCMH_SCALAR_STRING) {
+        return ESP_FAIL;
+    }
+    if (snapshot.string_len >= size) {
+        TBC_LOGW("Buffer is too small (%d<=%d) for attribute:%s! %s()",
+                 size, snapshot.string_len, mirror->key, __FUNCTION__);
+        return ESP_FAIL;
+    }
+    if (version) {
+        *version = ver;
+    }
+    return ESP_OK;
+}
+
+//==== Snapshot store API =======================================================
+
+tbc_err_t tbcmh_attributemirror_store_open(tbcmh_handle_t client,
+                                        const tbcmh_attributemirror_store_config_t *config)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(client, ESP_FAIL);
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(config, ESP_FAIL);
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(config->path, ESP_FAIL);
+
+    // Take semaphore
+    if (xSemaphoreTakeRecursive(client->_lock, (TickType_t)0xFFFFF) != pdTRUE) {
+         TBC_LOGE("Unable to take semaphore! %s()", __FUNCTION__);
+         return ESP_FAIL;
+    }
+
+    attributemirrorstore_t *store = &client->attributemirrorstore;
+    if (store->is_opened) {
+         TBC_LOGE("Snapshot of attributes is already opened! %s()", __FUNCTION__);
+         xSemaphoreGiveRecursive(client->_lock);
+         return ESP_FAIL;
+    }
+
+    int path_len = strlen(config->path);
+    store->path = TBC_MALLOC(path_len + 1);
+    store->temp_path = TBC_MALLOC(path_len + 5);
+    if (!store->path || !store->temp_path) {
+         TBC_LOGE("Unable to malloc memeory! %s()", __FUNCTION__);
+         goto attributemirrorstore_fail;
+    }
+    memcpy(store->path, config->path, path_len + 1);
+    snprintf(store->temp_path, path_len + 5, "%s.tmp", config->path);
+    memcpy(&store->config, config, sizeof(store->config));
+    store->config.path = store->path;
+
+    // "<path>.tmp" is complete if snapshot file is missing, see _attributemirrorstore_save()
+    cJSON *object = _attributemirrorstore_load(store->path);
+    if (!object) {
+         object = _attributemirrorstore_load(store->temp_path);
+         if (object) {
+              rename(store->temp_path, store->path);
+         }
+    }
+    if (object) {
+         double ts = cJSON_GetNumberValue(cJSON_GetObjectItem(object, "ts"));
+         store->restored_ts = (ts > 0) ? (int64_t)ts : 0; // NaN if missing
+         cJSON *client_attributes = cJSON_DetachItemFromObjectCaseSensitive(object, "client");
+         cJSON *shared_attributes = cJSON_DetachItemFromObjectCaseSensitive(object, "shared");
+         store->client_attributes = cJSON_IsObject(client_attributes) ? client_attributes : NULL;
+         store->shared_attributes = cJSON_IsObject(shared_attributes) ? shared_attributes : NULL;
+         if (!store->client_attributes) {
+              cJSON_Delete(client_attributes);
+         }
+         if (!store->shared_attributes) {
+              cJSON_Delete(shared_attributes);
+         }
+         cJSON_Delete(object);
+    }
+    if (!store->client_attributes) {
+         store->client_attributes = cJSON_CreateObject();
+    }
+    if (!store->shared_attributes) {
+         store->shared_attributes = cJSON_CreateObject();
+    }
+    if (!store->client_attributes || !store->shared_attributes) {
+         TBC_LOGE("Unable to malloc memeory! %s()", __FUNCTION__);
+         goto attributemirrorstore_fail;
+    }
+    store->is_dirty = false;
+    store->last_save_time = esp_timer_get_time();
+    store->is_opened = true;
+
+    // Mirrors start with the last known values
+    attributemirror_t *mirror = NULL;
+    LIST_FOREACH(mirror, &client->attributemirror_list, entry) {
+         _attributemirrorstore_restore(store, mirror);
+    }
+    TBC_LOGI("Snapshot of attributes is opened, client=%d, shared=%d, ts=%lld",
+             cJSON_GetArraySize(store->client_attributes),
+             cJSON_GetArraySize(store->shared_attributes), (long long)store->restored_ts);
+
+    // Give semaphore
+    xSemaphoreGiveRecursive(client->_lock);
+    return ESP_OK;
+
+attributemirrorstore_fail:
+    TBC_FIELD_FREE(store->path);
+    TBC_FIELD_FREE(store->temp_path);
+    cJSON_Delete(store->client_attributes);
+    cJSON_Delete(store->shared_attributes);
+    memset(store, 0x00, sizeof(attributemirrorstore_t));
+    xSemaphoreGiveRecursive(client->_lock);
+    return ESP_FAIL;
+}
+
+void tbcmh_attributemirror_store_close(tbcmh_handle_t client)
+{
+    TBC_CHECK_PTR(client);
+
+    // Take semaphore
+    if (xSemaphoreTakeRecursive(client->_lock, (TickType_t)0xFFFFF) != pdTRUE) {
+         TBC_LOGE("Unable to take semaphore! %s()", __FUNCTION__);
+         return;
+    }
+
+    attributemirrorstore_t *store = &client->attributemirrorstore;
+    if (store->is_opened && store->is_dirty) {
+         _attributemirrorstore_save(client);
+    }
+    TBC_FIELD_FREE(store->path);
+    TBC_FIELD_FREE(store->temp_path);
+    cJSON_Delete(store->client_attributes);
+    cJSON_Delete(store->shared_attributes);
+    memset(store, 0x00, sizeof(attributemirrorstore_t));
+
+    // Give semaphore
+    xSemaphoreGiveRecursive(client->_lock);
+}
+
+int64_t tbcmh_attributemirror_get_snapshot_age(tbcmh_handle_t client)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(client, -1);
+
+    attributemirrorstore_t *store = &client->attributemirrorstore;
+    int64_t now = _attributemirrorstore_now_ms(client);
+    int64_t ts = store->restored_ts;
+    if (!store->is_opened || ts <= 0 || now <= 0 || now < ts) {
+        return -1;
+    }
+    return now - ts;
+}
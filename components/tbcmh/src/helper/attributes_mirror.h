@@ -0,0 +1,97 @@
+// Copyright 2022 liangzhuzhi2020@gmail.com, https://github.com/liang-zhu-zi/esp32-thingsboard-mqtt-client
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// This file is called by tbc_mqtt_helper.c/.h.
+
+#ifndef _ATTRIBUTES_MIRROR_H_
+#define _ATTRIBUTES_MIRROR_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#include "sys/queue.h"
+#include "tbc_utils.h"
+#include "tbc_mqtt_helper.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Local mirror of a device attribute, see tbcmh_attributemirror_add()
+ *
+ * It is written by tbcmh_run() and read in any task without lock:
+ * seq is odd while it is written, and a reader retries if seq is changed during its read.
+ */
+typedef struct tbcmh_attributemirror
+{
+     tbcmh_key_t key;          /*!< Interned key */
+     bool is_shared;           /*!< shared attribute if true, otherwise client-side attribute */
+     int subscribe_id;         /*!< subscription of shared attribute, -1 if none */
+
+     atomic_uint seq;          /*!< seqlock sequence, seq/2 is version, i.e. count of updates */
+     tbcmh_scalar_type_t type; /*!< type of value, TBCMH_SCALAR_NULL before it is received */
+     int64_t int_value;        /*!< TBCMH_SCALAR_INT */
+     double float_value;       /*!< TBCMH_SCALAR_INT & TBCMH_SCALAR_FLOAT */
+     bool bool_value;          /*!< TBCMH_SCALAR_BOOL */
+     int string_len;           /*!< TBCMH_SCALAR_STRING, length of string */
+     int max_string_len;       /*!< capacity of string, exclude '\0'. 0 if strings are not mirrored */
+     char *string;             /*!< TBCMH_SCALAR_STRING, max_string_len+1 bytes */
+     bool is_restored;         /*!< value is restored from snapshot, not yet received in this run */
+
+     LIST_ENTRY(tbcmh_attributemirror) entry;
+} attributemirror_t;
+
+typedef LIST_HEAD(tbcmh_attributemirror_list, tbcmh_attributemirror) attributemirror_list_t;
+
+#define TBCMH_ATTRIBUTEMIRROR_STORE_SAVE_INTERVAL  (10*1000)  /*!< default min interval between saves, in ms */
+#define TBCMH_ATTRIBUTEMIRROR_STORE_MAX_KEYS       (64)       /*!< default max count of keys of each scope */
+#define TBCMH_ATTRIBUTEMIRROR_STORE_MAX_SIZE       (16*1024)  /*!< snapshot file larger than it is ignored */
+
+/**
+ * Snapshot of attributes persisted for warm start, see tbcmh_attributemirror_store_open().
+ * Snapshot file is {"ts":..,"client":{..},"shared":{..}}. It is written to "<path>.tmp" then renamed,
+ * so a power loss never leaves a torn snapshot.
+ */
+typedef struct attributemirrorstore
+{
+     bool is_opened;                                /*!< tbcmh_attributemirror_store_open() is called */
+     tbcmh_attributemirror_store_config_t config;   /*!< config, path points to path */
+     char *path;                                    /*!< path of snapshot file */
+     char *temp_path;                               /*!< path of snapshot file being written */
+     cJSON *client_attributes;                      /*!< last known client-side attributes, all keys */
+     cJSON *shared_attributes;                      /*!< last known shared attributes, mirrored keys only */
+     int64_t restored_ts;                           /*!< unix ms when the restored snapshot was saved, 0 if none */
+     bool is_dirty;                                 /*!< changed since last save */
+     int64_t last_save_time;                        /*!< esp_timer_get_time() of the last save, in us */
+} attributemirrorstore_t;
+
+void _tbcmh_attributemirror_on_create(tbcmh_handle_t client);
+void _tbcmh_attributemirror_on_destroy(tbcmh_handle_t client);
+void _tbcmh_attributemirror_on_response(tbcmh_handle_t client,
+                                        const cJSON *client_attributes,
+                                        const cJSON *shared_attributes);
+void _tbcmh_attributemirror_on_publish(tbcmh_handle_t client, const cJSON *object);
+void _tbcmh_attributemirror_on_publish_payload(tbcmh_handle_t client, const char *payload, int len);
+void _tbcmh_attributemirror_on_run(tbcmh_handle_t client);
+
+int _tbcmh_attributemirror_restore_keys(tbcmh_handle_t client, const char *client_keys,
+                                        char **fetch_keys, cJSON **restored);
+
+#ifdef __cplusplus
+}
+#endif //__cplusplus
+
+#endif
@@ -53,10 +53,224 @@ static tbc_err_t _attributesrequest_destroy(attributesrequest_t *attributesreque
 {
     TBC_CHECK_PTR_WITH_RETURN_VALUE(attributesrequest, ESP_FAIL);
 
+    _tbcmh_keyintern_release_names(attributesrequest->restored);
+    cJSON_Delete(attributesrequest->restored);
     TBC_FREE(attributesrequest);
     return ESP_OK;
 }
 
+//==== Combined attributes request at connect time ===================================
+
+static void _attributesrequestbatch_destroy(attributesrequestbatch_t *batch)
+{
+    attributesrequestmember_t *member = NULL, *next;
+    LIST_FOREACH_SAFE(member, &batch->member_list, entry, next) {
+         LIST_REMOVE(member, entry);
+         TBC_FIELD_FREE(member->client_keys);
+         TBC_FIELD_FREE(member->shared_keys);
+         TBC_FREE(member);
+    }
+    TBC_FIELD_FREE(batch->client_keys);
+    TBC_FIELD_FREE(batch->shared_keys);
+    TBC_FREE(batch);
+}
+
+static bool _attributesrequestbatch_has_key(const char *keys, const char *key, int key_len)
+{
+    const char *begin = keys;
+    while (*begin) {
+         const char *end = strchr(begin, ',');
+         if (!end) {
+              end = begin + strlen(begin);
+         }
+         if (end - begin == key_len && strncmp(begin, key, key_len) == 0) {
+              return true;
+         }
+         begin = *end ? end + 1 : end;
+    }
+    return false;
+}
+
+// Append comma separated new_keys which aren't in *keys yet
+static bool _attributesrequestbatch_add_keys(char **keys, const char *new_keys)
+{
+    if (!new_keys || !new_keys[0]) {
+         return true;
+    }
+
+    int len = *keys ? strlen(*keys) : 0;
+    char *merged = TBC_MALLOC(len + strlen(new_keys) + 2);
+    if (!merged) {
+         TBC_LOGE("Unable to malloc memeory! %s()", __FUNCTION__);
+         return false;
+    }
+    if (len > 0) {
+         memcpy(merged, *keys, len);
+    }
+    merged[len] = '\0';
+
+    const char *begin = new_keys;
+    while (*begin) {
+         const char *end = strchr(begin, ',');
+         if (!end) {
+              end = begin + strlen(begin);
+         }
+         const char *key = begin;
+         int key_len = end - begin;
+         while (key_len > 0 && key[0] == ' ') {
+              key++;
+              key_len--;
+         }
+         while (key_len > 0 && key[key_len - 1] == ' ') {
+              key_len--;
+         }
+         if (key_len > 0 && !_attributesrequestbatch_has_key(merged, key, key_len)) {
+              if (len > 0) {
+                   merged[len++] = ',';
+              }
+              memcpy(merged + len, key, key_len);
+              len += key_len;
+              merged[len] = '\0';
+         }
+         begin = *end ? end + 1 : end;
+    }
+
+    TBC_FIELD_FREE(*keys);
+    *keys = merged;
+    return true;
+}
+
+// Join a request into the combined request. This function is in client->_lock!!!
+static tbc_err_t _attributesrequestbatch_add(attributesrequestbatch_t *batch,
+                                 void *context,
+                                 tbcmh_attributes_on_response_t on_response,
+                                 tbcmh_attributes_on_timeout_t on_timeout,
+                                 const char *client_keys, const char *shared_keys)
+{
+    // A request with the same callbacks & context, e.g. an extension requesting key by key,
+    // is merged into the same member, so that it is answered once
+    attributesrequestmember_t *member = NULL;
+    LIST_FOREACH(member, &batch->member_list, entry) {
+         if (member->on_response == on_response && member->on_timeout == on_timeout
+             && member->context == context) {
+              break;
+         }
+    }
+    if (member) {
+         return (_attributesrequestbatch_add_keys(&member->client_keys, client_keys)
+                 && _attributesrequestbatch_add_keys(&member->shared_keys, shared_keys)
+                 && _attributesrequestbatch_add_keys(&batch->client_keys, client_keys)
+                 && _attributesrequestbatch_add_keys(&batch->shared_keys, shared_keys)) ? ESP_OK : ESP_FAIL;
+    }
+
+    member = TBC_MALLOC(sizeof(attributesrequestmember_t));
+    if (!member) {
+         TBC_LOGE("Unable to malloc memeory! %s()", __FUNCTION__);
+         return ESP_FAIL;
+    }
+    memset(member, 0x00, sizeof(attributesrequestmember_t));
+    member->context = context;
+    member->on_response = on_response;
+    member->on_timeout = on_timeout;
+
+    if (!_attributesrequestbatch_add_keys(&member->client_keys, client_keys)
+        || !_attributesrequestbatch_add_keys(&member->shared_keys, shared_keys)
+        || !_attributesrequestbatch_add_keys(&batch->client_keys, client_keys)
+        || !_attributesrequestbatch_add_keys(&batch->shared_keys, shared_keys)) {
+         TBC_FIELD_FREE(member->client_keys);
+         TBC_FIELD_FREE(member->shared_keys);
+         TBC_FREE(member);
+         return ESP_FAIL;
+    }
+
+    // Insert member to list, keep the order of calls
+    attributesrequestmember_t *it, *last = NULL;
+    if (LIST_FIRST(&batch->member_list) == NULL) {
+         LIST_INSERT_HEAD(&batch->member_list, member, entry);
+    } else {
+         LIST_FOREACH(it, &batch->member_list, entry) {
+              last = it;
+         }
+         if (it == NULL) {
+              assert(last);
+              LIST_INSERT_AFTER(last, member, entry);
+         }
+    }
+    batch->count++;
+    return ESP_OK;
+}
+
+// Members of attributes which are in keys, by reference. return NULL if keys is NULL
+static cJSON *_attributesrequestbatch_filter(tbcmh_handle_t client, const cJSON *attributes, const char *keys)
+{
+    if (!keys) {
+         return NULL;
+    }
+    cJSON *filtered = cJSON_CreateObject(); // create json object
+    if (!filtered) {
+         TBC_LOGE("Unable to malloc memeory! %s()", __FUNCTION__);
+         return NULL;
+    }
+
+    cJSON *item = NULL;
+    cJSON_ArrayForEach(item, attributes) {
+         if (item->string && _attributesrequestbatch_has_key(keys, item->string, strlen(item->string))) {
+              cJSON_AddItemReferenceToObject(filtered, item->string, item);
+         }
+    }
+    // Members are named by interned keys, as same as a response of its own
+    _tbcmh_keyintern_canonicalize(client, filtered);
+    return filtered;
+}
+
+static void _attributesrequestbatch_free_filtered(cJSON *filtered)
+{
+    _tbcmh_keyintern_release_names(filtered);
+    cJSON_Delete(filtered); // references only
+}
+
+// Dispatch the response to all members. Each member is answered with its own keys only.
+static void _attributesrequestbatch_on_response(tbcmh_handle_t client,
+                                 void *context,
+                                 const cJSON *client_attributes,
+                                 const cJSON *shared_attributes)
+{
+    attributesrequestbatch_t *batch = (attributesrequestbatch_t *)context;
+    TBC_CHECK_PTR(batch);
+
+    attributesrequestmember_t *member = NULL;
+    LIST_FOREACH(member, &batch->member_list, entry) {
+         if (!member->on_response) {
+              continue;
+         }
+         cJSON *member_client_attributes = _attributesrequestbatch_filter(client, client_attributes,
+                                                                          member->client_keys);
+         cJSON *member_shared_attributes = _attributesrequestbatch_filter(client, shared_attributes,
+                                                                          member->shared_keys);
+         member->on_response(client, member->context, member_client_attributes, member_shared_attributes);
+         _attributesrequestbatch_free_filtered(member_client_attributes);
+         _attributesrequestbatch_free_filtered(member_shared_attributes);
+    }
+    _attributesrequestbatch_destroy(batch);
+}
+
+static tbc_err_t _attributesrequestbatch_on_timeout(tbcmh_handle_t client, void *context)
+{
+    attributesrequestbatch_t *batch = (attributesrequestbatch_t *)context;
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(batch, ESP_FAIL);
+
+    attributesrequestmember_t *member = NULL;
+    LIST_FOREACH(member, &batch->member_list, entry) {
+         if (member->on_timeout) {
+              member->on_timeout(client, member->context);
+         }
+    }
+    _attributesrequestbatch_destroy(batch);
+    return ESP_OK;
+}
+
+//==== Attributes request ==============================================================
+
 void _tbcmh_attributesrequest_on_create(tbcmh_handle_t client)
 {
     // This function is in semaphore/client->_lock!!!
@@ -70,6 +284,7 @@ void _tbcmh_attributesrequest_on_create(tbcmh_handle_t client)
 
     // list create
     memset(&client->attributesrequest_list, 0x00, sizeof(client->attributesrequest_list)); //client->attributesrequest_list = LIST_HEAD_INITIALIZER(client->attributesrequest_list);
+    memset(&client->attributesrequest_local_list, 0x00, sizeof(client->attributesrequest_local_list));
 
     // Give semaphore
     // xSemaphoreGiveRecursive(client->_lock);
@@ -88,6 +303,18 @@ void _tbcmh_attributesrequest_on_destroy(tbcmh_handle_t client)
 
     memset(&client->attributesrequest_list, 0x00, sizeof(client->attributesrequest_list));
 
+    attributesrequest_t *attributesrequest = NULL, *next;
+    LIST_FOREACH_SAFE(attributesrequest, &client->attributesrequest_local_list, entry, next) {
+         LIST_REMOVE(attributesrequest, entry);
+         _attributesrequest_destroy(attributesrequest);
+    }
+    memset(&client->attributesrequest_local_list, 0x00, sizeof(client->attributesrequest_local_list));
+
+    if (client->attributesrequest_batch) {
+         _attributesrequestbatch_destroy(client->attributesrequest_batch);
+         client->attributesrequest_batch = NULL;
+    }
+
     // Give semaphore
     // xSemaphoreGiveRecursive(client->_lock);
 }
@@ -96,6 +323,17 @@ void _tbcmh_attributesrequest_on_connected(tbcmh_handle_t client)
 {
     // This function is in semaphore/client->_lock!!!
     TBC_CHECK_PTR(client);
+
+    // Collect requests of modules & on_connected(), until _tbcmh_attributesrequest_batch_send()
+    if (!client->attributesrequest_batch) {
+         attributesrequestbatch_t *batch = TBC_MALLOC(sizeof(attributesrequestbatch_t));
+         if (!batch) {
+              TBC_LOGW("Unable to malloc memeory, attributes requests aren't combined! %s()", __FUNCTION__);
+              return;
+         }
+         memset(batch, 0x00, sizeof(attributesrequestbatch_t));
+         client->attributesrequest_batch = batch;
+    }
 }
 
 void _tbcmh_attributesrequest_on_disconnected(tbcmh_handle_t client)
@@ -109,6 +347,13 @@ void _tbcmh_attributesrequest_on_disconnected(tbcmh_handle_t client)
     //      return;
     // }
 
+    // collected requests are never sent
+    if (client->attributesrequest_batch) {
+         attributesrequestbatch_t *batch = client->attributesrequest_batch;
+         client->attributesrequest_batch = NULL;
+         _attributesrequestbatch_on_timeout(client, batch);
+    }
+
     // remove all item in attributesrequest_list
     _tbcmh_attributesrequest_on_check_timeout(client, (uint64_t)time(NULL)+ TB_MQTT_TIMEOUT + 2);
     memset(&client->attributesrequest_list, 0x00, sizeof(client->attributesrequest_list));
@@ -140,6 +385,37 @@ tbc_err_t tbcmh_attributes_request(tbcmh_handle_t client,
          goto attributesrequest_fail;
      }
 
+     // Joined into one request at connect time
+     if (client->attributesrequest_batch) {
+          tbc_err_t result = _attributesrequestbatch_add(client->attributesrequest_batch,
+                                context, on_response, on_timeout, client_keys, shared_keys);
+          xSemaphoreGiveRecursive(client->_lock);
+          return result;
+     }
+
+     // Client-side attributes are owned by the device, those in snapshot needn't be fetched
+     char *fetch_keys = NULL;
+     cJSON *restored = NULL;
+     if (_tbcmh_attributemirror_restore_keys(client, client_keys, &fetch_keys, &restored) > 0) {
+          client_keys = fetch_keys[0] ? fetch_keys : NULL;
+     }
+
+     // All are restored, it is answered in tbcmh_run()
+     if (!client_keys && !shared_keys) {
+          TBC_FIELD_FREE(fetch_keys);
+          attributesrequest_t *attributesrequest = _attributesrequest_create(client, 0,
+                                context, on_response, on_timeout);
+          if (!attributesrequest) {
+               TBC_LOGE("Init attributesrequest failure! %s()", __FUNCTION__);
+               cJSON_Delete(restored);
+               goto attributesrequest_fail;
+          }
+          attributesrequest->restored = restored;
+          LIST_INSERT_HEAD(&client->attributesrequest_local_list, attributesrequest, entry);
+          xSemaphoreGiveRecursive(client->_lock);
+          return ESP_OK;
+     }
+
      // NOTE: It must subscribe response topic, then send request!
      // Subscript topic <===  empty->non-empty
      if (tbcmh_is_connected(client) && LIST_EMPTY(&client->attributesrequest_list)) {
@@ -153,8 +429,10 @@ tbc_err_t tbcmh_attributes_request(tbcmh_handle_t client,
      uint32_t request_id = _tbcmh_get_request_id(client);
      int msg_id = tbcm_attributes_request_ex(client->tbmqttclient, client_keys, shared_keys,
                                request_id, 1/*qos*/, 0/*retain*/);
+     TBC_FIELD_FREE(fetch_keys);
      if (msg_id<0) {
           TBC_LOGE("Init tbcm_attributes_request failure! %s()", __FUNCTION__);
+          cJSON_Delete(restored);
           goto attributesrequest_fail;
      }
 
@@ -163,8 +441,10 @@ tbc_err_t tbcmh_attributes_request(tbcmh_handle_t client,
                                 context, on_response, on_timeout);
      if (!attributesrequest) {
           TBC_LOGE("Init attributesrequest failure! %s()", __FUNCTION__);
+          cJSON_Delete(restored);
           goto attributesrequest_fail;
      }
+     attributesrequest->restored = restored;
 
      // Insert attributesrequest to list
      attributesrequest_t *it, *last = NULL;
@@ -242,53 +522,15 @@ tbc_err_t tbcmh_clientattributes_request(tbcmh_handle_t client,
      }
      va_end(ap);
 
-    // NOTE: It must subscribe response topic, then send request!
-    // Subscript topic <===  empty->non-empty
-    if (tbcmh_is_connected(client) && LIST_EMPTY(&client->attributesrequest_list)) {
-       int msg_id = tbcm_subscribe(client->tbmqttclient,
-                                TB_MQTT_TOPIC_ATTRIBUTES_RESPONSE_SUBSCRIBE, 0);
-       TBC_LOGI("sent subscribe successful, msg_id=%d, topic=%s",
-                                msg_id, TB_MQTT_TOPIC_ATTRIBUTES_RESPONSE_SUBSCRIBE);
-    }
-
-     // Send msg to server
-     uint32_t request_id = _tbcmh_get_request_id(client);
-     int msg_id = tbcm_attributes_request_ex(client->tbmqttclient, client_keys, NULL,
-                               request_id, 1/*qos*/, 0/*retain*/);
-     if (msg_id<0) {
-          TBC_LOGE("Init tbcm_attributes_request failure! %s()", __FUNCTION__);
-          goto attributesrequest_of_client_fail;
-     }
-
-     // Create attributesrequest
-     attributesrequest_t *attributesrequest = _attributesrequest_create(client, request_id,
-                                context, on_response, on_timeout);
-     if (!attributesrequest) {
-          TBC_LOGE("Init attributesrequest failure! %s()", __FUNCTION__);
-          goto attributesrequest_of_client_fail;
-     }
-
-     // Insert attributesrequest to list
-     attributesrequest_t *it, *last = NULL;
-     if (LIST_FIRST(&client->attributesrequest_list) == NULL) {
-          // Insert head
-          LIST_INSERT_HEAD(&client->attributesrequest_list, attributesrequest, entry);
-     } else {
-          // Insert last
-          LIST_FOREACH(it, &client->attributesrequest_list, entry) {
-               last = it;
-          }
-          if (it == NULL) {
-               assert(last);
-               LIST_INSERT_AFTER(last, attributesrequest, entry);
-          }
-     }
+     // Send msg to server, or answer it by snapshot
+     tbc_err_t result = tbcmh_attributes_request(client, context, on_response, on_timeout,
+                               client_keys, NULL);
 
      // Give semaphore
      xSemaphoreGiveRecursive(client->_lock);
 
      TBC_FREE(client_keys);
-     return ESP_OK;
+     return result;
 
 attributesrequest_of_client_fail:
      xSemaphoreGiveRecursive(client->_lock);
@@ -349,54 +591,16 @@ tbc_err_t tbcmh_sharedattributes_request(tbcmh_handle_t client,
         }
      }
      va_end(ap);
-     
-     // NOTE: It must subscribe response topic, then send request!
-     // Subscript topic <===  empty->non-empty
-     if (tbcmh_is_connected(client) && LIST_EMPTY(&client->attributesrequest_list)) {
-        int msg_id = tbcm_subscribe(client->tbmqttclient,
-                                TB_MQTT_TOPIC_ATTRIBUTES_RESPONSE_SUBSCRIBE, 0);
-        TBC_LOGI("sent subscribe successful, msg_id=%d, topic=%s",
-                                msg_id, TB_MQTT_TOPIC_ATTRIBUTES_RESPONSE_SUBSCRIBE);
-     }
 
      // Send msg to server
-     uint32_t request_id = _tbcmh_get_request_id(client);
-     int msg_id = tbcm_attributes_request_ex(client->tbmqttclient, NULL, shared_keys,
-                               request_id, 1/*qos*/, 0/*retain*/);
-     if (msg_id<0) {
-          TBC_LOGE("Init tbcm_attributes_request failure! %s()", __FUNCTION__);
-          goto attributesrequest_of_shared_fail;
-     }
-
-     // Create attributesrequest
-     attributesrequest_t *attributesrequest = _attributesrequest_create(client, request_id,
-                                context, on_response, on_timeout);
-     if (!attributesrequest) {
-          TBC_LOGE("Init attributesrequest failure! %s()", __FUNCTION__);
-          goto attributesrequest_of_shared_fail;
-     }
-
-     // Insert attributesrequest to list
-     attributesrequest_t *it, *last = NULL;
-     if (LIST_FIRST(&client->attributesrequest_list) == NULL) {
-          // Insert head
-          LIST_INSERT_HEAD(&client->attributesrequest_list, attributesrequest, entry);
-     } else {
-          // Insert last
-          LIST_FOREACH(it, &client->attributesrequest_list, entry) {
-               last = it;
-          }
-          if (it == NULL) {
-               assert(last);
-               LIST_INSERT_AFTER(last, attributesrequest, entry);
-          }
-     }
+     tbc_err_t result = tbcmh_attributes_request(client, context, on_response, on_timeout,
+                               NULL, shared_keys);
 
      // Give semaphore
      xSemaphoreGiveRecursive(client->_lock);
 
      TBC_FREE(shared_keys);
-     return ESP_OK;
+     return result;
 
 attributesrequest_of_shared_fail:
      xSemaphoreGiveRecursive(client->_lock);
@@ -440,16 +644,41 @@ void _tbcmh_attributesrequest_on_data(tbcmh_handle_t client, uint32_t request_id
      // Give semaphore
      // xSemaphoreGiveRecursive(client->_lock);
 
-     if (!attributesrequest) {
-          TBC_LOGW("Unable to find attribute request:%u! %s()", request_id, __FUNCTION__);
-          return;
-     }
-
      // foreach item to set value of clientattribute in lock/unlodk.  Don't call tbcmh's funciton in set value callback!
      //int result = 0;
      cJSON *client_attributes = cJSON_GetObjectItem(object, TB_MQTT_KEY_ATTRIBUTES_RESPONSE_CLIENT);
      // foreach item to set value of sharedattribute in lock/unlodk.  Don't call tbcmh's funciton in set value callback!
      cJSON *shared_attributes = cJSON_GetObjectItem(object, TB_MQTT_KEY_ATTRIBUTES_RESPONSE_SHARED);
+     // Members are named by interned keys, so that they are matched by pointer
+     _tbcmh_keyintern_canonicalize(client, client_attributes);
+     _tbcmh_keyintern_canonicalize(client, shared_attributes);
+
+     // Values are fresh even if the request is timed out
+     _tbcmh_attributemirror_on_response(client, client_attributes, shared_attributes);
+
+     if (!attributesrequest) {
+          TBC_LOGW("Unable to find attribute request:%u! %s()", request_id, __FUNCTION__);
+          _tbcmh_keyintern_release_names(client_attributes);
+          _tbcmh_keyintern_release_names(shared_attributes);
+          return;
+     }
+     cJSON *response_client_attributes = client_attributes;
+
+     // Restored values are answered together with fetched ones
+     if (attributesrequest->restored) {
+          cJSON *item = NULL;
+          cJSON_ArrayForEach(item, client_attributes) {
+               cJSON *copy = cJSON_Duplicate(item, true);
+               if (copy && item->string) {
+                    cJSON_DeleteItemFromObjectCaseSensitive(attributesrequest->restored, item->string);
+                    cJSON_AddItemToObject(attributesrequest->restored, item->string, copy);
+               } else {
+                    cJSON_Delete(copy);
+               }
+          }
+          _tbcmh_keyintern_canonicalize(client, attributesrequest->restored);
+          client_attributes = attributesrequest->restored;
+     }
 
      // Do response
      if (attributesrequest->on_response) { //result != 2 &&  //result is equal to 2 if calling tbcmh_disconnect()/tbcmh_destroy() inside _tbcmh_attributessubscribe_on_data() --> on_set()
@@ -459,6 +688,8 @@ void _tbcmh_attributesrequest_on_data(tbcmh_handle_t client, uint32_t request_id
      }
 
      // Free cache
+     _tbcmh_keyintern_release_names(response_client_attributes);
+     _tbcmh_keyintern_release_names(shared_attributes);
      _attributesrequest_destroy(attributesrequest);
 }
 
@@ -523,3 +754,69 @@ void _tbcmh_attributesrequest_on_check_timeout(tbcmh_handle_t client, uint64_t t
      }
 }
 
+
+// Answer requests whose keys are all restored from snapshot
+void _tbcmh_attributesrequest_on_run(tbcmh_handle_t client)
+{
+     TBC_CHECK_PTR(client);
+
+     if (LIST_EMPTY(&client->attributesrequest_local_list)) {
+          return;
+     }
+
+     // Take semaphore
+     if (xSemaphoreTakeRecursive(client->_lock, (TickType_t)0xFFFFF) != pdTRUE) {
+          TBC_LOGE("Unable to take semaphore! %s()", __FUNCTION__);
+          return;
+     }
+
+     // on_response() may send another request
+     attributesrequest_t *attributesrequest = NULL;
+     while ((attributesrequest = LIST_FIRST(&client->attributesrequest_local_list))) {
+          LIST_REMOVE(attributesrequest, entry);
+          _tbcmh_keyintern_canonicalize(client, attributesrequest->restored);
+          if (attributesrequest->on_response) {
+               attributesrequest->on_response(attributesrequest->client,
+                                   attributesrequest->context,
+                                   attributesrequest->restored, NULL);
+          }
+          _attributesrequest_destroy(attributesrequest);
+     }
+
+     // Give semaphore
+     xSemaphoreGiveRecursive(client->_lock);
+}
+
+// Send requests collected at connect time as one request
+void _tbcmh_attributesrequest_batch_send(tbcmh_handle_t client)
+{
+     TBC_CHECK_PTR(client);
+
+     // Take semaphore
+     if (xSemaphoreTakeRecursive(client->_lock, (TickType_t)0xFFFFF) != pdTRUE) {
+          TBC_LOGE("Unable to take semaphore! %s()", __FUNCTION__);
+          return;
+     }
+
+     attributesrequestbatch_t *batch = client->attributesrequest_batch;
+     client->attributesrequest_batch = NULL;
+     if (!batch || batch->count == 0) {
+          if (batch) {
+               _attributesrequestbatch_destroy(batch);
+          }
+          xSemaphoreGiveRecursive(client->_lock);
+          return;
+     }
+
+     TBC_LOGI("Send %d attributes requests as one, clientKeys=%s, sharedKeys=%s", batch->count,
+              batch->client_keys ? batch->client_keys : "", batch->shared_keys ? batch->shared_keys : "");
+     if (tbcmh_attributes_request(client, batch, _attributesrequestbatch_on_response,
+                                  _attributesrequestbatch_on_timeout,
+                                  batch->client_keys, batch->shared_keys) != ESP_OK) {
+          // members are told by timeout, they got ESP_OK already
+          _attributesrequestbatch_on_timeout(client, batch);
+     }
+
+     // Give semaphore
+     xSemaphoreGiveRecursive(client->_lock);
+}
@@ -39,18 +39,50 @@ typedef struct attributesrequest
      void *context;                                     /*!< Context of callback*/
      tbcmh_attributes_on_response_t on_response; /*!< Callback of dealing successful */
      tbcmh_attributes_on_timeout_t on_timeout;   /*!< Callback of response timeout */
+     cJSON *restored;                                   /*!< client-side attributes answered by snapshot, not fetched */
 
      LIST_ENTRY(attributesrequest) entry;
 } attributesrequest_t;
 
 typedef LIST_HEAD(tbcmh_attributesrequest_list, attributesrequest) attributesrequest_list_t;
 
+/**
+ * Requests with the same on_response & context joined into the combined attributes request
+ * at connect time. It is answered once with its own keys only.
+ */
+typedef struct attributesrequestmember
+{
+     void *context;                              /*!< Context of callback*/
+     tbcmh_attributes_on_response_t on_response; /*!< Callback of dealing successful */
+     tbcmh_attributes_on_timeout_t on_timeout;   /*!< Callback of response timeout */
+     char *client_keys;                          /*!< keys of this member only, NULL if none */
+     char *shared_keys;                          /*!< keys of this member only, NULL if none */
+
+     LIST_ENTRY(attributesrequestmember) entry;
+} attributesrequestmember_t;
+
+typedef LIST_HEAD(tbcmh_attributesrequestmember_list, attributesrequestmember) attributesrequestmember_list_t;
+
+/**
+ * Attributes requests of all modules at connect time, they are sent as one request and
+ * the response is dispatched to each of them
+ */
+typedef struct attributesrequestbatch
+{
+     char *client_keys;                          /*!< comma separated keys without duplicates, NULL if none */
+     char *shared_keys;                          /*!< comma separated keys without duplicates, NULL if none */
+     int count;                                  /*!< count of members */
+     attributesrequestmember_list_t member_list; /*!< joined requests, in the order of calls */
+} attributesrequestbatch_t;
+
 void _tbcmh_attributesrequest_on_create(tbcmh_handle_t client);
 void _tbcmh_attributesrequest_on_destroy(tbcmh_handle_t client);
 void _tbcmh_attributesrequest_on_connected(tbcmh_handle_t client);
+void _tbcmh_attributesrequest_batch_send(tbcmh_handle_t client);
 void _tbcmh_attributesrequest_on_disconnected(tbcmh_handle_t client);
 void _tbcmh_attributesrequest_on_data(tbcmh_handle_t client, uint32_t request_id, const cJSON *object);
 void _tbcmh_attributesrequest_on_check_timeout(tbcmh_handle_t client, uint64_t timestamp);
+void _tbcmh_attributesrequest_on_run(tbcmh_handle_t client);
 
 #ifdef __cplusplus
 }
@@ -41,10 +41,7 @@ static tbc_err_t _subscribekey_list_append(
     }
 
     memset(subscribekey, 0x00, sizeof(subscribekey_t));
-    subscribekey->key = TBC_MALLOC(strlen(key)+1);
-    if (subscribekey->key) {
-        strcpy(subscribekey->key, key);
-    }
+    subscribekey->key = tbcmh_key_intern(key);
 
     // Insert subscribekey to list
     subscribekey_t *it, *last = NULL;
@@ -74,18 +71,59 @@ static tbc_err_t _subscribekey_list_empty(subscribekey_list_t *subscribekey_list
     LIST_FOREACH_SAFE(subscribekey, subscribekey_list, entry, next) {
          // remove from subscribekey list and free
          LIST_REMOVE(subscribekey, entry);
-         TBC_FREE(subscribekey->key);
+         tbcmh_key_release(subscribekey->key);
          TBC_FREE(subscribekey);
     }
 
     return ESP_OK;
 }
 
+#define _ATTRIBUTESSUBSCRIBE_BUCKET(client, key) \
+     (&(client)->attributessubscribe_index[tbcmh_key_hash(key) & (TBCMH_ATTRIBUTESSUBSCRIBE_BUCKETS - 1)])
+
+// Add keys of attributessubscribe to key index of client
+static void _attributessubscribe_index_add(tbcmh_handle_t client, attributessubscribe_t *attributessubscribe)
+{
+    subscribekey_t *subscribekey = NULL;
+    LIST_FOREACH(subscribekey, &attributessubscribe->key_list, entry) {
+         if (subscribekey->key) {
+              subscribekey->attributessubscribe = attributessubscribe;
+              LIST_INSERT_HEAD(_ATTRIBUTESSUBSCRIBE_BUCKET(client, subscribekey->key), subscribekey, index_entry);
+         }
+    }
+}
+
+// Remove keys of attributessubscribe from key index of client
+static void _attributessubscribe_index_remove(attributessubscribe_t *attributessubscribe)
+{
+    subscribekey_t *subscribekey = NULL;
+    LIST_FOREACH(subscribekey, &attributessubscribe->key_list, entry) {
+         if (subscribekey->key) {
+              LIST_REMOVE(subscribekey, index_entry);
+         }
+    }
+}
+
+// Mark subscriptions of key by mark
+static void _attributessubscribe_index_mark(tbcmh_handle_t client, tbcmh_key_t key, uint32_t mark)
+{
+    subscribekey_t *subscribekey = NULL;
+    LIST_FOREACH(subscribekey, _ATTRIBUTESSUBSCRIBE_BUCKET(client, key), index_entry) {
+         if (subscribekey->key == key) {
+              subscribekey->attributessubscribe->mark = mark;
+         }
+    }
+}
+
 static attributessubscribe_t *_attributessubscribe_create(
                                         void *context,
-                                        tbcmh_attributes_on_update_t on_update)
+                                        tbcmh_attributes_on_update_t on_update,
+                                        tbcmh_attributes_on_stream_t on_stream)
 {
-    TBC_CHECK_PTR_WITH_RETURN_VALUE(on_update, NULL);
+    if (!on_update && !on_stream) {
+        TBC_LOGE("on_update and on_stream are NULL! %s()", __FUNCTION__);
+        return NULL;
+    }
     
     attributessubscribe_t *attributessubscribe = TBC_MALLOC(sizeof(attributessubscribe_t));
     if (!attributessubscribe) {
@@ -98,6 +136,7 @@ static attributessubscribe_t *_attributessubscribe_create(
     memset(&attributessubscribe->key_list, 0x00, sizeof(attributessubscribe->key_list));
     attributessubscribe->context = context;
     attributessubscribe->on_update = on_update;
+    attributessubscribe->on_stream = on_stream;
     return attributessubscribe;
 }
 
@@ -111,6 +150,21 @@ static tbc_err_t _attributessubscribe_destroy(attributessubscribe_t *attributess
     return ESP_OK;
 }
 
+static void _attributesstream_free(tbcmh_handle_t client)
+{
+    attributesstream_t *stream = client->attributesstream;
+    if (!stream) {
+        return;
+    }
+
+    client->attributesstream = NULL;
+    _tbcmh_jsonbuilder_clear(&stream->builder);
+    _tbcmh_keyintern_release_names(stream->object);
+    cJSON_Delete(stream->object);
+    tbcmh_key_release(stream->top_key);
+    TBC_FREE(stream);
+}
+
 void _tbcmh_attributessubscribe_on_create(tbcmh_handle_t client)
 {
     // This function is in semaphore/client->_lock!!!
@@ -124,6 +178,9 @@ void _tbcmh_attributessubscribe_on_create(tbcmh_handle_t client)
     
     // list create
     memset(&client->attributessubscribe_list, 0x00, sizeof(client->attributessubscribe_list)); //client->attributessubscribe_list = LIST_HEAD_INITIALIZER(client->attributessubscribe_list);
+    memset(client->attributessubscribe_index, 0x00, sizeof(client->attributessubscribe_index));
+    client->attributessubscribe_mark = 0;
+    client->attributesstream = NULL;
 
     // Give semaphore
     // xSemaphoreGiveRecursive(client->_lock);
@@ -148,50 +205,22 @@ void _tbcmh_attributessubscribe_on_destroy(tbcmh_handle_t client)
          _attributessubscribe_destroy(attributessubscribe);
     }
     memset(&client->attributessubscribe_list, 0x00, sizeof(client->attributessubscribe_list));
+    memset(client->attributessubscribe_index, 0x00, sizeof(client->attributessubscribe_index));
+    _attributesstream_free(client);
 
     // Give semaphore
     // xSemaphoreGiveRecursive(client->_lock);
 }
 
-int tbcmh_attributes_subscribe(tbcmh_handle_t client,
-                                        void *context,
-                                        tbcmh_attributes_on_update_t on_update,
-                                        int count, /*const char *key,*/...)
+// Insert attributessubscribe to list & key index, and subscribe the topic if it is the first one.
+// return subscribe_id
+static int _attributessubscribe_insert(tbcmh_handle_t client, attributessubscribe_t *attributessubscribe)
 {
-    TBC_CHECK_PTR_WITH_RETURN_VALUE(client, ESP_FAIL);
-    TBC_CHECK_PTR_WITH_RETURN_VALUE(on_update, ESP_FAIL);
-
-    // Take semaphore
-    if (xSemaphoreTakeRecursive(client->_lock, (TickType_t)0xFFFFF) != pdTRUE) {
-         TBC_LOGE("Unable to take semaphore! %s()", __FUNCTION__);
-         return ESP_FAIL;
-    }
-
-    // Create attributessubscribe
-    attributessubscribe_t *attributessubscribe = _attributessubscribe_create(context, on_update);
-    if (!attributessubscribe) {
-         // Give semaphore
-         xSemaphoreGiveRecursive(client->_lock);
-         TBC_LOGE("Init attributessubscribe failure! %s()", __FUNCTION__);
-         return ESP_FAIL;
-    }
-
-    // Append key
-    if (count>0) {
-        va_list ap;
-        va_start(ap, count);
-        int i = 0;
-        for (i=0; i<count; i++) {
-            // insert key to attributessubscribe
-            const char *key = va_arg(ap, const char*);
-            _subscribekey_list_append(&attributessubscribe->key_list, key);
-        }
-        va_end(ap);
-    }
-
+    // This function is in semaphore/client->_lock!!!
     bool isEmptyBefore = LIST_EMPTY(&client->attributessubscribe_list);
 
-    // Insert attributessubscribe to list
+    // Insert attributessubscribe to list & key index
+    _attributessubscribe_index_add(client, attributessubscribe);
     attributessubscribe_t *it, *last = NULL;
     if (LIST_FIRST(&client->attributessubscribe_list) == NULL) {
          // Insert head
@@ -215,19 +244,16 @@ int tbcmh_attributes_subscribe(tbcmh_handle_t client,
                 msg_id, TB_MQTT_TOPIC_SHARED_ATTRIBUTES);
     }
 
-    // Give semaphore
-    xSemaphoreGiveRecursive(client->_lock);
     return attributessubscribe->subscribe_id;
 }
 
-int tbcmh_attributes_subscribe_of_array(tbcmh_handle_t client, //int qos /*=0*/,
+// Subscribe keys of an array by on_update or on_stream
+static int _attributessubscribe_of_array(tbcmh_handle_t client,
                                         void *context,
                                         tbcmh_attributes_on_update_t on_update,
+                                        tbcmh_attributes_on_stream_t on_stream,
                                         int count, const char *keys[])
 {
-    TBC_CHECK_PTR_WITH_RETURN_VALUE(client, ESP_FAIL);
-    TBC_CHECK_PTR_WITH_RETURN_VALUE(on_update, ESP_FAIL);
-
     // Take semaphore
     if (xSemaphoreTakeRecursive(client->_lock, (TickType_t)0xFFFFF) != pdTRUE) {
          TBC_LOGE("Unable to take semaphore! %s()", __FUNCTION__);
@@ -235,7 +261,7 @@ int tbcmh_attributes_subscribe_of_array(tbcmh_handle_t client, //int qos /*=0*/,
     }
 
     // Create attributessubscribe
-    attributessubscribe_t *attributessubscribe = _attributessubscribe_create(context, on_update);
+    attributessubscribe_t *attributessubscribe = _attributessubscribe_create(context, on_update, on_stream);
     if (!attributessubscribe) {
          // Give semaphore
          xSemaphoreGiveRecursive(client->_lock);
@@ -249,35 +275,76 @@ int tbcmh_attributes_subscribe_of_array(tbcmh_handle_t client, //int qos /*=0*/,
         _subscribekey_list_append(&attributessubscribe->key_list, keys[i]);
     }
 
-    bool isEmptyBefore = LIST_EMPTY(&client->attributessubscribe_list);
+    int subscribe_id = _attributessubscribe_insert(client, attributessubscribe);
 
-    // Insert attributessubscribe to list
-    attributessubscribe_t *it, *last = NULL;
-    if (LIST_FIRST(&client->attributessubscribe_list) == NULL) {
-         // Insert head
-         LIST_INSERT_HEAD(&client->attributessubscribe_list, attributessubscribe, entry);
-    } else {
-         // Insert last
-         LIST_FOREACH(it, &client->attributessubscribe_list, entry) {
-              last = it;
-         }
-         if (it == NULL) {
-              assert(last);
-              LIST_INSERT_AFTER(last, attributessubscribe, entry);
-         }
+    // Give semaphore
+    xSemaphoreGiveRecursive(client->_lock);
+    return subscribe_id;
+}
+
+int tbcmh_attributes_subscribe(tbcmh_handle_t client,
+                                        void *context,
+                                        tbcmh_attributes_on_update_t on_update,
+                                        int count, /*const char *key,*/...)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(client, ESP_FAIL);
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(on_update, ESP_FAIL);
+
+    // Take semaphore
+    if (xSemaphoreTakeRecursive(client->_lock, (TickType_t)0xFFFFF) != pdTRUE) {
+         TBC_LOGE("Unable to take semaphore! %s()", __FUNCTION__);
+         return ESP_FAIL;
     }
 
-    // Subscript topic <===  empty->non-empty
-    if (tbcmh_is_connected(client) && isEmptyBefore && !LIST_EMPTY(&client->attributessubscribe_list))
-    {
-        int msg_id = tbcm_subscribe(client->tbmqttclient, TB_MQTT_TOPIC_SHARED_ATTRIBUTES, 0);
-        TBC_LOGI("sent subscribe successful, msg_id=%d, topic=%s",
-                msg_id, TB_MQTT_TOPIC_SHARED_ATTRIBUTES);
+    // Create attributessubscribe
+    attributessubscribe_t *attributessubscribe = _attributessubscribe_create(context, on_update, NULL);
+    if (!attributessubscribe) {
+         // Give semaphore
+         xSemaphoreGiveRecursive(client->_lock);
+         TBC_LOGE("Init attributessubscribe failure! %s()", __FUNCTION__);
+         return ESP_FAIL;
+    }
+
+    // Append key
+    if (count>0) {
+        va_list ap;
+        va_start(ap, count);
+        int i = 0;
+        for (i=0; i<count; i++) {
+            // insert key to attributessubscribe
+            const char *key = va_arg(ap, const char*);
+            _subscribekey_list_append(&attributessubscribe->key_list, key);
+        }
+        va_end(ap);
     }
 
+    int subscribe_id = _attributessubscribe_insert(client, attributessubscribe);
+
     // Give semaphore
     xSemaphoreGiveRecursive(client->_lock);
-    return attributessubscribe->subscribe_id;
+    return subscribe_id;
+}
+
+int tbcmh_attributes_subscribe_of_array(tbcmh_handle_t client, //int qos /*=0*/,
+                                        void *context,
+                                        tbcmh_attributes_on_update_t on_update,
+                                        int count, const char *keys[])
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(client, ESP_FAIL);
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(on_update, ESP_FAIL);
+
+    return _attributessubscribe_of_array(client, context, on_update, NULL, count, keys);
+}
+
+int tbcmh_attributes_subscribe_stream(tbcmh_handle_t client,
+                                        void *context,
+                                        tbcmh_attributes_on_stream_t on_stream,
+                                        int count, const char *keys[])
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(client, ESP_FAIL);
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(on_stream, ESP_FAIL);
+
+    return _attributessubscribe_of_array(client, context, NULL, on_stream, count, keys);
 }
 
 /**
@@ -314,8 +381,9 @@ tbc_err_t tbcmh_attributes_unsubscribe(tbcmh_handle_t client, int attributes_sub
     attributessubscribe_t *attributessubscribe = NULL, *next;
     LIST_FOREACH_SAFE(attributessubscribe, &client->attributessubscribe_list, entry, next) {
          if (attributessubscribe && attributessubscribe->subscribe_id == attributes_subscribe_id) {
-             // Remove form list
+             // Remove form list & key index
              LIST_REMOVE(attributessubscribe, entry);
+             _attributessubscribe_index_remove(attributessubscribe);
              _attributessubscribe_destroy(attributessubscribe);
              break;
          }
@@ -349,50 +417,134 @@ void _tbcmh_attributessubscribe_on_disconnected(tbcmh_handle_t client)
 {
     // This function is in semaphore/client->_lock!!!
     TBC_CHECK_PTR(client);
-    //no code
+
+    // the rest fragments will never arrive
+    _attributesstream_free(client);
 }
 
 //on received: unpack & deal
 // return 2 if calling tbcmh_disconnect()/tbcmh_destroy() inside on_update()
 // return 1 if calling tbcmh_sharedattribute_unregister()/tbcmh_attributes_unsubscribe inside on_update()
 // return 0 otherwise
-int _tbcmh_attributessubscribe_on_data(tbcmh_handle_t client, const cJSON *object)
+// return the subscribed key if key of a top-level member is subscribed, otherwise NULL
+static tbcmh_key_t _attributessubscribe_find_key(tbcmh_handle_t client, const char *key, int key_len)
 {
-     TBC_CHECK_PTR_WITH_RETURN_VALUE(client, 0);
-     TBC_CHECK_PTR_WITH_RETURN_VALUE(object, 0);
+     subscribekey_t *subscribekey = NULL;
+     bool is_escaped = (memchr(key, '\\', key_len) != NULL);
+     if (!is_escaped) {
+          tbcmh_key_t interned = tbcmh_key_find(key, key_len);
+          if (!interned) {
+               return NULL;
+          }
+          LIST_FOREACH(subscribekey, _ATTRIBUTESSUBSCRIBE_BUCKET(client, interned), index_entry) {
+               if (subscribekey->key == interned && subscribekey->attributessubscribe->on_update) {
+                    return subscribekey->key;
+               }
+          }
+          return NULL;
+     }
+
+     // Keys with escapes aren't interned as is, compare them char by char
+     int i;
+     for (i=0; i<TBCMH_ATTRIBUTESSUBSCRIBE_BUCKETS; i++) {
+          LIST_FOREACH(subscribekey, &client->attributessubscribe_index[i], index_entry) {
+               if (subscribekey->attributessubscribe->on_update
+                   && _tbcmh_jsonscanner_equals(key, key_len, subscribekey->key)) {
+                    return subscribekey->key;
+               }
+          }
+     }
+     return NULL;
+}
 
+// Parse subscribed members of shared attributes only.
+// return NULL if no member is subscribed
+static cJSON *_attributessubscribe_parse(tbcmh_handle_t client, const char *payload, int length)
+{
+     // A subscription without keys wants all shared attributes
+     attributessubscribe_t *attributessubscribe = NULL;
+     LIST_FOREACH(attributessubscribe, &client->attributessubscribe_list, entry) {
+          if (attributessubscribe->on_update && LIST_EMPTY(&attributessubscribe->key_list)) {
+               cJSON *object = _tbcmh_jsonarena_parse(client, payload, length);
+               _tbcmh_keyintern_canonicalize(client, object);
+               return object;
+          }
+     }
+
+     jsonscanner_t scanner;
+     if (!_tbcmh_jsonscanner_init(&scanner, payload, length)) {
+          TBC_LOGW("Shared attributes is not a json object! %s()", __FUNCTION__);
+          return NULL;
+     }
+
+     cJSON *object = NULL;
+     const char *key = NULL, *value = NULL;
+     int key_len = 0, value_len = 0;
+     while (_tbcmh_jsonscanner_next(&scanner, &key, &key_len, &value, &value_len)) {
+          tbcmh_key_t subscribed_key = _attributessubscribe_find_key(client, key, key_len);
+          if (!subscribed_key) {
+               continue;
+          }
+
+          cJSON *item = _tbcmh_jsonarena_parse(client, value, value_len);
+          if (!item) {
+               TBC_LOGW("Unable to parse shared attribute:%s! %s()", subscribed_key, __FUNCTION__);
+               continue;
+          }
+          if (!object) {
+               object = _tbcmh_jsonarena_create_object(client); // create json object
+          }
+          if (!object) {
+               _tbcmh_jsonarena_delete(client, item);
+               continue;
+          }
+          // Named by the interned key, it isn't copied but referenced
+          if (!cJSON_AddItemToObjectCS(object, _tbcmh_keyintern_retain(subscribed_key), item)) {
+               tbcmh_key_release(subscribed_key);
+               _tbcmh_jsonarena_delete(client, item);
+          }
+     }
+     return object;
+}
+
+static int _attributessubscribe_do_update(tbcmh_handle_t client, const cJSON *object)
+{
      // Take semaphore
      // if (xSemaphoreTakeRecursive(client->_lock, (TickType_t)0xFFFFF) != pdTRUE) {
      //      TBC_LOGE("Unable to take semaphore! %s()", __FUNCTION__);
      //      return 0;
      // }
 
+     // Mark subscriptions of members by key index, each member is looked up once
+     uint32_t mark = ++client->attributessubscribe_mark;
+     const cJSON *item = NULL;
+     cJSON_ArrayForEach(item, object) {
+          tbcmh_key_t key = tbcmh_key_of_item(item);
+          if (key) {
+               _attributessubscribe_index_mark(client, key, mark);
+          }
+     }
+
      // foreach itme to set value of attributessubscribe in lock/unlodk.  Don't call tbcmh's funciton in set value callback!
      tbc_err_t result = 0;
      attributessubscribe_t *attributessubscribe = NULL, *next;
      LIST_FOREACH_SAFE(attributessubscribe, &client->attributessubscribe_list, entry, next) {
-          if (attributessubscribe) {
+          if (attributessubscribe && attributessubscribe->on_update) {
                if (LIST_EMPTY(&attributessubscribe->key_list)) {
                     attributessubscribe->on_update(client, attributessubscribe->context, object);
                     continue;
                }
 
-               subscribekey_t *subscribekey = NULL, *next;
-               LIST_FOREACH_SAFE(subscribekey, &attributessubscribe->key_list, entry, next) {
-                   if (cJSON_HasObjectItem(object, subscribekey->key)) {
-                        if (attributessubscribe->on_update) {
-                            result = attributessubscribe->on_update(client, attributessubscribe->context, object); //cJSON *value = cJSON_GetObjectItem(object, key);
-                            if (result==2) { //called tbcmh_disconnect()/tbcmh_destroy() inside on_set()
-                                // Give semaphore
-                                // xSemaphoreGiveRecursive(client->_lock);
-                                return 2;
-                            }
-                            if (result==1) { //called tbcmh_attributes_unsubscribe() inside on_set()
-                                return 1;
-                            }
-                        }
-                        break;
-                   }
+               if (attributessubscribe->mark == mark) {
+                    result = attributessubscribe->on_update(client, attributessubscribe->context, object); //cJSON *value = cJSON_GetObjectItem(object, key);
+                    if (result==2) { //called tbcmh_disconnect()/tbcmh_destroy() inside on_set()
+                         // Give semaphore
+                         // xSemaphoreGiveRecursive(client->_lock);
+                         return 2;
+                    }
+                    if (result==1) { //called tbcmh_attributes_unsubscribe() inside on_set()
+                         return 1;
+                    }
                }
           }
      }
@@ -402,3 +554,218 @@ int _tbcmh_attributessubscribe_on_data(tbcmh_handle_t client, const cJSON *objec
      return result;
 }
 
+int _tbcmh_attributessubscribe_on_data(tbcmh_handle_t client, const char *payload, int length)
+{
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(client, 0);
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(payload, 0);
+
+     if (LIST_EMPTY(&client->attributessubscribe_list)) {
+          return 0;
+     }
+
+     // JSON events are delivered to on_stream(), so parse it as a single fragment
+     attributessubscribe_t *attributessubscribe = NULL;
+     LIST_FOREACH(attributessubscribe, &client->attributessubscribe_list, entry) {
+          if (attributessubscribe->on_stream) {
+               return _tbcmh_attributessubscribe_on_fragment(client, payload, length, 0, length);
+          }
+     }
+
+     // Skip parsing if none of shared attributes is subscribed
+     cJSON *object = _attributessubscribe_parse(client, payload, length);
+     if (!object) {
+          TBC_LOGD("None of shared attributes is subscribed! %s()", __FUNCTION__);
+          return 0;
+     }
+
+     int result = _attributessubscribe_do_update(client, object);
+     _tbcmh_keyintern_release_names(object);
+     _tbcmh_jsonarena_delete(client, object); // delete json object
+     return result;
+}
+
+
+// return true if the member being streamed is subscribed by attributessubscribe,
+// subscriptions of it are marked when it begins
+static bool _attributessubscribe_has_key(tbcmh_handle_t client, attributessubscribe_t *attributessubscribe)
+{
+     return LIST_EMPTY(&attributessubscribe->key_list)
+            || attributessubscribe->mark == client->attributessubscribe_mark;
+}
+
+typedef struct attributesstream_context
+{
+     tbcmh_handle_t client;
+     int result;               /*!< 2 or 1 if returned by on_stream() */
+} attributesstream_context_t;
+
+// return false to stop parsing
+static bool _attributesstream_on_event(void *context, const tbcmh_json_event_t *event)
+{
+     attributesstream_context_t *stream_context = (attributesstream_context_t *)context;
+     tbcmh_handle_t client = stream_context->client;
+     attributesstream_t *stream = client->attributesstream;
+
+     // the top-level object
+     if (event->depth == 0) {
+          if (event->type != TBCMH_JSON_EVENT_OBJECT_BEGIN && event->type != TBCMH_JSON_EVENT_OBJECT_END) {
+               TBC_LOGW("Shared attributes is not a json object! %s()", __FUNCTION__);
+               return false;
+          }
+          return true;
+     }
+
+     // the value of a top-level member begins
+     attributessubscribe_t *attributessubscribe = NULL;
+     if (event->depth == 1 && !stream->is_in_member) {
+          stream->is_in_member = true;
+          tbcmh_key_release(stream->top_key);
+          stream->top_key = _tbcmh_keyintern_acquire(event->top_key, strlen(event->top_key));
+          stream->is_building = false;
+          uint32_t mark = ++client->attributessubscribe_mark;
+          if (stream->top_key) { // subscribed keys are always interned
+               _attributessubscribe_index_mark(client, stream->top_key, mark);
+          }
+          LIST_FOREACH(attributessubscribe, &client->attributessubscribe_list, entry) {
+               if (attributessubscribe->on_update && _attributessubscribe_has_key(client, attributessubscribe)) {
+                    stream->is_building = true;
+                    break;
+               }
+          }
+     }
+     // the value of a top-level member ends
+     if (event->depth == 1
+         && event->type != TBCMH_JSON_EVENT_OBJECT_BEGIN && event->type != TBCMH_JSON_EVENT_ARRAY_BEGIN
+         && !event->is_partial) {
+          stream->is_in_member = false;
+     }
+
+     // build it for on_update()
+     if (stream->is_building) {
+          cJSON *value = NULL;
+          if (!_tbcmh_jsonbuilder_add(&stream->builder, event, &value)) {
+               TBC_LOGW("Unable to build shared attribute:%s! %s()", event->top_key, __FUNCTION__);
+               _tbcmh_jsonbuilder_clear(&stream->builder);
+               stream->is_building = false;
+          } else if (value) {
+               if (!stream->object) {
+                    stream->object = cJSON_CreateObject(); // create json object
+               }
+               // Named by the interned key, it isn't copied
+               bool is_added = false;
+               if (stream->object) {
+                    is_added = stream->top_key ? cJSON_AddItemToObjectCS(stream->object,
+                                                                         _tbcmh_keyintern_retain(stream->top_key), value)
+                                               : cJSON_AddItemToObject(stream->object, event->top_key, value);
+               }
+               if (!is_added) {
+                    if (stream->object && stream->top_key) {
+                         tbcmh_key_release(stream->top_key);
+                    }
+                    cJSON_Delete(value);
+               }
+          }
+     }
+
+     // deliver it to on_stream()
+     tbcmh_json_event_t stream_event = *event;
+     if (stream->top_key) {
+          stream_event.top_key = stream->top_key;
+     }
+     uint32_t seq = ++stream->event_seq;
+     attributessubscribe = LIST_FIRST(&client->attributessubscribe_list);
+     while (attributessubscribe) {
+          if (attributessubscribe->delivered == seq || !attributessubscribe->on_stream
+              || !_attributessubscribe_has_key(client, attributessubscribe)) {
+               attributessubscribe = LIST_NEXT(attributessubscribe, entry);
+               continue;
+          }
+          attributessubscribe->delivered = seq;
+          int result = attributessubscribe->on_stream(client, attributessubscribe->context, &stream_event);
+          if (result==2) { //called tbcmh_disconnect()/tbcmh_destroy() inside on_stream()
+               stream_context->result = 2;
+               return false;
+          }
+          if (result==1) { //called tbcmh_attributes_unsubscribe() inside on_stream()
+               // the list is changed, walk the updated one again. the delivered ones are skipped
+               stream_context->result = 1;
+               attributessubscribe = LIST_FIRST(&client->attributessubscribe_list);
+               continue;
+          }
+          attributessubscribe = LIST_NEXT(attributessubscribe, entry);
+     }
+     return true;
+}
+
+// Parse shared attributes fragment by fragment. Fragments must arrive in order.
+// return 2 if calling tbcmh_disconnect()/tbcmh_destroy() inside on_update()/on_stream()
+// return 1 if calling tbcmh_attributes_unsubscribe() inside on_update()/on_stream()
+// return 0 otherwise
+int _tbcmh_attributessubscribe_on_fragment(tbcmh_handle_t client, const char *payload, int length,
+                                           int payload_offset, int total_payload_len)
+{
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(client, 0);
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(payload, 0);
+
+     // the first fragment
+     if (payload_offset == 0) {
+          _attributesstream_free(client);
+          if (LIST_EMPTY(&client->attributessubscribe_list)) {
+               return 0;
+          }
+          client->attributesstream = TBC_MALLOC(sizeof(attributesstream_t));
+          if (!client->attributesstream) {
+               TBC_LOGE("Unable to malloc memeory! %s()", __FUNCTION__);
+               return 0;
+          }
+          memset(client->attributesstream, 0x00, sizeof(attributesstream_t));
+          _tbcmh_jsonsax_init(&client->attributesstream->sax, _attributesstream_on_event);
+          _tbcmh_jsonbuilder_init(&client->attributesstream->builder);
+     }
+     if (!client->attributesstream) {
+          TBC_LOGD("Skip fragment of dropped shared attributes! %s()", __FUNCTION__);
+          return 0;
+     }
+     if (client->attributesstream->next_offset != payload_offset) {
+          TBC_LOGW("Fragment of shared attributes is lost! %s()", __FUNCTION__);
+          _attributesstream_free(client);
+          return 0;
+     }
+     client->attributesstream->next_offset += length;
+
+     attributesstream_context_t stream_context = {client, 0};
+     if (!_tbcmh_jsonsax_feed(&client->attributesstream->sax, payload, length, &stream_context)) {
+          if (stream_context.result == 2) {
+               return 2; // client may be destroyed, don't touch it
+          }
+          if (stream_context.result != 1) {
+               TBC_LOGW("Unable to parse shared attributes! %s()", __FUNCTION__);
+          }
+          _attributesstream_free(client);
+          return stream_context.result;
+     }
+     if (payload_offset + length < total_payload_len) {
+          return 0;
+     }
+
+     // the last fragment
+     attributesstream_t *stream = client->attributesstream;
+     bool is_done = _tbcmh_jsonsax_is_done(&stream->sax);
+     cJSON *object = stream->object;
+     stream->object = NULL;
+     _attributesstream_free(client);
+     if (!is_done) {
+          TBC_LOGW("Shared attributes is incomplete! %s()", __FUNCTION__);
+          _tbcmh_keyintern_release_names(object);
+          cJSON_Delete(object);
+          return 0;
+     }
+     if (!object) {
+          return 0;
+     }
+
+     int result = _attributessubscribe_do_update(client, object);
+     _tbcmh_keyintern_release_names(object);
+     cJSON_Delete(object); // delete json object
+     return result;
+}
@@ -22,15 +22,22 @@
 
 #include "sys/queue.h"
 #include "tbc_mqtt_helper.h"
+#include "json_sax.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+#define TBCMH_ATTRIBUTESSUBSCRIBE_BUCKETS  (16)  /*!< hash buckets of key index of subscriptions, must be power of 2 */
+
+struct attributessubscribe;
+
 typedef struct subscribekey
 {
-     char *key; /*!< Key */
+     tbcmh_key_t key; /*!< Interned key */
+     struct attributessubscribe *attributessubscribe; /*!< subscription which owns this key */
      LIST_ENTRY(subscribekey) entry;
+     LIST_ENTRY(subscribekey) index_entry; /*!< entry in key index of client, see attributessubscribe_index */
 } subscribekey_t;
 
 typedef LIST_HEAD(subscribekey_list, subscribekey) subscribekey_list_t;
@@ -45,17 +52,37 @@ typedef struct attributessubscribe
      subscribekey_list_t key_list;         /*!< A list of some keys */
      void *context;                        /*!< Context of getting/setting value*/
      tbcmh_attributes_on_update_t on_update; /*!< Callback of setting value to context */
+     tbcmh_attributes_on_stream_t on_stream; /*!< Callback of each JSON event, instead of on_update */
+     uint32_t mark;                        /*!< equal to attributessubscribe_mark if one of its keys is in the payload being dispatched */
+     uint32_t delivered;                   /*!< equal to event_seq of attributesstream if the event being streamed is delivered to it */
 
      LIST_ENTRY(attributessubscribe) entry;
 } attributessubscribe_t;
 
 typedef LIST_HEAD(tbcmh_attributessubscribe_list, attributessubscribe) attributessubscribe_list_t;
 
+/**
+ * Parsing state of shared attributes which are streamed fragment by fragment
+ */
+typedef struct attributesstream
+{
+     jsonsax_t sax;            /*!< incremental parser of payload */
+     jsonbuilder_t builder;    /*!< builder of the member being parsed, for on_update() */
+     int next_offset;          /*!< offset of the next fragment, a lost fragment drops the whole payload */
+     tbcmh_key_t top_key;      /*!< interned key of the member being parsed, NULL if it isn't interned */
+     bool is_in_member;        /*!< the value of a top-level member is being parsed */
+     bool is_building;         /*!< the member being parsed is built for on_update() */
+     cJSON *object;            /*!< members built for on_update() */
+     uint32_t event_seq;       /*!< sequence of the event being delivered to on_stream() */
+} attributesstream_t;
+
 void _tbcmh_attributessubscribe_on_create(tbcmh_handle_t client);
 void _tbcmh_attributessubscribe_on_destroy(tbcmh_handle_t client);
 void _tbcmh_attributessubscribe_on_connected(tbcmh_handle_t client);
 void _tbcmh_attributessubscribe_on_disconnected(tbcmh_handle_t client);
-int  _tbcmh_attributessubscribe_on_data(tbcmh_handle_t client, const cJSON *object);
+int  _tbcmh_attributessubscribe_on_data(tbcmh_handle_t client, const char *payload, int length);
+int  _tbcmh_attributessubscribe_on_fragment(tbcmh_handle_t client, const char *payload, int length,
+                                            int payload_offset, int total_payload_len);
 
 
 #ifdef __cplusplus
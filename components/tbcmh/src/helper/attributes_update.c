@@ -30,6 +30,9 @@ int tbcmh_attributes_update(tbcmh_handle_t client, const char *attributes,
 {
     TBC_CHECK_PTR_WITH_RETURN_VALUE(client, ESP_FAIL);
     TBC_CHECK_PTR_WITH_RETURN_VALUE(attributes, ESP_FAIL);
+    if (!_tbcmh_txwriter_check_json(client, __FUNCTION__)) {
+        return ESP_FAIL;
+    }
 
     // Take semaphore
     if (xSemaphoreTakeRecursive(client->_lock, (TickType_t)0xFFFFF) != pdTRUE) {
@@ -39,6 +42,9 @@ int tbcmh_attributes_update(tbcmh_handle_t client, const char *attributes,
 
     // send package...
     int msg_id = tbcm_clientattributes_publish(client->tbmqttclient, attributes, qos, retain);
+    if (msg_id >= 0) {
+        _tbcmh_attributemirror_on_publish_payload(client, attributes, strlen(attributes));
+    }
 
     // Give semaphore
     xSemaphoreGiveRecursive(client->_lock);
@@ -51,11 +57,7 @@ int tbcmh_attributes_update_ex(tbcmh_handle_t client, tbcmh_value_t *object,
      TBC_CHECK_PTR_WITH_RETURN_VALUE(client, ESP_FAIL);
      TBC_CHECK_PTR_WITH_RETURN_VALUE(object, ESP_FAIL);
 
-     // send package...
-     char *pack = cJSON_PrintUnformatted(object); //cJSON_Print()
-     int msg_id = tbcmh_attributes_update(client, pack, qos/*= 1*/, retain/*= 0*/);
-     cJSON_free(pack); // free memory
-
-     return msg_id;
+     // send package... print to the reusable TX buffer instead of cJSON_PrintUnformatted()
+     return _tbcmh_txwriter_publish_object(client, TBCMH_TX_ATTRIBUTES, object, qos/*= 1*/, retain/*= 0*/);
 }
 
@@ -267,10 +267,11 @@ tbc_err_t tbcmh_twoway_clientrpc_request(tbcmh_handle_t client, const char *meth
 }
 
 //on response
-void _tbcmh_clientrpc_on_data(tbcmh_handle_t client, uint32_t request_id, const cJSON *object)
+void _tbcmh_clientrpc_on_data(tbcmh_handle_t client, uint32_t request_id,
+                              const char *payload, int length)
 {
      TBC_CHECK_PTR(client);
-     TBC_CHECK_PTR(object);
+     TBC_CHECK_PTR(payload);
 
      // Take semaphore
      // if (xSemaphoreTakeRecursive(client->_lock, (TickType_t)0xFFFFF) != pdTRUE) {
@@ -305,11 +306,18 @@ void _tbcmh_clientrpc_on_data(tbcmh_handle_t client, uint32_t request_id, const
           return;
      }
 
-     // Do response
+     // Do response. Parse results only, after the request is matched
      if (clientrpc->on_response) {
+        const char *value = NULL;
+        int value_len = 0;
+        cJSON *results = NULL;
+        if (_tbcmh_jsonscanner_find(payload, length, TB_MQTT_KEY_RPC_RESULTS, &value, &value_len)) {
+            results = _tbcmh_jsonarena_parse(client, value, value_len);
+        }
         clientrpc->on_response(clientrpc->client, clientrpc->context,
                             clientrpc->method, //clientrpc->request_id,
-                            cJSON_GetObjectItem(object, TB_MQTT_KEY_RPC_RESULTS));
+                            results);
+        _tbcmh_jsonarena_delete(client, results); // delete json object
      }
 
      // Free cache
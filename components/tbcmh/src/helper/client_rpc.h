@@ -53,7 +53,7 @@ void _tbcmh_clientrpc_on_create(tbcmh_handle_t client);
 void _tbcmh_clientrpc_on_destroy(tbcmh_handle_t client);
 void _tbcmh_clientrpc_on_connected(tbcmh_handle_t client);
 void _tbcmh_clientrpc_on_disconnected(tbcmh_handle_t client);
-void _tbcmh_clientrpc_on_data(tbcmh_handle_t client, uint32_t request_id, const cJSON *object);
+void _tbcmh_clientrpc_on_data(tbcmh_handle_t client, uint32_t request_id, const char *payload, int length);
 void _tbcmh_clientrpc_on_check_timeout(tbcmh_handle_t client, uint64_t timestamp);
 
 #ifdef __cplusplus
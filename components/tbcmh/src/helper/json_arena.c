@@ -0,0 +1,457 @@
+// Copyright 2022 liangzhuzhi2020@gmail.com, https://github.com/liang-zhu-zi/esp32-thingsboard-mqtt-client
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// This file is called by tbc_mqtt_helper.c/.h.
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "esp_err.h"
+
+#include "tbc_utils.h"
+#include "tbc_mqtt_helper_internal.h"
+
+#include "json_scanner.h"
+#include "json_arena.h"
+
+static const char *TAG = "JSON_ARENA";
+
+// The arena of a client is used by the task of MQTT events only,
+// from _tbcmh_jsonarena_begin() to _tbcmh_jsonarena_end(). No lock is needed.
+
+/**
+ * Parser of a JSON text into arena
+ */
+typedef struct jsonarenaparser
+{
+     jsonarena_t *arena;
+     const char *json;
+     int len;
+     int pos;
+     int depth;
+     int node_count;
+} jsonarenaparser_t;
+
+static bool _jsonarena_contains(const jsonarena_t *arena, const void *ptr)
+{
+    return arena->buffer && (const char *)ptr >= arena->buffer
+           && (const char *)ptr < arena->buffer + TBCMH_JSON_ARENA_SIZE;
+}
+
+static void *_jsonarena_alloc(jsonarena_t *arena, int size)
+{
+    int aligned = (size + 7) & ~7;
+    if (arena->used + aligned > TBCMH_JSON_ARENA_SIZE) {
+        return NULL;
+    }
+    void *ptr = arena->buffer + arena->used;
+    arena->used += aligned;
+    return ptr;
+}
+
+static cJSON *_jsonarena_new_item(jsonarenaparser_t *parser, int type)
+{
+    cJSON *item = _jsonarena_alloc(parser->arena, sizeof(cJSON));
+    if (item) {
+        memset(item, 0x00, sizeof(cJSON));
+        item->type = type;
+        parser->node_count++;
+    }
+    return item;
+}
+
+static void _jsonarena_skip_whitespace(jsonarenaparser_t *parser)
+{
+    while (parser->pos < parser->len && (unsigned char)parser->json[parser->pos] <= ' ') {
+        parser->pos++;
+    }
+}
+
+static bool _jsonarena_skip_literal(jsonarenaparser_t *parser, const char *literal, int literal_len)
+{
+    if (parser->len - parser->pos < literal_len
+        || memcmp(parser->json + parser->pos, literal, literal_len) != 0) {
+        return false;
+    }
+    parser->pos += literal_len;
+    return true;
+}
+
+// json[pos] is '"'. Unescape the string into arena
+static char *_jsonarena_parse_string(jsonarenaparser_t *parser)
+{
+    int start = ++parser->pos;
+    while (parser->pos < parser->len && parser->json[parser->pos] != '\"') {
+        parser->pos += (parser->json[parser->pos] == '\\') ? 2 : 1;
+    }
+    if (parser->pos >= parser->len) {
+        return NULL;
+    }
+    int end = parser->pos++;
+
+    // An unescaped string is never longer than its escaped text
+    char *str = _jsonarena_alloc(parser->arena, end - start + 1);
+    if (!str) {
+        return NULL;
+    }
+    int pos = start, len = 0;
+    while (pos < end) {
+        char c = parser->json[pos++];
+        if (c != '\\') {
+            str[len++] = c;
+            continue;
+        }
+        int n = _tbcmh_jsonscanner_decode_escape(parser->json, end, &pos, (unsigned char *)str + len);
+        if (n < 0) {
+            return NULL;
+        }
+        len += n;
+    }
+    str[len] = '\0';
+    return str;
+}
+
+static bool _jsonarena_parse_number(jsonarenaparser_t *parser, cJSON *item)
+{
+    char number[64];
+    int len = 0;
+    while (parser->pos < parser->len && len < (int)sizeof(number) - 1) {
+        char c = parser->json[parser->pos];
+        if (!((c >= '0' && c <= '9') || c == '+' || c == '-' || c == '.' || c == 'e' || c == 'E')) {
+            break;
+        }
+        number[len++] = c;
+        parser->pos++;
+    }
+    number[len] = '\0';
+
+    char *end = NULL;
+    double value = strtod(number, &end);
+    if (len == 0 || end != number + len) {
+        return false;
+    }
+    // Same as cJSON: valueint is saturated
+    item->valuedouble = value;
+    if (value >= INT_MAX) {
+        item->valueint = INT_MAX;
+    } else if (value <= (double)INT_MIN) {
+        item->valueint = INT_MIN;
+    } else {
+        item->valueint = (int)value;
+    }
+    return true;
+}
+
+static cJSON *_jsonarena_parse_value(jsonarenaparser_t *parser);
+
+// json[pos] is '{' or '['
+static cJSON *_jsonarena_parse_container(jsonarenaparser_t *parser, bool is_object)
+{
+    if (parser->depth >= TBCMH_JSON_ARENA_MAX_DEPTH) {
+        return NULL;
+    }
+    cJSON *container = _jsonarena_new_item(parser, is_object ? cJSON_Object : cJSON_Array);
+    if (!container) {
+        return NULL;
+    }
+    char close = is_object ? '}' : ']';
+    parser->pos++;
+    parser->depth++;
+
+    _jsonarena_skip_whitespace(parser);
+    if (parser->pos < parser->len && parser->json[parser->pos] == close) {
+        parser->pos++;
+        parser->depth--;
+        return container;
+    }
+
+    cJSON *tail = NULL;
+    while (parser->pos < parser->len) {
+        char *key = NULL;
+        if (is_object) {
+            _jsonarena_skip_whitespace(parser);
+            if (parser->pos >= parser->len || parser->json[parser->pos] != '\"'
+                || !(key = _jsonarena_parse_string(parser))) {
+                return NULL;
+            }
+            _jsonarena_skip_whitespace(parser);
+            if (parser->pos >= parser->len || parser->json[parser->pos] != ':') {
+                return NULL;
+            }
+            parser->pos++;
+        }
+
+        cJSON *item = _jsonarena_parse_value(parser);
+        if (!item) {
+            return NULL;
+        }
+        item->string = key;
+        // Same links as cJSON: prev of the first child is the last child
+        if (tail) {
+            tail->next = item;
+            item->prev = tail;
+        } else {
+            container->child = item;
+        }
+        tail = item;
+        container->child->prev = tail;
+
+        _jsonarena_skip_whitespace(parser);
+        if (parser->pos >= parser->len) {
+            return NULL;
+        }
+        char c = parser->json[parser->pos++];
+        if (c == close) {
+            parser->depth--;
+            return container;
+        }
+        if (c != ',') {
+            return NULL;
+        }
+    }
+    return NULL;
+}
+
+static cJSON *_jsonarena_parse_value(jsonarenaparser_t *parser)
+{
+    _jsonarena_skip_whitespace(parser);
+    if (parser->pos >= parser->len) {
+        return NULL;
+    }
+
+    cJSON *item = NULL;
+    char c = parser->json[parser->pos];
+    switch (c) {
+    case '{':
+    case '[':
+        return _jsonarena_parse_container(parser, c == '{');
+    case '\"':
+        item = _jsonarena_new_item(parser, cJSON_String);
+        if (item && !(item->valuestring = _jsonarena_parse_string(parser))) {
+            return NULL;
+        }
+        return item;
+    case 't':
+        return _jsonarena_skip_literal(parser, "true", 4) ? _jsonarena_new_item(parser, cJSON_True) : NULL;
+    case 'f':
+        return _jsonarena_skip_literal(parser, "false", 5) ? _jsonarena_new_item(parser, cJSON_False) : NULL;
+    case 'n':
+        return _jsonarena_skip_literal(parser, "null", 4) ? _jsonarena_new_item(parser, cJSON_NULL) : NULL;
+    default:
+        item = _jsonarena_new_item(parser, cJSON_Number);
+        return (item && _jsonarena_parse_number(parser, item)) ? item : NULL;
+    }
+}
+
+// Count nodes of a tree which are in arena
+static int _jsonarena_count(const jsonarena_t *arena, const cJSON *item)
+{
+    int count = 0;
+    for (; item; item = item->next) {
+        if (_jsonarena_contains(arena, item)) {
+            count++;
+        }
+        if (!(item->type & cJSON_IsReference)) {
+            count += _jsonarena_count(arena, item->child);
+        }
+    }
+    return count;
+}
+
+// A callback which detached nodes of a lent tree keeps them beyond the message
+static void _jsonarena_check_tree(jsonarena_t *arena, const cJSON *item)
+{
+    int i;
+    for (i = 0; i < arena->tree_count; i++) {
+        if (arena->trees[i] != item) {
+            continue;
+        }
+        // the tree itself, not its siblings
+        int count = 1 + ((item->type & cJSON_IsReference) ? 0 : _jsonarena_count(arena, item->child));
+        if (count != arena->node_counts[i]) {
+            TBC_LOGE("%d cJSON nodes of a received message are detached! "
+                     "Callbacks MUST cJSON_Duplicate() what they keep.", arena->node_counts[i] - count);
+        }
+        arena->trees[i] = NULL;
+        return;
+    }
+}
+
+// Free heap nodes of a chain of siblings which may be mixed with arena nodes.
+// Arena nodes are released at once in _tbcmh_jsonarena_end().
+static void _jsonarena_delete_chain(jsonarena_t *arena, cJSON *item)
+{
+    while (item) {
+        cJSON *next = item->next;
+        if (_jsonarena_contains(arena, item)) {
+            _jsonarena_check_tree(arena, item);
+        }
+        if (!(item->type & cJSON_IsReference)) {
+            _jsonarena_delete_chain(arena, item->child);
+        }
+        if (!_jsonarena_contains(arena, item)) {
+            item->next = NULL;
+            item->child = NULL;
+            if (_jsonarena_contains(arena, item->valuestring)) {
+                item->valuestring = NULL;
+            }
+            if (_jsonarena_contains(arena, item->string)) {
+                item->string = NULL;
+            }
+            cJSON_Delete(item);
+        }
+        item = next;
+    }
+}
+
+void _tbcmh_jsonarena_on_create(tbcmh_handle_t client)
+{
+    // This function is in semaphore/client->_lock!!!
+    TBC_CHECK_PTR(client);
+
+    memset(&client->jsonarena, 0x00, sizeof(client->jsonarena));
+}
+
+void _tbcmh_jsonarena_on_destroy(tbcmh_handle_t client)
+{
+    // This function is in semaphore/client->_lock!!!
+    TBC_CHECK_PTR(client);
+
+    if (client->jsonarena.is_begun) {
+        TBC_LOGW("json arena is still being used! %s()", __FUNCTION__);
+    }
+    TBC_FIELD_FREE(client->jsonarena.buffer);
+    memset(&client->jsonarena, 0x00, sizeof(client->jsonarena));
+}
+
+// Begin a received message. return false if the arena is unavailable, then heap is used.
+bool _tbcmh_jsonarena_begin(tbcmh_handle_t client)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(client, false);
+
+    jsonarena_t *arena = &client->jsonarena;
+    if (arena->is_begun) {
+        TBC_LOGW("json arena is already being used! %s()", __FUNCTION__);
+        return false;
+    }
+    if (!arena->buffer) {
+        arena->buffer = TBC_MALLOC(TBCMH_JSON_ARENA_SIZE);
+        if (!arena->buffer) {
+            TBC_LOGW("Unable to malloc memeory of json arena!");
+            return false;
+        }
+    }
+    arena->used = 0;
+    arena->tree_count = 0;
+    arena->is_overflow = false;
+    arena->is_begun = true;
+    return true;
+}
+
+// Same as cJSON_ParseWithLength(), but nodes are built in arena.
+// It falls back to cJSON_ParseWithLength() if the arena isn't begun, is full or the text is too deep.
+// The result MUST be deleted by _tbcmh_jsonarena_delete().
+cJSON *_tbcmh_jsonarena_parse(tbcmh_handle_t client, const char *value, int length)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(client, NULL);
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(value, NULL);
+
+    jsonarena_t *arena = &client->jsonarena;
+    if (arena->is_begun && arena->tree_count < TBCMH_JSON_ARENA_MAX_TREES) {
+        jsonarenaparser_t parser = {
+            .arena = arena,
+            .json = value,
+            .len = length,
+        };
+        int used = arena->used;
+        cJSON *object = _jsonarena_parse_value(&parser);
+        if (object) {
+            arena->trees[arena->tree_count] = object;
+            arena->node_counts[arena->tree_count] = parser.node_count;
+            arena->tree_count++;
+            return object;
+        }
+        // Roll back, then let cJSON parse it or report the syntax error
+        arena->used = used;
+        arena->is_overflow = true;
+    }
+    return cJSON_ParseWithLength(value, length);
+}
+
+// An empty object in arena, or in heap if it is unavailable.
+// It MUST be deleted by _tbcmh_jsonarena_delete().
+cJSON *_tbcmh_jsonarena_create_object(tbcmh_handle_t client)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(client, NULL);
+
+    jsonarena_t *arena = &client->jsonarena;
+    if (arena->is_begun) {
+        cJSON *object = _jsonarena_alloc(arena, sizeof(cJSON));
+        if (object) {
+            memset(object, 0x00, sizeof(cJSON));
+            object->type = cJSON_Object;
+            return object;
+        }
+    }
+    return cJSON_CreateObject();
+}
+
+// Same as cJSON_Delete(), for trees from _tbcmh_jsonarena_parse(), _tbcmh_jsonarena_create_object()
+// and any heap tree mixed with their nodes. Heap nodes are freed, arena nodes are left.
+void _tbcmh_jsonarena_delete(tbcmh_handle_t client, cJSON *item)
+{
+    TBC_CHECK_PTR(client);
+    if (!item) {
+        return;
+    }
+
+    // siblings aren't deleted, same as cJSON_Delete() of a detached item
+    cJSON *next = item->next;
+    item->next = NULL;
+    _jsonarena_delete_chain(&client->jsonarena, item);
+    if (_jsonarena_contains(&client->jsonarena, item)) {
+        item->next = next;
+    }
+}
+
+// Same as cJSON_free(), but a string in arena isn't freed
+void _tbcmh_jsonarena_free(tbcmh_handle_t client, void *ptr)
+{
+    if (client && _jsonarena_contains(&client->jsonarena, ptr)) {
+        return;
+    }
+    cJSON_free(ptr);
+}
+
+// Release all arena nodes of the message at once.
+// All parsed trees MUST be _tbcmh_jsonarena_delete()'d before it.
+void _tbcmh_jsonarena_end(tbcmh_handle_t client)
+{
+    TBC_CHECK_PTR(client);
+
+    jsonarena_t *arena = &client->jsonarena;
+    if (!arena->is_begun) {
+        return;
+    }
+    if (arena->is_overflow) {
+        TBC_LOGD("json arena(%d) is too small or the message is too deep, it is parsed into heap!",
+                TBCMH_JSON_ARENA_SIZE);
+    }
+
+    arena->used = 0;
+    arena->tree_count = 0;
+    arena->is_overflow = false;
+    arena->is_begun = false;
+}
@@ -0,0 +1,67 @@
+// Copyright 2022 liangzhuzhi2020@gmail.com, https://github.com/liang-zhu-zi/esp32-thingsboard-mqtt-client
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// This file is called by tbc_mqtt_helper.c/.h.
+
+#ifndef _JSON_ARENA_H_
+#define _JSON_ARENA_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "tbc_utils.h"
+#include "tbc_mqtt_helper.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TBCMH_JSON_ARENA_SIZE       (8*1024)  /*!< a received message beyond it is parsed into heap */
+#define TBCMH_JSON_ARENA_MAX_DEPTH  (16)      /*!< a deeper message is parsed into heap */
+#define TBCMH_JSON_ARENA_MAX_TREES  (16)      /*!< trees of a message which are checked when deleted */
+
+/**
+ * Bump-pointer arena of cJSON nodes parsed from a received message.
+ *
+ * cJSON hooks aren't used, nodes are built by the arena parser itself, so that
+ * the application keeps its own cJSON hooks. The trees are lent to callbacks
+ * as `const cJSON *`, callbacks MUST cJSON_Duplicate() what they keep.
+ */
+typedef struct jsonarena
+{
+     char *buffer;      /*!< allocated at first use, kept until tbcmh_destroy() */
+     int used;          /*!< used bytes of buffer, it is reset to 0 after each message */
+     bool is_begun;     /*!< between _tbcmh_jsonarena_begin() and _tbcmh_jsonarena_end() */
+     bool is_overflow;  /*!< some trees of current message are parsed into heap */
+
+     int tree_count;                                 /*!< count of trees parsed into arena */
+     const cJSON *trees[TBCMH_JSON_ARENA_MAX_TREES]; /*!< roots of trees parsed into arena */
+     int node_counts[TBCMH_JSON_ARENA_MAX_TREES];    /*!< count of nodes of each tree when it is parsed */
+} jsonarena_t;
+
+void _tbcmh_jsonarena_on_create(tbcmh_handle_t client);
+void _tbcmh_jsonarena_on_destroy(tbcmh_handle_t client);
+bool _tbcmh_jsonarena_begin(tbcmh_handle_t client);
+cJSON *_tbcmh_jsonarena_parse(tbcmh_handle_t client, const char *value, int length);
+cJSON *_tbcmh_jsonarena_create_object(tbcmh_handle_t client);
+void _tbcmh_jsonarena_delete(tbcmh_handle_t client, cJSON *item);
+void _tbcmh_jsonarena_free(tbcmh_handle_t client, void *ptr);
+void _tbcmh_jsonarena_end(tbcmh_handle_t client);
+
+#ifdef __cplusplus
+}
+#endif //__cplusplus
+
+#endif
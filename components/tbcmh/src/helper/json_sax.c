@@ -0,0 +1,577 @@
+// Copyright 2022 liangzhuzhi2020@gmail.com, https://github.com/liang-zhu-zi/esp32-thingsboard-mqtt-client
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// This file is called by tbc_mqtt_helper.c/.h.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_err.h"
+
+#include "tbc_utils.h"
+#include "tbc_mqtt_helper.h"
+
+#include "json_sax.h"
+
+static const char *TAG = "JSON_SAX";
+
+#define JSONSAX_STATE_VALUE          0  /*!< expect a value */
+#define JSONSAX_STATE_VALUE_OR_END   1  /*!< expect a value or ']', after '[' */
+#define JSONSAX_STATE_KEY_OR_END     2  /*!< expect a key or '}', after '{' */
+#define JSONSAX_STATE_KEY            3  /*!< expect a key, after ',' in object */
+#define JSONSAX_STATE_COLON          4  /*!< expect ':', after key */
+#define JSONSAX_STATE_COMMA_OR_END   5  /*!< expect ',' or '}'/']', after value */
+#define JSONSAX_STATE_STRING         6  /*!< in string */
+#define JSONSAX_STATE_NUMBER         7  /*!< in number */
+#define JSONSAX_STATE_LITERAL        8  /*!< in true/false/null */
+#define JSONSAX_STATE_DONE           9  /*!< the top-level value is closed */
+#define JSONSAX_STATE_ERROR          10 /*!< syntax error or overflow */
+
+void _tbcmh_jsonsax_init(jsonsax_t *sax, jsonsax_on_event_t on_event)
+{
+    TBC_CHECK_PTR(sax);
+
+    memset(sax, 0x00, sizeof(jsonsax_t));
+    sax->on_event = on_event;
+    sax->state = JSONSAX_STATE_VALUE;
+}
+
+bool _tbcmh_jsonsax_is_done(const jsonsax_t *sax)
+{
+    return sax && sax->state == JSONSAX_STATE_DONE;
+}
+
+static bool _jsonsax_error(jsonsax_t *sax, const char *reason)
+{
+    TBC_LOGW("%s at depth %d!", reason, sax->depth);
+    sax->state = JSONSAX_STATE_ERROR;
+    return false;
+}
+
+static void _jsonsax_event_init(jsonsax_t *sax, tbcmh_json_event_t *event, tbcmh_json_event_type_t type)
+{
+    memset(event, 0x00, sizeof(tbcmh_json_event_t));
+    event->type = type;
+    event->depth = sax->depth;
+    event->index = -1;
+    if (sax->depth > 0) {
+        if (sax->containers[sax->depth - 1] == '{') {
+            event->key = sax->key;
+        } else {
+            event->index = sax->indexes[sax->depth - 1];
+        }
+        if (sax->containers[0] == '{') {
+            event->top_key = sax->top_key;
+        }
+    }
+}
+
+// A value is done, so expect ',' or the end of its container
+static void _jsonsax_end_value(jsonsax_t *sax)
+{
+    if (sax->depth == 0) {
+        sax->state = JSONSAX_STATE_DONE;
+        return;
+    }
+    sax->indexes[sax->depth - 1]++;
+    sax->state = JSONSAX_STATE_COMMA_OR_END;
+}
+
+// return false if it is stopped by on_event()
+static bool _jsonsax_emit_string(jsonsax_t *sax, bool is_partial, void *context)
+{
+    tbcmh_json_event_t event;
+    _jsonsax_event_init(sax, &event, TBCMH_JSON_EVENT_STRING);
+    sax->token[sax->token_len] = '\0';
+    event.string = sax->token;
+    event.string_len = sax->token_len;
+    event.is_partial = is_partial;
+    sax->token_len = 0;
+    return sax->on_event(context, &event);
+}
+
+// Append unescaped bytes to token. Long strings are emitted chunk by chunk.
+// return false on overflow or if it is stopped by on_event()
+static bool _jsonsax_append(jsonsax_t *sax, const char *bytes, int len, void *context)
+{
+    if (sax->token_len + len > TBCMH_JSON_SAX_TOKEN_SIZE) {
+        if (sax->state != JSONSAX_STATE_STRING || sax->is_key) {
+            return _jsonsax_error(sax, "Key or number is too long");
+        }
+        if (!_jsonsax_emit_string(sax, true, context)) {
+            return false;
+        }
+    }
+    memcpy(sax->token + sax->token_len, bytes, len);
+    sax->token_len += len;
+    return true;
+}
+
+static bool _jsonsax_append_codepoint(jsonsax_t *sax, uint32_t codepoint, void *context)
+{
+    char utf8[4];
+    int len;
+    if (codepoint < 0x80) {
+        utf8[0] = (char)codepoint;
+        len = 1;
+    } else if (codepoint < 0x800) {
+        utf8[0] = (char)(0xC0 | (codepoint >> 6));
+        utf8[1] = (char)(0x80 | (codepoint & 0x3F));
+        len = 2;
+    } else if (codepoint < 0x10000) {
+        utf8[0] = (char)(0xE0 | (codepoint >> 12));
+        utf8[1] = (char)(0x80 | ((codepoint >> 6) & 0x3F));
+        utf8[2] = (char)(0x80 | (codepoint & 0x3F));
+        len = 3;
+    } else {
+        utf8[0] = (char)(0xF0 | (codepoint >> 18));
+        utf8[1] = (char)(0x80 | ((codepoint >> 12) & 0x3F));
+        utf8[2] = (char)(0x80 | ((codepoint >> 6) & 0x3F));
+        utf8[3] = (char)(0x80 | (codepoint & 0x3F));
+        len = 4;
+    }
+    return _jsonsax_append(sax, utf8, len, context);
+}
+
+static int _jsonsax_hex(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+// return false on error or if it is stopped by on_event()
+static bool _jsonsax_on_string_char(jsonsax_t *sax, char c, void *context)
+{
+    if (sax->escape >= 2) {
+        int hex = _jsonsax_hex(c);
+        if (hex < 0) {
+            return _jsonsax_error(sax, "Invalid \\u escape");
+        }
+        sax->codepoint = (sax->codepoint << 4) | hex;
+        if (++sax->escape < 6) {
+            return true;
+        }
+        sax->escape = 0;
+        uint32_t codepoint = sax->codepoint;
+        bool is_low = (codepoint >= 0xDC00 && codepoint <= 0xDFFF);
+        if (sax->high_surrogate) {
+            if (!is_low) {
+                return _jsonsax_error(sax, "Lone high surrogate");
+            }
+            codepoint = 0x10000 + ((sax->high_surrogate - 0xD800) << 10) + (codepoint - 0xDC00);
+            sax->high_surrogate = 0;
+        } else if (codepoint >= 0xD800 && codepoint <= 0xDBFF) {
+            sax->high_surrogate = codepoint; // wait for the low surrogate
+            return true;
+        } else if (is_low) {
+            return _jsonsax_error(sax, "Lone low surrogate");
+        }
+        return _jsonsax_append_codepoint(sax, codepoint, context);
+    }
+
+    // A high surrogate must be followed by \u of a low surrogate, like cJSON
+    if (sax->high_surrogate && (sax->escape == 0 ? c != '\\' : c != 'u')) {
+        return _jsonsax_error(sax, "Lone high surrogate");
+    }
+
+    if (sax->escape == 1) {
+        sax->escape = 0;
+        char unescaped;
+        switch (c) {
+        case '\"': unescaped = '\"'; break;
+        case '\\': unescaped = '\\'; break;
+        case '/':  unescaped = '/';  break;
+        case 'b':  unescaped = '\b'; break;
+        case 'f':  unescaped = '\f'; break;
+        case 'n':  unescaped = '\n'; break;
+        case 'r':  unescaped = '\r'; break;
+        case 't':  unescaped = '\t'; break;
+        case 'u':
+            sax->escape = 2;
+            sax->codepoint = 0;
+            return true;
+        default:
+            return _jsonsax_error(sax, "Invalid escape");
+        }
+        return _jsonsax_append(sax, &unescaped, 1, context);
+    }
+
+    if (c == '\\') {
+        sax->escape = 1;
+        return true;
+    }
+    if ((unsigned char)c < 0x20) {
+        return _jsonsax_error(sax, "Control character in string");
+    }
+    if (c != '\"') {
+        return _jsonsax_append(sax, &c, 1, context);
+    }
+
+    // end of string
+    if (sax->is_key) {
+        memcpy(sax->key, sax->token, sax->token_len);
+        sax->key[sax->token_len] = '\0';
+        if (sax->depth == 1) {
+            memcpy(sax->top_key, sax->key, sax->token_len + 1);
+        }
+        sax->token_len = 0;
+        sax->state = JSONSAX_STATE_COLON;
+        return true;
+    }
+    if (!_jsonsax_emit_string(sax, false, context)) {
+        return false;
+    }
+    _jsonsax_end_value(sax);
+    return true;
+}
+
+static bool _jsonsax_emit_number(jsonsax_t *sax, void *context)
+{
+    char *end = NULL;
+    sax->token[sax->token_len] = '\0';
+    double number = strtod(sax->token, &end);
+    if (end != sax->token + sax->token_len) {
+        return _jsonsax_error(sax, "Invalid number");
+    }
+
+    tbcmh_json_event_t event;
+    _jsonsax_event_init(sax, &event, TBCMH_JSON_EVENT_NUMBER);
+    event.number = number;
+    sax->token_len = 0;
+    if (!sax->on_event(context, &event)) {
+        return false;
+    }
+    _jsonsax_end_value(sax);
+    return true;
+}
+
+static bool _jsonsax_emit_literal(jsonsax_t *sax, void *context)
+{
+    tbcmh_json_event_t event;
+    sax->token[sax->token_len] = '\0';
+    if (strcmp(sax->token, "true") == 0) {
+        _jsonsax_event_init(sax, &event, TBCMH_JSON_EVENT_BOOL);
+        event.boolean = true;
+    } else if (strcmp(sax->token, "false") == 0) {
+        _jsonsax_event_init(sax, &event, TBCMH_JSON_EVENT_BOOL);
+        event.boolean = false;
+    } else if (strcmp(sax->token, "null") == 0) {
+        _jsonsax_event_init(sax, &event, TBCMH_JSON_EVENT_NULL);
+    } else {
+        return _jsonsax_error(sax, "Invalid literal");
+    }
+
+    sax->token_len = 0;
+    if (!sax->on_event(context, &event)) {
+        return false;
+    }
+    _jsonsax_end_value(sax);
+    return true;
+}
+
+static bool _jsonsax_begin_value(jsonsax_t *sax, char c, void *context)
+{
+    tbcmh_json_event_t event;
+    switch (c) {
+    case '{':
+    case '[':
+        if (sax->depth >= TBCMH_JSON_SAX_MAX_DEPTH) {
+            return _jsonsax_error(sax, "Nesting is too deep");
+        }
+        _jsonsax_event_init(sax, &event, (c == '{') ? TBCMH_JSON_EVENT_OBJECT_BEGIN : TBCMH_JSON_EVENT_ARRAY_BEGIN);
+        if (!sax->on_event(context, &event)) {
+            return false;
+        }
+        sax->containers[sax->depth] = c;
+        sax->indexes[sax->depth] = 0;
+        sax->depth++;
+        sax->state = (c == '{') ? JSONSAX_STATE_KEY_OR_END : JSONSAX_STATE_VALUE_OR_END;
+        return true;
+
+    case '\"':
+        sax->is_key = false;
+        sax->token_len = 0;
+        sax->state = JSONSAX_STATE_STRING;
+        return true;
+
+    case 't':
+    case 'f':
+    case 'n':
+        sax->token[0] = c;
+        sax->token_len = 1;
+        sax->state = JSONSAX_STATE_LITERAL;
+        return true;
+
+    default:
+        if (c == '-' || (c >= '0' && c <= '9')) {
+            sax->token[0] = c;
+            sax->token_len = 1;
+            sax->state = JSONSAX_STATE_NUMBER;
+            return true;
+        }
+        return _jsonsax_error(sax, "Unexpected character");
+    }
+}
+
+static bool _jsonsax_end_container(jsonsax_t *sax, char c, void *context)
+{
+    if (sax->depth <= 0 || sax->containers[sax->depth - 1] != ((c == '}') ? '{' : '[')) {
+        return _jsonsax_error(sax, "Unmatched bracket");
+    }
+    sax->depth--;
+
+    tbcmh_json_event_t event;
+    _jsonsax_event_init(sax, &event, (c == '}') ? TBCMH_JSON_EVENT_OBJECT_END : TBCMH_JSON_EVENT_ARRAY_END);
+    event.key = NULL; // key of a nested member may be overwritten already
+    if (!sax->on_event(context, &event)) {
+        return false;
+    }
+    _jsonsax_end_value(sax);
+    return true;
+}
+
+// Feed a fragment. Fragments of a payload must be fed in order.
+// return false on syntax error, or if it is stopped by on_event(). Don't touch sax in the latter case.
+bool _tbcmh_jsonsax_feed(jsonsax_t *sax, const char *data, int len, void *context)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(sax, false);
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(sax->on_event, false);
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(data, false);
+
+    int i = 0;
+    while (i < len) {
+        char c = data[i];
+
+        // tokens
+        switch (sax->state) {
+        case JSONSAX_STATE_ERROR:
+            return false;
+
+        case JSONSAX_STATE_STRING:
+            if (!_jsonsax_on_string_char(sax, c, context)) {
+                return false;
+            }
+            i++;
+            continue;
+
+        case JSONSAX_STATE_NUMBER:
+            if ((c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E') {
+                if (!_jsonsax_append(sax, &c, 1, context)) {
+                    return false;
+                }
+                i++;
+            } else if (!_jsonsax_emit_number(sax, context)) {
+                return false;
+            }
+            continue; // c isn't consumed when number ends
+
+        case JSONSAX_STATE_LITERAL:
+            if (c >= 'a' && c <= 'z') {
+                if (!_jsonsax_append(sax, &c, 1, context)) {
+                    return false;
+                }
+                i++;
+            } else if (!_jsonsax_emit_literal(sax, context)) {
+                return false;
+            }
+            continue; // c isn't consumed when literal ends
+
+        default:
+            break;
+        }
+
+        i++;
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+            continue;
+        }
+
+        // structure
+        bool result = true;
+        switch (sax->state) {
+        case JSONSAX_STATE_VALUE_OR_END:
+            if (c == ']') {
+                result = _jsonsax_end_container(sax, c, context);
+                break;
+            }
+            // fall through
+        case JSONSAX_STATE_VALUE:
+            result = _jsonsax_begin_value(sax, c, context);
+            break;
+
+        case JSONSAX_STATE_KEY_OR_END:
+            if (c == '}') {
+                result = _jsonsax_end_container(sax, c, context);
+                break;
+            }
+            // fall through
+        case JSONSAX_STATE_KEY:
+            if (c != '\"') {
+                return _jsonsax_error(sax, "Expect a key");
+            }
+            sax->is_key = true;
+            sax->token_len = 0;
+            sax->state = JSONSAX_STATE_STRING;
+            break;
+
+        case JSONSAX_STATE_COLON:
+            if (c != ':') {
+                return _jsonsax_error(sax, "Expect ':'");
+            }
+            sax->state = JSONSAX_STATE_VALUE;
+            break;
+
+        case JSONSAX_STATE_COMMA_OR_END:
+            if (c == ',') {
+                sax->state = (sax->containers[sax->depth - 1] == '{') ? JSONSAX_STATE_KEY : JSONSAX_STATE_VALUE;
+            } else if (c == '}' || c == ']') {
+                result = _jsonsax_end_container(sax, c, context);
+            } else {
+                return _jsonsax_error(sax, "Expect ',' or the end");
+            }
+            break;
+
+        case JSONSAX_STATE_DONE:
+        default:
+            return _jsonsax_error(sax, "Unexpected character after the end");
+        }
+        if (!result) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void _tbcmh_jsonbuilder_init(jsonbuilder_t *builder)
+{
+    TBC_CHECK_PTR(builder);
+    memset(builder, 0x00, sizeof(jsonbuilder_t));
+}
+
+// Add an event of the value being built. The first event is the value itself.
+// *value is set when the value is completed, it is owned by caller.
+// return false on failure, then clear the builder.
+bool _tbcmh_jsonbuilder_add(jsonbuilder_t *builder, const tbcmh_json_event_t *event, cJSON **value)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(builder, false);
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(event, false);
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(value, false);
+
+    *value = NULL;
+    cJSON *item = NULL;
+    switch (event->type) {
+    case TBCMH_JSON_EVENT_OBJECT_END:
+    case TBCMH_JSON_EVENT_ARRAY_END:
+        if (builder->depth <= 0) {
+            return false;
+        }
+        builder->depth--;
+        if (builder->depth == 0) {
+            *value = builder->stack[0];
+            builder->stack[0] = NULL;
+        }
+        return true;
+
+    case TBCMH_JSON_EVENT_OBJECT_BEGIN:
+        item = cJSON_CreateObject();
+        break;
+    case TBCMH_JSON_EVENT_ARRAY_BEGIN:
+        item = cJSON_CreateArray();
+        break;
+
+    case TBCMH_JSON_EVENT_STRING:
+        if (!event->is_partial && !builder->string) {
+            item = cJSON_CreateString(event->string);
+            break;
+        }
+        // join chunks of a long string
+        char *string = TBC_REALLOC(builder->string, builder->string_len + event->string_len + 1);
+        if (!string) {
+            TBC_LOGE("Unable to malloc memeory! %s()", __FUNCTION__);
+            return false;
+        }
+        memcpy(string + builder->string_len, event->string, event->string_len);
+        builder->string = string;
+        builder->string_len += event->string_len;
+        builder->string[builder->string_len] = '\0';
+        if (event->is_partial) {
+            return true;
+        }
+        item = cJSON_CreateString(builder->string);
+        TBC_FIELD_FREE(builder->string);
+        builder->string_len = 0;
+        break;
+
+    case TBCMH_JSON_EVENT_NUMBER:
+        item = cJSON_CreateNumber(event->number);
+        break;
+    case TBCMH_JSON_EVENT_BOOL:
+        item = cJSON_CreateBool(event->boolean);
+        break;
+    case TBCMH_JSON_EVENT_NULL:
+    default:
+        item = cJSON_CreateNull();
+        break;
+    }
+    if (!item) {
+        TBC_LOGE("Unable to create json item! %s()", __FUNCTION__);
+        return false;
+    }
+
+    bool is_container = (event->type == TBCMH_JSON_EVENT_OBJECT_BEGIN
+                         || event->type == TBCMH_JSON_EVENT_ARRAY_BEGIN);
+    if (builder->depth > 0) {
+        cJSON *parent = builder->stack[builder->depth - 1];
+        bool is_added = cJSON_IsObject(parent)
+                        ? cJSON_AddItemToObject(parent, event->key ? event->key : "", item)
+                        : cJSON_AddItemToArray(parent, item);
+        if (!is_added) {
+            cJSON_Delete(item);
+            return false;
+        }
+    } else if (!is_container) {
+        *value = item; // a scalar value
+        return true;
+    }
+
+    if (is_container) {
+        if (builder->depth >= TBCMH_JSON_SAX_MAX_DEPTH) {
+            if (builder->depth == 0) {
+                cJSON_Delete(item);
+            }
+            return false;
+        }
+        builder->stack[builder->depth++] = item;
+    }
+    return true;
+}
+
+void _tbcmh_jsonbuilder_clear(jsonbuilder_t *builder)
+{
+    TBC_CHECK_PTR(builder);
+
+    if (builder->depth > 0 && builder->stack[0]) {
+        cJSON_Delete(builder->stack[0]);
+    }
+    TBC_FIELD_FREE(builder->string);
+    memset(builder, 0x00, sizeof(jsonbuilder_t));
+}
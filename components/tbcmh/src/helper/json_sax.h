@@ -0,0 +1,84 @@
+// Copyright 2022 liangzhuzhi2020@gmail.com, https://github.com/liang-zhu-zi/esp32-thingsboard-mqtt-client
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// This file is called by tbc_mqtt_helper.c/.h.
+
+#ifndef _JSON_SAX_H_
+#define _JSON_SAX_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "tbc_utils.h"
+#include "tbc_mqtt_helper.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TBCMH_JSON_SAX_MAX_DEPTH   (16)   /*!< max nesting depth of a streamed payload */
+#define TBCMH_JSON_SAX_TOKEN_SIZE  (256)  /*!< max length of keys & numbers, longer strings are split into chunks of it */
+
+// return false to stop parsing
+typedef bool (*jsonsax_on_event_t)(void *context, const tbcmh_json_event_t *event);
+
+/**
+ * Incremental JSON parser. It is fed fragment by fragment, and emits events.
+ * Its memory is fixed, it doesn't depend on payload size.
+ */
+typedef struct jsonsax
+{
+     jsonsax_on_event_t on_event;              /*!< callback of events */
+
+     int state;                                /*!< JSONSAX_STATE_* */
+     int depth;                                /*!< count of open objects & arrays */
+     char containers[TBCMH_JSON_SAX_MAX_DEPTH];/*!< '{' or '[' of each open container */
+     int indexes[TBCMH_JSON_SAX_MAX_DEPTH];    /*!< count of values in each open container */
+
+     char token[TBCMH_JSON_SAX_TOKEN_SIZE+1];  /*!< unescaped key or string chunk, number or literal being scanned */
+     int token_len;                            /*!< length of token */
+     bool is_key;                              /*!< string being scanned is a key */
+     int escape;                               /*!< 0: none, 1: after '\\', 2~5: hex digits of \\u */
+     uint32_t codepoint;                       /*!< \\u escape being scanned */
+     uint32_t high_surrogate;                  /*!< the last \\u escape if it is a high surrogate */
+
+     char key[TBCMH_JSON_SAX_TOKEN_SIZE+1];    /*!< key of current member */
+     char top_key[TBCMH_JSON_SAX_TOKEN_SIZE+1];/*!< key of current top-level member */
+} jsonsax_t;
+
+/**
+ * Builder of a cJSON value from events, e.g. for callbacks which still want a cJSON tree
+ */
+typedef struct jsonbuilder
+{
+     cJSON *stack[TBCMH_JSON_SAX_MAX_DEPTH];   /*!< open objects & arrays, stack[0] is the value being built */
+     int depth;                                /*!< count of open objects & arrays */
+     char *string;                             /*!< chunks of a long string value */
+     int string_len;                           /*!< length of string */
+} jsonbuilder_t;
+
+void _tbcmh_jsonsax_init(jsonsax_t *sax, jsonsax_on_event_t on_event);
+bool _tbcmh_jsonsax_feed(jsonsax_t *sax, const char *data, int len, void *context);
+bool _tbcmh_jsonsax_is_done(const jsonsax_t *sax);
+
+void _tbcmh_jsonbuilder_init(jsonbuilder_t *builder);
+bool _tbcmh_jsonbuilder_add(jsonbuilder_t *builder, const tbcmh_json_event_t *event, cJSON **value);
+void _tbcmh_jsonbuilder_clear(jsonbuilder_t *builder);
+
+#ifdef __cplusplus
+}
+#endif //__cplusplus
+
+#endif
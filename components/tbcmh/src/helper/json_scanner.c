@@ -0,0 +1,376 @@
+// Copyright 2022 liangzhuzhi2020@gmail.com, https://github.com/liang-zhu-zi/esp32-thingsboard-mqtt-client
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// This file is called by tbc_mqtt_helper.c/.h.
+
+#include <string.h>
+
+#include "esp_err.h"
+
+#include "tbc_utils.h"
+
+#include "json_scanner.h"
+
+static const char *TAG = "JSON_SCANNER";
+
+static bool _jsonscanner_is_whitespace(char c)
+{
+    return (c == ' ') || (c == '\t') || (c == '\n') || (c == '\r');
+}
+
+static void _jsonscanner_skip_whitespace(jsonscanner_t *scanner)
+{
+    while (scanner->pos < scanner->len && _jsonscanner_is_whitespace(scanner->json[scanner->pos])) {
+        scanner->pos++;
+    }
+}
+
+// json[pos] is '"'. Move pos behind the closing '"'.
+static bool _jsonscanner_skip_string(jsonscanner_t *scanner)
+{
+    scanner->pos++;
+    while (scanner->pos < scanner->len) {
+        char c = scanner->json[scanner->pos++];
+        if (c == '\\') {
+            scanner->pos++; // skip escaped char. digits of \uXXXX are normal chars
+        } else if (c == '\"') {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Move pos behind a value: string, object, array, number, true, false or null
+static bool _jsonscanner_skip_value(jsonscanner_t *scanner)
+{
+    if (scanner->pos >= scanner->len) {
+        return false;
+    }
+
+    char c = scanner->json[scanner->pos];
+    if (c == '\"') {
+        return _jsonscanner_skip_string(scanner);
+    }
+
+    if (c == '{' || c == '[') {
+        int depth = 0;
+        while (scanner->pos < scanner->len) {
+            c = scanner->json[scanner->pos];
+            if (c == '\"') {
+                if (!_jsonscanner_skip_string(scanner)) {
+                    return false;
+                }
+                continue;
+            }
+            scanner->pos++;
+            if (c == '{' || c == '[') {
+                depth++;
+            } else if (c == '}' || c == ']') {
+                if (--depth == 0) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    int start = scanner->pos;
+    while (scanner->pos < scanner->len) {
+        c = scanner->json[scanner->pos];
+        if (c == ',' || c == '}' || c == ']' || _jsonscanner_is_whitespace(c)) {
+            break;
+        }
+        scanner->pos++;
+    }
+    return scanner->pos > start;
+}
+
+static int _jsonscanner_parse_hex4(const char *str, int len, int pos)
+{
+    int i, value = 0;
+    if (pos + 4 > len) {
+        return -1;
+    }
+    for (i = 0; i < 4; i++) {
+        char c = str[pos + i];
+        value <<= 4;
+        if (c >= '0' && c <= '9') {
+            value |= c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            value |= c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            value |= c - 'A' + 10;
+        } else {
+            return -1;
+        }
+    }
+    return value;
+}
+
+// Decode the escape sequence behind '\\' at str[*pos] into UTF-8.
+// return count of bytes in out, -1 on error
+int _tbcmh_jsonscanner_decode_escape(const char *str, int len, int *pos, unsigned char out[4])
+{
+    if (*pos >= len) {
+        return -1;
+    }
+
+    char c = str[(*pos)++];
+    switch (c) {
+    case '\"': case '\\': case '/':
+        out[0] = c;   return 1;
+    case 'b': out[0] = '\b'; return 1;
+    case 'f': out[0] = '\f'; return 1;
+    case 'n': out[0] = '\n'; return 1;
+    case 'r': out[0] = '\r'; return 1;
+    case 't': out[0] = '\t'; return 1;
+    case 'u':
+        break;
+    default:
+        return -1;
+    }
+
+    long codepoint = _jsonscanner_parse_hex4(str, len, *pos);
+    if (codepoint < 0) {
+        return -1;
+    }
+    *pos += 4;
+    if (codepoint >= 0xD800 && codepoint <= 0xDBFF) {
+        // UTF-16 surrogate pair
+        if (*pos + 6 > len || str[*pos] != '\\' || str[*pos + 1] != 'u') {
+            return -1;
+        }
+        long low = _jsonscanner_parse_hex4(str, len, *pos + 2);
+        if (low < 0xDC00 || low > 0xDFFF) {
+            return -1;
+        }
+        *pos += 6;
+        codepoint = 0x10000 + (((codepoint & 0x3FF) << 10) | (low & 0x3FF));
+    } else if (codepoint >= 0xDC00 && codepoint <= 0xDFFF) {
+        // lone low surrogate, it is rejected like cJSON
+        return -1;
+    }
+
+    if (codepoint < 0x80) {
+        out[0] = (unsigned char)codepoint;
+        return 1;
+    } else if (codepoint < 0x800) {
+        out[0] = (unsigned char)(0xC0 | (codepoint >> 6));
+        out[1] = (unsigned char)(0x80 | (codepoint & 0x3F));
+        return 2;
+    } else if (codepoint < 0x10000) {
+        out[0] = (unsigned char)(0xE0 | (codepoint >> 12));
+        out[1] = (unsigned char)(0x80 | ((codepoint >> 6) & 0x3F));
+        out[2] = (unsigned char)(0x80 | (codepoint & 0x3F));
+        return 3;
+    }
+    out[0] = (unsigned char)(0xF0 | (codepoint >> 18));
+    out[1] = (unsigned char)(0x80 | ((codepoint >> 12) & 0x3F));
+    out[2] = (unsigned char)(0x80 | ((codepoint >> 6) & 0x3F));
+    out[3] = (unsigned char)(0x80 | (codepoint & 0x3F));
+    return 4;
+}
+
+//==== JSON scanner ===================================================================
+
+// return true if json is an object, then call _tbcmh_jsonscanner_next()
+bool _tbcmh_jsonscanner_init(jsonscanner_t *scanner, const char *json, int len)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(scanner, false);
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(json, false);
+
+    scanner->json = json;
+    scanner->len = len;
+    scanner->pos = 0;
+
+    _jsonscanner_skip_whitespace(scanner);
+    if (scanner->pos >= scanner->len || scanner->json[scanner->pos] != '{') {
+        TBC_LOGD("json is not an object!");
+        return false;
+    }
+    scanner->pos++;
+    return true;
+}
+
+// Get next top-level member.
+// key is without quotes and may contain escapes, value is raw JSON text of the member value.
+// return false at the end of the object or on a syntax error
+bool _tbcmh_jsonscanner_next(jsonscanner_t *scanner, const char **key, int *key_len,
+                             const char **value, int *value_len)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(scanner, false);
+
+    _jsonscanner_skip_whitespace(scanner);
+    if (scanner->pos < scanner->len && scanner->json[scanner->pos] == ',') {
+        scanner->pos++;
+        _jsonscanner_skip_whitespace(scanner);
+    }
+    if (scanner->pos >= scanner->len || scanner->json[scanner->pos] != '\"') {
+        return false;
+    }
+
+    int start = scanner->pos;
+    if (!_jsonscanner_skip_string(scanner)) {
+        return false;
+    }
+    if (key) {
+        *key = scanner->json + start + 1;
+    }
+    if (key_len) {
+        *key_len = scanner->pos - start - 2;
+    }
+
+    _jsonscanner_skip_whitespace(scanner);
+    if (scanner->pos >= scanner->len || scanner->json[scanner->pos] != ':') {
+        return false;
+    }
+    scanner->pos++;
+    _jsonscanner_skip_whitespace(scanner);
+
+    start = scanner->pos;
+    if (!_jsonscanner_skip_value(scanner)) {
+        return false;
+    }
+    if (value) {
+        *value = scanner->json + start;
+    }
+    if (value_len) {
+        *value_len = scanner->pos - start;
+    }
+    return true;
+}
+
+// return true if json is an array, then call _tbcmh_jsonscanner_next_element()
+bool _tbcmh_jsonscanner_init_array(jsonscanner_t *scanner, const char *json, int len)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(scanner, false);
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(json, false);
+
+    scanner->json = json;
+    scanner->len = len;
+    scanner->pos = 0;
+
+    _jsonscanner_skip_whitespace(scanner);
+    if (scanner->pos >= scanner->len || scanner->json[scanner->pos] != '[') {
+        TBC_LOGD("json is not an array!");
+        return false;
+    }
+    scanner->pos++;
+    return true;
+}
+
+// Get next top-level element of array, value is raw JSON text of the element.
+// return false at the end of the array or on a syntax error
+bool _tbcmh_jsonscanner_next_element(jsonscanner_t *scanner, const char **value, int *value_len)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(scanner, false);
+
+    _jsonscanner_skip_whitespace(scanner);
+    if (scanner->pos < scanner->len && scanner->json[scanner->pos] == ',') {
+        scanner->pos++;
+        _jsonscanner_skip_whitespace(scanner);
+    }
+    if (scanner->pos >= scanner->len || scanner->json[scanner->pos] == ']') {
+        return false;
+    }
+
+    int start = scanner->pos;
+    if (!_jsonscanner_skip_value(scanner)) {
+        return false;
+    }
+    if (value) {
+        *value = scanner->json + start;
+    }
+    if (value_len) {
+        *value_len = scanner->pos - start;
+    }
+    return true;
+}
+
+// Find a top-level member of json object without parsing the other members
+bool _tbcmh_jsonscanner_find(const char *json, int len, const char *key,
+                             const char **value, int *value_len)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(key, false);
+
+    jsonscanner_t scanner;
+    if (!_tbcmh_jsonscanner_init(&scanner, json, len)) {
+        return false;
+    }
+
+    const char *member_key = NULL;
+    int member_key_len = 0;
+    while (_tbcmh_jsonscanner_next(&scanner, &member_key, &member_key_len, value, value_len)) {
+        if (_tbcmh_jsonscanner_equals(member_key, member_key_len, key)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Get content of a string value, without quotes and may contain escapes
+bool _tbcmh_jsonscanner_get_string(const char *value, int value_len,
+                                   const char **str, int *str_len)
+{
+    if (!value || value_len < 2 || value[0] != '\"' || value[value_len - 1] != '\"') {
+        return false;
+    }
+    if (str) {
+        *str = value + 1;
+    }
+    if (str_len) {
+        *str_len = value_len - 2;
+    }
+    return true;
+}
+
+// Compare a JSON string content (without quotes, may contain escapes) with a C string
+bool _tbcmh_jsonscanner_equals(const char *str, int str_len, const char *cstr)
+{
+    if (!str || !cstr) {
+        return false;
+    }
+
+    const unsigned char *p = (const unsigned char *)cstr;
+    int i = 0;
+    while (i < str_len) {
+        // cstr ends, e.g. "a\u0000b" isn't "a". Never compare its '\0' with a decoded 0 byte
+        if (*p == '\0') {
+            return false;
+        }
+        if (str[i] != '\\') {
+            if (*p != (unsigned char)str[i]) {
+                return false;
+            }
+            p++;
+            i++;
+            continue;
+        }
+
+        unsigned char decoded[4];
+        int j, n;
+        i++;
+        n = _tbcmh_jsonscanner_decode_escape(str, str_len, &i, decoded);
+        if (n < 0) {
+            return false;
+        }
+        for (j = 0; j < n; j++, p++) {
+            if (*p == '\0' || *p != decoded[j]) {
+                return false;
+            }
+        }
+    }
+    return *p == '\0';
+}
@@ -0,0 +1,57 @@
+// Copyright 2022 liangzhuzhi2020@gmail.com, https://github.com/liang-zhu-zi/esp32-thingsboard-mqtt-client
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// This file is called by tbc_mqtt_helper.c/.h.
+
+#ifndef _JSON_SCANNER_H_
+#define _JSON_SCANNER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "tbc_utils.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Zero-allocation scanner of top-level members of a JSON object, or elements of a JSON array.
+ * Keys and values are returned as spans of the source text, they are not copied.
+ */
+typedef struct jsonscanner
+{
+     const char *json;  /*!< JSON object or array text, it needn't be '\0' terminated */
+     int len;           /*!< length of json */
+     int pos;           /*!< current scanning position */
+} jsonscanner_t;
+
+bool _tbcmh_jsonscanner_init(jsonscanner_t *scanner, const char *json, int len);
+bool _tbcmh_jsonscanner_next(jsonscanner_t *scanner, const char **key, int *key_len,
+                             const char **value, int *value_len);
+bool _tbcmh_jsonscanner_init_array(jsonscanner_t *scanner, const char *json, int len);
+bool _tbcmh_jsonscanner_next_element(jsonscanner_t *scanner, const char **value, int *value_len);
+bool _tbcmh_jsonscanner_find(const char *json, int len, const char *key,
+                             const char **value, int *value_len);
+bool _tbcmh_jsonscanner_get_string(const char *value, int value_len,
+                                   const char **str, int *str_len);
+bool _tbcmh_jsonscanner_equals(const char *str, int str_len, const char *cstr);
+int _tbcmh_jsonscanner_decode_escape(const char *str, int len, int *pos, unsigned char out[4]);
+
+#ifdef __cplusplus
+}
+#endif //__cplusplus
+
+#endif
@@ -0,0 +1,286 @@
+// Copyright 2022 liangzhuzhi2020@gmail.com, https://github.com/liang-zhu-zi/esp32-thingsboard-mqtt-client
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// This file is called by tbc_mqtt_helper.c/.h.
+
+#include <stddef.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_err.h"
+
+#include "tbc_utils.h"
+#include "tbc_mqtt_helper_internal.h"
+
+#include "key_intern.h"
+
+static const char *TAG = "KEY_INTERN";
+
+// Interned keys are shared by all clients and extensions: extensions register keys
+// before they are bound to a client, and a key must resolve to the same pointer in both.
+// Only lookups are done in critical section, malloc/free are done out of it.
+static keyintern_list_t _keyintern_buckets[TBCMH_KEY_INTERN_BUCKETS];
+static portMUX_TYPE _keyintern_spinlock = portMUX_INITIALIZER_UNLOCKED;
+// Address range of all keys ever interned, see _keyintern_is_interned()
+static const char *_keyintern_lowest = NULL;
+static const char *_keyintern_highest = NULL;
+
+static uint32_t _keyintern_hash(const char *key, int len)
+{
+    uint32_t hash = 2166136261u;
+    int i;
+    for (i = 0; i < len; i++) {
+        hash ^= (uint8_t)key[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// This function is in _keyintern_spinlock!!!
+static keyintern_t *_keyintern_lookup(uint32_t hash, const char *key, int len)
+{
+    keyintern_t *keyintern = NULL;
+    LIST_FOREACH(keyintern, &_keyintern_buckets[hash & (TBCMH_KEY_INTERN_BUCKETS - 1)], entry) {
+        if (keyintern->hash == hash && keyintern->len == len
+            && memcmp(keyintern->key, key, len) == 0) {
+            return keyintern;
+        }
+    }
+    return NULL;
+}
+
+// Is name a key of the intern table? name is dereferenced only if it is in the address range
+// of interned keys, then it is matched by pointer. This function is in _keyintern_spinlock!!!
+static bool _keyintern_is_interned(const char *name)
+{
+    if (!name || name < _keyintern_lowest || name >= _keyintern_highest) {
+        return false;
+    }
+    const keyintern_t *candidate = (const keyintern_t *)(name - offsetof(keyintern_t, key));
+    keyintern_t *keyintern = NULL;
+    LIST_FOREACH(keyintern, &_keyintern_buckets[candidate->hash & (TBCMH_KEY_INTERN_BUCKETS - 1)], entry) {
+        if (keyintern->key == name) {
+            return true;
+        }
+    }
+    return false;
+}
+
+tbcmh_key_t tbcmh_key_intern(const char *key)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(key, NULL);
+
+    int len = strlen(key);
+    uint32_t hash = _keyintern_hash(key, len);
+
+    taskENTER_CRITICAL(&_keyintern_spinlock);
+    keyintern_t *keyintern = _keyintern_lookup(hash, key, len);
+    if (keyintern) {
+        keyintern->refcount++;
+    }
+    taskEXIT_CRITICAL(&_keyintern_spinlock);
+    if (keyintern) {
+        return keyintern->key;
+    }
+
+    keyintern_t *created = TBC_MALLOC(sizeof(keyintern_t) + len + 1);
+    if (!created) {
+        TBC_LOGE("Unable to malloc memeory! key=%s %s()", key, __FUNCTION__);
+        return NULL;
+    }
+    memset(created, 0x00, sizeof(keyintern_t));
+    created->hash = hash;
+    created->refcount = 1;
+    created->len = len;
+    memcpy(created->key, key, len + 1);
+
+    // Look up again, the same key may be interned by another task meanwhile
+    taskENTER_CRITICAL(&_keyintern_spinlock);
+    keyintern = _keyintern_lookup(hash, key, len);
+    if (keyintern) {
+        keyintern->refcount++;
+    } else {
+        LIST_INSERT_HEAD(&_keyintern_buckets[hash & (TBCMH_KEY_INTERN_BUCKETS - 1)], created, entry);
+        if (!_keyintern_lowest || created->key < _keyintern_lowest) {
+            _keyintern_lowest = created->key;
+        }
+        if (created->key + len + 1 > _keyintern_highest) {
+            _keyintern_highest = created->key + len + 1;
+        }
+    }
+    taskEXIT_CRITICAL(&_keyintern_spinlock);
+
+    if (keyintern) {
+        TBC_FREE(created);
+        return keyintern->key;
+    }
+    return created->key;
+}
+
+tbcmh_key_t tbcmh_key_find(const char *key, int len)
+{
+    if (!key || len < 0) {
+        return NULL;
+    }
+
+    uint32_t hash = _keyintern_hash(key, len);
+    taskENTER_CRITICAL(&_keyintern_spinlock);
+    keyintern_t *keyintern = _keyintern_lookup(hash, key, len);
+    taskEXIT_CRITICAL(&_keyintern_spinlock);
+    return keyintern ? keyintern->key : NULL;
+}
+
+// Same as tbcmh_key_find(), but a reference is taken. It MUST be paired with a tbcmh_key_release()
+tbcmh_key_t _tbcmh_keyintern_acquire(const char *key, int len)
+{
+    if (!key || len < 0) {
+        return NULL;
+    }
+
+    uint32_t hash = _keyintern_hash(key, len);
+    taskENTER_CRITICAL(&_keyintern_spinlock);
+    keyintern_t *keyintern = _keyintern_lookup(hash, key, len);
+    if (keyintern) {
+        keyintern->refcount++;
+    }
+    taskEXIT_CRITICAL(&_keyintern_spinlock);
+    return keyintern ? keyintern->key : NULL;
+}
+
+// Take another reference of an interned key. It MUST be paired with a tbcmh_key_release()
+tbcmh_key_t _tbcmh_keyintern_retain(tbcmh_key_t key)
+{
+    if (!key) {
+        return NULL;
+    }
+
+    keyintern_t *keyintern = (keyintern_t *)(key - offsetof(keyintern_t, key));
+    taskENTER_CRITICAL(&_keyintern_spinlock);
+    keyintern->refcount++;
+    taskEXIT_CRITICAL(&_keyintern_spinlock);
+    return key;
+}
+
+void tbcmh_key_release(tbcmh_key_t key)
+{
+    if (!key) {
+        return;
+    }
+
+    keyintern_t *keyintern = (keyintern_t *)(key - offsetof(keyintern_t, key));
+    bool is_unused = false;
+    taskENTER_CRITICAL(&_keyintern_spinlock);
+    if (keyintern->refcount > 0 && --keyintern->refcount == 0) {
+        LIST_REMOVE(keyintern, entry);
+        is_unused = true;
+    }
+    taskEXIT_CRITICAL(&_keyintern_spinlock);
+
+    if (is_unused) {
+        TBC_FREE(keyintern);
+    }
+}
+
+uint32_t tbcmh_key_hash(tbcmh_key_t key)
+{
+    if (!key) {
+        return 0;
+    }
+
+    // hash is immutable, no lock is needed
+    const keyintern_t *keyintern = (const keyintern_t *)(key - offsetof(keyintern_t, key));
+    return keyintern->hash;
+}
+
+tbcmh_key_t tbcmh_key_of_item(const cJSON *item)
+{
+    if (!item || !item->string) {
+        return NULL;
+    }
+    if (item->type & cJSON_StringIsConst) {
+        // named by _tbcmh_keyintern_canonicalize(), or by a constant string of the application
+        taskENTER_CRITICAL(&_keyintern_spinlock);
+        bool is_interned = _keyintern_is_interned(item->string);
+        taskEXIT_CRITICAL(&_keyintern_spinlock);
+        if (is_interned) {
+            return item->string;
+        }
+    }
+    return tbcmh_key_find(item->string, strlen(item->string));
+}
+
+cJSON *tbcmh_key_get_item(const cJSON *object, tbcmh_key_t key)
+{
+    if (!object || !key) {
+        return NULL;
+    }
+
+    cJSON *item = NULL;
+    cJSON_ArrayForEach(item, object) {
+        if (tbcmh_key_of_item(item) == key) {
+            return item;
+        }
+    }
+    return NULL;
+}
+
+// Rename members of a received object to interned keys, so that they are matched by pointer.
+// Members of unknown keys are kept unchanged. A reference of each interned key is taken,
+// _tbcmh_keyintern_release_names() MUST be called before the object is deleted.
+void _tbcmh_keyintern_canonicalize(tbcmh_handle_t client, cJSON *object)
+{
+    if (!object) {
+        return;
+    }
+
+    cJSON *item = NULL;
+    cJSON_ArrayForEach(item, object) {
+        if (!item->string || (item->type & cJSON_StringIsConst)) {
+            continue;
+        }
+        tbcmh_key_t key = _tbcmh_keyintern_acquire(item->string, strlen(item->string));
+        if (key) {
+            _tbcmh_jsonarena_free(client, item->string); // a name in json arena isn't freed
+            item->string = (char *)key;
+            item->type |= cJSON_StringIsConst;
+        }
+    }
+}
+
+// Release interned keys which name members of object, i.e. references taken by
+// _tbcmh_keyintern_canonicalize() or _tbcmh_keyintern_retain(). The names are cleared.
+void _tbcmh_keyintern_release_names(cJSON *object)
+{
+    if (!object) {
+        return;
+    }
+
+    cJSON *item = NULL;
+    cJSON_ArrayForEach(item, object) {
+        if (!item->string || !(item->type & cJSON_StringIsConst)) {
+            continue;
+        }
+        taskENTER_CRITICAL(&_keyintern_spinlock);
+        bool is_interned = _keyintern_is_interned(item->string);
+        taskEXIT_CRITICAL(&_keyintern_spinlock);
+        if (is_interned) {
+            tbcmh_key_t key = item->string;
+            item->string = NULL;
+            item->type &= ~cJSON_StringIsConst;
+            tbcmh_key_release(key);
+        }
+    }
+}
@@ -0,0 +1,57 @@
+// Copyright 2022 liangzhuzhi2020@gmail.com, https://github.com/liang-zhu-zi/esp32-thingsboard-mqtt-client
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// This file is called by tbc_mqtt_helper.c/.h.
+
+#ifndef _KEY_INTERN_H_
+#define _KEY_INTERN_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sys/queue.h"
+#include "tbc_utils.h"
+#include "tbc_mqtt_helper.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TBCMH_KEY_INTERN_BUCKETS  (32)  /*!< hash buckets of interned keys, must be power of 2 */
+
+/**
+ * An interned key. tbcmh_key_t points to its key[].
+ */
+typedef struct keyintern
+{
+     LIST_ENTRY(keyintern) entry;
+     uint32_t hash;      /*!< FNV-1a hash of key */
+     uint32_t refcount;  /*!< it is freed when refcount drops to 0 */
+     int len;            /*!< length of key, exclude '\0' */
+     char key[];         /*!< '\0' terminated key */
+} keyintern_t;
+
+typedef LIST_HEAD(keyintern_list, keyintern) keyintern_list_t;
+
+tbcmh_key_t _tbcmh_keyintern_acquire(const char *key, int len);
+tbcmh_key_t _tbcmh_keyintern_retain(tbcmh_key_t key);
+void _tbcmh_keyintern_canonicalize(tbcmh_handle_t client, cJSON *object);
+void _tbcmh_keyintern_release_names(cJSON *object);
+
+#ifdef __cplusplus
+}
+#endif //__cplusplus
+
+#endif
@@ -40,6 +40,23 @@ static void _otaupdate_on_sw_attributesrequest_response(tbcmh_handle_t client,
 
 const static char *TAG = "otaupdate";
 
+#define OTAUPDATE_KEY_TITLE         0  /*!< fw_title or sw_title */
+#define OTAUPDATE_KEY_VERSION       1  /*!< fw_version or sw_version */
+#define OTAUPDATE_KEY_SIZE          2  /*!< fw_size or sw_size */
+#define OTAUPDATE_KEY_CHECKSUM      3  /*!< fw_checksum or sw_checksum */
+#define OTAUPDATE_KEY_CHECKSUM_ALG  4  /*!< fw_checksum_algorithm or sw_checksum_algorithm */
+#define OTAUPDATE_KEY_MAX           5
+
+// Names of F/W & S/W shared attributes, indexed by tbcmh_otaupdate_type_t
+static const char *const _otaupdate_key_names[2][OTAUPDATE_KEY_MAX] = {
+     {TB_MQTT_KEY_FW_TITLE, TB_MQTT_KEY_FW_VERSION, TB_MQTT_KEY_FW_SIZE,
+      TB_MQTT_KEY_FW_CHECKSUM, TB_MQTT_KEY_FW_CHECKSUM_ALG},
+     {TB_MQTT_KEY_SW_TITLE, TB_MQTT_KEY_SW_VERSION, TB_MQTT_KEY_SW_SIZE,
+      TB_MQTT_KEY_SW_CHECKSUM, TB_MQTT_KEY_SW_CHECKSUM_ALG}
+};
+// Interned keys of them. Each client holds a reference from on_create() to on_destroy().
+static tbcmh_key_t _otaupdate_keys[2][OTAUPDATE_KEY_MAX] = {0};
+
 /*!< Initialize otaupdate_t */
 static otaupdate_t *_otaupdate_create(tbcmh_handle_t client,
                         const char *ota_description,
@@ -599,6 +616,14 @@ void _tbcmh_otaupdate_on_create(tbcmh_handle_t client)
     // list create
     memset(&client->otaupdate_list, 0x00, sizeof(client->otaupdate_list)); //client->otaupdate_list = LIST_HEAD_INITIALIZER(client->otaupdate_list);
 
+    // intern keys of shared attributes
+    int type, i;
+    for (type = TBCMH_OTAUPDATE_TYPE_FW; type <= TBCMH_OTAUPDATE_TYPE_SW; type++) {
+         for (i = 0; i < OTAUPDATE_KEY_MAX; i++) {
+              _otaupdate_keys[type][i] = tbcmh_key_intern(_otaupdate_key_names[type][i]);
+         }
+    }
+
     // Give semaphore
     // xSemaphoreGiveRecursive(client->_lock);
 }
@@ -627,6 +652,14 @@ void _tbcmh_otaupdate_on_destroy(tbcmh_handle_t client)
     }
     memset(&client->otaupdate_list, 0x00, sizeof(client->otaupdate_list));
 
+    // release keys of shared attributes. They are still interned if other clients hold them.
+    int type, i;
+    for (type = TBCMH_OTAUPDATE_TYPE_FW; type <= TBCMH_OTAUPDATE_TYPE_SW; type++) {
+         for (i = 0; i < OTAUPDATE_KEY_MAX; i++) {
+              tbcmh_key_release(_otaupdate_keys[type][i]);
+         }
+    }
+
     // Give semaphore
     // xSemaphoreGiveRecursive(client->_lock);
 }
@@ -732,15 +765,11 @@ void _tbcmh_otaupdate_on_connected(tbcmh_handle_t client)
 
              // send init current f/w info telemetry
              _otaupdate_publish_early_current_version(otaupdate);
-             tbcmh_attributes_subscribe(client,
+             tbcmh_attributes_subscribe_of_array(client,
                     otaupdate/*context*/,
                     _otaupdate_on_fw_attributesupdate,
-                    5/*count*/,
-                    TB_MQTT_KEY_FW_TITLE,
-                    TB_MQTT_KEY_FW_VERSION,
-                    TB_MQTT_KEY_FW_SIZE,
-                    TB_MQTT_KEY_FW_CHECKSUM,
-                    TB_MQTT_KEY_FW_CHECKSUM_ALG);
+                    OTAUPDATE_KEY_MAX/*count*/,
+                    _otaupdate_keys[TBCMH_OTAUPDATE_TYPE_FW]);
              // send f/w info attributes request
              tbcmh_sharedattributes_request(client,
                     otaupdate/*context*/,
@@ -763,15 +792,11 @@ void _tbcmh_otaupdate_on_connected(tbcmh_handle_t client)
 
              // send init current s/w telemetry
              _otaupdate_publish_early_current_version(otaupdate);
-             tbcmh_attributes_subscribe(client,
+             tbcmh_attributes_subscribe_of_array(client,
                     otaupdate/*context*/,
                     _otaupdate_on_sw_attributesupdate,
-                    5/*count*/,
-                    TB_MQTT_KEY_SW_TITLE,
-                    TB_MQTT_KEY_SW_VERSION,
-                    TB_MQTT_KEY_SW_SIZE,
-                    TB_MQTT_KEY_SW_CHECKSUM,
-                    TB_MQTT_KEY_SW_CHECKSUM_ALG);
+                    OTAUPDATE_KEY_MAX/*count*/,
+                    _otaupdate_keys[TBCMH_OTAUPDATE_TYPE_SW]);
              // send s/w info attributes request
              tbcmh_sharedattributes_request(client,
                     otaupdate/*context*/,
@@ -883,6 +908,21 @@ static void __otaupdate_on_sharedattributes(tbcmh_handle_t client,
      }
 }
 
+// Get all shared attributes of F/W or S/W by interned keys.
+// return false if any of them is missing
+static bool _otaupdate_get_attributes(tbcmh_otaupdate_type_t ota_type,
+                                      const cJSON *object, cJSON *items[OTAUPDATE_KEY_MAX])
+{
+     int i;
+     for (i = 0; i < OTAUPDATE_KEY_MAX; i++) {
+          items[i] = tbcmh_key_get_item(object, _otaupdate_keys[ota_type][i]);
+          if (!items[i]) {
+               return false;
+          }
+     }
+     return true;
+}
+
 // return 2 if calling tbcmh_disconnect()/tbcmh_destroy() inside on_update()
 // return 1 if calling tbcmh_sharedattribute_unregister()/tbcmh_attributes_unsubscribe inside on_update()
 // return 0 otherwise
@@ -896,17 +936,14 @@ static int _otaupdate_on_fw_attributesupdate(tbcmh_handle_t client,
           return 0;
      }
 
-     if (cJSON_HasObjectItem(object, TB_MQTT_KEY_FW_TITLE) &&
-         cJSON_HasObjectItem(object, TB_MQTT_KEY_FW_VERSION) &&
-         cJSON_HasObjectItem(object, TB_MQTT_KEY_FW_SIZE) &&
-         cJSON_HasObjectItem(object, TB_MQTT_KEY_FW_CHECKSUM) &&
-         cJSON_HasObjectItem(object, TB_MQTT_KEY_FW_CHECKSUM_ALG))
+     cJSON *items[OTAUPDATE_KEY_MAX];
+     if (_otaupdate_get_attributes(TBCMH_OTAUPDATE_TYPE_FW, object, items))
      {
-          char *ota_title = cJSON_GetStringValue(cJSON_GetObjectItem(object, TB_MQTT_KEY_FW_TITLE));
-          char *ota_version = cJSON_GetStringValue(cJSON_GetObjectItem(object, TB_MQTT_KEY_FW_VERSION));
-          int ota_size = cJSON_GetNumberValue(cJSON_GetObjectItem(object, TB_MQTT_KEY_FW_SIZE));
-          char *ota_checksum = cJSON_GetStringValue(cJSON_GetObjectItem(object, TB_MQTT_KEY_FW_CHECKSUM));
-          char *ota_checksum_algorithm = cJSON_GetStringValue(cJSON_GetObjectItem(object, TB_MQTT_KEY_FW_CHECKSUM_ALG));
+          char *ota_title = cJSON_GetStringValue(items[OTAUPDATE_KEY_TITLE]);
+          char *ota_version = cJSON_GetStringValue(items[OTAUPDATE_KEY_VERSION]);
+          int ota_size = cJSON_GetNumberValue(items[OTAUPDATE_KEY_SIZE]);
+          char *ota_checksum = cJSON_GetStringValue(items[OTAUPDATE_KEY_CHECKSUM]);
+          char *ota_checksum_algorithm = cJSON_GetStringValue(items[OTAUPDATE_KEY_CHECKSUM_ALG]);
           __otaupdate_on_sharedattributes(client, TBCMH_OTAUPDATE_TYPE_FW,
                     ota_title, ota_version, ota_size, ota_checksum, ota_checksum_algorithm);
      }
@@ -927,17 +964,14 @@ static int _otaupdate_on_sw_attributesupdate(tbcmh_handle_t client,
          return 0;
     }
 
-    if (cJSON_HasObjectItem(object, TB_MQTT_KEY_SW_TITLE) &&
-        cJSON_HasObjectItem(object, TB_MQTT_KEY_SW_VERSION) &&
-        cJSON_HasObjectItem(object, TB_MQTT_KEY_SW_SIZE) &&
-        cJSON_HasObjectItem(object, TB_MQTT_KEY_SW_CHECKSUM) &&
-        cJSON_HasObjectItem(object, TB_MQTT_KEY_SW_CHECKSUM_ALG))
+    cJSON *items[OTAUPDATE_KEY_MAX];
+    if (_otaupdate_get_attributes(TBCMH_OTAUPDATE_TYPE_SW, object, items))
     {
-         char *sw_title = cJSON_GetStringValue(cJSON_GetObjectItem(object, TB_MQTT_KEY_SW_TITLE));
-         char *sw_version = cJSON_GetStringValue(cJSON_GetObjectItem(object, TB_MQTT_KEY_SW_VERSION));
-         int sw_size = cJSON_GetNumberValue(cJSON_GetObjectItem(object, TB_MQTT_KEY_SW_SIZE));
-         char *sw_checksum = cJSON_GetStringValue(cJSON_GetObjectItem(object, TB_MQTT_KEY_SW_CHECKSUM));
-         char *sw_checksum_algorithm = cJSON_GetStringValue(cJSON_GetObjectItem(object, TB_MQTT_KEY_SW_CHECKSUM_ALG));
+         char *sw_title = cJSON_GetStringValue(items[OTAUPDATE_KEY_TITLE]);
+         char *sw_version = cJSON_GetStringValue(items[OTAUPDATE_KEY_VERSION]);
+         int sw_size = cJSON_GetNumberValue(items[OTAUPDATE_KEY_SIZE]);
+         char *sw_checksum = cJSON_GetStringValue(items[OTAUPDATE_KEY_CHECKSUM]);
+         char *sw_checksum_algorithm = cJSON_GetStringValue(items[OTAUPDATE_KEY_CHECKSUM_ALG]);
          __otaupdate_on_sharedattributes(client, TBCMH_OTAUPDATE_TYPE_SW,
                 sw_title, sw_version, sw_size, sw_checksum, sw_checksum_algorithm);
     }
@@ -0,0 +1,463 @@
+// Copyright 2022 liangzhuzhi2020@gmail.com, https://github.com/liang-zhu-zi/esp32-thingsboard-mqtt-client
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// This file is called by tbc_mqtt_helper.c/.h.
+
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "esp_err.h"
+
+#include "tbc_utils.h"
+#include "tbc_mqtt_helper_internal.h"
+
+#include "pb_codec.h"
+
+static const char *TAG = "PB_CODEC";
+
+// Protobuf wire types
+#define PB_WIRETYPE_VARINT   (0)
+#define PB_WIRETYPE_FIXED64  (1)
+#define PB_WIRETYPE_LENGTH   (2)
+#define PB_WIRETYPE_FIXED32  (5)
+
+// ThingsBoard transport.proto:
+//   message KeyValueProto { string key = 1; KeyValueType type = 2; bool bool_v = 3;
+//          int64 long_v = 4; double double_v = 5; string string_v = 6; string json_v = 7; }
+//   enum KeyValueType { BOOLEAN_V = 0; LONG_V = 1; DOUBLE_V = 2; STRING_V = 3; JSON_V = 4; }
+//   message TsKvProto { int64 ts = 1; KeyValueProto kv = 2; }
+//   message AttributeUpdateNotificationMsg { repeated TsKvProto sharedUpdated = 1;
+//          repeated string sharedDeleted = 2; }
+//   message GetAttributeResponseMsg { int32 requestId = 1; repeated TsKvProto clientAttributeList = 2;
+//          repeated TsKvProto sharedAttributeList = 3; string error = 5; }
+//   message ToServerRpcResponseMsg { int32 requestId = 1; string payload = 2; string error = 3; }
+#define PB_KV_KEY          (1)
+#define PB_KV_TYPE         (2)
+#define PB_KV_BOOL         (3)
+#define PB_KV_LONG         (4)
+#define PB_KV_DOUBLE       (5)
+#define PB_KV_STRING       (6)
+#define PB_KV_JSON         (7)
+#define PB_KV_TYPE_BOOLEAN (0)
+#define PB_KV_TYPE_LONG    (1)
+#define PB_KV_TYPE_DOUBLE  (2)
+#define PB_KV_TYPE_STRING  (3)
+#define PB_KV_TYPE_JSON    (4)
+#define PB_TSKV_KV         (2)
+#define PB_ATTRIBUTES_UPDATE_SHARED   (1)
+#define PB_ATTRIBUTES_UPDATE_DELETED  (2)
+#define PB_ATTRIBUTES_RESPONSE_CLIENT (2)
+#define PB_ATTRIBUTES_RESPONSE_SHARED (3)
+#define PB_ATTRIBUTES_RESPONSE_ERROR  (5)
+#define PB_CLIENTRPC_RESPONSE_PAYLOAD (2)
+#define PB_CLIENTRPC_RESPONSE_ERROR   (3)
+
+#define _pbcodec_put_literal(json, literal)  _tbcmh_txwriter_put_raw(json, literal, sizeof(literal) - 1)
+
+//==== Encoding =======================================================================
+
+static bool _pbcodec_put_varint(txwriter_t *txwriter, uint64_t value)
+{
+    char buf[10];
+    int len = 0;
+    do {
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        buf[len++] = value ? (byte | 0x80) : byte;
+    } while (value);
+    return _tbcmh_txwriter_put_raw(txwriter, buf, len);
+}
+
+static bool _pbcodec_put_tag(txwriter_t *txwriter, uint32_t field_number, int wire_type)
+{
+    return _pbcodec_put_varint(txwriter, ((uint64_t)field_number << 3) | wire_type);
+}
+
+// Little-endian, independent of host byte order
+static bool _pbcodec_put_fixed(txwriter_t *txwriter, uint64_t value, int size)
+{
+    char buf[8];
+    int i;
+    for (i = 0; i < size; i++) {
+        buf[i] = (value >> (8 * i)) & 0xFF;
+    }
+    return _tbcmh_txwriter_put_raw(txwriter, buf, size);
+}
+
+// int32, int64, uint32, uint64, bool & enum
+bool _tbcmh_pbcodec_put_int(txwriter_t *txwriter, uint32_t field_number, int64_t value)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(txwriter, false);
+    return _pbcodec_put_tag(txwriter, field_number, PB_WIRETYPE_VARINT)
+        && _pbcodec_put_varint(txwriter, (uint64_t)value);
+}
+
+bool _tbcmh_pbcodec_put_double(txwriter_t *txwriter, uint32_t field_number, double value)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(txwriter, false);
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return _pbcodec_put_tag(txwriter, field_number, PB_WIRETYPE_FIXED64)
+        && _pbcodec_put_fixed(txwriter, bits, 8);
+}
+
+bool _tbcmh_pbcodec_put_float(txwriter_t *txwriter, uint32_t field_number, float value)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(txwriter, false);
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return _pbcodec_put_tag(txwriter, field_number, PB_WIRETYPE_FIXED32)
+        && _pbcodec_put_fixed(txwriter, bits, 4);
+}
+
+// string, bytes & embedded message
+bool _tbcmh_pbcodec_put_bytes(txwriter_t *txwriter, uint32_t field_number, const char *value, int len)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(txwriter, false);
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(value, false);
+    return _pbcodec_put_tag(txwriter, field_number, PB_WIRETYPE_LENGTH)
+        && _pbcodec_put_varint(txwriter, len)
+        && _tbcmh_txwriter_put_raw(txwriter, value, len);
+}
+
+//==== Decoding =======================================================================
+
+/**
+ * Reader of a protobuf message, no field is copied
+ */
+typedef struct pbreader
+{
+    const uint8_t *pos;
+    const uint8_t *end;
+} pbreader_t;
+
+/**
+ * A field of protobuf message
+ */
+typedef struct pbfield
+{
+    uint32_t number;
+    int wire_type;
+    uint64_t varint;    /*!< value of PB_WIRETYPE_VARINT, PB_WIRETYPE_FIXED64 & PB_WIRETYPE_FIXED32 */
+    const char *data;   /*!< value of PB_WIRETYPE_LENGTH */
+    int len;
+} pbfield_t;
+
+static void _pbreader_init(pbreader_t *reader, const char *data, int len)
+{
+    reader->pos = (const uint8_t *)data;
+    reader->end = (const uint8_t *)data + len;
+}
+
+static bool _pbreader_varint(pbreader_t *reader, uint64_t *value)
+{
+    uint64_t result = 0;
+    int shift;
+    for (shift = 0; shift < 64 && reader->pos < reader->end; shift += 7) {
+        uint8_t byte = *reader->pos++;
+        result |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool _pbreader_fixed(pbreader_t *reader, int size, uint64_t *value)
+{
+    if (reader->end - reader->pos < size) {
+        return false;
+    }
+    uint64_t result = 0;
+    int i;
+    for (i = 0; i < size; i++) {
+        result |= (uint64_t)reader->pos[i] << (8 * i);
+    }
+    reader->pos += size;
+    *value = result;
+    return true;
+}
+
+// return false at the end of message or on a malformed field
+static bool _pbreader_next(pbreader_t *reader, pbfield_t *field)
+{
+    uint64_t tag, len;
+    if (reader->pos >= reader->end || !_pbreader_varint(reader, &tag)) {
+        return false;
+    }
+
+    memset(field, 0x00, sizeof(pbfield_t));
+    field->number = tag >> 3;
+    field->wire_type = tag & 0x07;
+    switch (field->wire_type) {
+    case PB_WIRETYPE_VARINT:
+        return _pbreader_varint(reader, &field->varint);
+    case PB_WIRETYPE_FIXED64:
+        return _pbreader_fixed(reader, 8, &field->varint);
+    case PB_WIRETYPE_FIXED32:
+        return _pbreader_fixed(reader, 4, &field->varint);
+    case PB_WIRETYPE_LENGTH:
+        if (!_pbreader_varint(reader, &len) || len > (uint64_t)(reader->end - reader->pos)) {
+            return false;
+        }
+        field->data = (const char *)reader->pos;
+        field->len = len;
+        reader->pos += len;
+        return true;
+    default:
+        TBC_LOGW("wire_type(%d) is unsupported!", field->wire_type);
+        return false;
+    }
+}
+
+// `"key":value` of a KeyValueProto, prefixed with ',' if it isn't the first member
+static bool _pbcodec_kv_to_json(const char *data, int len, txwriter_t *json, int *count)
+{
+    const char *key = NULL, *str = NULL;
+    int key_len = 0, str_len = 0;
+    uint64_t type = PB_KV_TYPE_BOOLEAN, bool_v = 0, long_v = 0, double_v = 0;
+
+    pbreader_t reader;
+    pbfield_t field;
+    _pbreader_init(&reader, data, len);
+    while (_pbreader_next(&reader, &field)) {
+        switch (field.number) {
+        case PB_KV_KEY:    key = field.data; key_len = field.len; break;
+        case PB_KV_TYPE:   type = field.varint;                   break;
+        case PB_KV_BOOL:   bool_v = field.varint;                 break;
+        case PB_KV_LONG:   long_v = field.varint;                 break;
+        case PB_KV_DOUBLE: double_v = field.varint;               break;
+        case PB_KV_STRING:
+        case PB_KV_JSON:   str = field.data; str_len = field.len; break;
+        default:                                                  break;
+        }
+    }
+    if (reader.pos != reader.end || !key) {
+        TBC_LOGW("KeyValueProto is malformed!");
+        return false;
+    }
+
+    if ((*count > 0 && !_pbcodec_put_literal(json, ","))
+        || !_tbcmh_txwriter_put_string(json, key, key_len)
+        || !_pbcodec_put_literal(json, ":")) {
+        return false;
+    }
+    (*count)++;
+
+    double number;
+    switch (type) {
+    case PB_KV_TYPE_BOOLEAN:
+        return bool_v ? _pbcodec_put_literal(json, "true")
+                      : _pbcodec_put_literal(json, "false");
+    case PB_KV_TYPE_LONG:
+        return _tbcmh_txwriter_put_int(json, (int64_t)long_v);
+    case PB_KV_TYPE_DOUBLE:
+        memcpy(&number, &double_v, sizeof(number));
+        return _tbcmh_txwriter_put_number(json, number);
+    case PB_KV_TYPE_STRING:
+        return _tbcmh_txwriter_put_string(json, str ? str : "", str_len);
+    case PB_KV_TYPE_JSON:
+        return (str && str_len > 0) ? _tbcmh_txwriter_put_raw(json, str, str_len)
+                                    : _pbcodec_put_literal(json, "null");
+    default:
+        TBC_LOGW("KeyValueType(%u) is unsupported!", (uint32_t)type);
+        return _pbcodec_put_literal(json, "null");
+    }
+}
+
+// Members of all TsKvProto with field_number in message
+static bool _pbcodec_tskv_list_to_json(const char *payload, int length, uint32_t field_number,
+                                       txwriter_t *json, int *count)
+{
+    pbreader_t reader, tskv_reader;
+    pbfield_t field, tskv_field;
+    _pbreader_init(&reader, payload, length);
+    while (_pbreader_next(&reader, &field)) {
+        if (field.number != field_number || field.wire_type != PB_WIRETYPE_LENGTH) {
+            continue;
+        }
+        _pbreader_init(&tskv_reader, field.data, field.len);
+        while (_pbreader_next(&tskv_reader, &tskv_field)) {
+            if (tskv_field.number == PB_TSKV_KV && tskv_field.wire_type == PB_WIRETYPE_LENGTH
+                && !_pbcodec_kv_to_json(tskv_field.data, tskv_field.len, json, count)) {
+                return false;
+            }
+        }
+    }
+    return reader.pos == reader.end;
+}
+
+// Are all top-level fields of message well-formed?
+static bool _pbcodec_is_valid(const char *payload, int length)
+{
+    pbreader_t reader;
+    pbfield_t field;
+    _pbreader_init(&reader, payload, length);
+    while (_pbreader_next(&reader, &field)) {
+    }
+    return reader.pos == reader.end;
+}
+
+// A string field of message, or NULL
+static const char *_pbcodec_get_string(const char *payload, int length, uint32_t field_number,
+                                       int *len)
+{
+    pbreader_t reader;
+    pbfield_t field;
+    _pbreader_init(&reader, payload, length);
+    while (_pbreader_next(&reader, &field)) {
+        if (field.number == field_number && field.wire_type == PB_WIRETYPE_LENGTH) {
+            *len = field.len;
+            return field.data;
+        }
+    }
+    return NULL;
+}
+
+// GetAttributeResponseMsg -> {"client":{...},"shared":{...}}
+static bool _pbcodec_attributes_response_to_json(const char *payload, int length, txwriter_t *json)
+{
+    int count = 0;
+    int len = 0;
+    const char *error = _pbcodec_get_string(payload, length, PB_ATTRIBUTES_RESPONSE_ERROR, &len);
+    if (error && len > 0) {
+        TBC_LOGW("attributes response error: %.*s", len, error);
+    }
+
+    bool result = _pbcodec_put_literal(json, "{\"" TB_MQTT_KEY_ATTRIBUTES_RESPONSE_CLIENT "\":{")
+        && _pbcodec_tskv_list_to_json(payload, length, PB_ATTRIBUTES_RESPONSE_CLIENT, json, &count);
+    count = 0;
+    return result
+        && _pbcodec_put_literal(json, "},\"" TB_MQTT_KEY_ATTRIBUTES_RESPONSE_SHARED "\":{")
+        && _pbcodec_tskv_list_to_json(payload, length, PB_ATTRIBUTES_RESPONSE_SHARED, json, &count)
+        && _pbcodec_put_literal(json, "}}");
+}
+
+// AttributeUpdateNotificationMsg -> {"key1":value1,...,"deleted":["key2",...]}
+static bool _pbcodec_attributes_update_to_json(const char *payload, int length, txwriter_t *json)
+{
+    int count = 0;
+    if (!_pbcodec_put_literal(json, "{")
+        || !_pbcodec_tskv_list_to_json(payload, length, PB_ATTRIBUTES_UPDATE_SHARED, json, &count)) {
+        return false;
+    }
+
+    int deleted = 0;
+    pbreader_t reader;
+    pbfield_t field;
+    _pbreader_init(&reader, payload, length);
+    while (_pbreader_next(&reader, &field)) {
+        if (field.number != PB_ATTRIBUTES_UPDATE_DELETED || field.wire_type != PB_WIRETYPE_LENGTH) {
+            continue;
+        }
+        if (deleted == 0) {
+            if ((count > 0 && !_pbcodec_put_literal(json, ","))
+                || !_pbcodec_put_literal(json, "\"deleted\":[")) {
+                return false;
+            }
+        } else if (!_pbcodec_put_literal(json, ",")) {
+            return false;
+        }
+        if (!_tbcmh_txwriter_put_string(json, field.data, field.len)) {
+            return false;
+        }
+        deleted++;
+    }
+    if (deleted > 0 && !_pbcodec_put_literal(json, "]")) {
+        return false;
+    }
+    return _pbcodec_put_literal(json, "}");
+}
+
+// RpcRequestMsg -> {"method":"...","params":...}
+static bool _pbcodec_serverrpc_request_to_json(const char *payload, int length, txwriter_t *json)
+{
+    int method_len = 0, params_len = 0;
+    const char *method = _pbcodec_get_string(payload, length, TBCMH_PB_RPC_REQUEST_METHOD, &method_len);
+    const char *params = _pbcodec_get_string(payload, length, TBCMH_PB_RPC_REQUEST_PARAMS, &params_len);
+    if (!method) {
+        TBC_LOGW("RpcRequestMsg.method is missing!");
+        return false;
+    }
+
+    bool result = _pbcodec_put_literal(json, "{\"" TB_MQTT_KEY_RPC_METHOD "\":")
+        && _tbcmh_txwriter_put_string(json, method, method_len);
+    if (result && params && params_len > 0) {
+        // params is a JSON string in the default schema
+        result = _pbcodec_put_literal(json, ",\"" TB_MQTT_KEY_RPC_PARAMS "\":")
+            && _tbcmh_txwriter_put_raw(json, params, params_len);
+    }
+    return result && _pbcodec_put_literal(json, "}");
+}
+
+// ToServerRpcResponseMsg -> payload, it is a JSON string
+static bool _pbcodec_clientrpc_response_to_json(const char *payload, int length, txwriter_t *json)
+{
+    int len = 0;
+    const char *error = _pbcodec_get_string(payload, length, PB_CLIENTRPC_RESPONSE_ERROR, &len);
+    if (error && len > 0) {
+        TBC_LOGW("client-side RPC response error: %.*s", len, error);
+    }
+
+    const char *response = _pbcodec_get_string(payload, length, PB_CLIENTRPC_RESPONSE_PAYLOAD, &len);
+    if (!response || len <= 0) {
+        return _pbcodec_put_literal(json, "{}");
+    }
+    return _tbcmh_txwriter_put_raw(json, response, len);
+}
+
+// Decode a received protobuf message to the JSON payload of the same topic.
+// json is an empty standalone txwriter_t, it is null-terminated on success.
+bool _tbcmh_pbcodec_to_json(tbcm_topic_id_t topic, const char *payload, int length,
+                            txwriter_t *json)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(payload, false);
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(json, false);
+
+    if (!_pbcodec_is_valid(payload, length)) {
+        TBC_LOGW("protobuf message is malformed! topic=%d, payload_len=%d", topic, length);
+        return false;
+    }
+
+    json->max_size = TBCMH_PB_JSON_MAX_SIZE;
+    bool result = false;
+    switch (topic) {
+    case TBCM_RX_TOPIC_ATTRIBUTES_RESPONSE:
+         result = _pbcodec_attributes_response_to_json(payload, length, json);
+         break;
+    case TBCM_RX_TOPIC_SHARED_ATTRIBUTES:
+         result = _pbcodec_attributes_update_to_json(payload, length, json);
+         break;
+    case TBCM_RX_TOPIC_SERVERRPC_REQUEST:
+         result = _pbcodec_serverrpc_request_to_json(payload, length, json);
+         break;
+    case TBCM_RX_TOPIC_CLIENTRPC_RESPONSE:
+         result = _pbcodec_clientrpc_response_to_json(payload, length, json);
+         break;
+    default:
+         TBC_LOGE("topic(%d) isn't protobuf!", topic);
+         return false;
+    }
+
+    if (!result) {
+         TBC_LOGW("Unable to decode protobuf message! topic=%d, payload_len=%d", topic, length);
+         return false;
+    }
+    // _txwriter_reserve() always keeps two bytes
+    json->buffer[json->len] = '\0';
+    return true;
+}
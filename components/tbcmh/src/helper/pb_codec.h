@@ -0,0 +1,56 @@
+// Copyright 2022 liangzhuzhi2020@gmail.com, https://github.com/liang-zhu-zi/esp32-thingsboard-mqtt-client
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// This file is called by tbc_mqtt_helper.c/.h.
+
+#ifndef _PB_CODEC_H_
+#define _PB_CODEC_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "tbc_utils.h"
+#include "tbc_mqtt_helper.h"
+#include "tbc_mqtt_wapper.h"
+
+#include "tx_writer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TBCMH_PB_JSON_MAX_SIZE  (128*1024)  /*!< max size of JSON decoded from a protobuf message */
+
+// Field numbers of the default RPC proto schemas of device profile
+#define TBCMH_PB_RPC_REQUEST_METHOD       (1)  /*!< RpcRequestMsg.method */
+#define TBCMH_PB_RPC_REQUEST_REQUESTID    (2)  /*!< RpcRequestMsg.requestId */
+#define TBCMH_PB_RPC_REQUEST_PARAMS       (3)  /*!< RpcRequestMsg.params */
+#define TBCMH_PB_RPC_RESPONSE_PAYLOAD     (1)  /*!< RpcResponseMsg.payload */
+
+// Encoding
+bool _tbcmh_pbcodec_put_int(txwriter_t *txwriter, uint32_t field_number, int64_t value);
+bool _tbcmh_pbcodec_put_double(txwriter_t *txwriter, uint32_t field_number, double value);
+bool _tbcmh_pbcodec_put_float(txwriter_t *txwriter, uint32_t field_number, float value);
+bool _tbcmh_pbcodec_put_bytes(txwriter_t *txwriter, uint32_t field_number, const char *value, int len);
+
+// Decoding a received protobuf message to the JSON payload of the same topic
+bool _tbcmh_pbcodec_to_json(tbcm_topic_id_t topic, const char *payload, int length,
+                            txwriter_t *json);
+
+#ifdef __cplusplus
+}
+#endif //__cplusplus
+
+#endif
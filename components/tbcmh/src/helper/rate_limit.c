@@ -0,0 +1,177 @@
+// Copyright 2022 liangzhuzhi2020@gmail.com, https://github.com/liang-zhu-zi/esp32-thingsboard-mqtt-client
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// This file is called by tbc_mqtt_helper.c/.h.
+
+#include <string.h>
+
+#include "esp_err.h"
+
+#include "tbc_mqtt_helper_internal.h"
+
+#define TB_RPC_METHOD_GET_SESSION_LIMITS "getSessionLimits"
+
+const static char *TAG = "rate_limit";
+
+//==== Rate limit & priority of publish messages ================================
+void _tbcmh_ratelimit_on_create(tbcmh_handle_t client)
+{
+    // This function is in semaphore/client->_lock!!!
+    TBC_CHECK_PTR(client);
+
+    memset(&client->ratelimitsession, 0x00, sizeof(client->ratelimitsession));
+}
+
+void _tbcmh_ratelimit_on_destroy(tbcmh_handle_t client)
+{
+    // This function is in semaphore/client->_lock!!!
+    TBC_CHECK_PTR(client);
+
+    memset(&client->ratelimitsession, 0x00, sizeof(client->ratelimitsession));
+}
+
+// tbcmh_ratelimit_class_t & tbcm_ratelimit_class_t are in the same order
+static bool _ratelimit_class_is_valid(tbcmh_ratelimit_class_t cls)
+{
+    return cls >= TBCMH_RATELIMIT_ALL && cls <= TBCMH_RATELIMIT_OTA;
+}
+
+tbc_err_t tbcmh_ratelimit_config(tbcmh_handle_t client, tbcmh_ratelimit_class_t cls,
+                                 const char *limits, tbcmh_ratelimit_policy_t policy,
+                                 uint32_t max_wait_ms)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(client, ESP_FAIL);
+    if (!_ratelimit_class_is_valid(cls)) {
+        TBC_LOGE("cls(%d) is error! %s()", cls, __FUNCTION__);
+        return ESP_FAIL;
+    }
+
+    bool result = tbcm_ratelimit_set(client->tbmqttclient, (tbcm_ratelimit_class_t)cls, limits,
+                                     (tbcm_ratelimit_policy_t)policy, max_wait_ms);
+    return result ? ESP_OK : ESP_FAIL;
+}
+
+uint32_t tbcmh_ratelimit_get_rejected(tbcmh_handle_t client, tbcmh_ratelimit_class_t cls)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(client, 0);
+    if (!_ratelimit_class_is_valid(cls)) {
+        return 0;
+    }
+
+    return tbcm_ratelimit_rejected(client->tbmqttclient, (tbcm_ratelimit_class_t)cls);
+}
+
+static void _ratelimit_apply_session_limit(tbcmh_handle_t client, tbcmh_ratelimit_class_t cls,
+                                           const cJSON *rate_limits, const char *name)
+{
+    cJSON *limits = cJSON_GetObjectItem(rate_limits, name);
+    if (!cJSON_IsString(limits) || !limits->valuestring) {
+        return;
+    }
+
+    TBC_LOGI("Apply rate limit: %s=%s", name, limits->valuestring);
+    tbcmh_ratelimit_config(client, cls, limits->valuestring,
+                           client->ratelimitsession.policy,
+                           client->ratelimitsession.max_wait_ms);
+}
+
+// e.g. {"maxPayloadSize":65536,"maxInflightMessages":100,
+//       "rateLimits":{"messages":"200:1,6000:60","telemetryMessages":"100:1,3000:60","telemetryDataPoints":"200:1,6000:60"}}
+static void _ratelimit_on_session_limits(tbcmh_handle_t client, void *context,
+                                         const char *method, const tbcmh_rpc_results_t *results)
+{
+    TBC_CHECK_PTR(client);
+
+    cJSON *rate_limits = cJSON_GetObjectItem(results, "rateLimits");
+    if (!cJSON_IsObject(rate_limits)) {
+        TBC_LOGW("rateLimits isn't in response of %s!", method);
+        return;
+    }
+    _ratelimit_apply_session_limit(client, TBCMH_RATELIMIT_ALL, rate_limits, "messages");
+    _ratelimit_apply_session_limit(client, TBCMH_RATELIMIT_TELEMETRY, rate_limits, "telemetryMessages");
+}
+
+static int _ratelimit_on_session_limits_timeout(tbcmh_handle_t client, void *context,
+                                                const char *method)
+{
+    TBC_LOGW("%s is timeout, the server may not advertise rate limits!", method);
+    return ESP_OK;
+}
+
+tbc_err_t tbcmh_ratelimit_request_session_limits(tbcmh_handle_t client,
+                                 tbcmh_ratelimit_policy_t policy, uint32_t max_wait_ms)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(client, ESP_FAIL);
+
+    // Take semaphore
+    if (xSemaphoreTakeRecursive(client->_lock, (TickType_t)0xFFFFF) != pdTRUE) {
+         TBC_LOGE("Unable to take semaphore! %s()", __FUNCTION__);
+         return ESP_FAIL;
+    }
+
+    client->ratelimitsession.policy = policy;
+    client->ratelimitsession.max_wait_ms = max_wait_ms;
+
+    // Give semaphore
+    xSemaphoreGiveRecursive(client->_lock);
+
+    // params is NULL, "{}" is sent
+    return tbcmh_twoway_clientrpc_request(client, TB_RPC_METHOD_GET_SESSION_LIMITS,
+                                     NULL, NULL,
+                                     _ratelimit_on_session_limits,
+                                     _ratelimit_on_session_limits_timeout);
+}
+
+tbc_err_t tbcmh_txqueue_config(tbcmh_handle_t client, const tbcmh_txqueue_config_t *config)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(client, ESP_FAIL);
+
+    if (!config) {
+        tbcm_txqueue_set(client->tbmqttclient, false, 0, NULL, 0);
+        return ESP_OK;
+    }
+    tbcm_txqueue_set(client->tbmqttclient, true, config->max_size,
+                     config->weights, config->max_drain_count);
+    return ESP_OK;
+}
+
+int tbcmh_txqueue_get_count(tbcmh_handle_t client)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(client, 0);
+
+    return tbcm_txqueue_count(client->tbmqttclient);
+}
+
+uint32_t tbcmh_txqueue_get_lost_count(tbcmh_handle_t client, tbcmh_tx_type_t type)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(client, 0);
+
+    switch (type) {
+    case TBCMH_TX_TELEMETRY:
+        return tbcm_txqueue_lost_count(client->tbmqttclient, TBCM_TXQUEUE_PRIORITY_TELEMETRY);
+    case TBCMH_TX_ATTRIBUTES:
+        return tbcm_txqueue_lost_count(client->tbmqttclient, TBCM_TXQUEUE_PRIORITY_ATTRIBUTES);
+    default:
+        TBC_LOGE("type(%d) is error!", type);
+        return 0;
+    }
+}
+
+void _tbcmh_txqueue_on_run(tbcmh_handle_t client)
+{
+    TBC_CHECK_PTR(client);
+
+    // TX queue is protected by the lock of tbcm, not client->_lock
+    tbcm_txqueue_drain(client->tbmqttclient);
+}
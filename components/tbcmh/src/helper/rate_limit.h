@@ -0,0 +1,44 @@
+// Copyright 2022 liangzhuzhi2020@gmail.com, https://github.com/liang-zhu-zi/esp32-thingsboard-mqtt-client
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// This file is called by tbc_mqtt_helper.c/.h.
+
+#ifndef _RATE_LIMIT_HELPER_H_
+#define _RATE_LIMIT_HELPER_H_
+
+#include "tbc_utils.h"
+#include "tbc_mqtt_helper.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Policy of the rate limits advertised by the server, see tbcmh_ratelimit_request_session_limits()
+ */
+typedef struct ratelimitsession
+{
+     tbcmh_ratelimit_policy_t policy; /*!< what to do when the rate limit is reached */
+     uint32_t max_wait_ms;            /*!< max waiting time for TBCMH_RATELIMIT_WAIT */
+} ratelimitsession_t;
+
+void _tbcmh_ratelimit_on_create(tbcmh_handle_t client);
+void _tbcmh_ratelimit_on_destroy(tbcmh_handle_t client);
+void _tbcmh_txqueue_on_run(tbcmh_handle_t client);
+
+#ifdef __cplusplus
+}
+#endif //__cplusplus
+
+#endif
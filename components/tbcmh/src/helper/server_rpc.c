@@ -25,7 +25,8 @@ const static char *TAG = "serverrpc";
 /*!< Initialize serverrpc */
 static serverrpc_t *_serverrpc_create(tbcmh_handle_t client,
                                             const char *method, void *context,
-                                            tbcmh_serverrpc_on_request_t on_request)
+                                            tbcmh_serverrpc_on_request_t on_request,
+                                            tbcmh_serverrpc_on_params_t on_params)
 {
     TBC_CHECK_PTR_WITH_RETURN_VALUE(method, NULL);
     TBC_CHECK_PTR_WITH_RETURN_VALUE(on_request, NULL);
@@ -38,12 +39,10 @@ static serverrpc_t *_serverrpc_create(tbcmh_handle_t client,
 
     memset(serverrpc, 0x00, sizeof(serverrpc_t));
     serverrpc->client = client;
-    serverrpc->method = TBC_MALLOC(strlen(method)+1);
-    if (serverrpc->method) {
-        strcpy(serverrpc->method, method);
-    }
+    serverrpc->method = tbcmh_key_intern(method);
     serverrpc->context = context;
     serverrpc->on_request = on_request;
+    serverrpc->on_params = on_params;
     return serverrpc;
 }
 
@@ -59,12 +58,10 @@ static serverrpc_t * _serverrpc_clone_wo_listentry(serverrpc_t *src)
 
     memset(serverrpc, 0x00, sizeof(serverrpc_t));
     serverrpc->client = src->client;
-    serverrpc->method = TBC_MALLOC(strlen(src->method)+1);
-    if (serverrpc->method) {
-        strcpy(serverrpc->method, src->method);
-    }
+    serverrpc->method = tbcmh_key_intern(src->method);
     serverrpc->context = src->context;
     serverrpc->on_request = src->on_request;
+    serverrpc->on_params = src->on_params;
     return serverrpc;
 }
 
@@ -73,11 +70,27 @@ static tbc_err_t _serverrpc_destroy(serverrpc_t *serverrpc)
 {
     TBC_CHECK_PTR_WITH_RETURN_VALUE(serverrpc, ESP_FAIL);
 
-    TBC_FREE(serverrpc->method);
+    tbcmh_key_release(serverrpc->method);
     TBC_FREE(serverrpc);
     return ESP_OK;
 }
 
+static void _serverrpcstream_free(tbcmh_handle_t client)
+{
+    serverrpcstream_t *stream = client->serverrpcstream;
+    if (!stream) {
+        return;
+    }
+
+    client->serverrpcstream = NULL;
+    if (stream->cache) {
+        _serverrpc_destroy(stream->cache);
+    }
+    _tbcmh_jsonbuilder_clear(&stream->builder);
+    cJSON_Delete(stream->params);
+    TBC_FREE(stream);
+}
+
 void _tbcmh_serverrpc_on_create(tbcmh_handle_t client)
 {
     // This function is in semaphore/client->_lock!!!
@@ -91,6 +104,7 @@ void _tbcmh_serverrpc_on_create(tbcmh_handle_t client)
 
     // list create
     memset(&client->serverrpc_list, 0x00, sizeof(client->serverrpc_list)); //client->serverrpc_list = LIST_HEAD_INITIALIZER(client->serverrpc_list);
+    client->serverrpcstream = NULL;
 
     // Give semaphore
     // xSemaphoreGiveRecursive(client->_lock);
@@ -115,16 +129,16 @@ void _tbcmh_serverrpc_on_destroy(tbcmh_handle_t client)
          _serverrpc_destroy(serverrpc);
     }
     memset(&client->serverrpc_list, 0x00, sizeof(client->serverrpc_list));
+    _serverrpcstream_free(client);
 
     // Give semaphore
     // xSemaphoreGiveRecursive(client->_lock);
 }
 
-//Call it before connect()
-//return 0/ESP_OK on successful, otherwise return -1/ESP_FAIL
-tbc_err_t tbcmh_serverrpc_subscribe(tbcmh_handle_t client,
+static tbc_err_t _serverrpc_subscribe(tbcmh_handle_t client,
                                    const char *method, void *context,
-                                   tbcmh_serverrpc_on_request_t on_request)
+                                   tbcmh_serverrpc_on_request_t on_request,
+                                   tbcmh_serverrpc_on_params_t on_params)
 {
      TBC_CHECK_PTR_WITH_RETURN_VALUE(client, ESP_FAIL);
 
@@ -135,7 +149,7 @@ tbc_err_t tbcmh_serverrpc_subscribe(tbcmh_handle_t client,
      }
 
      // Create serverrpc
-     serverrpc_t *serverrpc = _serverrpc_create(client, method, context, on_request);
+     serverrpc_t *serverrpc = _serverrpc_create(client, method, context, on_request, on_params);
      if (!serverrpc) {
           // Give semaphore
           xSemaphoreGiveRecursive(client->_lock);
@@ -174,6 +188,26 @@ tbc_err_t tbcmh_serverrpc_subscribe(tbcmh_handle_t client,
      return ESP_OK;
 }
 
+//Call it before connect()
+//return 0/ESP_OK on successful, otherwise return -1/ESP_FAIL
+tbc_err_t tbcmh_serverrpc_subscribe(tbcmh_handle_t client,
+                                   const char *method, void *context,
+                                   tbcmh_serverrpc_on_request_t on_request)
+{
+     return _serverrpc_subscribe(client, method, context, on_request, NULL);
+}
+
+//Call it before connect()
+//return 0/ESP_OK on successful, otherwise return -1/ESP_FAIL
+tbc_err_t tbcmh_serverrpc_subscribe_stream(tbcmh_handle_t client,
+                                   const char *method, void *context,
+                                   tbcmh_serverrpc_on_params_t on_params,
+                                   tbcmh_serverrpc_on_request_t on_request)
+{
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(on_params, ESP_FAIL);
+     return _serverrpc_subscribe(client, method, context, on_request, on_params);
+}
+
 // remove from LIST_ENTRY(tbcmh_serverrpc_) & delete
 //return 0/ESP_OK on successful, otherwise return -1/ESP_FAIL
 tbc_err_t tbcmh_serverrpc_unsubscribe(tbcmh_handle_t client, const char *method)
@@ -190,9 +224,10 @@ tbc_err_t tbcmh_serverrpc_unsubscribe(tbcmh_handle_t client, const char *method)
      bool isEmptyBefore = LIST_EMPTY(&client->serverrpc_list);
 
      // Search item
+     tbcmh_key_t interned = tbcmh_key_find(method, strlen(method));
      serverrpc_t *serverrpc = NULL, *next;
      LIST_FOREACH_SAFE(serverrpc, &client->serverrpc_list, entry, next) {
-          if (serverrpc && strcmp(serverrpc->method, method)==0) {
+          if (serverrpc && interned && serverrpc->method == interned) {
              // Remove from list and destroy
              LIST_REMOVE(serverrpc, entry);
              _serverrpc_destroy(serverrpc);
@@ -235,19 +270,69 @@ void _tbcmh_serverrpc_on_disconnected(tbcmh_handle_t client)
 {
     // This function is in semaphore/client->_lock!!!
     TBC_CHECK_PTR(client);
-    // ...
+
+    // the rest fragments will never arrive
+    _serverrpcstream_free(client);
+}
+
+// Call on_request(), then send reply. cache & params are destroyed inside.
+static void _serverrpc_do_request(tbcmh_handle_t client, serverrpc_t *cache,
+                                  uint32_t request_id, cJSON *params)
+{
+     // Do request
+     tbcmh_rpc_results_t *result = NULL;
+     if (cache && cache->on_request) {
+         result = cache->on_request(cache->client, cache->context, request_id, cache->method, params);
+     }
+     _tbcmh_jsonarena_delete(client, params); // delete json object
+     // Send reply
+     if (result) {
+          #if 0
+          cJSON* reply = cJSON_CreateObject();
+          cJSON_AddStringToObject(reply, TB_MQTT_KEY_RPC_METHOD, method);
+          cJSON_AddItemToObject(reply, TB_MQTT_KEY_RPC_RESULTS, result);
+          const char *response = cJSON_PrintUnformatted(reply); //cJSON_Print()
+          tbcm_serverrpc_response(client_->tbmqttclient, request_id, response, 1/*qos*/, 0/*retain*/);
+          cJSON_free(response); // free memory
+          cJSON_Delete(reply); // delete json object
+          #else
+          char *response = cJSON_PrintUnformatted(result); //cJSON_Print(result);
+          if (response && client->config.payload_type == TBC_TRANSPORT_PAYLOAD_TYPE_PROTOBUF) {
+               // RpcResponseMsg of the default proto schema, payload is JSON string
+               txwriter_t pb;
+               memset(&pb, 0x00, sizeof(pb));
+               if (_tbcmh_pbcodec_put_bytes(&pb, TBCMH_PB_RPC_RESPONSE_PAYLOAD, response, strlen(response))) {
+                    tbcm_serverrpc_response_ex(client->tbmqttclient, request_id, pb.buffer, pb.len,
+                                               1/*qos*/, 0/*retain*/);
+               }
+               TBC_FIELD_FREE(pb.buffer);
+          } else {
+               tbcm_serverrpc_response(client->tbmqttclient, request_id, response, 1/*qos*/, 0/*retain*/);
+          }
+          cJSON_free(response); // free memory
+          cJSON_Delete(result); // delete json object
+          #endif
+     }
+     // Free serverrpc
+     _serverrpc_destroy(cache);
+
+     return;
 }
 
 //on request.
-void _tbcmh_serverrpc_on_data(tbcmh_handle_t client, uint32_t request_id, const cJSON *object)
+void _tbcmh_serverrpc_on_data(tbcmh_handle_t client, uint32_t request_id,
+                              const char *payload, int length)
 {
      TBC_CHECK_PTR(client);
-     TBC_CHECK_PTR(object);
-
-     const char *method = NULL;
-     if (cJSON_HasObjectItem(object, TB_MQTT_KEY_RPC_METHOD)) {
-          cJSON *methodItem = cJSON_GetObjectItem(object, TB_MQTT_KEY_RPC_METHOD);
-          method = cJSON_GetStringValue(methodItem);
+     TBC_CHECK_PTR(payload);
+
+     // Route by method before parsing. Only params is parsed, and only if method is subscribed.
+     const char *value = NULL, *method = NULL;
+     int value_len = 0, method_len = 0;
+     if (!_tbcmh_jsonscanner_find(payload, length, TB_MQTT_KEY_RPC_METHOD, &value, &value_len)
+         || !_tbcmh_jsonscanner_get_string(value, value_len, &method, &method_len)) {
+          TBC_LOGW("Unable to get method of server-rpc! %s()", __FUNCTION__);
+          return;
      }
 
      // Take semaphore
@@ -256,9 +341,13 @@ void _tbcmh_serverrpc_on_data(tbcmh_handle_t client, uint32_t request_id, const
      //      return;
      // }
 
+     // Methods with escapes aren't interned as is, compare them char by char
+     bool is_escaped = (memchr(method, '\\', method_len) != NULL);
+     tbcmh_key_t interned = is_escaped ? NULL : tbcmh_key_find(method, method_len);
      serverrpc_t *serverrpc = NULL, *cache = NULL;
      LIST_FOREACH(serverrpc, &client->serverrpc_list, entry) {
-          if (serverrpc && strcmp(serverrpc->method, method)==0) {
+          if (serverrpc && (is_escaped ? _tbcmh_jsonscanner_equals(method, method_len, serverrpc->method)
+                                       : (interned && serverrpc->method == interned))) {
               // Clone serverrpc
               cache = _serverrpc_clone_wo_listentry(serverrpc);
               break;
@@ -269,36 +358,149 @@ void _tbcmh_serverrpc_on_data(tbcmh_handle_t client, uint32_t request_id, const
      // xSemaphoreGiveRecursive(client->_lock);
 
      if (!cache) {
-          TBC_LOGW("Unable to deal server-rpc:%s! %s()", method, __FUNCTION__);
+          TBC_LOGW("Unable to deal server-rpc:%.*s! %s()", method_len, method, __FUNCTION__);
           return;
      }
 
-     // Do request
-     tbcmh_rpc_results_t *result = NULL;
-     if (cache && cache->on_request) {
-         result = cache->on_request(cache->client, cache->context, request_id, cache->method,
-                                    cJSON_GetObjectItem(object, TB_MQTT_KEY_RPC_PARAMS));
+     // JSON events of params are delivered to on_params(), so parse it as a single fragment
+     if (cache->on_params) {
+          _serverrpc_destroy(cache);
+          _tbcmh_serverrpc_on_fragment(client, request_id, payload, length, 0, length);
+          return;
      }
-     // Send reply
-     if (result) {
-          #if 0
-          cJSON* reply = cJSON_CreateObject();
-          cJSON_AddStringToObject(reply, TB_MQTT_KEY_RPC_METHOD, method);
-          cJSON_AddItemToObject(reply, TB_MQTT_KEY_RPC_RESULTS, result);
-          const char *response = cJSON_PrintUnformatted(reply); //cJSON_Print()
-          tbcm_serverrpc_response(client_->tbmqttclient, request_id, response, 1/*qos*/, 0/*retain*/);
-          cJSON_free(response); // free memory
-          cJSON_Delete(reply); // delete json object
-          #else
-          char *response = cJSON_PrintUnformatted(result); //cJSON_Print(result);
-          tbcm_serverrpc_response(client->tbmqttclient, request_id, response, 1/*qos*/, 0/*retain*/);
-          cJSON_free(response); // free memory
-          cJSON_Delete(result); // delete json object
-          #endif
+
+     // Parse params only
+     cJSON *params = NULL;
+     if (_tbcmh_jsonscanner_find(payload, length, TB_MQTT_KEY_RPC_PARAMS, &value, &value_len)) {
+          params = _tbcmh_jsonarena_parse(client, value, value_len);
      }
-     // Free serverrpc
-     _serverrpc_destroy(cache);
 
-     return;
+     _serverrpc_do_request(client, cache, request_id, params);
 }
 
+
+
+// return false to stop parsing
+static bool _serverrpcstream_on_event(void *context, const tbcmh_json_event_t *event)
+{
+     tbcmh_handle_t client = (tbcmh_handle_t)context;
+     serverrpcstream_t *stream = client->serverrpcstream;
+
+     // the top-level object
+     if (event->depth == 0) {
+          if (event->type != TBCMH_JSON_EVENT_OBJECT_BEGIN && event->type != TBCMH_JSON_EVENT_OBJECT_END) {
+               TBC_LOGW("Server-rpc request is not a json object! %s()", __FUNCTION__);
+               return false;
+          }
+          return true;
+     }
+
+     // method: route by it
+     if (strcmp(event->top_key, TB_MQTT_KEY_RPC_METHOD) == 0) {
+          if (event->depth != 1 || event->type != TBCMH_JSON_EVENT_STRING || event->is_partial) {
+               TBC_LOGW("Invalid method of server-rpc! %s()", __FUNCTION__);
+               return false;
+          }
+          tbcmh_key_t interned = tbcmh_key_find(event->string, event->string_len);
+          serverrpc_t *serverrpc = NULL;
+          LIST_FOREACH(serverrpc, &client->serverrpc_list, entry) {
+               if (serverrpc && interned && serverrpc->method == interned) {
+                    // Clone serverrpc
+                    stream->cache = _serverrpc_clone_wo_listentry(serverrpc);
+                    break;
+               }
+          }
+          if (!stream->cache) {
+               TBC_LOGW("Unable to deal server-rpc:%s! %s()", event->string, __FUNCTION__);
+               return false;
+          }
+          return true;
+     }
+
+     // params: deliver it to on_params(), or build it for on_request()
+     if (strcmp(event->top_key, TB_MQTT_KEY_RPC_PARAMS) == 0) {
+          serverrpc_t *cache = stream->cache;
+          if (!cache) {
+               TBC_LOGW("Params precedes method of server-rpc, drop it! %s()", __FUNCTION__);
+               return false;
+          }
+          if (cache->on_params) {
+               if (cache->on_params(cache->client, cache->context, stream->request_id, cache->method, event) != ESP_OK) {
+                    TBC_LOGI("Server-rpc:%s is dropped by on_params()! %s()", cache->method, __FUNCTION__);
+                    return false;
+               }
+               return true;
+          }
+
+          cJSON *value = NULL;
+          if (!_tbcmh_jsonbuilder_add(&stream->builder, event, &value)) {
+               TBC_LOGW("Unable to build params of server-rpc:%s! %s()", cache->method, __FUNCTION__);
+               return false;
+          }
+          if (value) {
+               cJSON_Delete(stream->params);
+               stream->params = value;
+          }
+     }
+     return true;
+}
+
+// Parse a server-rpc request fragment by fragment. Fragments must arrive in order.
+void _tbcmh_serverrpc_on_fragment(tbcmh_handle_t client, uint32_t request_id,
+                                  const char *payload, int length,
+                                  int payload_offset, int total_payload_len)
+{
+     TBC_CHECK_PTR(client);
+     TBC_CHECK_PTR(payload);
+
+     // the first fragment
+     if (payload_offset == 0) {
+          _serverrpcstream_free(client);
+          client->serverrpcstream = TBC_MALLOC(sizeof(serverrpcstream_t));
+          if (!client->serverrpcstream) {
+               TBC_LOGE("Unable to malloc memeory! %s()", __FUNCTION__);
+               return;
+          }
+          memset(client->serverrpcstream, 0x00, sizeof(serverrpcstream_t));
+          _tbcmh_jsonsax_init(&client->serverrpcstream->sax, _serverrpcstream_on_event);
+          _tbcmh_jsonbuilder_init(&client->serverrpcstream->builder);
+          client->serverrpcstream->request_id = request_id;
+     }
+     if (!client->serverrpcstream || client->serverrpcstream->request_id != request_id) {
+          TBC_LOGD("Skip fragment of dropped server-rpc request! %s()", __FUNCTION__);
+          return;
+     }
+     if (client->serverrpcstream->next_offset != payload_offset) {
+          TBC_LOGW("Fragment of server-rpc request is lost! %s()", __FUNCTION__);
+          _serverrpcstream_free(client);
+          return;
+     }
+     client->serverrpcstream->next_offset += length;
+
+     if (!_tbcmh_jsonsax_feed(&client->serverrpcstream->sax, payload, length, client)) {
+          _serverrpcstream_free(client);
+          return;
+     }
+     if (payload_offset + length < total_payload_len) {
+          return;
+     }
+
+     // the last fragment
+     serverrpcstream_t *stream = client->serverrpcstream;
+     bool is_done = _tbcmh_jsonsax_is_done(&stream->sax);
+     serverrpc_t *cache = stream->cache;
+     cJSON *params = stream->params;
+     stream->cache = NULL;
+     stream->params = NULL;
+     _serverrpcstream_free(client);
+     if (!is_done || !cache) {
+          TBC_LOGW("Server-rpc request is incomplete! %s()", __FUNCTION__);
+          if (cache) {
+               _serverrpc_destroy(cache);
+          }
+          cJSON_Delete(params);
+          return;
+     }
+
+     _serverrpc_do_request(client, cache, request_id, params);
+}
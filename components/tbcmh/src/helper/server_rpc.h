@@ -19,6 +19,7 @@
 
 #include "tbc_utils.h"
 #include "tbc_mqtt_helper.h"
+#include "json_sax.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -31,24 +32,40 @@ typedef struct serverrpc
 {
      tbcmh_handle_t client;        /*!< ThingsBoard MQTT Client Helper */
 
-     char *method; /*!< method value */
+     tbcmh_key_t method; /*!< method value, interned */
      ////char *method_key;   /*!< method key, default "method" */
      ////char *params_key;   /*!< params key, default "params" */
      ////char *results_key;  /*!< results key, default "results" */
 
      void *context;                           /*!< Context of callback */
      tbcmh_serverrpc_on_request_t on_request; /*!< Callback of server-rpc request */
+     tbcmh_serverrpc_on_params_t on_params;   /*!< Callback of each JSON event of params, NULL if params is parsed as a whole */
 
      LIST_ENTRY(serverrpc) entry;
 } serverrpc_t;
 
 typedef LIST_HEAD(tbcmh_serverrpc_list, serverrpc) serverrpc_list_t;
 
+/**
+ * Parsing state of a server-rpc request which is streamed fragment by fragment
+ */
+typedef struct serverrpcstream
+{
+     jsonsax_t sax;            /*!< incremental parser of payload */
+     jsonbuilder_t builder;    /*!< builder of params, if on_params() isn't set */
+     uint32_t request_id;      /*!< request_id of this request */
+     int next_offset;          /*!< offset of the next fragment, a lost fragment drops the whole payload */
+     serverrpc_t *cache;       /*!< clone of the serverrpc of method, NULL until method is parsed */
+     cJSON *params;            /*!< params built for on_request() */
+} serverrpcstream_t;
+
 void _tbcmh_serverrpc_on_create(tbcmh_handle_t client);
 void _tbcmh_serverrpc_on_destroy(tbcmh_handle_t client);
 void _tbcmh_serverrpc_on_connected(tbcmh_handle_t client);
 void _tbcmh_serverrpc_on_disconnected(tbcmh_handle_t client);
-void _tbcmh_serverrpc_on_data(tbcmh_handle_t client, uint32_t request_id, const cJSON *object);
+void _tbcmh_serverrpc_on_data(tbcmh_handle_t client, uint32_t request_id, const char *payload, int length);
+void _tbcmh_serverrpc_on_fragment(tbcmh_handle_t client, uint32_t request_id, const char *payload, int length,
+                                  int payload_offset, int total_payload_len);
 
 #ifdef __cplusplus
 }
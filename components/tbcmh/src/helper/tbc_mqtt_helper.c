@@ -59,7 +59,7 @@ tbcmh_handle_t tbcmh_init(void)
      // These should be passed by pointer as they contain a lot of data.
      // client->is_running_in_mqtt_task = is_running_in_mqtt_task;
      // if (!client->is_running_in_mqtt_task) {
-        client->_xQueue = xQueueCreate(40, sizeof(tbcm_event_t));
+        client->_xQueue = xQueueCreate(TBCMH_EVENT_QUEUE_SIZE, sizeof(tbcm_event_t));
          if (client->_xQueue == NULL) {
               TBC_LOGE("failed to create the queue! %s()", __FUNCTION__);
          }
@@ -85,6 +85,13 @@ tbcmh_handle_t tbcmh_init(void)
      _tbcmh_otaupdate_on_create(client);        //chunk: req-resp
      _tbcmh_claimingdevice_on_create(client);
      _tbcmh_provision_on_create(client);  //req-resp
+     _tbcmh_txwriter_on_create(client);
+     _tbcmh_telemetry_on_create(client);
+     _tbcmh_telemetrystore_on_create(client);
+     _tbcmh_jsonarena_on_create(client);
+     _tbcmh_ratelimit_on_create(client);
+     _tbcmh_timesync_on_create(client);
+     _tbcmh_attributemirror_on_create(client);
 
      client->next_request_id = 0;
      client->last_check_timestamp = (uint64_t)time(NULL);
@@ -107,11 +114,18 @@ void tbcmh_destroy(tbcmh_handle_t client)
      //tbce_clientattributes_destroy(client);
      _tbcmh_attributessubscribe_on_destroy(client);
      _tbcmh_attributesrequest_on_destroy(client);
+     _tbcmh_attributemirror_on_destroy(client);
      _tbcmh_serverrpc_on_destroy(client);
      _tbcmh_clientrpc_on_destroy(client);
      _tbcmh_otaupdate_on_destroy(client);
      _tbcmh_claimingdevice_on_destroy(client);
      _tbcmh_provision_on_destroy(client);
+     _tbcmh_txwriter_on_destroy(client);
+     _tbcmh_telemetry_on_destroy(client);
+     _tbcmh_telemetrystore_on_destroy(client);
+     _tbcmh_jsonarena_on_destroy(client);
+     _tbcmh_ratelimit_on_destroy(client);
+     _tbcmh_timesync_on_destroy(client);
 
      if (client->_lock) {
           vSemaphoreDelete(client->_lock);
@@ -306,6 +320,7 @@ bool tbcmh_connect_using_url(tbcmh_handle_t client,
     transport.credentials.token = config->access_token;
     transport.credentials.type = TBC_TRANSPORT_CREDENTIALS_TYPE_ACCESS_TOKEN;
     transport.log_rxtx_package = config->log_rxtx_package;
+    transport.payload_type = config->payload_type;
     result = tbcmh_connect(client, &transport, context, on_connected, on_disconnected);
 
 fail_exit:
@@ -359,6 +374,8 @@ void tbcmh_disconnect(tbcmh_handle_t client)
      _tbcmh_provision_on_disconnected(client);   //empty all request
      _tbcmh_otaupdate_on_disconnected(client);         //empty all request
      _tbcmh_claimingdevice_on_disconnected(client);
+     _tbcmh_telemetrystore_on_disconnected(client);
+     _tbcmh_telemetry_on_disconnected(client);
 
      // SemaphoreHandle_t lock;
      // uint16_t next_request_id;
@@ -373,6 +390,25 @@ bool tbcmh_is_connected(tbcmh_handle_t client)
      return false;
 }
 
+tbc_err_t tbcmh_get_link_stats(tbcmh_handle_t client, tbcmh_link_stats_t *stats)
+{
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(client, ESP_FAIL);
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(stats, ESP_FAIL);
+
+     memset(stats, 0x00, sizeof(tbcmh_link_stats_t));
+     stats->outbox_size = tbcm_outbox_size(client->tbmqttclient);
+     stats->ack_latency_ms = tbcm_ack_latency(client->tbmqttclient);
+     stats->txqueue_count = tbcm_txqueue_count(client->tbmqttclient);
+     stats->event_queue_size = TBCMH_EVENT_QUEUE_SIZE;
+     if (client->_xQueue) {
+          stats->event_queue_count = uxQueueMessagesWaiting(client->_xQueue);
+     }
+     // high-water mark since last call. It is updated in MQTT task, a race only loses one peak
+     stats->event_queue_high_water = client->event_queue_high_water;
+     client->event_queue_high_water = stats->event_queue_count;
+     return ESP_OK;
+}
+
 static void __on_tbcm_connected(tbcmh_handle_t client)
 {
      if (!client) {
@@ -386,7 +422,7 @@ static void __on_tbcm_connected(tbcmh_handle_t client)
           return;
      }
 
-     //_tbcmh_telemetry_on_connected(client);
+     _tbcmh_telemetrystore_on_connected(client);
      _tbcmh_attributesrequest_on_connected(client);
      //_tbcmh_clientattribute_on_connected(client);
      _tbcmh_attributessubscribe_on_connected(client);
@@ -395,6 +431,7 @@ static void __on_tbcm_connected(tbcmh_handle_t client)
      _tbcmh_claimingdevice_on_connected(client);
      _tbcmh_otaupdate_on_connected(client);
      _tbcmh_provision_on_connected(client);
+     _tbcmh_telemetry_on_connected(client);
 
      // clone parameter in lock/unlock
      void *context = client->context;
@@ -409,6 +446,9 @@ static void __on_tbcm_connected(tbcmh_handle_t client)
          on_connected(client, context);
      }
      TBC_LOGI("after call on_connected()");
+
+     // attributes requests of modules & on_connected() are sent as one
+     _tbcmh_attributesrequest_batch_send(client);
      return;
 }
 
@@ -434,6 +474,8 @@ static void __on_tbcm_disonnected(tbcmh_handle_t client)
      _tbcmh_provision_on_disconnected(client);   //empty all request
      _tbcmh_otaupdate_on_disconnected(client);         //empty all request
      _tbcmh_claimingdevice_on_disconnected(client);
+     _tbcmh_telemetrystore_on_disconnected(client);
+     _tbcmh_telemetry_on_disconnected(client);
 
      // clone parameter in lock/unlock
      void *context = client->context;
@@ -461,30 +503,68 @@ static void __on_tbcm_data_handle(tbcm_event_t *event)
         TBC_LOGE("event->event_id(%d) is not TBCM_EVENT_DATA(%d)!", event->event_id, TBCM_EVENT_DATA);
         return;
     }
+
+    // Large JSON payload is streamed fragment by fragment, it is parsed incrementally
+    if (event->data.total_payload_len > event->data.payload_len) {
+        switch (event->data.topic) {
+        case TBCM_RX_TOPIC_SHARED_ATTRIBUTES:
+             _tbcmh_attributessubscribe_on_fragment(client, event->data.payload, event->data.payload_len,
+                                                    event->data.payload_offset, event->data.total_payload_len);
+             break;
+        case TBCM_RX_TOPIC_SERVERRPC_REQUEST:
+             _tbcmh_serverrpc_on_fragment(client, event->data.request_id,
+                                          event->data.payload, event->data.payload_len,
+                                          event->data.payload_offset, event->data.total_payload_len);
+             break;
+        default:
+             TBC_LOGW("Unexpected fragment: event->data.topic=%d", event->data.topic);
+             break;
+        }
+        return;
+    }
+
+    // Decode protobuf to JSON of the same topic, then deal it as usual
+    const char *payload = event->data.payload;
+    int payload_len = event->data.payload_len;
+    txwriter_t json;
+    memset(&json, 0x00, sizeof(json));
+    if (client->config.payload_type == TBC_TRANSPORT_PAYLOAD_TYPE_PROTOBUF
+        && (event->data.topic == TBCM_RX_TOPIC_ATTRIBUTES_RESPONSE
+            || event->data.topic == TBCM_RX_TOPIC_SHARED_ATTRIBUTES
+            || event->data.topic == TBCM_RX_TOPIC_SERVERRPC_REQUEST
+            || event->data.topic == TBCM_RX_TOPIC_CLIENTRPC_RESPONSE)) {
+        if (!_tbcmh_pbcodec_to_json(event->data.topic, payload, payload_len, &json)) {
+            TBC_FIELD_FREE(json.buffer);
+            return;
+        }
+        payload = json.buffer;
+        payload_len = json.len;
+    }
+
+    // cJSON nodes of this message are parsed into arena, and are released at once at the end.
+    // They are lent to callbacks, which MUST cJSON_Duplicate() what they keep.
+    _tbcmh_jsonarena_begin(client);
     
     switch (event->data.topic) {
     case TBCM_RX_TOPIC_ATTRIBUTES_RESPONSE:  /*!< request_id,           payload, payload_len */
-         object = cJSON_ParseWithLength(event->data.payload, event->data.payload_len);
+         object = _tbcmh_jsonarena_parse(client, payload, payload_len);
          _tbcmh_attributesrequest_on_data(client, event->data.request_id, object);
-         cJSON_Delete(object);
+         _tbcmh_jsonarena_delete(client, object);
          break;
     
     case TBCM_RX_TOPIC_SHARED_ATTRIBUTES:    /*!<                       payload, payload_len */
-         object = cJSON_ParseWithLength(event->data.payload, event->data.payload_len);
-         _tbcmh_attributessubscribe_on_data(client, object);
-         cJSON_Delete(object);
+         // parse subscribed keys only
+         _tbcmh_attributessubscribe_on_data(client, payload, payload_len);
          break;
     
     case TBCM_RX_TOPIC_SERVERRPC_REQUEST:    /*!< request_id,           payload, payload_len */
-         object = cJSON_ParseWithLength(event->data.payload, event->data.payload_len);
-         _tbcmh_serverrpc_on_data(client, event->data.request_id, object);
-         cJSON_Delete(object);
+         // route by method, then parse params only
+         _tbcmh_serverrpc_on_data(client, event->data.request_id, payload, payload_len);
          break;
         
     case TBCM_RX_TOPIC_CLIENTRPC_RESPONSE:   /*!< request_id,           payload, payload_len */
-         object = cJSON_ParseWithLength(event->data.payload, event->data.payload_len);
-         _tbcmh_clientrpc_on_data(client, event->data.request_id, object);
-         cJSON_Delete(object);
+         // route by request_id, then parse results only
+         _tbcmh_clientrpc_on_data(client, event->data.request_id, payload, payload_len);
          break;
     
     case TBCM_RX_TOPIC_FW_RESPONSE:          /*!< request_id, chunk_id, payload, payload_len */
@@ -495,9 +575,9 @@ static void __on_tbcm_data_handle(tbcm_event_t *event)
          break;
     
     case TBCM_RX_TOPIC_PROVISION_RESPONSE:   /*!< (no request_id)       payload, payload_len */
-         object = cJSON_ParseWithLength(event->data.payload, event->data.payload_len);
+         object = _tbcmh_jsonarena_parse(client, payload, payload_len);
          _tbcmh_provision_on_data(client, event->data.request_id, object);
-         cJSON_Delete(object);
+         _tbcmh_jsonarena_delete(client, object);
          break;
 
     case TBCM_RX_TOPIC_ERROR:
@@ -505,6 +585,9 @@ static void __on_tbcm_data_handle(tbcm_event_t *event)
          TBC_LOGW("Other topic: event->data.topic=%d", event->data.topic);
          break;
     }
+
+    _tbcmh_jsonarena_end(client);
+    TBC_FIELD_FREE(json.buffer);
 }
 
 static void __on_tbcm_check_timeout(tbcmh_handle_t client)
@@ -561,6 +644,7 @@ static void _on_tbcm_event_handle(tbcm_event_t *event)
           break;
      case TBCM_EVENT_PUBLISHED:
           TBC_LOGI("TBCM_EVENT_PUBLISHED, msg_id=%d", event->msg_id);
+          _tbcmh_telemetrystore_on_published(client, event->msg_id);
           break;
 
      case TBCM_EVENT_DATA:
@@ -640,6 +724,12 @@ static void _on_tbcm_event_bridge_receive(tbcmh_handle_t client)
 void tbcmh_run(tbcmh_handle_t client)
 {
     _on_tbcm_event_bridge_receive(client);
+    _tbcmh_txqueue_on_run(client);
+    _tbcmh_telemetry_on_run(client);
+    _tbcmh_telemetrystore_on_run(client);
+    _tbcmh_timesync_on_run(client);
+    _tbcmh_attributesrequest_on_run(client);
+    _tbcmh_attributemirror_on_run(client);
 }
 
 // call in user task, NOT mqtt task!
@@ -715,6 +805,12 @@ static void _on_tbcm_event_bridge_send(tbcm_event_t *event)
         }
         TBC_LOGW("send innermsg timeout! %s()", __FUNCTION__);
     }
+
+    // high-water mark, it is read by tbcmh_get_link_stats()
+    uint32_t waiting = uxQueueMessagesWaiting(client->_xQueue);
+    if (waiting > client->event_queue_high_water) {
+        client->event_queue_high_water = waiting;
+    }
     
     // Give semaphore
     // xSemaphoreGiveRecursive(client->_lock);
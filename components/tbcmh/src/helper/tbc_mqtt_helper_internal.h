@@ -29,6 +29,7 @@
 // #include "tbc_mqtt_helper.h"
 
 #include "telemetry_upload.h"
+#include "telemetry_store.h"
 //#include "client_attribute.h"
 //#include "shared_attribute.h"
 #include "attributes_update.h"
@@ -39,11 +40,22 @@
 #include "provision_request.h"
 #include "claiming_device.h"
 #include "ota_update.h"
+#include "tx_writer.h"
+#include "json_scanner.h"
+#include "json_arena.h"
+#include "pb_codec.h"
+#include "key_intern.h"
+#include "json_sax.h"
+#include "rate_limit.h"
+#include "time_sync.h"
+#include "attributes_mirror.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+#define TBCMH_EVENT_QUEUE_SIZE (40)   /*!< capacity of _xQueue, events from MQTT task to user task */
+
 /**
  * ThingsBoard MQTT Client Helper 
  */
@@ -54,6 +66,7 @@ typedef struct tbcmh_client
      tbcm_handle_t tbmqttclient;
      // bool is_running_in_mqtt_task;           /*!< is these code running in MQTT task? */
      QueueHandle_t _xQueue;
+     volatile uint32_t event_queue_high_water; /*!< high-water mark of _xQueue, reset by tbcmh_get_link_stats() */
 
      // modify at connect & disconnect
      tbc_transport_storage_t config;         // TODO: remove it???
@@ -66,11 +79,25 @@ typedef struct tbcmh_client
      // timeseriesaxis_list_t   timeseriesaxis_list;      /*!< telemetry time-series data entries */
      // clientattribute_list_t  clientattribute_list;     /*!< client attributes entries */
      attributessubscribe_list_t attributessubscribe_list; /*!< attributes subscreibe entries */
+     subscribekey_list_t attributessubscribe_index[TBCMH_ATTRIBUTESSUBSCRIBE_BUCKETS]; /*!< subscribed keys indexed by hash of key */
+     uint32_t attributessubscribe_mark;                   /*!< mark of the payload being dispatched */
      attributesrequest_list_t   attributesrequest_list;   /*!< attributes request entries */
+     attributesrequest_list_t   attributesrequest_local_list; /*!< attributes requests answered by snapshot */
+     attributesrequestbatch_t  *attributesrequest_batch;  /*!< requests combined at connect time, NULL if not collecting */
+     attributemirror_list_t     attributemirror_list;     /*!< local mirrors of attributes */
+     attributemirrorstore_t     attributemirrorstore;     /*!< snapshot of attributes for warm start */
+     attributesstream_t *attributesstream;                /*!< shared attributes being streamed, NULL if none */
      serverrpc_list_t serverrpc_list; /*!< server side RPC entries */
+     serverrpcstream_t *serverrpcstream; /*!< server side RPC request being streamed, NULL if none */
      clientrpc_list_t clientrpc_list; /*!< client side RPC entries */
      otaupdate_list_t otaupdate_list; /*!< A device may have multiple firmware */
      provision_list_t deviceprovision_list;     /*!< device provision entries */
+     txwriter_t txwriter;             /*!< streaming JSON writer of telemetry & attributes */
+     telemetrybatch_t telemetrybatch; /*!< timestamped telemetry samples to be published together */
+     telemetrystore_t telemetrystore; /*!< store-and-forward log of telemetry while offline */
+     jsonarena_t jsonarena;           /*!< arena of cJSON nodes of a received message */
+     ratelimitsession_t ratelimitsession; /*!< policy of the rate limits advertised by the server */
+     timesync_t timesync;             /*!< device clock aligned to the server clock */
 
      //SemaphoreHandle_t lock;
      uint16_t next_request_id;
@@ -0,0 +1,618 @@
+// Copyright 2022 liangzhuzhi2020@gmail.com, https://github.com/liang-zhu-zi/esp32-thingsboard-mqtt-client
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// This file is called by tbc_mqtt_helper.c/.h.
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "esp_err.h"
+#include "esp_timer.h"
+
+#include "tbc_utils.h"
+#include "tbc_mqtt_helper_internal.h"
+
+#include "telemetry_store.h"
+
+static const char *TAG = "TELEMETRY_STORE";
+
+//==== Log & cursor files ============================================================
+
+// Make sure written data survives a power loss
+static bool _telemetrystore_close_file(FILE *file, bool is_written)
+{
+    bool result = true;
+    if (is_written) {
+        result = (fflush(file) == 0) && (fsync(fileno(file)) == 0);
+    }
+    return (fclose(file) == 0) && result;
+}
+
+// The cursor is saved with its complement, a torn write is detected as an invalid cursor
+static bool _telemetrystore_save_cursor(telemetrystore_t *store)
+{
+    FILE *file = fopen(store->cursor_path, "wb");
+    if (!file) {
+        TBC_LOGE("Unable to open %s!", store->cursor_path);
+        return false;
+    }
+    uint32_t cursor[2] = {store->cursor, ~store->cursor};
+    bool result = (fwrite(cursor, sizeof(cursor), 1, file) == 1);
+    return _telemetrystore_close_file(file, true) && result;
+}
+
+static uint32_t _telemetrystore_load_cursor(telemetrystore_t *store)
+{
+    FILE *file = fopen(store->cursor_path, "rb");
+    if (!file) {
+        return 0;
+    }
+    uint32_t cursor[2] = {0, 0};
+    bool result = (fread(cursor, sizeof(cursor), 1, file) == 1);
+    fclose(file);
+    if (!result || cursor[0] != ~cursor[1]) {
+        TBC_LOGW("Cursor of telemetry log is invalid, replay from the beginning!");
+        return 0;
+    }
+    return cursor[0];
+}
+
+// Find the end of the last complete record. A record torn by a power loss is discarded.
+// The cursor must be at the boundary of a record, otherwise it is stale, e.g. the cursor file
+// isn't removed with its log, and replay restarts from the beginning.
+static uint32_t _telemetrystore_scan(telemetrystore_t *store)
+{
+    FILE *file = fopen(store->log_path, "rb");
+    if (!file) {
+        store->cursor = 0;
+        return 0;
+    }
+    fseek(file, 0, SEEK_END);
+    long file_size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    uint32_t offset = 0;
+    uint32_t len = 0;
+    bool is_cursor_valid = (store->cursor == 0);
+    while (fread(&len, sizeof(len), 1, file) == 1) {
+        if (len == 0 || offset + sizeof(len) + len > file_size) {
+            break;
+        }
+        offset += sizeof(len) + len;
+        is_cursor_valid = is_cursor_valid || (store->cursor == offset);
+        fseek(file, offset, SEEK_SET);
+    }
+    fclose(file);
+
+    if (offset != file_size) {
+        TBC_LOGW("Discard a torn record of telemetry log! size=%ld, valid=%u", file_size, offset);
+        if (truncate(store->log_path, offset) != 0) {
+            TBC_LOGE("Unable to truncate %s!", store->log_path);
+        }
+    }
+    if (!is_cursor_valid) {
+        TBC_LOGW("Cursor(%u) of telemetry log isn't at a record, replay from the beginning!", store->cursor);
+        store->cursor = 0;
+    }
+    return offset;
+}
+
+// Sync appended records to flash, so they survive a power loss
+static bool _telemetrystore_sync(telemetrystore_t *store)
+{
+    bool result = true;
+    if (store->file && store->is_unsynced) {
+        result = (fflush(store->file) == 0) && (fsync(fileno(store->file)) == 0);
+    }
+    store->is_unsynced = false;
+    store->last_sync_time = esp_timer_get_time();
+    return result;
+}
+
+static void _telemetrystore_close_log(telemetrystore_t *store)
+{
+    if (store->file) {
+        if (!_telemetrystore_sync(store)) {
+            TBC_LOGE("Unable to sync %s!", store->log_path);
+        }
+        fclose(store->file);
+        store->file = NULL;
+    }
+}
+
+// All records are acknowledged, remove files to reclaim space
+static void _telemetrystore_drain(telemetrystore_t *store)
+{
+    _telemetrystore_close_log(store);
+    store->size = 0;
+    store->cursor = 0;
+    store->inflight_end = 0;
+    // A cursor which isn't removed would skip records of the next log, so it is reset instead
+    if (remove(store->cursor_path) != 0 && errno != ENOENT && !_telemetrystore_save_cursor(store)) {
+        TBC_LOGE("Unable to reset cursor of telemetry log!");
+    }
+    remove(store->log_path);
+}
+
+// Copy unacknowledged records to a new log file, so space of acknowledged records is reclaimed
+// while the log is still pending. The cursor is reset before the new log replaces the old one,
+// a power loss between them replays acknowledged records again, instead of losing unacknowledged ones.
+static bool _telemetrystore_compact(telemetrystore_t *store)
+{
+    _telemetrystore_close_log(store);
+
+    FILE *src = fopen(store->log_path, "rb");
+    FILE *dst = src ? fopen(store->temp_path, "wb") : NULL;
+    bool result = src && dst && (fseek(src, store->cursor, SEEK_SET) == 0);
+    char buffer[256];
+    uint32_t offset = store->cursor;
+    while (result && offset < store->size) {
+        uint32_t len = store->size - offset;
+        if (len > sizeof(buffer)) {
+            len = sizeof(buffer);
+        }
+        result = (fread(buffer, 1, len, src) == len) && (fwrite(buffer, 1, len, dst) == len);
+        offset += len;
+    }
+    if (src) {
+        fclose(src);
+    }
+    if (dst) {
+        result = _telemetrystore_close_file(dst, true) && result;
+    }
+    if (!result) {
+        TBC_LOGE("Unable to copy %s to %s!", store->log_path, store->temp_path);
+        remove(store->temp_path);
+        return false;
+    }
+
+    uint32_t cursor = store->cursor;
+    store->cursor = 0;
+    if (!_telemetrystore_save_cursor(store)) {
+        TBC_LOGE("Unable to reset cursor of telemetry log!");
+        store->cursor = cursor;
+        _telemetrystore_save_cursor(store);
+        remove(store->temp_path);
+        return false;
+    }
+    // rename() of FAT doesn't replace an existing file. A new log without its old one is recovered when opening
+    remove(store->log_path);
+    if (rename(store->temp_path, store->log_path) != 0) {
+        TBC_LOGE("Unable to rename %s to %s!", store->temp_path, store->log_path);
+        store->size = _telemetrystore_scan(store);
+        return false;
+    }
+
+    store->size -= cursor;
+    if (store->inflight_msg_id >= 0) {
+        store->inflight_end -= cursor;
+    }
+    TBC_LOGI("Telemetry log is compacted, %u bytes are reclaimed", cursor);
+    return true;
+}
+
+//==== Append ========================================================================
+
+bool _tbcmh_telemetrystore_is_pending(tbcmh_handle_t client)
+{
+    // This function is in semaphore/client->_lock!!!
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(client, false);
+
+    telemetrystore_t *store = &client->telemetrystore;
+    return store->is_opened && store->cursor < store->size;
+}
+
+// Append a record, acknowledged records are reclaimed if the log file is full
+static bool _telemetrystore_append_record(telemetrystore_t *store, const char *prefix, int prefix_len,
+                                          const char *payload, int len, const char *suffix)
+{
+    uint32_t suffix_len = strlen(suffix);
+    uint32_t record_len = prefix_len + len + suffix_len;
+    int max_size = (store->config.max_size > 0) ? store->config.max_size : TBCMH_TELEMETRY_STORE_MAX_SIZE;
+    if (store->size - store->cursor + sizeof(record_len) + record_len > max_size) {
+        TBC_LOGW("Telemetry log is full, drop it! pending=%u", store->size - store->cursor);
+        return false;
+    }
+    if (store->size + sizeof(record_len) + record_len > max_size && !_telemetrystore_compact(store)) {
+        TBC_LOGW("Unable to compact telemetry log, drop it! size=%u", store->size);
+        return false;
+    }
+
+    // The log is kept open. Records are flushed for replay at once, and fsync() is batched
+    if (!store->file) {
+        store->file = fopen(store->log_path, "ab");
+        if (!store->file) {
+            TBC_LOGE("Unable to open %s!", store->log_path);
+            return false;
+        }
+    }
+    FILE *file = store->file;
+    bool result = (fwrite(&record_len, sizeof(record_len), 1, file) == 1)
+                  && (fwrite(prefix, 1, prefix_len, file) == prefix_len)
+                  && (fwrite(payload, 1, len, file) == len)
+                  && (fwrite(suffix, 1, suffix_len, file) == suffix_len)
+                  && (fflush(file) == 0);
+    if (!result) {
+        TBC_LOGE("Unable to append to %s!", store->log_path);
+        fclose(store->file);
+        store->file = NULL;
+        store->is_unsynced = false;
+        store->size = _telemetrystore_scan(store);
+        return false;
+    }
+    store->size += sizeof(record_len) + record_len;
+    store->is_unsynced = true;
+    return true;
+}
+
+// Append an object as a record, it is stamped with ts if it hasn't "ts"
+static bool _telemetrystore_append_object(telemetrystore_t *store, const char *object, int len, int64_t ts)
+{
+    char prefix[48] = {0};
+    int prefix_len = 0;
+    const char *suffix = "";
+    const char *value = NULL;
+    int value_len = 0;
+    if (!_tbcmh_jsonscanner_find(object, len, "ts", &value, &value_len)) {
+        prefix_len = snprintf(prefix, sizeof(prefix), "{\"ts\":%lld,\"values\":", (long long)ts);
+        suffix = "}";
+    }
+    return _telemetrystore_append_record(store, prefix, prefix_len, object, len, suffix);
+}
+
+// Append telemetry as records. An array is appended as its elements, an object without "ts" is stamped.
+bool _tbcmh_telemetrystore_append(tbcmh_handle_t client, const char *payload, int len)
+{
+    // This function is in semaphore/client->_lock!!!
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(client, false);
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(payload, false);
+
+    telemetrystore_t *store = &client->telemetrystore;
+    if (!store->is_opened) {
+        return false;
+    }
+
+    // trim
+    while (len > 0 && (*payload == ' ' || *payload == '\t' || *payload == '\r' || *payload == '\n')) {
+        payload++;
+        len--;
+    }
+    while (len > 0 && (payload[len-1] == ' ' || payload[len-1] == '\t' || payload[len-1] == '\r'
+                       || payload[len-1] == '\n' || payload[len-1] == '\0')) {
+        len--;
+    }
+
+    // Elements of an array are stamped with the same ts, they are joined with ',' when replaying
+    bool result = true;
+    int64_t ts = tbcmh_timesync_now_ms(client);
+    if (len >= 2 && payload[0] == '[' && payload[len-1] == ']') {
+        jsonscanner_t scanner;
+        const char *element = NULL;
+        int element_len = 0;
+        _tbcmh_jsonscanner_init_array(&scanner, payload, len);
+        while (_tbcmh_jsonscanner_next_element(&scanner, &element, &element_len)) {
+            if (element_len < 2 || element[0] != '{') {
+                TBC_LOGW("Element of telemetry is not a json object, skip it! %s()", __FUNCTION__);
+                result = false;
+                continue;
+            }
+            result = _telemetrystore_append_object(store, element, element_len, ts) && result;
+        }
+    } else if (len >= 2 && payload[0] == '{') {
+        result = _telemetrystore_append_object(store, payload, len, ts);
+    } else {
+        TBC_LOGW("Telemetry is not a json object or array! %s()", __FUNCTION__);
+        return false;
+    }
+
+    int interval = (store->config.sync_interval_ms > 0) ? store->config.sync_interval_ms
+                                                        : TBCMH_TELEMETRY_STORE_SYNC_INTERVAL;
+    if (store->is_unsynced && esp_timer_get_time() - store->last_sync_time >= (int64_t)interval * 1000
+        && !_telemetrystore_sync(store)) {
+        TBC_LOGE("Unable to sync %s!", store->log_path);
+    }
+    return result;
+}
+
+// Move telemetry of the priority TX queue to the log, it isn't sent while offline.
+// Queued telemetry is older than telemetry appended after it, so it is called before appending.
+void _tbcmh_telemetrystore_take_queued(tbcmh_handle_t client)
+{
+    // This function is in semaphore/client->_lock!!!
+    TBC_CHECK_PTR(client);
+
+    if (!client->telemetrystore.is_opened
+        || client->config.payload_type != TBC_TRANSPORT_PAYLOAD_TYPE_JSON) {
+        return;
+    }
+
+    int len = 0;
+    char *payload = NULL;
+    while ((payload = tbcm_txqueue_take_telemetry(client->tbmqttclient, &len)) != NULL) {
+        if (!_tbcmh_telemetrystore_append(client, payload, len)) {
+            TBC_LOGW("Unable to append queued telemetry to log, drop it!");
+        }
+        TBC_FREE(payload);
+    }
+}
+
+//==== Replay ========================================================================
+
+// Publish records after cursor as an array of at most replay_size bytes
+static void _telemetrystore_replay(tbcmh_handle_t client)
+{
+    telemetrystore_t *store = &client->telemetrystore;
+    FILE *file = fopen(store->log_path, "rb");
+    if (!file) {
+        TBC_LOGE("Unable to open %s!", store->log_path);
+        return;
+    }
+    fseek(file, store->cursor, SEEK_SET);
+
+    int replay_size = (store->config.replay_size > 0) ? store->config.replay_size : TBCMH_TELEMETRY_STORE_REPLAY_SIZE;
+    char *buffer = NULL;
+    int buffer_len = 0;
+    uint32_t offset = store->cursor;
+    uint32_t len = 0;
+    while (offset < store->size && fread(&len, sizeof(len), 1, file) == 1) {
+        // '[' or ',' before it, and ']' & '\0' after it. The first record is always sent, even it is big.
+        if (buffer && buffer_len + len + 3 > replay_size) {
+            break;
+        }
+        char *temp = TBC_REALLOC(buffer, buffer_len + len + 3);
+        if (!temp) {
+            TBC_LOGE("Unable to realloc memeory! %s()", __FUNCTION__);
+            break;
+        }
+        buffer = temp;
+        buffer[buffer_len] = (buffer_len == 0) ? '[' : ',';
+        if (fread(buffer + buffer_len + 1, 1, len, file) != len) {
+            TBC_LOGE("Unable to read %s!", store->log_path);
+            break;
+        }
+        buffer_len += 1 + len;
+        offset += sizeof(len) + len;
+    }
+    fclose(file);
+
+    if (buffer && offset > store->cursor) {
+        buffer[buffer_len++] = ']';
+        buffer[buffer_len] = '\0';
+        // never queued by priority TX queue, msg_id is tracked
+        int msg_id = tbcm_telemetry_publish_now(client->tbmqttclient, buffer, buffer_len, 1/*qos*/, 0/*retain*/);
+        if (msg_id > 0) {
+            store->inflight_msg_id = msg_id;
+            store->inflight_end = offset;
+        } else {
+            TBC_LOGW("Unable to replay telemetry log! %s()", __FUNCTION__);
+        }
+    }
+    TBC_FREE(buffer);
+}
+
+void _tbcmh_telemetrystore_on_run(tbcmh_handle_t client)
+{
+    TBC_CHECK_PTR(client);
+
+    telemetrystore_t *store = &client->telemetrystore;
+    int64_t now = esp_timer_get_time();
+    int sync_interval = (store->config.sync_interval_ms > 0) ? store->config.sync_interval_ms
+                                                             : TBCMH_TELEMETRY_STORE_SYNC_INTERVAL;
+    bool is_sync_due = store->is_unsynced && now - store->last_sync_time >= (int64_t)sync_interval * 1000;
+    if (!is_sync_due && (!_tbcmh_telemetrystore_is_pending(client) || store->inflight_msg_id >= 0)) {
+        return;
+    }
+
+    // Take semaphore
+    if (xSemaphoreTakeRecursive(client->_lock, (TickType_t)0xFFFFF) != pdTRUE) {
+         TBC_LOGE("Unable to take semaphore! %s()", __FUNCTION__);
+         return;
+    }
+
+    if (is_sync_due && !_telemetrystore_sync(store)) {
+        TBC_LOGE("Unable to sync %s!", store->log_path);
+    }
+
+    int interval = (store->config.replay_interval_ms > 0) ? store->config.replay_interval_ms
+                                                          : TBCMH_TELEMETRY_STORE_REPLAY_INTERVAL;
+    if (_tbcmh_telemetrystore_is_pending(client) && store->inflight_msg_id < 0
+        && tbcmh_is_connected(client) && now - store->last_replay_time >= (int64_t)interval * 1000
+        && tbcm_txqueue_count(client->tbmqttclient) == 0) { // replay yields to queued messages
+        store->last_replay_time = now;
+        _telemetrystore_replay(client);
+    }
+
+    // Give semaphore
+    xSemaphoreGiveRecursive(client->_lock);
+}
+
+void _tbcmh_telemetrystore_on_published(tbcmh_handle_t client, int msg_id)
+{
+    TBC_CHECK_PTR(client);
+
+    telemetrystore_t *store = &client->telemetrystore;
+    if (!store->is_opened || store->inflight_msg_id < 0 || store->inflight_msg_id != msg_id) {
+        return;
+    }
+
+    // Take semaphore
+    if (xSemaphoreTakeRecursive(client->_lock, (TickType_t)0xFFFFF) != pdTRUE) {
+         TBC_LOGE("Unable to take semaphore! %s()", __FUNCTION__);
+         return;
+    }
+
+    // Acknowledged, move cursor durably
+    store->inflight_msg_id = -1;
+    store->cursor = store->inflight_end;
+    if (store->cursor >= store->size) {
+        TBC_LOGI("Telemetry log is drained!");
+        _telemetrystore_drain(store);
+    } else if (!_telemetrystore_save_cursor(store)) {
+        TBC_LOGE("Unable to save cursor of telemetry log!");
+    }
+
+    // Give semaphore
+    xSemaphoreGiveRecursive(client->_lock);
+}
+
+//==== Lifecycle =====================================================================
+
+void _tbcmh_telemetrystore_on_create(tbcmh_handle_t client)
+{
+    // This function is in semaphore/client->_lock!!!
+    TBC_CHECK_PTR(client);
+
+    memset(&client->telemetrystore, 0x00, sizeof(client->telemetrystore));
+    client->telemetrystore.inflight_msg_id = -1;
+}
+
+void _tbcmh_telemetrystore_on_destroy(tbcmh_handle_t client)
+{
+    // This function is in semaphore/client->_lock!!!
+    TBC_CHECK_PTR(client);
+
+    tbcmh_telemetry_store_close(client);
+}
+
+void _tbcmh_telemetrystore_on_connected(tbcmh_handle_t client)
+{
+    // This function is in semaphore/client->_lock!!!
+    TBC_CHECK_PTR(client);
+
+    // replay at once
+    telemetrystore_t *store = &client->telemetrystore;
+    store->inflight_msg_id = -1;
+    store->last_replay_time = 0;
+    if (_tbcmh_telemetrystore_is_pending(client)) {
+        TBC_LOGI("Replay telemetry log, pending=%u", store->size - store->cursor);
+    }
+}
+
+void _tbcmh_telemetrystore_on_disconnected(tbcmh_handle_t client)
+{
+    // This function is in semaphore/client->_lock!!!
+    TBC_CHECK_PTR(client);
+
+    // The inflight replay publish isn't acknowledged, it is resent from cursor after reconnecting
+    client->telemetrystore.inflight_msg_id = -1;
+    _tbcmh_telemetrystore_take_queued(client);
+}
+
+tbc_err_t tbcmh_telemetry_store_open(tbcmh_handle_t client, const tbcmh_telemetry_store_config_t *config)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(client, ESP_FAIL);
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(config, ESP_FAIL);
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(config->path, ESP_FAIL);
+
+    // Take semaphore
+    if (xSemaphoreTakeRecursive(client->_lock, (TickType_t)0xFFFFF) != pdTRUE) {
+         TBC_LOGE("Unable to take semaphore! %s()", __FUNCTION__);
+         return ESP_FAIL;
+    }
+
+    telemetrystore_t *store = &client->telemetrystore;
+    if (store->is_opened) {
+         TBC_LOGE("Telemetry log is already opened! %s()", __FUNCTION__);
+         xSemaphoreGiveRecursive(client->_lock);
+         return ESP_FAIL;
+    }
+
+    int path_len = strlen(config->path);
+    store->log_path = TBC_MALLOC(path_len + 1);
+    store->cursor_path = TBC_MALLOC(path_len + 5);
+    store->temp_path = TBC_MALLOC(path_len + 5);
+    if (!store->log_path || !store->cursor_path || !store->temp_path) {
+         TBC_LOGE("Unable to malloc memeory! %s()", __FUNCTION__);
+         TBC_FIELD_FREE(store->log_path);
+         TBC_FIELD_FREE(store->cursor_path);
+         TBC_FIELD_FREE(store->temp_path);
+         xSemaphoreGiveRecursive(client->_lock);
+         return ESP_FAIL;
+    }
+    memcpy(store->log_path, config->path, path_len + 1);
+    snprintf(store->cursor_path, path_len + 5, "%s.cur", config->path);
+    snprintf(store->temp_path, path_len + 5, "%s.tmp", config->path);
+    memcpy(&store->config, config, sizeof(store->config));
+    store->config.path = store->log_path;
+
+    // Recover a compacting interrupted by a power loss. The new log is complete if the old one is removed
+    FILE *file = fopen(store->log_path, "rb");
+    if (file) {
+         fclose(file);
+         remove(store->temp_path);
+    } else if (rename(store->temp_path, store->log_path) == 0) {
+         TBC_LOGW("Recover compacted telemetry log!");
+    }
+
+    // Recover size & cursor of the last run
+    store->cursor = _telemetrystore_load_cursor(store);
+    store->size = _telemetrystore_scan(store);
+    store->file = NULL;
+    store->is_unsynced = false;
+    store->last_sync_time = esp_timer_get_time();
+    if (store->cursor >= store->size) {
+         _telemetrystore_drain(store);
+    }
+    store->inflight_msg_id = -1;
+    store->last_replay_time = 0;
+    store->is_opened = true;
+    TBC_LOGI("Telemetry log is opened, size=%u, cursor=%u", store->size, store->cursor);
+
+    // Give semaphore
+    xSemaphoreGiveRecursive(client->_lock);
+    return ESP_OK;
+}
+
+void tbcmh_telemetry_store_close(tbcmh_handle_t client)
+{
+    TBC_CHECK_PTR(client);
+
+    // Take semaphore
+    if (xSemaphoreTakeRecursive(client->_lock, (TickType_t)0xFFFFF) != pdTRUE) {
+         TBC_LOGE("Unable to take semaphore! %s()", __FUNCTION__);
+         return;
+    }
+
+    telemetrystore_t *store = &client->telemetrystore;
+    _telemetrystore_close_log(store);
+    TBC_FIELD_FREE(store->log_path);
+    TBC_FIELD_FREE(store->cursor_path);
+    TBC_FIELD_FREE(store->temp_path);
+    memset(store, 0x00, sizeof(telemetrystore_t));
+    store->inflight_msg_id = -1;
+
+    // Give semaphore
+    xSemaphoreGiveRecursive(client->_lock);
+}
+
+int tbcmh_telemetry_store_get_pending(tbcmh_handle_t client)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(client, 0);
+
+    // Take semaphore
+    if (xSemaphoreTakeRecursive(client->_lock, (TickType_t)0xFFFFF) != pdTRUE) {
+         TBC_LOGE("Unable to take semaphore! %s()", __FUNCTION__);
+         return 0;
+    }
+
+    telemetrystore_t *store = &client->telemetrystore;
+    int pending = _tbcmh_telemetrystore_is_pending(client) ? (store->size - store->cursor) : 0;
+
+    // Give semaphore
+    xSemaphoreGiveRecursive(client->_lock);
+    return pending;
+}
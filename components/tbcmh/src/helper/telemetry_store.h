@@ -0,0 +1,72 @@
+// Copyright 2022 liangzhuzhi2020@gmail.com, https://github.com/liang-zhu-zi/esp32-thingsboard-mqtt-client
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// This file is called by tbc_mqtt_helper.c/.h.
+
+#ifndef _TELEMETRY_STORE_H_
+#define _TELEMETRY_STORE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "tbc_mqtt_helper.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TBCMH_TELEMETRY_STORE_MAX_SIZE         (64*1024) /*!< default max size of log file */
+#define TBCMH_TELEMETRY_STORE_REPLAY_SIZE      (4*1024)  /*!< default max payload size of a replay publish */
+#define TBCMH_TELEMETRY_STORE_REPLAY_INTERVAL  (100)     /*!< default min interval between replay publishes, in ms */
+#define TBCMH_TELEMETRY_STORE_SYNC_INTERVAL    (1000)    /*!< default max interval between fsync() of appended records, in ms */
+
+/**
+ * ThingsBoard MQTT Client Helper store-and-forward log of telemetry.
+ * Each record of log file is a 4-byte length and an element of telemetry array, e.g. {"ts":..,"values":{..}}
+ */
+typedef struct telemetrystore
+{
+     bool is_opened;                          /*!< tbcmh_telemetry_store_open() is called */
+     tbcmh_telemetry_store_config_t config;   /*!< config, path points to log_path */
+     char *log_path;                          /*!< path of log file */
+     char *cursor_path;                       /*!< path of cursor file */
+     char *temp_path;                         /*!< path of new log file while compacting */
+     FILE *file;                              /*!< log file opened for appending, NULL if it isn't opened yet */
+     bool is_unsynced;                        /*!< records are appended after the last fsync() */
+     int64_t last_sync_time;                  /*!< esp_timer_get_time() of the last fsync(), in us */
+     uint32_t size;                           /*!< size of log file, acknowledged records before cursor are reclaimed by compacting */
+     uint32_t cursor;                         /*!< offset of the first unacknowledged record, it is saved durably */
+     uint32_t inflight_end;                   /*!< end offset of records in the inflight replay publish */
+     int inflight_msg_id;                     /*!< msg_id of the inflight replay publish, -1 if none */
+     int64_t last_replay_time;                /*!< esp_timer_get_time() of the last replay publish, in us */
+} telemetrystore_t;
+
+void _tbcmh_telemetrystore_on_create(tbcmh_handle_t client);
+void _tbcmh_telemetrystore_on_destroy(tbcmh_handle_t client);
+void _tbcmh_telemetrystore_on_connected(tbcmh_handle_t client);
+void _tbcmh_telemetrystore_on_disconnected(tbcmh_handle_t client);
+void _tbcmh_telemetrystore_on_published(tbcmh_handle_t client, int msg_id);
+void _tbcmh_telemetrystore_on_run(tbcmh_handle_t client);
+
+bool _tbcmh_telemetrystore_is_pending(tbcmh_handle_t client);
+bool _tbcmh_telemetrystore_append(tbcmh_handle_t client, const char *payload, int len);
+void _tbcmh_telemetrystore_take_queued(tbcmh_handle_t client);
+
+#ifdef __cplusplus
+}
+#endif //__cplusplus
+
+#endif
@@ -17,17 +17,46 @@
 #include <string.h>
 
 #include "esp_err.h"
+#include "esp_timer.h"
 
 #include "tbc_utils.h"
 #include "tbc_mqtt_helper_internal.h"
 
 static const char *TAG = "TELEMETRY_UPLOAD";
 
+// Publish telemetry, or append it to the store-and-forward log if it is offline or the log isn't drained yet.
+// This function is in semaphore/client->_lock!!!
+// return msg_id on success, 0 if it is appended to the log, -1 on failure
+int _tbcmh_telemetry_publish(tbcmh_handle_t client, const char *payload, int len, int qos, int retain)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(client, ESP_FAIL);
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(payload, ESP_FAIL);
+
+    // Protobuf payload isn't stored
+    bool is_stored = client->telemetrystore.is_opened
+                     && client->config.payload_type == TBC_TRANSPORT_PAYLOAD_TYPE_JSON;
+    if (is_stored && (!tbcmh_is_connected(client) || _tbcmh_telemetrystore_is_pending(client))) {
+        if (!tbcmh_is_connected(client)) {
+            _tbcmh_telemetrystore_take_queued(client);
+        }
+        return _tbcmh_telemetrystore_append(client, payload, len) ? 0 : ESP_FAIL;
+    }
+
+    int msg_id = tbcm_telemetry_publish_ex(client->tbmqttclient, payload, len, qos, retain);
+    if (msg_id < 0 && is_stored) {
+        return _tbcmh_telemetrystore_append(client, payload, len) ? 0 : ESP_FAIL;
+    }
+    return msg_id;
+}
+
 int tbcmh_telemetry_upload(tbcmh_handle_t client, const char *telemetry,
                             int qos/*= 1*/, int retain/*= 0*/)
 {
     TBC_CHECK_PTR_WITH_RETURN_VALUE(client, ESP_FAIL);
     TBC_CHECK_PTR_WITH_RETURN_VALUE(telemetry, ESP_FAIL);
+    if (!_tbcmh_txwriter_check_json(client, __FUNCTION__)) {
+        return ESP_FAIL;
+    }
 
     // Take semaphore
     if (xSemaphoreTakeRecursive(client->_lock, (TickType_t)0xFFFFF) != pdTRUE) {
@@ -35,7 +64,7 @@ int tbcmh_telemetry_upload(tbcmh_handle_t client, const char *telemetry,
          return ESP_FAIL;
     }
 
-    int msg_id = tbcm_telemetry_publish(client->tbmqttclient, telemetry, qos, retain);
+    int msg_id = _tbcmh_telemetry_publish(client, telemetry, strlen(telemetry), qos, retain);
 
     // Give semaphore
     xSemaphoreGiveRecursive(client->_lock);
@@ -48,8 +77,250 @@ int tbcmh_telemetry_upload_ex(tbcmh_handle_t client, const tbcmh_value_t *object
     TBC_CHECK_PTR_WITH_RETURN_VALUE(client, ESP_FAIL);
     TBC_CHECK_PTR_WITH_RETURN_VALUE(object, ESP_FAIL);
 
-    char *pack = cJSON_PrintUnformatted(object); //cJSON_Print()
-    int msg_id = tbcmh_telemetry_upload(client, pack, qos, retain);
-    cJSON_free(pack); // free memory
+    // print to the reusable TX buffer instead of cJSON_PrintUnformatted()
+    return _tbcmh_txwriter_publish_object(client, TBCMH_TX_TELEMETRY, object, qos, retain);
+}
+
+//==== Telemetry batch ===============================================================
+
+static int _telemetrybatch_max_payload_size(const telemetrybatch_t *batch)
+{
+    return (batch->config.max_payload_size > 0) ? batch->config.max_payload_size : TBCMH_TX_BUFFER_MAX_SIZE;
+}
+
+// '{"ts":..,"values":{..}}' with a leading '[' or ','
+static bool _telemetrybatch_put_sample(txwriter_t *writer, int64_t ts, const cJSON *values)
+{
+    return _tbcmh_txwriter_put_raw(writer, (writer->count > 0) ? ",{\"ts\":" : "[{\"ts\":", 7)
+           && _tbcmh_txwriter_put_int(writer, ts)
+           && _tbcmh_txwriter_put_raw(writer, ",\"values\":", 10)
+           && _tbcmh_txwriter_put_json(writer, values)
+           && _tbcmh_txwriter_put_raw(writer, "}", 1);
+}
+
+// Publish pending samples, or append them to the store-and-forward log if it is offline.
+// Samples are kept until they are published or appended.
+// This function is in semaphore/client->_lock!!!
+static int _telemetrybatch_flush(tbcmh_handle_t client)
+{
+    telemetrybatch_t *batch = &client->telemetrybatch;
+    txwriter_t *writer = &batch->writer;
+    if (writer->count <= 0) {
+        return 0;
+    }
+    if (!tbcmh_is_connected(client) && !client->telemetrystore.is_opened) {
+        return ESP_FAIL; // kept until it is connected
+    }
+
+    // _txwriter_reserve() always keeps two bytes for ']' & '\0'
+    writer->buffer[writer->len++] = ']';
+    writer->buffer[writer->len] = '\0';
+    int msg_id = _tbcmh_telemetry_publish(client, writer->buffer, writer->len,
+                                          batch->config.qos, 0/*retain*/);
+    if (msg_id < 0) {
+        TBC_LOGW("Unable to publish telemetry batch, keep it! count=%d", writer->count);
+        writer->buffer[--writer->len] = '\0';
+        return msg_id;
+    }
+
+    float fill_ratio = (float)writer->len / _telemetrybatch_max_payload_size(batch);
+    batch->stats.sample_count += writer->count;
+    batch->stats.publish_count++;
+    batch->stats.last_fill_ratio = fill_ratio;
+    batch->stats.avg_fill_ratio += (fill_ratio - batch->stats.avg_fill_ratio) / batch->stats.publish_count;
+
+    writer->len = 0;
+    writer->count = 0;
+    return msg_id;
+}
+
+void _tbcmh_telemetry_on_create(tbcmh_handle_t client)
+{
+    // This function is in semaphore/client->_lock!!!
+    TBC_CHECK_PTR(client);
+
+    memset(&client->telemetrybatch, 0x00, sizeof(client->telemetrybatch));
+}
+
+void _tbcmh_telemetry_on_destroy(tbcmh_handle_t client)
+{
+    // This function is in semaphore/client->_lock!!!
+    TBC_CHECK_PTR(client);
+
+    if (client->telemetrybatch.writer.count > 0) {
+        TBC_LOGW("Drop %d samples of telemetry batch!", client->telemetrybatch.writer.count);
+    }
+    TBC_FIELD_FREE(client->telemetrybatch.writer.buffer);
+    memset(&client->telemetrybatch, 0x00, sizeof(client->telemetrybatch));
+}
+
+// Publish samples kept while it was offline
+void _tbcmh_telemetry_on_connected(tbcmh_handle_t client)
+{
+    // This function is in semaphore/client->_lock!!!
+    TBC_CHECK_PTR(client);
+
+    _telemetrybatch_flush(client);
+}
+
+// Hand pending samples to the store-and-forward log, otherwise they are kept until it is connected
+void _tbcmh_telemetry_on_disconnected(tbcmh_handle_t client)
+{
+    // This function is in semaphore/client->_lock!!!
+    TBC_CHECK_PTR(client);
+
+    if (client->telemetrystore.is_opened) {
+        _telemetrybatch_flush(client);
+    }
+}
+
+// Flush the batch if its oldest sample is too old
+void _tbcmh_telemetry_on_run(tbcmh_handle_t client)
+{
+    TBC_CHECK_PTR(client);
+
+    telemetrybatch_t *batch = &client->telemetrybatch;
+    if (batch->writer.count <= 0 || batch->config.flush_age_ms <= 0) {
+        return;
+    }
+
+    // Take semaphore
+    if (xSemaphoreTakeRecursive(client->_lock, (TickType_t)0xFFFFF) != pdTRUE) {
+         TBC_LOGE("Unable to take semaphore! %s()", __FUNCTION__);
+         return;
+    }
+
+    if (batch->writer.count > 0
+        && esp_timer_get_time() - batch->first_time >= (int64_t)batch->config.flush_age_ms * 1000) {
+        _telemetrybatch_flush(client);
+    }
+
+    // Give semaphore
+    xSemaphoreGiveRecursive(client->_lock);
+}
+
+tbc_err_t tbcmh_telemetry_batch_config(tbcmh_handle_t client,
+                                       const tbcmh_telemetry_batch_config_t *config)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(client, ESP_FAIL);
+    if (config && (config->max_payload_size < 0 || config->flush_size < 0
+                   || config->flush_count < 0 || config->flush_age_ms < 0)) {
+        TBC_LOGE("config of telemetry batch is error! %s()", __FUNCTION__);
+        return ESP_FAIL;
+    }
+
+    // Take semaphore
+    if (xSemaphoreTakeRecursive(client->_lock, (TickType_t)0xFFFFF) != pdTRUE) {
+         TBC_LOGE("Unable to take semaphore! %s()", __FUNCTION__);
+         return ESP_FAIL;
+    }
+
+    telemetrybatch_t *batch = &client->telemetrybatch;
+    _telemetrybatch_flush(client);
+    if (config) {
+        memcpy(&batch->config, config, sizeof(batch->config));
+    } else {
+        memset(&batch->config, 0x00, sizeof(batch->config));
+    }
+    batch->writer.max_size = batch->config.max_payload_size;
+
+    // Give semaphore
+    xSemaphoreGiveRecursive(client->_lock);
+    return ESP_OK;
+}
+
+tbc_err_t tbcmh_telemetry_batch_add(tbcmh_handle_t client, int64_t ts, const tbcmh_value_t *values)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(client, ESP_FAIL);
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(values, ESP_FAIL);
+    if (!cJSON_IsObject(values)) {
+        TBC_LOGE("values is not a json object! %s()", __FUNCTION__);
+        return ESP_FAIL;
+    }
+    if (!_tbcmh_txwriter_check_json(client, __FUNCTION__)) {
+        return ESP_FAIL;
+    }
+    if (ts <= 0) {
+        ts = tbcmh_timesync_now_ms(client);
+    }
+
+    // Take semaphore
+    if (xSemaphoreTakeRecursive(client->_lock, (TickType_t)0xFFFFF) != pdTRUE) {
+         TBC_LOGE("Unable to take semaphore! %s()", __FUNCTION__);
+         return ESP_FAIL;
+    }
+
+    telemetrybatch_t *batch = &client->telemetrybatch;
+    txwriter_t *writer = &batch->writer;
+    int len = writer->len;
+    bool result = _telemetrybatch_put_sample(writer, ts, values);
+    if (!result && writer->count > 0) {
+        // It doesn't fit in max_payload_size. Split: flush pending samples, then start a new batch
+        writer->len = len;
+        batch->stats.split_count++;
+        _telemetrybatch_flush(client);
+        // pending samples are kept if they can't be published, then there is no room for the new one
+        len = writer->len;
+        result = (writer->count == 0) && _telemetrybatch_put_sample(writer, ts, values);
+    }
+    if (!result) {
+        TBC_LOGW("Sample doesn't fit in max payload size(%d)! %s()",
+                 _telemetrybatch_max_payload_size(batch), __FUNCTION__);
+        writer->len = len;
+        batch->stats.dropped_count++;
+        xSemaphoreGiveRecursive(client->_lock);
+        return ESP_FAIL;
+    }
+    if (writer->count++ == 0) {
+        batch->first_time = esp_timer_get_time();
+    }
+
+    // Flush if any threshold is reached. ']' will be appended
+    int flush_size = (batch->config.flush_size > 0) ? batch->config.flush_size
+                                                    : _telemetrybatch_max_payload_size(batch);
+    if (writer->len + 1 >= flush_size
+        || (batch->config.flush_count > 0 && writer->count >= batch->config.flush_count)
+        || (batch->config.flush_age_ms > 0
+            && esp_timer_get_time() - batch->first_time >= (int64_t)batch->config.flush_age_ms * 1000)) {
+        _telemetrybatch_flush(client);
+    }
+
+    // Give semaphore
+    xSemaphoreGiveRecursive(client->_lock);
+    return ESP_OK;
+}
+
+int tbcmh_telemetry_batch_flush(tbcmh_handle_t client)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(client, ESP_FAIL);
+
+    // Take semaphore
+    if (xSemaphoreTakeRecursive(client->_lock, (TickType_t)0xFFFFF) != pdTRUE) {
+         TBC_LOGE("Unable to take semaphore! %s()", __FUNCTION__);
+         return ESP_FAIL;
+    }
+
+    int msg_id = _telemetrybatch_flush(client);
+
+    // Give semaphore
+    xSemaphoreGiveRecursive(client->_lock);
     return msg_id;
 }
+
+tbc_err_t tbcmh_telemetry_batch_get_stats(tbcmh_handle_t client, tbcmh_telemetry_batch_stats_t *stats)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(client, ESP_FAIL);
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(stats, ESP_FAIL);
+
+    // Take semaphore
+    if (xSemaphoreTakeRecursive(client->_lock, (TickType_t)0xFFFFF) != pdTRUE) {
+         TBC_LOGE("Unable to take semaphore! %s()", __FUNCTION__);
+         return ESP_FAIL;
+    }
+
+    memcpy(stats, &client->telemetrybatch.stats, sizeof(tbcmh_telemetry_batch_stats_t));
+
+    // Give semaphore
+    xSemaphoreGiveRecursive(client->_lock);
+    return ESP_OK;
+}
@@ -17,14 +17,33 @@
 #ifndef _TELEMETRY_UPLOAD_H_
 #define _TELEMETRY_UPLOAD_H_
 
+#include <stdint.h>
+
 //#include "tbc_utils.h"
-//#include "tbc_mqtt_helper.h"
+#include "tbc_mqtt_helper.h"
+#include "tx_writer.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-//
+/**
+ * ThingsBoard MQTT Client Helper telemetry batch
+ */
+typedef struct telemetrybatch
+{
+     tbcmh_telemetry_batch_config_t config; /*!< thresholds of flushing */
+     txwriter_t writer;                     /*!< pending '[{"ts":..,"values":{..}},...', count is count of samples */
+     int64_t first_time;                    /*!< esp_timer_get_time() of the oldest pending sample, in us */
+     tbcmh_telemetry_batch_stats_t stats;   /*!< statistics */
+} telemetrybatch_t;
+
+void _tbcmh_telemetry_on_create(tbcmh_handle_t client);
+void _tbcmh_telemetry_on_destroy(tbcmh_handle_t client);
+void _tbcmh_telemetry_on_connected(tbcmh_handle_t client);
+void _tbcmh_telemetry_on_disconnected(tbcmh_handle_t client);
+void _tbcmh_telemetry_on_run(tbcmh_handle_t client);
+int  _tbcmh_telemetry_publish(tbcmh_handle_t client, const char *payload, int len, int qos, int retain);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,297 @@
+// Copyright 2022 liangzhuzhi2020@gmail.com, https://github.com/liang-zhu-zi/esp32-thingsboard-mqtt-client
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// This file is called by tbc_mqtt_helper.c/.h.
+
+
+#include <string.h>
+#include <math.h>
+#include <sys/time.h>
+
+#include "esp_err.h"
+#include "esp_timer.h"
+
+#include "tbc_mqtt_helper_internal.h"
+
+const static char *TAG = "time_sync";
+
+//==== Device clock aligned to the server clock =================================
+void _tbcmh_timesync_on_create(tbcmh_handle_t client)
+{
+    // This function is in semaphore/client->_lock!!!
+    TBC_CHECK_PTR(client);
+
+    memset(&client->timesync, 0x00, sizeof(client->timesync));
+    portMUX_INITIALIZE(&client->timesync.spinlock);
+}
+
+void _tbcmh_timesync_on_destroy(tbcmh_handle_t client)
+{
+    // This function is in semaphore/client->_lock!!!
+    TBC_CHECK_PTR(client);
+
+    TBC_FIELD_FREE(client->timesync.method);
+    memset(&client->timesync, 0x00, sizeof(client->timesync));
+    portMUX_INITIALIZE(&client->timesync.spinlock);
+}
+
+static int64_t _timesync_system_ms(void)
+{
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (int64_t)now.tv_sec * 1000 + now.tv_usec / 1000;
+}
+
+// Add a sample: server time was server_us at monotonic time mono_us
+static void _timesync_add_sample(timesync_t *timesync, int64_t mono_us, int64_t server_us,
+                                 uint32_t rtt_ms)
+{
+    int64_t offset_us = server_us - mono_us;
+    int64_t error_us = 0;
+    bool is_stepped = false;
+
+    taskENTER_CRITICAL(&timesync->spinlock);
+    if (timesync->is_synced) {
+        error_us = offset_us - (timesync->offset_us
+                   + (int64_t)(timesync->drift * (mono_us - timesync->base_us)));
+        is_stepped = llabs(error_us) > (int64_t)TBCMH_TIMESYNC_STEP_MS * 1000;
+    }
+    if (!timesync->is_synced || is_stepped) {
+        // (re)start drift estimation
+        timesync->anchor_us = mono_us;
+        timesync->anchor_offset_us = offset_us;
+        timesync->drift = 0;
+    } else if (mono_us - timesync->anchor_us >= (int64_t)TBCMH_TIMESYNC_DRIFT_MIN_SPAN_MS * 1000) {
+        timesync->drift = (double)(offset_us - timesync->anchor_offset_us)
+                          / (double)(mono_us - timesync->anchor_us);
+    }
+    timesync->base_us = mono_us;
+    timesync->offset_us = offset_us;
+    timesync->rtt_ms = rtt_ms;
+    timesync->sync_count++;
+    timesync->is_synced = true;
+    taskEXIT_CRITICAL(&timesync->spinlock);
+
+    if (is_stepped) {
+        TBC_LOGW("Server clock is stepped by %lldms, drift estimation is restarted!",
+                 error_us / 1000);
+    } else {
+        TBC_LOGD("Time sample: offset=%lldus error=%lldus rtt=%ums",
+                 offset_us, error_us, rtt_ms);
+    }
+}
+
+// e.g. {"currentTime":1664603253888}, {"time":1664603253888} or 1664603253888
+static bool _timesync_parse_results(const tbcmh_rpc_results_t *results, int64_t *server_ms)
+{
+    const cJSON *value = results;
+    if (cJSON_IsObject(results)) {
+        value = cJSON_GetObjectItem(results, "currentTime");
+        if (!value) {
+            value = cJSON_GetObjectItem(results, "time");
+        }
+    }
+    if (!cJSON_IsNumber(value) || value->valuedouble <= 0) {
+        return false;
+    }
+    *server_ms = (int64_t)value->valuedouble;
+    return true;
+}
+
+static void _timesync_on_response(tbcmh_handle_t client, void *context,
+                                  const char *method, const tbcmh_rpc_results_t *results)
+{
+    TBC_CHECK_PTR(client);
+
+    int64_t now_us = esp_timer_get_time();
+    timesync_t *timesync = &client->timesync;
+    if ((uint32_t)(uintptr_t)context != timesync->request_seq || timesync->request_us == 0) {
+        TBC_LOGW("Stale response of %s is ignored!", method);
+        return;
+    }
+    int64_t request_us = timesync->request_us;
+    timesync->request_us = 0;
+
+    int64_t server_ms = 0;
+    if (!_timesync_parse_results(results, &server_ms)) {
+        TBC_LOGW("currentTime isn't in response of %s!", method);
+        return;
+    }
+
+    // A long RTT means an asymmetric delay is likely, drop it. best_rtt_ms is raised
+    // on each drop, so a permanently slower network is accepted after a few requests.
+    uint32_t rtt_ms = (uint32_t)((now_us - request_us) / 1000);
+    if (timesync->best_rtt_ms > 0 && rtt_ms > timesync->best_rtt_ms * TBCMH_TIMESYNC_RTT_FACTOR) {
+        TBC_LOGW("RTT(%ums) of %s is too long, the sample is dropped!", rtt_ms, method);
+        timesync->best_rtt_ms += timesync->best_rtt_ms / 2 + 1;
+        return;
+    }
+    if (timesync->best_rtt_ms == 0 || rtt_ms < timesync->best_rtt_ms) {
+        timesync->best_rtt_ms = rtt_ms;
+    }
+
+    // The server read its clock in the middle of the round trip
+    _timesync_add_sample(timesync, request_us + (now_us - request_us) / 2,
+                         server_ms * 1000, rtt_ms);
+}
+
+static int _timesync_on_timeout(tbcmh_handle_t client, void *context, const char *method)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(client, ESP_OK);
+
+    if ((uint32_t)(uintptr_t)context == client->timesync.request_seq) {
+        client->timesync.request_us = 0;
+    }
+    TBC_LOGW("%s is timeout, the server may not serve the current time!", method);
+    return ESP_OK;
+}
+
+// This function is in semaphore/client->_lock!!!
+static tbc_err_t _timesync_send_request(tbcmh_handle_t client, int64_t now_us)
+{
+    timesync_t *timesync = &client->timesync;
+    timesync->request_seq++;
+    timesync->request_us = now_us;
+    if (timesync->interval_ms > 0) {
+        timesync->next_due_us = now_us + (int64_t)timesync->interval_ms * 1000;
+    }
+
+    // params is NULL, "{}" is sent
+    tbc_err_t result = tbcmh_twoway_clientrpc_request(client,
+                                     timesync->method ? timesync->method : TBCMH_TIMESYNC_METHOD,
+                                     NULL, (void *)(uintptr_t)timesync->request_seq,
+                                     _timesync_on_response,
+                                     _timesync_on_timeout);
+    if (result != ESP_OK) {
+        timesync->request_us = 0;
+    }
+    return result;
+}
+
+tbc_err_t tbcmh_timesync_request(tbcmh_handle_t client, const char *method, uint32_t interval_ms)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(client, ESP_FAIL);
+
+    // Take semaphore
+    if (xSemaphoreTakeRecursive(client->_lock, (TickType_t)0xFFFFF) != pdTRUE) {
+         TBC_LOGE("Unable to take semaphore! %s()", __FUNCTION__);
+         return ESP_FAIL;
+    }
+
+    timesync_t *timesync = &client->timesync;
+    TBC_FIELD_FREE(timesync->method);
+    TBC_FIELD_STRDUP(timesync->method, method);
+    timesync->interval_ms = interval_ms;
+
+    tbc_err_t result = ESP_OK;
+    int64_t now_us = esp_timer_get_time();
+    if (timesync->request_us == 0) {
+        result = _timesync_send_request(client, now_us);
+    } else if (interval_ms > 0) {
+        timesync->next_due_us = now_us + (int64_t)interval_ms * 1000;
+    }
+
+    // Give semaphore
+    xSemaphoreGiveRecursive(client->_lock);
+    return result;
+}
+
+tbc_err_t tbcmh_timesync_set_reference(tbcmh_handle_t client, int64_t unix_ms)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(client, ESP_FAIL);
+
+    int64_t now_us = esp_timer_get_time();
+    if (unix_ms <= 0) {
+        unix_ms = _timesync_system_ms();
+    }
+    _timesync_add_sample(&client->timesync, now_us, unix_ms * 1000, 0);
+    return ESP_OK;
+}
+
+int64_t tbcmh_timesync_now_ms(tbcmh_handle_t client)
+{
+    if (!client) {
+        return _timesync_system_ms();
+    }
+
+    // esp_timer_get_time() reads a hardware counter, it isn't a syscall like gettimeofday()
+    int64_t now_us = esp_timer_get_time();
+    timesync_t *timesync = &client->timesync;
+
+    taskENTER_CRITICAL(&timesync->spinlock);
+    bool is_synced = timesync->is_synced;
+    int64_t base_us = timesync->base_us;
+    int64_t offset_us = timesync->offset_us;
+    double drift = timesync->drift;
+    taskEXIT_CRITICAL(&timesync->spinlock);
+
+    if (!is_synced) {
+        return _timesync_system_ms();
+    }
+    return (now_us + offset_us + (int64_t)(drift * (now_us - base_us))) / 1000;
+}
+
+tbc_err_t tbcmh_timesync_get_status(tbcmh_handle_t client, tbcmh_timesync_status_t *status)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(client, ESP_FAIL);
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(status, ESP_FAIL);
+
+    memset(status, 0x00, sizeof(tbcmh_timesync_status_t));
+    int64_t server_ms = tbcmh_timesync_now_ms(client);
+    int64_t now_us = esp_timer_get_time();
+    timesync_t *timesync = &client->timesync;
+
+    taskENTER_CRITICAL(&timesync->spinlock);
+    status->is_synced = timesync->is_synced;
+    status->drift_ppm = timesync->drift * 1e6;
+    status->rtt_ms = timesync->rtt_ms;
+    status->age_ms = timesync->is_synced ? (uint32_t)((now_us - timesync->base_us) / 1000) : 0;
+    status->sync_count = timesync->sync_count;
+    taskEXIT_CRITICAL(&timesync->spinlock);
+
+    if (status->is_synced) {
+        status->offset_ms = server_ms - _timesync_system_ms();
+    }
+    return ESP_OK;
+}
+
+void _tbcmh_timesync_on_run(tbcmh_handle_t client)
+{
+    TBC_CHECK_PTR(client);
+
+    timesync_t *timesync = &client->timesync;
+    if (timesync->interval_ms == 0 && timesync->request_us == 0) {
+        return;
+    }
+
+    // Take semaphore
+    if (xSemaphoreTakeRecursive(client->_lock, (TickType_t)0xFFFFF) != pdTRUE) {
+         TBC_LOGE("Unable to take semaphore! %s()", __FUNCTION__);
+         return;
+    }
+
+    int64_t now_us = esp_timer_get_time();
+    // The request is lost, e.g. disconnected before its response
+    if (timesync->request_us != 0
+        && now_us - timesync->request_us >= (int64_t)TBCMH_TIMESYNC_REQUEST_TIMEOUT_MS * 1000) {
+        timesync->request_us = 0;
+    }
+    if (timesync->interval_ms > 0 && timesync->request_us == 0
+        && now_us >= timesync->next_due_us && tbcmh_is_connected(client)) {
+        _timesync_send_request(client, now_us);
+    }
+
+    // Give semaphore
+    xSemaphoreGiveRecursive(client->_lock);
+}
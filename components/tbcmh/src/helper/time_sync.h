@@ -0,0 +1,72 @@
+// Copyright 2022 liangzhuzhi2020@gmail.com, https://github.com/liang-zhu-zi/esp32-thingsboard-mqtt-client
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// This file is called by tbc_mqtt_helper.c/.h.
+
+
+#ifndef _TIME_SYNC_HELPER_H_
+#define _TIME_SYNC_HELPER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "freertos/FreeRTOS.h"
+
+#include "tbc_utils.h"
+#include "tbc_mqtt_protocol.h"
+#include "tbc_mqtt_helper.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TBCMH_TIMESYNC_METHOD             "getCurrentTime" /*!< default client-side RPC method */
+#define TBCMH_TIMESYNC_DRIFT_MIN_SPAN_MS  (60*1000)        /*!< drift is estimated over samples at least 1 minute apart */
+#define TBCMH_TIMESYNC_STEP_MS            (1000)           /*!< a sample this far from the model restarts drift estimation */
+#define TBCMH_TIMESYNC_RTT_FACTOR         (4)              /*!< a sample with RTT above 4x the best RTT is dropped */
+#define TBCMH_TIMESYNC_REQUEST_TIMEOUT_MS (TB_MQTT_TIMEOUT*1000) /*!< a pending request is given up after it */
+
+/**
+ * Device clock model: server time = monotonic time + offset + drift * elapsed
+ */
+typedef struct timesync
+{
+     portMUX_TYPE spinlock;      /*!< protects the model, tbcmh_timesync_now_ms() is called in any task */
+     bool is_synced;             /*!< at least one sample is taken */
+     int64_t base_us;            /*!< monotonic time of the last sample */
+     int64_t offset_us;          /*!< server time - monotonic time, at base_us */
+     double drift;               /*!< (server - device) / device rate, e.g. 20e-6 is 20ppm fast server */
+     int64_t anchor_us;          /*!< monotonic time of the first sample of drift estimation */
+     int64_t anchor_offset_us;   /*!< offset of the first sample of drift estimation */
+     uint32_t rtt_ms;            /*!< round trip time of the last sample */
+     uint32_t best_rtt_ms;       /*!< best round trip time seen */
+     uint32_t sync_count;        /*!< count of accepted samples */
+
+     // periodic resync by client-side RPC, in client->_lock
+     char *method;               /*!< client-side RPC method, e.g. "getCurrentTime" */
+     uint32_t interval_ms;       /*!< resync interval, 0 if not periodic */
+     int64_t next_due_us;        /*!< monotonic time of the next resync */
+     int64_t request_us;         /*!< monotonic time of the pending request, 0 if none */
+     uint32_t request_seq;       /*!< sequence of the pending request, a stale response is ignored */
+} timesync_t;
+
+void _tbcmh_timesync_on_create(tbcmh_handle_t client);
+void _tbcmh_timesync_on_destroy(tbcmh_handle_t client);
+void _tbcmh_timesync_on_run(tbcmh_handle_t client);
+
+#ifdef __cplusplus
+}
+#endif //__cplusplus
+
+#endif
@@ -0,0 +1,462 @@
+// Copyright 2022 liangzhuzhi2020@gmail.com, https://github.com/liang-zhu-zi/esp32-thingsboard-mqtt-client
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// This file is called by tx_writer.c.
+
+#include <string.h>
+#include <math.h>
+
+#include "tx_number.h"
+
+//==== Fixed-point ===================================================================
+
+#define TXNUMBER_MAX_EXACT_DOUBLE  (9007199254740992.0)  // 2^53, all integers below it are exact
+
+static const double _txnumber_pow10[TXNUMBER_MAX_DECIMALS + 1] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9
+};
+
+// Print mantissa/10^decimals, e.g. (-255, 1) -> "-25.5", (5, 3) -> "0.005".
+// Trailing zeros of fraction are removed if trim is true.
+// return length of output, it is 24 bytes at most.
+int _tbcmh_txnumber_format_fixed(char *out, int64_t mantissa, int decimals, bool trim)
+{
+    uint64_t u = (mantissa < 0) ? (uint64_t)0 - (uint64_t)mantissa : (uint64_t)mantissa;
+    if (trim) {
+        while (decimals > 0 && u % 10 == 0) {
+            u /= 10;
+            decimals--;
+        }
+    }
+
+    char digits[24]; // reversed digits
+    int n = 0;
+    do {
+        digits[n++] = '0' + (u % 10);
+        u /= 10;
+    } while (u);
+    while (n <= decimals) {
+        digits[n++] = '0';
+    }
+
+    char *p = out;
+    if (mantissa < 0) {
+        *p++ = '-';
+    }
+    while (n > decimals) {
+        *p++ = digits[--n];
+    }
+    if (decimals > 0) {
+        *p++ = '.';
+        while (n > 0) {
+            *p++ = digits[--n];
+        }
+    }
+    *p = '\0';
+    return p - out;
+}
+
+//==== Grisu2 ========================================================================
+
+// Shortest digits of a double by Grisu2 of Florian Loitsch, "Printing Floating-Point Numbers
+// Quickly and Accurately with Integers", PLDI 2010. The digits are always parsed back to
+// the same double. They are the shortest for about 99.9% of doubles, a few digits longer for the others.
+
+/**
+ * Do-it-yourself floating point, f * 2^e
+ */
+typedef struct txnumber_diyfp
+{
+    uint64_t f;  /*!< significand */
+    int e;       /*!< binary exponent */
+} txnumber_diyfp_t;
+
+#define TXNUMBER_HIDDEN_BIT      (0x0010000000000000ULL)
+#define TXNUMBER_FRACTION_MASK   (0x000FFFFFFFFFFFFFULL)
+#define TXNUMBER_EXPONENT_BIAS   (0x3FF + 52)
+
+// Normalized 10^k for k = -348, -340, ..., 340, their significands are rounded to 64 bits
+static const struct {
+    uint64_t f;
+    int16_t e;
+} _txnumber_cached_powers[] = {
+    {0xfa8fd5a0081c0288ULL, -1220}, // 1e-348
+    {0xbaaee17fa23ebf76ULL, -1193}, // 1e-340
+    {0x8b16fb203055ac76ULL, -1166}, // 1e-332
+    {0xcf42894a5dce35eaULL, -1140}, // 1e-324
+    {0x9a6bb0aa55653b2dULL, -1113}, // 1e-316
+    {0xe61acf033d1a45dfULL, -1087}, // 1e-308
+    {0xab70fe17c79ac6caULL, -1060}, // 1e-300
+    {0xff77b1fcbebcdc4fULL, -1034}, // 1e-292
+    {0xbe5691ef416bd60cULL, -1007}, // 1e-284
+    {0x8dd01fad907ffc3cULL,  -980}, // 1e-276
+    {0xd3515c2831559a83ULL,  -954}, // 1e-268
+    {0x9d71ac8fada6c9b5ULL,  -927}, // 1e-260
+    {0xea9c227723ee8bcbULL,  -901}, // 1e-252
+    {0xaecc49914078536dULL,  -874}, // 1e-244
+    {0x823c12795db6ce57ULL,  -847}, // 1e-236
+    {0xc21094364dfb5637ULL,  -821}, // 1e-228
+    {0x9096ea6f3848984fULL,  -794}, // 1e-220
+    {0xd77485cb25823ac7ULL,  -768}, // 1e-212
+    {0xa086cfcd97bf97f4ULL,  -741}, // 1e-204
+    {0xef340a98172aace5ULL,  -715}, // 1e-196
+    {0xb23867fb2a35b28eULL,  -688}, // 1e-188
+    {0x84c8d4dfd2c63f3bULL,  -661}, // 1e-180
+    {0xc5dd44271ad3cdbaULL,  -635}, // 1e-172
+    {0x936b9fcebb25c996ULL,  -608}, // 1e-164
+    {0xdbac6c247d62a584ULL,  -582}, // 1e-156
+    {0xa3ab66580d5fdaf6ULL,  -555}, // 1e-148
+    {0xf3e2f893dec3f126ULL,  -529}, // 1e-140
+    {0xb5b5ada8aaff80b8ULL,  -502}, // 1e-132
+    {0x87625f056c7c4a8bULL,  -475}, // 1e-124
+    {0xc9bcff6034c13053ULL,  -449}, // 1e-116
+    {0x964e858c91ba2655ULL,  -422}, // 1e-108
+    {0xdff9772470297ebdULL,  -396}, // 1e-100
+    {0xa6dfbd9fb8e5b88fULL,  -369}, // 1e-92
+    {0xf8a95fcf88747d94ULL,  -343}, // 1e-84
+    {0xb94470938fa89bcfULL,  -316}, // 1e-76
+    {0x8a08f0f8bf0f156bULL,  -289}, // 1e-68
+    {0xcdb02555653131b6ULL,  -263}, // 1e-60
+    {0x993fe2c6d07b7facULL,  -236}, // 1e-52
+    {0xe45c10c42a2b3b06ULL,  -210}, // 1e-44
+    {0xaa242499697392d3ULL,  -183}, // 1e-36
+    {0xfd87b5f28300ca0eULL,  -157}, // 1e-28
+    {0xbce5086492111aebULL,  -130}, // 1e-20
+    {0x8cbccc096f5088ccULL,  -103}, // 1e-12
+    {0xd1b71758e219652cULL,   -77}, // 1e-4
+    {0x9c40000000000000ULL,   -50}, // 1e4
+    {0xe8d4a51000000000ULL,   -24}, // 1e12
+    {0xad78ebc5ac620000ULL,     3}, // 1e20
+    {0x813f3978f8940984ULL,    30}, // 1e28
+    {0xc097ce7bc90715b3ULL,    56}, // 1e36
+    {0x8f7e32ce7bea5c70ULL,    83}, // 1e44
+    {0xd5d238a4abe98068ULL,   109}, // 1e52
+    {0x9f4f2726179a2245ULL,   136}, // 1e60
+    {0xed63a231d4c4fb27ULL,   162}, // 1e68
+    {0xb0de65388cc8ada8ULL,   189}, // 1e76
+    {0x83c7088e1aab65dbULL,   216}, // 1e84
+    {0xc45d1df942711d9aULL,   242}, // 1e92
+    {0x924d692ca61be758ULL,   269}, // 1e100
+    {0xda01ee641a708deaULL,   295}, // 1e108
+    {0xa26da3999aef774aULL,   322}, // 1e116
+    {0xf209787bb47d6b85ULL,   348}, // 1e124
+    {0xb454e4a179dd1877ULL,   375}, // 1e132
+    {0x865b86925b9bc5c2ULL,   402}, // 1e140
+    {0xc83553c5c8965d3dULL,   428}, // 1e148
+    {0x952ab45cfa97a0b3ULL,   455}, // 1e156
+    {0xde469fbd99a05fe3ULL,   481}, // 1e164
+    {0xa59bc234db398c25ULL,   508}, // 1e172
+    {0xf6c69a72a3989f5cULL,   534}, // 1e180
+    {0xb7dcbf5354e9beceULL,   561}, // 1e188
+    {0x88fcf317f22241e2ULL,   588}, // 1e196
+    {0xcc20ce9bd35c78a5ULL,   614}, // 1e204
+    {0x98165af37b2153dfULL,   641}, // 1e212
+    {0xe2a0b5dc971f303aULL,   667}, // 1e220
+    {0xa8d9d1535ce3b396ULL,   694}, // 1e228
+    {0xfb9b7cd9a4a7443cULL,   720}, // 1e236
+    {0xbb764c4ca7a44410ULL,   747}, // 1e244
+    {0x8bab8eefb6409c1aULL,   774}, // 1e252
+    {0xd01fef10a657842cULL,   800}, // 1e260
+    {0x9b10a4e5e9913129ULL,   827}, // 1e268
+    {0xe7109bfba19c0c9dULL,   853}, // 1e276
+    {0xac2820d9623bf429ULL,   880}, // 1e284
+    {0x80444b5e7aa7cf85ULL,   907}, // 1e292
+    {0xbf21e44003acdd2dULL,   933}, // 1e300
+    {0x8e679c2f5e44ff8fULL,   960}, // 1e308
+    {0xd433179d9c8cb841ULL,   986}, // 1e316
+    {0x9e19db92b4e31ba9ULL,  1013}, // 1e324
+    {0xeb96bf6ebadf77d9ULL,  1039}, // 1e332
+    {0xaf87023b9bf0ee6bULL,  1066}, // 1e340
+};
+
+static const uint64_t _txnumber_pow10_u64[20] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL,
+    1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+    100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL,
+    1000000000000000000ULL, 10000000000000000000ULL
+};
+
+static txnumber_diyfp_t _txnumber_diyfp_of(double value)
+{
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    int biased_e = (int)((bits >> 52) & 0x7FF);
+
+    txnumber_diyfp_t v;
+    v.f = bits & TXNUMBER_FRACTION_MASK;
+    if (biased_e != 0) {
+        v.f += TXNUMBER_HIDDEN_BIT;
+        v.e = biased_e - TXNUMBER_EXPONENT_BIAS;
+    } else {
+        v.e = 1 - TXNUMBER_EXPONENT_BIAS; // subnormal
+    }
+    return v;
+}
+
+static txnumber_diyfp_t _txnumber_diyfp_normalize(txnumber_diyfp_t v)
+{
+    int shift = __builtin_clzll(v.f);
+    v.f <<= shift;
+    v.e -= shift;
+    return v;
+}
+
+// Upper 64 bits of the 128-bit product, rounded. 32-bit MCUs have no 128-bit integer
+static txnumber_diyfp_t _txnumber_diyfp_mul(txnumber_diyfp_t x, txnumber_diyfp_t y)
+{
+    uint64_t a = x.f >> 32, b = x.f & 0xFFFFFFFFULL;
+    uint64_t c = y.f >> 32, d = y.f & 0xFFFFFFFFULL;
+    uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+    uint64_t tmp = (bd >> 32) + (ad & 0xFFFFFFFFULL) + (bc & 0xFFFFFFFFULL);
+    tmp += 1ULL << 31; // round
+
+    txnumber_diyfp_t product;
+    product.f = ac + (ad >> 32) + (bc >> 32) + (tmp >> 32);
+    product.e = x.e + y.e + 64;
+    return product;
+}
+
+// Boundaries m- & m+ of value: halfway to its neighbours, every number between them is parsed back to it.
+// They have the same exponent as normalized m+
+static void _txnumber_diyfp_boundaries(txnumber_diyfp_t v, txnumber_diyfp_t *minus, txnumber_diyfp_t *plus)
+{
+    txnumber_diyfp_t pl = {(v.f << 1) + 1, v.e - 1};
+    pl = _txnumber_diyfp_normalize(pl);
+
+    txnumber_diyfp_t mi;
+    if (v.f == TXNUMBER_HIDDEN_BIT) {
+        // a power of 2, its lower neighbour is closer
+        mi.f = (v.f << 2) - 1;
+        mi.e = v.e - 2;
+    } else {
+        mi.f = (v.f << 1) - 1;
+        mi.e = v.e - 1;
+    }
+    mi.f <<= mi.e - pl.e;
+    mi.e = pl.e;
+
+    *minus = mi;
+    *plus = pl;
+}
+
+// Cached 10^-K that the exponent of a normalized number multiplied by it is in [-60, -32]
+static txnumber_diyfp_t _txnumber_cached_power(int e, int *K)
+{
+    double dk = (-61 - e) * 0.30102999566398114 + 347; // log10(2), dk is always positive
+    int k = (int)dk;
+    if (dk - k > 0.0) {
+        k++;
+    }
+    int index = (k >> 3) + 1;
+    *K = -(-348 + (index << 3));
+
+    txnumber_diyfp_t power = {_txnumber_cached_powers[index].f, _txnumber_cached_powers[index].e};
+    return power;
+}
+
+// Move the last digit closer to w, while it is still in the boundaries
+static void _txnumber_grisu_round(char *digits, int len, uint64_t delta, uint64_t rest,
+                                  uint64_t ten_kappa, uint64_t wp_w)
+{
+    while (rest < wp_w && delta - rest >= ten_kappa
+           && (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w)) {
+        digits[len - 1]--;
+        rest += ten_kappa;
+    }
+}
+
+// Generate digits of Mp until the rest is in delta, the value is digits * 10^K
+static void _txnumber_digit_gen(txnumber_diyfp_t W, txnumber_diyfp_t Mp, uint64_t delta,
+                                char *digits, int *len, int *K)
+{
+    int shift = -Mp.e;
+    uint64_t one = 1ULL << shift;
+    uint64_t wp_w = Mp.f - W.f;
+    uint32_t p1 = (uint32_t)(Mp.f >> shift); // integer part
+    uint64_t p2 = Mp.f & (one - 1);          // fraction part
+
+    int kappa = 1;
+    while (kappa < 10 && p1 >= _txnumber_pow10_u64[kappa]) {
+        kappa++;
+    }
+
+    *len = 0;
+    while (kappa > 0) {
+        uint32_t d = p1 / (uint32_t)_txnumber_pow10_u64[kappa - 1];
+        p1 %= (uint32_t)_txnumber_pow10_u64[kappa - 1];
+        if (d || *len) {
+            digits[(*len)++] = '0' + d;
+        }
+        kappa--;
+        uint64_t rest = ((uint64_t)p1 << shift) + p2;
+        if (rest <= delta) {
+            *K += kappa;
+            _txnumber_grisu_round(digits, *len, delta, rest, _txnumber_pow10_u64[kappa] << shift, wp_w);
+            return;
+        }
+    }
+
+    for (;;) {
+        p2 *= 10;
+        delta *= 10;
+        char d = (char)(p2 >> shift);
+        if (d || *len) {
+            digits[(*len)++] = '0' + d;
+        }
+        p2 &= one - 1;
+        kappa--;
+        if (p2 < delta) {
+            *K += kappa;
+            int index = -kappa;
+            _txnumber_grisu_round(digits, *len, delta, p2, one,
+                                  (index < 20) ? wp_w * _txnumber_pow10_u64[index] : 0);
+            return;
+        }
+    }
+}
+
+// value must be positive and finite
+static void _txnumber_grisu2(double value, char *digits, int *len, int *K)
+{
+    txnumber_diyfp_t v = _txnumber_diyfp_of(value);
+    txnumber_diyfp_t w_m, w_p;
+    _txnumber_diyfp_boundaries(v, &w_m, &w_p);
+
+    txnumber_diyfp_t c_mk = _txnumber_cached_power(w_p.e, K);
+    txnumber_diyfp_t W = _txnumber_diyfp_mul(_txnumber_diyfp_normalize(v), c_mk);
+    txnumber_diyfp_t Wp = _txnumber_diyfp_mul(w_p, c_mk);
+    txnumber_diyfp_t Wm = _txnumber_diyfp_mul(w_m, c_mk);
+    // the products are rounded, shrink the boundaries by 1 ulp to stay inside them
+    Wm.f++;
+    Wp.f--;
+    _txnumber_digit_gen(W, Wp, Wp.f - Wm.f, digits, len, K);
+}
+
+// Place the decimal point of digits * 10^k like JavaScript:
+// no exponent if 1e-7 < value < 1e21, e.g. 12340000000, 12.34, 0.001234, 1.234e33, 1e-7
+static int _txnumber_prettify(char *out, const char *digits, int len, int k)
+{
+    int kk = len + k; // 10^(kk-1) <= value < 10^kk
+    char *p = out;
+    if (k >= 0 && kk <= 21) {
+        memcpy(p, digits, len);
+        p += len;
+        memset(p, '0', k);
+        p += k;
+    } else if (kk > 0 && kk <= 21) {
+        memcpy(p, digits, kk);
+        p += kk;
+        *p++ = '.';
+        memcpy(p, digits + kk, len - kk);
+        p += len - kk;
+    } else if (kk > -6 && kk <= 0) {
+        *p++ = '0';
+        *p++ = '.';
+        memset(p, '0', -kk);
+        p += -kk;
+        memcpy(p, digits, len);
+        p += len;
+    } else {
+        *p++ = digits[0];
+        if (len > 1) {
+            *p++ = '.';
+            memcpy(p, digits + 1, len - 1);
+            p += len - 1;
+        }
+        *p++ = 'e';
+        int exponent = kk - 1;
+        if (exponent < 0) {
+            *p++ = '-';
+            exponent = -exponent;
+        }
+        if (exponent >= 100) {
+            *p++ = '0' + exponent / 100;
+            exponent %= 100;
+            *p++ = '0' + exponent / 10;
+        } else if (exponent >= 10) {
+            *p++ = '0' + exponent / 10;
+        }
+        *p++ = '0' + exponent % 10;
+    }
+    *p = '\0';
+    return p - out;
+}
+
+//==== Number formatting =============================================================
+
+// Shortest decimal that is parsed back to the same double, e.g. 25.5 -> "25.5", -0.0 -> "-0".
+// Fast path: the smallest k (<= TXNUMBER_MAX_DECIMALS) that value*10^k is an integer N and
+// N/10^k == value. Both N and 10^k are exact and IEEE division is correctly rounded,
+// so strtod() of the printed N/10^k returns value, too. Common sensor readings such as
+// 25.5 or 3.14 take it without any digit generation.
+// Slow path: Grisu2, without snprintf()/strtod().
+// NaN & Infinity aren't JSON numbers, they are printed as "null".
+// return length of output, it is less than TXNUMBER_MAX_LEN.
+int _tbcmh_txnumber_format(char *out, double value)
+{
+    if (isnan(value) || isinf(value)) {
+        memcpy(out, "null", 5);
+        return 4;
+    }
+    if (value == 0.0) {
+        if (signbit(value)) {
+            memcpy(out, "-0", 3);
+            return 2;
+        }
+        memcpy(out, "0", 2);
+        return 1;
+    }
+
+    double magnitude = fabs(value);
+    if (magnitude >= 1.0e-4 && magnitude < 1.0e15) {
+        int k;
+        for (k = 0; k <= TXNUMBER_MAX_DECIMALS; k++) {
+            double scaled = value * _txnumber_pow10[k];
+            if (fabs(scaled) >= TXNUMBER_MAX_EXACT_DOUBLE) {
+                break;
+            }
+            int64_t mantissa = (int64_t)llround(scaled);
+            if ((double)mantissa / _txnumber_pow10[k] == value) {
+                return _tbcmh_txnumber_format_fixed(out, mantissa, k, false);
+            }
+        }
+    }
+
+    char *p = out;
+    if (value < 0) {
+        *p++ = '-';
+    }
+    char digits[20];
+    int len = 0;
+    int K = 0;
+    _txnumber_grisu2(magnitude, digits, &len, &K);
+    p += _txnumber_prettify(p, digits, len, K);
+    return p - out;
+}
+
+// Round to fixed decimals, trailing zeros are removed, e.g. (25.4996, 2) -> "25.5".
+// It is the shortest format if decimals is out of range or value*10^decimals isn't exact.
+// return length of output, it is less than TXNUMBER_MAX_LEN.
+int _tbcmh_txnumber_format_rounded(char *out, double value, int decimals)
+{
+    if (decimals < 0 || decimals > TXNUMBER_MAX_DECIMALS || isnan(value) || isinf(value)) {
+        return _tbcmh_txnumber_format(out, value);
+    }
+
+    double scaled = value * _txnumber_pow10[decimals];
+    if (fabs(scaled) >= TXNUMBER_MAX_EXACT_DOUBLE) {
+        return _tbcmh_txnumber_format(out, value);
+    }
+    return _tbcmh_txnumber_format_fixed(out, (int64_t)llround(scaled), decimals, true);
+}
@@ -0,0 +1,39 @@
+// Copyright 2022 liangzhuzhi2020@gmail.com, https://github.com/liang-zhu-zi/esp32-thingsboard-mqtt-client
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// This file is called by tx_writer.c.
+// It is pure C without ESP-IDF, so it is tested & benchmarked on a host, see test/host.
+
+#ifndef _TX_NUMBER_H_
+#define _TX_NUMBER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TXNUMBER_MAX_DECIMALS   (9)   /*!< max decimals of fast & fixed float formatting */
+#define TXNUMBER_MAX_LEN        (26)  /*!< max length of output, including '\0' */
+
+int _tbcmh_txnumber_format_fixed(char *out, int64_t mantissa, int decimals, bool trim);
+int _tbcmh_txnumber_format(char *out, double value);
+int _tbcmh_txnumber_format_rounded(char *out, double value, int decimals);
+
+#ifdef __cplusplus
+}
+#endif //__cplusplus
+
+#endif
@@ -0,0 +1,953 @@
+// Copyright 2022 liangzhuzhi2020@gmail.com, https://github.com/liang-zhu-zi/esp32-thingsboard-mqtt-client
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// This file is called by tbc_mqtt_helper.c/.h.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "esp_err.h"
+
+#include "tbc_utils.h"
+#include "tbc_mqtt_helper_internal.h"
+
+#include "tx_writer.h"
+#include "tx_number.h"
+
+static const char *TAG = "TX_WRITER";
+
+// Fields are static tables shared by all clients, they are registered once in any task
+static portMUX_TYPE _txwriter_spinlock = portMUX_INITIALIZER_UNLOCKED;
+
+//==== TX buffer ======================================================================
+
+// Make sure n bytes plus '}', tail and '\0' can be appended to the TX buffer
+static bool _txwriter_reserve(txwriter_t *txwriter, int n)
+{
+    int required = txwriter->len + n + 2 + txwriter->tail_len;
+    if (required <= txwriter->size) {
+        return true;
+    }
+    int max_size = (txwriter->max_size > 0) ? txwriter->max_size : TBCMH_TX_BUFFER_MAX_SIZE;
+    if (required > max_size) {
+        TBC_LOGW("required size(%d) is bigger than max size(%d)!", required, max_size);
+        return false;
+    }
+
+    int size = (txwriter->size > 0) ? txwriter->size : TBCMH_TX_BUFFER_INIT_SIZE;
+    while (size < required) {
+        size *= 2;
+    }
+    if (size > max_size) {
+        size = max_size;
+    }
+
+    char *buffer = TBC_REALLOC(txwriter->buffer, size);
+    if (!buffer) {
+        TBC_LOGE("Unable to realloc memeory! size=%d", size);
+        return false;
+    }
+    txwriter->buffer = buffer;
+    txwriter->size = size;
+    return true;
+}
+
+static void _txwriter_reset(txwriter_t *txwriter)
+{
+    txwriter->len = 0;
+    txwriter->count = 0;
+    txwriter->is_begun = false;
+    txwriter->is_protobuf = false;
+    txwriter->is_batch = false;
+    txwriter->tail_len = 0;
+}
+
+static bool _txwriter_put_raw(txwriter_t *txwriter, const char *raw, int len)
+{
+    if (!_txwriter_reserve(txwriter, len)) {
+        return false;
+    }
+    memcpy(txwriter->buffer + txwriter->len, raw, len);
+    txwriter->len += len;
+    return true;
+}
+
+// Quoted & escaped JSON string of str_len bytes. NULL is written as null.
+static bool _txwriter_put_stringn(txwriter_t *txwriter, const char *str, int str_len)
+{
+    if (!str) {
+        return _txwriter_put_raw(txwriter, "null", 4);
+    }
+
+    const unsigned char *p;
+    const unsigned char *end = (const unsigned char *)str + str_len;
+    int len = 2;
+    for (p = (const unsigned char *)str; p < end; p++) {
+        if (*p == '\"' || *p == '\\' || *p == '\b' || *p == '\f'
+            || *p == '\n' || *p == '\r' || *p == '\t') {
+            len += 2;
+        } else if (*p < 32) {
+            len += 6;
+        } else {
+            len++;
+        }
+    }
+    if (!_txwriter_reserve(txwriter, len)) {
+        return false;
+    }
+
+    char *out = txwriter->buffer + txwriter->len;
+    *out++ = '\"';
+    for (p = (const unsigned char *)str; p < end; p++) {
+        switch (*p) {
+        case '\"': *out++ = '\\'; *out++ = '\"'; break;
+        case '\\': *out++ = '\\'; *out++ = '\\'; break;
+        case '\b': *out++ = '\\'; *out++ = 'b';  break;
+        case '\f': *out++ = '\\'; *out++ = 'f';  break;
+        case '\n': *out++ = '\\'; *out++ = 'n';  break;
+        case '\r': *out++ = '\\'; *out++ = 'r';  break;
+        case '\t': *out++ = '\\'; *out++ = 't';  break;
+        default:
+            if (*p < 32) {
+                out += sprintf(out, "\\u%04x", *p);
+            } else {
+                *out++ = *p;
+            }
+            break;
+        }
+    }
+    *out++ = '\"';
+    txwriter->len += len;
+    return true;
+}
+
+// Quoted & escaped JSON string. NULL is written as null.
+static bool _txwriter_put_string(txwriter_t *txwriter, const char *str)
+{
+    return _txwriter_put_stringn(txwriter, str, str ? strlen(str) : 0);
+}
+
+//==== Number formatting =============================================================
+
+// Digits are generated by tx_number.c, see _tbcmh_txnumber_format()
+static bool _txwriter_put_int(txwriter_t *txwriter, int64_t value)
+{
+    if (!_txwriter_reserve(txwriter, 24)) {
+        return false;
+    }
+    txwriter->len += _tbcmh_txnumber_format_fixed(txwriter->buffer + txwriter->len, value, 0, false);
+    return true;
+}
+
+// Shortest decimal that is parsed back to the same double, "null" for NaN & Infinity
+static bool _txwriter_put_number(txwriter_t *txwriter, double value)
+{
+    if (!_txwriter_reserve(txwriter, TXNUMBER_MAX_LEN)) {
+        return false;
+    }
+    txwriter->len += _tbcmh_txnumber_format(txwriter->buffer + txwriter->len, value);
+    return true;
+}
+
+// Round to fixed decimals, trailing zeros are removed, e.g. (25.4996, 2) -> "25.5"
+static bool _txwriter_put_fixed(txwriter_t *txwriter, double value, int decimals)
+{
+    if (!_txwriter_reserve(txwriter, TXNUMBER_MAX_LEN)) {
+        return false;
+    }
+    txwriter->len += _tbcmh_txnumber_format_rounded(txwriter->buffer + txwriter->len, value, decimals);
+    return true;
+}
+
+//==== JSON values ===================================================================
+
+// Print a cJSON object/array into TX buffer without a temporary allocation
+static bool _txwriter_put_json(txwriter_t *txwriter, const cJSON *object)
+{
+    if (!_txwriter_reserve(txwriter, 64)) {
+        return false;
+    }
+    // cJSON_PrintPreallocated() fails if buffer is less than 5 bytes bigger than output
+    while (!cJSON_PrintPreallocated((cJSON *)object, txwriter->buffer + txwriter->len,
+                                    txwriter->size - txwriter->len - 2, false)) {
+        if (!_txwriter_reserve(txwriter, (txwriter->size - txwriter->len) * 2)) {
+            return false;
+        }
+    }
+    txwriter->len += strlen(txwriter->buffer + txwriter->len);
+    return true;
+}
+
+static bool _txwriter_put_value(txwriter_t *txwriter, const cJSON *value)
+{
+    if (cJSON_IsString(value)) {
+        return _txwriter_put_string(txwriter, value->valuestring);
+    } else if (cJSON_IsNumber(value)) {
+        return _txwriter_put_number(txwriter, value->valuedouble);
+    } else if (cJSON_IsTrue(value)) {
+        return _txwriter_put_raw(txwriter, "true", 4);
+    } else if (cJSON_IsFalse(value)) {
+        return _txwriter_put_raw(txwriter, "false", 5);
+    } else if (cJSON_IsNull(value)) {
+        return _txwriter_put_raw(txwriter, "null", 4);
+    } else if (cJSON_IsRaw(value) && value->valuestring) {
+        return _txwriter_put_raw(txwriter, value->valuestring, strlen(value->valuestring));
+    }
+    return _txwriter_put_json(txwriter, value);
+}
+
+static bool _txwriter_put_scalar(txwriter_t *txwriter, const tbcmh_scalar_t *value)
+{
+    switch (value->type) {
+    case TBCMH_SCALAR_INT:
+        return _txwriter_put_int(txwriter, value->value.int_value);
+    case TBCMH_SCALAR_FLOAT:
+        return _txwriter_put_number(txwriter, value->value.float_value);
+    case TBCMH_SCALAR_BOOL:
+        return value->value.bool_value ? _txwriter_put_raw(txwriter, "true", 4)
+                                       : _txwriter_put_raw(txwriter, "false", 5);
+    case TBCMH_SCALAR_STRING:
+        return _txwriter_put_stringn(txwriter, value->value.string.ptr, value->value.string.len);
+    case TBCMH_SCALAR_NULL:
+        return _txwriter_put_raw(txwriter, "null", 4);
+    default:
+        TBC_LOGE("value->type(%d) is error!", value->type);
+        return false;
+    }
+}
+
+// ',' (if it isn't the first pair) and "key":
+static bool _txwriter_put_key(txwriter_t *txwriter, const char *key)
+{
+    if (txwriter->count > 0 && !_txwriter_put_raw(txwriter, ",", 1)) {
+        return false;
+    }
+    return _txwriter_put_string(txwriter, key) && _txwriter_put_raw(txwriter, ":", 1);
+}
+
+static int _txwriter_publish(tbcmh_handle_t client, tbcmh_tx_type_t type,
+                             const char *payload, int len, int qos, int retain)
+{
+    switch (type) {
+    case TBCMH_TX_TELEMETRY:
+        return _tbcmh_telemetry_publish(client, payload, len, qos, retain);
+    case TBCMH_TX_ATTRIBUTES:
+        return tbcm_clientattributes_publish_ex(client->tbmqttclient, payload, len, qos, retain);
+    default:
+        TBC_LOGE("type(%d) is error!", type);
+        return -1;
+    }
+}
+
+bool _tbcmh_txwriter_put_raw(txwriter_t *txwriter, const char *raw, int len)
+{
+    return _txwriter_put_raw(txwriter, raw, len);
+}
+
+bool _tbcmh_txwriter_put_string(txwriter_t *txwriter, const char *str, int len)
+{
+    return _txwriter_put_stringn(txwriter, str, len);
+}
+
+bool _tbcmh_txwriter_put_int(txwriter_t *txwriter, int64_t value)
+{
+    return _txwriter_put_int(txwriter, value);
+}
+
+bool _tbcmh_txwriter_put_number(txwriter_t *txwriter, double value)
+{
+    return _txwriter_put_number(txwriter, value);
+}
+
+bool _tbcmh_txwriter_put_json(txwriter_t *txwriter, const cJSON *object)
+{
+    return _txwriter_put_json(txwriter, object);
+}
+
+//==== TX writer =====================================================================
+
+void _tbcmh_txwriter_on_create(tbcmh_handle_t client)
+{
+    // This function is in semaphore/client->_lock!!!
+    TBC_CHECK_PTR(client);
+
+    memset(&client->txwriter, 0x00, sizeof(client->txwriter));
+}
+
+void _tbcmh_txwriter_on_destroy(tbcmh_handle_t client)
+{
+    // This function is in semaphore/client->_lock!!!
+    TBC_CHECK_PTR(client);
+
+    TBC_FIELD_FREE(client->txwriter.buffer);
+    memset(&client->txwriter, 0x00, sizeof(client->txwriter));
+}
+
+// JSON publishers are unavailable if payload_type is protobuf, use tbcmh_tx_begin_proto() instead
+bool _tbcmh_txwriter_check_json(tbcmh_handle_t client, const char *function)
+{
+    if (client->config.payload_type != TBC_TRANSPORT_PAYLOAD_TYPE_JSON) {
+        TBC_LOGE("payload_type is protobuf, JSON payload is rejected! %s()", function);
+        return false;
+    }
+    return true;
+}
+
+// Publish a whole cJSON object/array through the TX buffer.
+// It falls back to cJSON_PrintUnformatted() if the TX buffer is being used or too small.
+int _tbcmh_txwriter_publish_object(tbcmh_handle_t client, tbcmh_tx_type_t type,
+                                   const cJSON *object, int qos, int retain)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(client, ESP_FAIL);
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(object, ESP_FAIL);
+    if (!_tbcmh_txwriter_check_json(client, __FUNCTION__)) {
+        return ESP_FAIL;
+    }
+
+    // Take semaphore
+    if (xSemaphoreTakeRecursive(client->_lock, (TickType_t)0xFFFFF) != pdTRUE) {
+         TBC_LOGE("Unable to take semaphore! %s()", __FUNCTION__);
+         return ESP_FAIL;
+    }
+
+    int msg_id = -1;
+    txwriter_t *txwriter = &client->txwriter;
+    if (!txwriter->is_begun && _txwriter_put_json(txwriter, object)) {
+        msg_id = _txwriter_publish(client, type, txwriter->buffer, txwriter->len, qos, retain);
+        _txwriter_reset(txwriter);
+    } else {
+        if (!txwriter->is_begun) {
+            _txwriter_reset(txwriter);
+        }
+        char *pack = cJSON_PrintUnformatted(object); //cJSON_Print()
+        if (pack) {
+            msg_id = _txwriter_publish(client, type, pack, strlen(pack), qos, retain);
+            cJSON_free(pack); // free memory
+        }
+    }
+    // Mirror the values only if they are published
+    if (type == TBCMH_TX_ATTRIBUTES && msg_id >= 0) {
+        _tbcmh_attributemirror_on_publish(client, object);
+    }
+
+    // Give semaphore
+    xSemaphoreGiveRecursive(client->_lock);
+    return msg_id;
+}
+
+//==== Streaming JSON writer API =====================================================
+
+// Take semaphore & get TX writer between tbcmh_tx_begin() and tbcmh_tx_commit()/tbcmh_tx_abort()
+static txwriter_t *_txwriter_take_begun(tbcmh_handle_t client, const char *function)
+{
+    if (xSemaphoreTakeRecursive(client->_lock, (TickType_t)0xFFFFF) != pdTRUE) {
+        TBC_LOGE("Unable to take semaphore! %s()", function);
+        return NULL;
+    }
+    if (!client->txwriter.is_begun) {
+        TBC_LOGE("tbcmh_tx_begin() isn't called! %s()", function);
+        xSemaphoreGiveRecursive(client->_lock);
+        return NULL;
+    }
+    return &client->txwriter;
+}
+
+// Same as _txwriter_take_begun(), and check JSON/protobuf of pending payload
+static txwriter_t *_txwriter_take_begun_as(tbcmh_handle_t client, bool is_protobuf,
+                                           const char *function)
+{
+    txwriter_t *txwriter = _txwriter_take_begun(client, function);
+    if (txwriter && txwriter->is_protobuf != is_protobuf) {
+        TBC_LOGE("pending payload isn't %s! %s()", is_protobuf ? "protobuf" : "JSON", function);
+        xSemaphoreGiveRecursive(client->_lock);
+        return NULL;
+    }
+    if (txwriter && txwriter->is_batch) {
+        TBC_LOGE("pending payload is a batch, use tbcmh_tx_add_row()! %s()", function);
+        xSemaphoreGiveRecursive(client->_lock);
+        return NULL;
+    }
+    return txwriter;
+}
+
+// Roll back a key/value pair that doesn't fit & give semaphore
+static tbc_err_t _txwriter_add_end(tbcmh_handle_t client, int len, bool result, const char *key)
+{
+    txwriter_t *txwriter = &client->txwriter;
+    if (result) {
+        txwriter->count++;
+    } else {
+        TBC_LOGW("Unable to add key/value to TX buffer! key=%s", key);
+        txwriter->len = len;
+    }
+    xSemaphoreGiveRecursive(client->_lock);
+    return result ? ESP_OK : ESP_FAIL;
+}
+
+static tbc_err_t _txwriter_begin(tbcmh_handle_t client, tbcmh_tx_type_t type,
+                                 bool is_protobuf, const char *function)
+{
+    // JSON (incl. timestamped & batch) isn't published if payload_type is protobuf
+    if (!is_protobuf && !_tbcmh_txwriter_check_json(client, function)) {
+         return ESP_FAIL;
+    }
+
+    // Take semaphore. It is given in tbcmh_tx_commit() or tbcmh_tx_abort()
+    if (xSemaphoreTakeRecursive(client->_lock, (TickType_t)0xFFFFF) != pdTRUE) {
+         TBC_LOGE("Unable to take semaphore! %s()", function);
+         return ESP_FAIL;
+    }
+
+    txwriter_t *txwriter = &client->txwriter;
+    if (txwriter->is_begun) {
+         TBC_LOGE("tbcmh_tx_begin() is already called! %s()", function);
+         xSemaphoreGiveRecursive(client->_lock);
+         return ESP_FAIL;
+    }
+
+    _txwriter_reset(txwriter);
+    // A protobuf message has no delimiter, but the buffer is allocated here as well
+    if (!_txwriter_put_raw(txwriter, "{", is_protobuf ? 0 : 1)) {
+         xSemaphoreGiveRecursive(client->_lock);
+         return ESP_FAIL;
+    }
+    txwriter->type = type;
+    txwriter->is_begun = true;
+    txwriter->is_protobuf = is_protobuf;
+    return ESP_OK;
+}
+
+tbc_err_t tbcmh_tx_begin(tbcmh_handle_t client, tbcmh_tx_type_t type)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(client, ESP_FAIL);
+    return _txwriter_begin(client, type, false, __FUNCTION__);
+}
+
+tbc_err_t tbcmh_tx_begin_ts(tbcmh_handle_t client, int64_t ts)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(client, ESP_FAIL);
+    if (ts <= 0) {
+        ts = tbcmh_timesync_now_ms(client);
+    }
+    if (_txwriter_begin(client, TBCMH_TX_TELEMETRY, false, __FUNCTION__) != ESP_OK) {
+        return ESP_FAIL;
+    }
+
+    // '{' is written by _txwriter_begin(): {"ts":..,"values":{ ... }}
+    txwriter_t *txwriter = &client->txwriter;
+    txwriter->tail_len = 1;
+    if (!_txwriter_put_raw(txwriter, "\"ts\":", 5) || !_txwriter_put_int(txwriter, ts)
+        || !_txwriter_put_raw(txwriter, ",\"values\":{", 11)) {
+        _txwriter_reset(txwriter);
+        xSemaphoreGiveRecursive(client->_lock);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+tbc_err_t tbcmh_tx_begin_batch(tbcmh_handle_t client)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(client, ESP_FAIL);
+    if (_txwriter_begin(client, TBCMH_TX_TELEMETRY, false, __FUNCTION__) != ESP_OK) {
+        return ESP_FAIL;
+    }
+
+    // '{' written by _txwriter_begin() is replaced by '[', ']' is appended by tbcmh_tx_commit()
+    txwriter_t *txwriter = &client->txwriter;
+    txwriter->buffer[0] = '[';
+    txwriter->is_batch = true;
+    return ESP_OK;
+}
+
+tbc_err_t tbcmh_tx_begin_proto(tbcmh_handle_t client, tbcmh_tx_type_t type)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(client, ESP_FAIL);
+    return _txwriter_begin(client, type, true, __FUNCTION__);
+}
+
+tbc_err_t tbcmh_tx_add_string(tbcmh_handle_t client, const char *key, const char *value)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(client, ESP_FAIL);
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(key, ESP_FAIL);
+
+    txwriter_t *txwriter = _txwriter_take_begun_as(client, false, __FUNCTION__);
+    if (!txwriter) {
+        return ESP_FAIL;
+    }
+
+    int len = txwriter->len;
+    bool result = _txwriter_put_key(txwriter, key) && _txwriter_put_string(txwriter, value);
+    return _txwriter_add_end(client, len, result, key);
+}
+
+tbc_err_t tbcmh_tx_add_int(tbcmh_handle_t client, const char *key, int64_t value)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(client, ESP_FAIL);
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(key, ESP_FAIL);
+
+    txwriter_t *txwriter = _txwriter_take_begun_as(client, false, __FUNCTION__);
+    if (!txwriter) {
+        return ESP_FAIL;
+    }
+
+    int len = txwriter->len;
+    bool result = _txwriter_put_key(txwriter, key) && _txwriter_put_int(txwriter, value);
+    return _txwriter_add_end(client, len, result, key);
+}
+
+tbc_err_t tbcmh_tx_add_float(tbcmh_handle_t client, const char *key, double value)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(client, ESP_FAIL);
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(key, ESP_FAIL);
+
+    txwriter_t *txwriter = _txwriter_take_begun_as(client, false, __FUNCTION__);
+    if (!txwriter) {
+        return ESP_FAIL;
+    }
+
+    int len = txwriter->len;
+    bool result = _txwriter_put_key(txwriter, key) && _txwriter_put_number(txwriter, value);
+    return _txwriter_add_end(client, len, result, key);
+}
+
+tbc_err_t tbcmh_tx_add_float_fixed(tbcmh_handle_t client, const char *key,
+                                   double value, int decimals)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(client, ESP_FAIL);
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(key, ESP_FAIL);
+
+    txwriter_t *txwriter = _txwriter_take_begun_as(client, false, __FUNCTION__);
+    if (!txwriter) {
+        return ESP_FAIL;
+    }
+
+    int len = txwriter->len;
+    bool result = _txwriter_put_key(txwriter, key) && _txwriter_put_fixed(txwriter, value, decimals);
+    return _txwriter_add_end(client, len, result, key);
+}
+
+tbc_err_t tbcmh_tx_add_bool(tbcmh_handle_t client, const char *key, bool value)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(client, ESP_FAIL);
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(key, ESP_FAIL);
+
+    txwriter_t *txwriter = _txwriter_take_begun_as(client, false, __FUNCTION__);
+    if (!txwriter) {
+        return ESP_FAIL;
+    }
+
+    int len = txwriter->len;
+    bool result = _txwriter_put_key(txwriter, key)
+        && _txwriter_put_raw(txwriter, value ? "true" : "false", value ? 4 : 5);
+    return _txwriter_add_end(client, len, result, key);
+}
+
+tbc_err_t tbcmh_tx_add_value(tbcmh_handle_t client, const char *key, const tbcmh_value_t *value)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(client, ESP_FAIL);
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(key, ESP_FAIL);
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(value, ESP_FAIL);
+
+    txwriter_t *txwriter = _txwriter_take_begun_as(client, false, __FUNCTION__);
+    if (!txwriter) {
+        return ESP_FAIL;
+    }
+
+    int len = txwriter->len;
+    bool result = _txwriter_put_key(txwriter, key) && _txwriter_put_value(txwriter, value);
+    return _txwriter_add_end(client, len, result, key);
+}
+
+tbc_err_t tbcmh_tx_add_scalar(tbcmh_handle_t client, const char *key, const tbcmh_scalar_t *value)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(client, ESP_FAIL);
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(key, ESP_FAIL);
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(value, ESP_FAIL);
+
+    txwriter_t *txwriter = _txwriter_take_begun_as(client, false, __FUNCTION__);
+    if (!txwriter) {
+        return ESP_FAIL;
+    }
+
+    int len = txwriter->len;
+    bool result = _txwriter_put_key(txwriter, key) && _txwriter_put_scalar(txwriter, value);
+    return _txwriter_add_end(client, len, result, key);
+}
+
+int tbcmh_tx_serialize_key(const char *key, char *fragment, int size)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(key, ESP_FAIL);
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(fragment, ESP_FAIL);
+
+    // a standalone writer, its buffer is freed here
+    txwriter_t txwriter;
+    memset(&txwriter, 0x00, sizeof(txwriter));
+    int len = ESP_FAIL;
+    if (_txwriter_put_string(&txwriter, key) && _txwriter_put_raw(&txwriter, ":", 1)
+        && txwriter.len <= size) {
+        memcpy(fragment, txwriter.buffer, txwriter.len);
+        len = txwriter.len;
+    }
+    TBC_FIELD_FREE(txwriter.buffer);
+    return len;
+}
+
+tbc_err_t tbcmh_tx_add_scalar_fragment(tbcmh_handle_t client, const char *fragment, int fragment_len,
+                                       const tbcmh_scalar_t *value, int decimals)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(client, ESP_FAIL);
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(fragment, ESP_FAIL);
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(value, ESP_FAIL);
+
+    txwriter_t *txwriter = _txwriter_take_begun_as(client, false, __FUNCTION__);
+    if (!txwriter) {
+        return ESP_FAIL;
+    }
+
+    int len = txwriter->len;
+    bool result = (txwriter->count == 0 || _txwriter_put_raw(txwriter, ",", 1))
+        && _txwriter_put_raw(txwriter, fragment, fragment_len);
+    if (result && value->type == TBCMH_SCALAR_FLOAT && decimals >= 0) {
+        result = _txwriter_put_fixed(txwriter, value->value.float_value, decimals);
+    } else if (result) {
+        result = _txwriter_put_scalar(txwriter, value);
+    }
+    return _txwriter_add_end(client, len, result, "(fragment)");
+}
+
+tbc_err_t tbcmh_tx_add_value_fragment(tbcmh_handle_t client, const char *fragment, int fragment_len,
+                                      const tbcmh_value_t *value, int decimals)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(client, ESP_FAIL);
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(fragment, ESP_FAIL);
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(value, ESP_FAIL);
+
+    txwriter_t *txwriter = _txwriter_take_begun_as(client, false, __FUNCTION__);
+    if (!txwriter) {
+        return ESP_FAIL;
+    }
+
+    int len = txwriter->len;
+    bool result = (txwriter->count == 0 || _txwriter_put_raw(txwriter, ",", 1))
+        && _txwriter_put_raw(txwriter, fragment, fragment_len);
+    if (result && cJSON_IsNumber(value) && decimals >= 0) {
+        result = _txwriter_put_fixed(txwriter, value->valuedouble, decimals);
+    } else if (result) {
+        result = _txwriter_put_value(txwriter, value);
+    }
+    return _txwriter_add_end(client, len, result, "(fragment)");
+}
+
+// ',' (if it isn't the first row) and {"ts":..,"values":{"key":value,...}}
+tbc_err_t tbcmh_tx_add_row(tbcmh_handle_t client, int64_t ts, const tbcmh_tx_column_t *columns,
+                           const tbcmh_scalar_t *values, int count)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(client, ESP_FAIL);
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(columns, ESP_FAIL);
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(values, ESP_FAIL);
+
+    txwriter_t *txwriter = _txwriter_take_begun(client, __FUNCTION__);
+    if (!txwriter) {
+        return ESP_FAIL;
+    }
+    if (!txwriter->is_batch) {
+        TBC_LOGE("tbcmh_tx_begin_batch() isn't called! %s()", __FUNCTION__);
+        xSemaphoreGiveRecursive(client->_lock);
+        return ESP_FAIL;
+    }
+
+    int len = txwriter->len;
+    bool result = _txwriter_put_raw(txwriter, (txwriter->count > 0) ? ",{\"ts\":" : "{\"ts\":",
+                                    (txwriter->count > 0) ? 7 : 6)
+                  && _txwriter_put_int(txwriter, ts)
+                  && _txwriter_put_raw(txwriter, ",\"values\":{", 11);
+    int i;
+    for (i = 0; result && i < count; i++) {
+        const tbcmh_tx_column_t *column = &columns[i];
+        result = (i == 0 || _txwriter_put_raw(txwriter, ",", 1))
+                 && _txwriter_put_raw(txwriter, column->fragment, column->fragment_len);
+        if (result && values[i].type == TBCMH_SCALAR_FLOAT && column->decimals >= 0) {
+            result = _txwriter_put_fixed(txwriter, values[i].value.float_value, column->decimals);
+        } else if (result) {
+            result = _txwriter_put_scalar(txwriter, &values[i]);
+        }
+    }
+    result = result && _txwriter_put_raw(txwriter, "}}", 2);
+    return _txwriter_add_end(client, len, result, "(row)");
+}
+
+tbc_err_t tbcmh_tx_register_fields(tbcmh_tx_field_t *fields, int count)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(fields, ESP_FAIL);
+    if (count <= 0) {
+        return (count == 0) ? ESP_OK : ESP_FAIL;
+    }
+
+    taskENTER_CRITICAL(&_txwriter_spinlock);
+    bool is_registered = (fields[count - 1].fragment != NULL);
+    taskEXIT_CRITICAL(&_txwriter_spinlock);
+    if (is_registered) {
+        return ESP_OK;
+    }
+
+    // All fragments are in one buffer. An escaped char is 6 bytes at most, plus quotes & ':'
+    int size = 0;
+    int i;
+    for (i = 0; i < count; i++) {
+        if (!fields[i].key) {
+            TBC_LOGE("fields[%d].key is NULL! %s()", i, __FUNCTION__);
+            return ESP_FAIL;
+        }
+        size += strlen(fields[i].key) * 6 + 3;
+    }
+    char *buffer = TBC_MALLOC(size);
+    int *lens = TBC_MALLOC(sizeof(int) * count);
+    if (!buffer || !lens) {
+        TBC_LOGE("Unable to malloc memeory!");
+        TBC_FREE(buffer);
+        TBC_FREE(lens);
+        return ESP_FAIL;
+    }
+    int len = 0;
+    for (i = 0; i < count; i++) {
+        lens[i] = tbcmh_tx_serialize_key(fields[i].key, buffer + len, size - len);
+        if (lens[i] < 0) {
+            TBC_LOGE("Unable to serialize fields[%d].key(%s)! %s()", i, fields[i].key, __FUNCTION__);
+            TBC_FREE(buffer);
+            TBC_FREE(lens);
+            return ESP_FAIL;
+        }
+        len += lens[i];
+    }
+
+    // Another task may have registered them meanwhile. The last fragment is set at last.
+    taskENTER_CRITICAL(&_txwriter_spinlock);
+    is_registered = (fields[count - 1].fragment != NULL);
+    if (!is_registered) {
+        len = 0;
+        for (i = 0; i < count; i++) {
+            fields[i].fragment = buffer + len;
+            fields[i].fragment_len = lens[i];
+            len += lens[i];
+        }
+    }
+    taskEXIT_CRITICAL(&_txwriter_spinlock);
+
+    if (is_registered) {
+        TBC_FREE(buffer);
+    }
+    TBC_FREE(lens);
+    return ESP_OK;
+}
+
+tbc_err_t tbcmh_tx_add_fields(tbcmh_handle_t client, const tbcmh_tx_field_t *fields,
+                              int count, const void *data)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(client, ESP_FAIL);
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(fields, ESP_FAIL);
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(data, ESP_FAIL);
+    if (count <= 0) {
+        return (count == 0) ? ESP_OK : ESP_FAIL;
+    }
+    if (!fields[count - 1].fragment) {
+        TBC_LOGE("fields aren't registered by tbcmh_tx_register_fields()! %s()", __FUNCTION__);
+        return ESP_FAIL;
+    }
+
+    txwriter_t *txwriter = _txwriter_take_begun_as(client, false, __FUNCTION__);
+    if (!txwriter) {
+        return ESP_FAIL;
+    }
+
+    int len = txwriter->len;
+    bool result = true;
+    int i;
+    for (i = 0; i < count; i++) {
+        const tbcmh_tx_field_t *field = &fields[i];
+        const char *member = (const char *)data + field->offset;
+        result = (txwriter->count + i == 0 || _txwriter_put_raw(txwriter, ",", 1))
+                 && _txwriter_put_raw(txwriter, field->fragment, field->fragment_len);
+        if (!result) {
+            break;
+        }
+        switch (field->type) {
+        case TBCMH_TX_FIELD_INT:
+            result = _txwriter_put_int(txwriter, *(const int64_t *)member);
+            break;
+        case TBCMH_TX_FIELD_FLOAT:
+            result = _txwriter_put_number(txwriter, *(const double *)member);
+            break;
+        case TBCMH_TX_FIELD_BOOL:
+            result = *(const bool *)member ? _txwriter_put_raw(txwriter, "true", 4)
+                                           : _txwriter_put_raw(txwriter, "false", 5);
+            break;
+        case TBCMH_TX_FIELD_STRING:
+            result = _txwriter_put_string(txwriter, *(const char * const *)member);
+            break;
+        default:
+            TBC_LOGE("field->type(%d) is error!", field->type);
+            result = false;
+            break;
+        }
+        if (!result) {
+            break;
+        }
+    }
+
+    if (result) {
+        txwriter->count += count - 1; // the last one is counted by _txwriter_add_end()
+    }
+    return _txwriter_add_end(client, len, result, result ? "" : fields[i].key);
+}
+
+//==== Protobuf payload ==============================================================
+
+// Roll back a protobuf field that doesn't fit & give semaphore
+static tbc_err_t _txwriter_add_proto_end(tbcmh_handle_t client, int len, bool result,
+                                         uint32_t field_number)
+{
+    txwriter_t *txwriter = &client->txwriter;
+    if (result) {
+        txwriter->count++;
+    } else {
+        TBC_LOGW("Unable to add field to TX buffer! field_number=%u", field_number);
+        txwriter->len = len;
+    }
+    xSemaphoreGiveRecursive(client->_lock);
+    return result ? ESP_OK : ESP_FAIL;
+}
+
+tbc_err_t tbcmh_tx_add_proto_int(tbcmh_handle_t client, uint32_t field_number, int64_t value)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(client, ESP_FAIL);
+
+    txwriter_t *txwriter = _txwriter_take_begun_as(client, true, __FUNCTION__);
+    if (!txwriter) {
+        return ESP_FAIL;
+    }
+
+    int len = txwriter->len;
+    bool result = _tbcmh_pbcodec_put_int(txwriter, field_number, value);
+    return _txwriter_add_proto_end(client, len, result, field_number);
+}
+
+tbc_err_t tbcmh_tx_add_proto_double(tbcmh_handle_t client, uint32_t field_number, double value)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(client, ESP_FAIL);
+
+    txwriter_t *txwriter = _txwriter_take_begun_as(client, true, __FUNCTION__);
+    if (!txwriter) {
+        return ESP_FAIL;
+    }
+
+    int len = txwriter->len;
+    bool result = _tbcmh_pbcodec_put_double(txwriter, field_number, value);
+    return _txwriter_add_proto_end(client, len, result, field_number);
+}
+
+tbc_err_t tbcmh_tx_add_proto_float(tbcmh_handle_t client, uint32_t field_number, float value)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(client, ESP_FAIL);
+
+    txwriter_t *txwriter = _txwriter_take_begun_as(client, true, __FUNCTION__);
+    if (!txwriter) {
+        return ESP_FAIL;
+    }
+
+    int len = txwriter->len;
+    bool result = _tbcmh_pbcodec_put_float(txwriter, field_number, value);
+    return _txwriter_add_proto_end(client, len, result, field_number);
+}
+
+tbc_err_t tbcmh_tx_add_proto_bool(tbcmh_handle_t client, uint32_t field_number, bool value)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(client, ESP_FAIL);
+
+    txwriter_t *txwriter = _txwriter_take_begun_as(client, true, __FUNCTION__);
+    if (!txwriter) {
+        return ESP_FAIL;
+    }
+
+    int len = txwriter->len;
+    bool result = _tbcmh_pbcodec_put_int(txwriter, field_number, value ? 1 : 0);
+    return _txwriter_add_proto_end(client, len, result, field_number);
+}
+
+tbc_err_t tbcmh_tx_add_proto_string(tbcmh_handle_t client, uint32_t field_number, const char *value)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(client, ESP_FAIL);
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(value, ESP_FAIL);
+
+    txwriter_t *txwriter = _txwriter_take_begun_as(client, true, __FUNCTION__);
+    if (!txwriter) {
+        return ESP_FAIL;
+    }
+
+    int len = txwriter->len;
+    bool result = _tbcmh_pbcodec_put_bytes(txwriter, field_number, value, strlen(value));
+    return _txwriter_add_proto_end(client, len, result, field_number);
+}
+
+int tbcmh_tx_commit(tbcmh_handle_t client, int qos/*= 1*/, int retain/*= 0*/)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(client, ESP_FAIL);
+
+    txwriter_t *txwriter = _txwriter_take_begun(client, __FUNCTION__);
+    if (!txwriter) {
+        return ESP_FAIL;
+    }
+
+    // _txwriter_reserve() always keeps two bytes for '}'(']' of batch) & '\0', plus tail
+    if (!txwriter->is_protobuf) {
+        while (txwriter->tail_len-- > 0) {
+            txwriter->buffer[txwriter->len++] = '}';
+        }
+        txwriter->buffer[txwriter->len++] = txwriter->is_batch ? ']' : '}';
+        txwriter->buffer[txwriter->len] = '\0';
+    }
+
+    int msg_id = -1;
+    if (txwriter->count > 0) {
+        msg_id = _txwriter_publish(client, txwriter->type, txwriter->buffer, txwriter->len,
+                                   qos, retain);
+        if (txwriter->type == TBCMH_TX_ATTRIBUTES && !txwriter->is_protobuf && msg_id >= 0) {
+            _tbcmh_attributemirror_on_publish_payload(client, txwriter->buffer, txwriter->len);
+        }
+    } else {
+        TBC_LOGW("Nothing is added to TX buffer! %s()", __FUNCTION__);
+    }
+    _txwriter_reset(txwriter);
+
+    // Give semaphore twice. It is taken above and in tbcmh_tx_begin()
+    xSemaphoreGiveRecursive(client->_lock);
+    xSemaphoreGiveRecursive(client->_lock);
+    return msg_id;
+}
+
+void tbcmh_tx_abort(tbcmh_handle_t client)
+{
+    TBC_CHECK_PTR(client);
+
+    if (!_txwriter_take_begun(client, __FUNCTION__)) {
+        return;
+    }
+    _txwriter_reset(&client->txwriter);
+
+    // Give semaphore twice. It is taken above and in tbcmh_tx_begin()
+    xSemaphoreGiveRecursive(client->_lock);
+    xSemaphoreGiveRecursive(client->_lock);
+}
@@ -0,0 +1,68 @@
+// Copyright 2022 liangzhuzhi2020@gmail.com, https://github.com/liang-zhu-zi/esp32-thingsboard-mqtt-client
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// This file is called by tbc_mqtt_helper.c/.h.
+
+#ifndef _TX_WRITER_H_
+#define _TX_WRITER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "tbc_utils.h"
+#include "tbc_mqtt_helper.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TBCMH_TX_BUFFER_INIT_SIZE  (512)       /*!< initial size of TX buffer */
+#define TBCMH_TX_BUFFER_MAX_SIZE   (16*1024)   /*!< TX buffer never grows beyond it */
+
+/**
+ * ThingsBoard MQTT Client Helper streaming JSON writer
+ */
+typedef struct txwriter
+{
+     char *buffer;          /*!< reusable TX buffer, it is kept between publishes */
+     int size;              /*!< allocated size of buffer */
+     int len;               /*!< length of pending payload, exclude '\0' */
+     int count;             /*!< count of key/value pairs in pending payload */
+     tbcmh_tx_type_t type;  /*!< topic of pending payload */
+     bool is_begun;         /*!< between tbcmh_tx_begin() and tbcmh_tx_commit()/tbcmh_tx_abort() */
+     bool is_protobuf;      /*!< pending payload is protobuf, begun by tbcmh_tx_begin_proto() */
+     bool is_batch;         /*!< pending payload is an array of rows, begun by tbcmh_tx_begin_batch() */
+     int max_size;          /*!< buffer never grows beyond it, 0 for TBCMH_TX_BUFFER_MAX_SIZE */
+     int tail_len;          /*!< extra closing bytes, e.g. '}' of "values" begun by tbcmh_tx_begin_ts() */
+} txwriter_t;
+
+void _tbcmh_txwriter_on_create(tbcmh_handle_t client);
+void _tbcmh_txwriter_on_destroy(tbcmh_handle_t client);
+bool _tbcmh_txwriter_check_json(tbcmh_handle_t client, const char *function);
+int _tbcmh_txwriter_publish_object(tbcmh_handle_t client, tbcmh_tx_type_t type,
+                                   const cJSON *object, int qos, int retain);
+
+// Primitives of a standalone txwriter_t, e.g. protobuf encoding & decoding
+bool _tbcmh_txwriter_put_raw(txwriter_t *txwriter, const char *raw, int len);
+bool _tbcmh_txwriter_put_string(txwriter_t *txwriter, const char *str, int len);
+bool _tbcmh_txwriter_put_int(txwriter_t *txwriter, int64_t value);
+bool _tbcmh_txwriter_put_number(txwriter_t *txwriter, double value);
+bool _tbcmh_txwriter_put_json(txwriter_t *txwriter, const cJSON *object);
+
+#ifdef __cplusplus
+}
+#endif //__cplusplus
+
+#endif
@@ -114,6 +114,7 @@ tbc_transport_config_t *tbc_transport_config_copy(tbc_transport_config_t *dest,
     TBC_CHECK_PTR_WITH_RETURN_VALUE(result, NULL);
 
     dest->log_rxtx_package = src->log_rxtx_package;
+    dest->payload_type = src->payload_type;
     return dest;
 }
 
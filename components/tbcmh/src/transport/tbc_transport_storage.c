@@ -132,6 +132,7 @@ void *tbc_transport_storage_fill_from_config(tbc_transport_storage_t *storage,
     _transport_authentication_storage_fill_from_config(&storage->authentication, &config->authentication);
 
     storage->log_rxtx_package = config->log_rxtx_package;
+    storage->payload_type = config->payload_type;
     return storage;
 }
 
@@ -199,5 +200,6 @@ void tbc_transport_storage_free_fields(tbc_transport_storage_t *storage)
     _transport_verification_storage_free_fields(&storage->verification);
     _transport_authentication_storage_free_fields(&storage->authentication);
     storage->log_rxtx_package = false;
+    storage->payload_type = TBC_TRANSPORT_PAYLOAD_TYPE_JSON;
 }
 
@@ -111,6 +111,7 @@ typedef struct tbc_transport_storage
   tbc_transport_authentication_storage_t authentication; /*!< Client authentication for mutual authentication using TLS */
 
   bool log_rxtx_package; /*!< print Rx/Tx MQTT package */
+  tbc_transport_payload_type_t payload_type; /*!< JSON or protobuf */
 } tbc_transport_storage_t;
 
 void *tbc_transport_storage_fill_from_config(tbc_transport_storage_t *storage,
@@ -0,0 +1,160 @@
+// Copyright 2022 liangzhuzhi2020@gmail.com, https://github.com/liang-zhu-zi/esp32-thingsboard-mqtt-client
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// ThingsBoard MQTT Client low layer API
+
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_err.h"
+#include "esp_timer.h"
+
+#include "tbc_utils.h"
+
+#include "tbc_mqtt_linkstats.h"
+
+const static char *TAG = "tbcm_linkstats";
+
+void tbcm_linkstats_init(tbcm_linkstats_t *linkstats)
+{
+    if (!linkstats) {
+         TBC_LOGE("linkstats is NULL!");
+         return;
+    }
+
+    memset(linkstats, 0x00, sizeof(tbcm_linkstats_t));
+    portMUX_INITIALIZE(&linkstats->spinlock);
+}
+
+// Fold a publish-ACK latency into the moving average. linkstats->spinlock must be held
+static void _tbcm_linkstats_add_latency(tbcm_linkstats_t *linkstats, int64_t latency_us)
+{
+    uint32_t latency_ms = (uint32_t)(latency_us / 1000);
+    if (linkstats->ack_count++ == 0) {
+        linkstats->ack_latency_ms = latency_ms;
+    } else {
+        linkstats->ack_latency_ms += ((int32_t)latency_ms - (int32_t)linkstats->ack_latency_ms)
+                                     >> TBCM_LINKSTATS_EWMA_SHIFT;
+    }
+}
+
+// Track a QoS 1/2 publish. If all slots are used, the oldest one is replaced.
+// publish_us is esp_timer_get_time() taken BEFORE esp_mqtt_client_publish(): the MQTT task may
+// receive the ACK before that call returns, then the ACK is already in the early-ACK ring.
+void tbcm_linkstats_on_publish(tbcm_linkstats_t *linkstats, int msg_id, int qos, int64_t publish_us)
+{
+    if (!linkstats || msg_id <= 0 || qos <= 0) {
+         return;
+    }
+
+    taskENTER_CRITICAL(&linkstats->spinlock);
+    int i;
+    for (i = 0; i < TBCM_LINKSTATS_EARLYACK_MAX; i++) {
+        tbcm_linkstats_earlyack_t *earlyack = &linkstats->earlyack[i];
+        // an ACK before publish_us belongs to an older publish with a wrapped-around msg_id
+        if (earlyack->msg_id == msg_id && earlyack->ack_us >= publish_us) {
+            _tbcm_linkstats_add_latency(linkstats, earlyack->ack_us - publish_us);
+            earlyack->msg_id = 0;
+            taskEXIT_CRITICAL(&linkstats->spinlock);
+            return;
+        }
+    }
+
+    tbcm_linkstats_inflight_t *slot = &linkstats->inflight[0];
+    for (i = 0; i < TBCM_LINKSTATS_INFLIGHT_MAX; i++) {
+        tbcm_linkstats_inflight_t *inflight = &linkstats->inflight[i];
+        if (inflight->msg_id == 0) {
+            slot = inflight;
+            break;
+        }
+        if (inflight->publish_us < slot->publish_us) {
+            slot = inflight;
+        }
+    }
+    slot->msg_id = msg_id;
+    slot->publish_us = publish_us;
+    taskEXIT_CRITICAL(&linkstats->spinlock);
+}
+
+// An ACK of an untracked publish is remembered in the early-ACK ring,
+// tbcm_linkstats_on_publish() picks it up if its publish is still being sent
+void tbcm_linkstats_on_published(tbcm_linkstats_t *linkstats, int msg_id)
+{
+    if (!linkstats || msg_id <= 0) {
+         return;
+    }
+
+    int64_t now_us = esp_timer_get_time();
+    taskENTER_CRITICAL(&linkstats->spinlock);
+    int i;
+    for (i = 0; i < TBCM_LINKSTATS_INFLIGHT_MAX; i++) {
+        tbcm_linkstats_inflight_t *inflight = &linkstats->inflight[i];
+        if (inflight->msg_id == msg_id) {
+            _tbcm_linkstats_add_latency(linkstats, now_us - inflight->publish_us);
+            inflight->msg_id = 0;
+            break;
+        }
+    }
+    if (i >= TBCM_LINKSTATS_INFLIGHT_MAX) {
+        tbcm_linkstats_earlyack_t *earlyack = &linkstats->earlyack[linkstats->earlyack_next];
+        earlyack->msg_id = msg_id;
+        earlyack->ack_us = now_us;
+        linkstats->earlyack_next = (linkstats->earlyack_next + 1) % TBCM_LINKSTATS_EARLYACK_MAX;
+    }
+    taskEXIT_CRITICAL(&linkstats->spinlock);
+}
+
+// The publish is deleted from outbox without ACK
+void tbcm_linkstats_on_deleted(tbcm_linkstats_t *linkstats, int msg_id)
+{
+    if (!linkstats || msg_id <= 0) {
+         return;
+    }
+
+    taskENTER_CRITICAL(&linkstats->spinlock);
+    int i;
+    for (i = 0; i < TBCM_LINKSTATS_INFLIGHT_MAX; i++) {
+        if (linkstats->inflight[i].msg_id == msg_id) {
+            linkstats->inflight[i].msg_id = 0;
+            break;
+        }
+    }
+    taskEXIT_CRITICAL(&linkstats->spinlock);
+}
+
+// Max of the moving average and the age of the oldest publish waiting for ACK,
+// so a stalled link is seen before any ACK arrives
+uint32_t tbcm_linkstats_get_ack_latency(tbcm_linkstats_t *linkstats)
+{
+    if (!linkstats) {
+         return 0;
+    }
+
+    int64_t now_us = esp_timer_get_time();
+    taskENTER_CRITICAL(&linkstats->spinlock);
+    uint32_t latency_ms = linkstats->ack_latency_ms;
+    int i;
+    for (i = 0; i < TBCM_LINKSTATS_INFLIGHT_MAX; i++) {
+        tbcm_linkstats_inflight_t *inflight = &linkstats->inflight[i];
+        int64_t age_ms = (now_us - inflight->publish_us) / 1000;
+        if (inflight->msg_id != 0 && age_ms >= TBCM_LINKSTATS_EXPIRE_MS) {
+            inflight->msg_id = 0;
+        } else if (inflight->msg_id != 0 && age_ms > latency_ms) {
+            latency_ms = (uint32_t)age_ms;
+        }
+    }
+    taskEXIT_CRITICAL(&linkstats->spinlock);
+    return latency_ms;
+}
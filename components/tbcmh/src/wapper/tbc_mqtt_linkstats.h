@@ -0,0 +1,75 @@
+// Copyright 2022 liangzhuzhi2020@gmail.com, https://github.com/liang-zhu-zi/esp32-thingsboard-mqtt-client
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// ThingsBoard Client MQTT link statistics API
+
+#ifndef _TBC_MQTT_LINKSTATS_H_
+#define _TBC_MQTT_LINKSTATS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TBCM_LINKSTATS_INFLIGHT_MAX (16)  /*!< max count of tracked publishes waiting for ACK */
+#define TBCM_LINKSTATS_EWMA_SHIFT   (3)   /*!< weight of a new ACK latency is 1/8 */
+#define TBCM_LINKSTATS_EXPIRE_MS    (60*1000) /*!< a publish without ACK is forgotten after it, e.g. it is expired in outbox */
+#define TBCM_LINKSTATS_EARLYACK_MAX (4)   /*!< max count of ACKs remembered before their publish is tracked */
+
+/**
+ * A QoS 1/2 publish waiting for ACK
+ */
+typedef struct tbcm_linkstats_inflight
+{
+    int msg_id;             /*!< message id, 0 if the slot is free */
+    int64_t publish_us;     /*!< esp_timer_get_time() of publish */
+} tbcm_linkstats_inflight_t;
+
+/**
+ * An ACK which arrives in MQTT task before esp_mqtt_client_publish() returns in the user task
+ */
+typedef struct tbcm_linkstats_earlyack
+{
+    int msg_id;             /*!< message id, 0 if the slot is free */
+    int64_t ack_us;         /*!< esp_timer_get_time() of ACK */
+} tbcm_linkstats_earlyack_t;
+
+/**
+ * ThingsBoard Client MQTT link statistics, e.g. publish-ACK latency
+ */
+typedef struct tbcm_linkstats
+{
+    portMUX_TYPE spinlock;  /*!< publishes are in user tasks, ACKs are in MQTT task */
+    tbcm_linkstats_inflight_t inflight[TBCM_LINKSTATS_INFLIGHT_MAX];
+    tbcm_linkstats_earlyack_t earlyack[TBCM_LINKSTATS_EARLYACK_MAX]; /*!< ring of ACKs of untracked publishes */
+    int earlyack_next;        /*!< next slot of earlyack[] to overwrite */
+    uint32_t ack_latency_ms;  /*!< moving average of publish-ACK latency */
+    uint32_t ack_count;       /*!< count of ACKed publishes */
+} tbcm_linkstats_t;
+
+void tbcm_linkstats_init(tbcm_linkstats_t *linkstats);
+void tbcm_linkstats_on_publish(tbcm_linkstats_t *linkstats, int msg_id, int qos, int64_t publish_us);
+void tbcm_linkstats_on_published(tbcm_linkstats_t *linkstats, int msg_id);
+void tbcm_linkstats_on_deleted(tbcm_linkstats_t *linkstats, int msg_id);
+uint32_t tbcm_linkstats_get_ack_latency(tbcm_linkstats_t *linkstats);
+
+#ifdef __cplusplus
+}
+#endif //__cplusplus
+
+#endif
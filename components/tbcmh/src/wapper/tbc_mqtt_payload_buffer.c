@@ -46,6 +46,7 @@ void tbcm_payload_buffer_init(tbcm_payload_buffer_t *buffer)
     //buffer->current_payload_offset = 0; /*!< Actual offset for the data associated with this event */
 
     buffer->received_len = 0;
+    buffer->is_streaming = false;
 }
 static void _tbcm_payload_buffer_free(tbcm_payload_buffer_t *buffer)
 {
@@ -68,6 +69,7 @@ static void _tbcm_payload_buffer_free(tbcm_payload_buffer_t *buffer)
     //buffer->current_payload_offset = 0; /*!< Actual offset for the data associated with this event */
 
     buffer->received_len = 0;
+    buffer->is_streaming = false;
 }
 
 static void _tbcm_payload_buffer_feed(tbcm_payload_buffer_t *buffer, tbcm_rx_msg_info *rx_msg)
@@ -170,8 +172,25 @@ static bool _tbcm_payload_buffer_is_completion(tbcm_payload_buffer_t *buffer)
     return true;
 }
 
+static void _tbcm_payload_buffer_stream_begin(tbcm_payload_buffer_t *buffer, tbcm_rx_msg_info *rx_msg)
+{
+    // only topic is kept, payload isn't merged. drop the old un-completion msg first
+    _tbcm_payload_buffer_free(buffer);
+    buffer->topic = TBC_MALLOC(rx_msg->topic_len);
+    if (!buffer->topic) {
+        TBC_LOGE("buffer->topic is NULL!");
+        return;
+    }
+    memcpy(buffer->topic, rx_msg->topic, rx_msg->topic_len);
+    buffer->topic_len = rx_msg->topic_len;
+    buffer->total_payload_len = rx_msg->total_payload_len;
+    buffer->received_len = 0;
+    buffer->is_streaming = true;
+}
+
 void tbcm_payload_buffer_pocess(tbcm_payload_buffer_t *buffer, esp_mqtt_event_handle_t src_event,
-                        void *client, tbcm_payload_buffer_on_process_t on_payload_process)
+                        void *client, tbcm_payload_buffer_is_streamed_t is_streamed,
+                        tbcm_payload_buffer_on_process_t on_payload_process)
 {
     // 0: if parameter is invalid, then return.
     if (!buffer || !src_event || !on_payload_process) {
@@ -211,14 +230,37 @@ void tbcm_payload_buffer_pocess(tbcm_payload_buffer_t *buffer, esp_mqtt_event_ha
 
     // 3: if new msg(rx_msg) is completion, then process it, return.
     if (_tbcm_rx_msg_is_completion(rx_msg)) {
-        on_payload_process(client, src_event, rx_msg->topic, rx_msg->topic_len, rx_msg->payload, rx_msg->payload_len);
+        on_payload_process(client, src_event, rx_msg->topic, rx_msg->topic_len, rx_msg->payload, rx_msg->payload_len,
+                           0, rx_msg->payload_len);
+        return;
+    }
+
+    // 4: if new msg(rx_msg) is streamed, then forward fragments one by one without merging, return.
+    if (rx_msg->topic && is_streamed &&
+        is_streamed(client, rx_msg->topic, rx_msg->topic_len, rx_msg->total_payload_len)) {
+        _tbcm_payload_buffer_stream_begin(buffer, rx_msg);
+    }
+    if (buffer->is_streaming) {
+        if (buffer->total_payload_len != rx_msg->total_payload_len ||
+            buffer->received_len != rx_msg->current_payload_offset) {
+            TBC_LOGW("Streamed fragment is out of order! offset(%d), received_len(%d)",
+                rx_msg->current_payload_offset, buffer->received_len);
+            _tbcm_payload_buffer_free(buffer);
+            return;
+        }
+        buffer->received_len += rx_msg->payload_len;
+        on_payload_process(client, src_event, buffer->topic, buffer->topic_len, rx_msg->payload, rx_msg->payload_len,
+                           rx_msg->current_payload_offset, buffer->total_payload_len);
+        if (buffer->received_len >= buffer->total_payload_len) {
+            _tbcm_payload_buffer_free(buffer);
+        }
         return;
     }
 
-    // 4: feed new msg(rx_msg) to buffer.
+    // 5: feed new msg(rx_msg) to buffer.
     _tbcm_payload_buffer_feed(buffer, rx_msg);
 
-    // 5: if buffer is completion, then process it, return.
+    // 6: if buffer is completion, then process it, return.
     if (_tbcm_payload_buffer_is_completion(buffer)) {
         // tbcm_rx_msg_info temp_rx_msg;
         // temp_rx_msg.topic       = buffer->topic;        /*!< Topic associated with this event */
@@ -227,7 +269,8 @@ void tbcm_payload_buffer_pocess(tbcm_payload_buffer_t *buffer, esp_mqtt_event_ha
         // temp_rx_msg.payload_len         = buffer->received_len;     /*!< Length of the data for this event */
         // temp_rx_msg.total_payload_len   = buffer->total_payload_len;/*!< Total length of the data (longer data are supplied with multiple events) */
         // temp_rx_msg.current_payload_offset = 0;                     /*!< Actual offset for the data associated with this event */
-        on_payload_process(client, src_event, buffer->topic, buffer->topic_len, buffer->payload, buffer->received_len);
+        on_payload_process(client, src_event, buffer->topic, buffer->topic_len, buffer->payload, buffer->received_len,
+                           0, buffer->received_len);
         _tbcm_payload_buffer_free(buffer);
         return;
     }
@@ -25,6 +25,7 @@ extern "C" {
 #endif
 
 #define MAX_TBCM_RX_MSG_LENGTH (128*1024)
+#define TBCM_RX_STREAM_THRESHOLD (4*1024)   /*!< longer payloads of streamed topics are forwarded fragment by fragment */
 
 /**
  * ThingsBoard MQTT Client receiving msg info
@@ -51,16 +52,26 @@ typedef struct tbcm_payload_buffer {
     //int current_payload_offset; /*!< Actual offset for the data associated with this event */
 
     int received_len;           /*!< Alread received payload/data length */
+    bool is_streaming;          /*!< Fragments are forwarded one by one without merging, payload is NULL */
 } tbcm_payload_buffer_t;
 
+// payload_offset & total_payload_len: offset of this fragment & length of the whole payload.
+//                                     They are 0 & payload_len if the payload is complete.
 typedef void (*tbcm_payload_buffer_on_process_t)
                                      (void *client, esp_mqtt_event_handle_t src_event,
                                       char *topic, int topic_len,
-                                      char *payload, int payload_len);
+                                      char *payload, int payload_len,
+                                      int payload_offset, int total_payload_len);
+
+// return true if fragments of this msg are forwarded one by one without merging
+typedef bool (*tbcm_payload_buffer_is_streamed_t)
+                                     (void *client, const char *topic, int topic_len,
+                                      int total_payload_len);
 
 void tbcm_payload_buffer_init(tbcm_payload_buffer_t *buffer);
 void tbcm_payload_buffer_pocess(tbcm_payload_buffer_t *buffer, esp_mqtt_event_handle_t src_event,
-                        void *client, tbcm_payload_buffer_on_process_t on_payload_process);
+                        void *client, tbcm_payload_buffer_is_streamed_t is_streamed,
+                        tbcm_payload_buffer_on_process_t on_payload_process);
 void tbcm_payload_buffer_clear(tbcm_payload_buffer_t *buffer);
 
 #ifdef __cplusplus
@@ -0,0 +1,293 @@
+// Copyright 2022 liangzhuzhi2020@gmail.com, https://github.com/liang-zhu-zi/esp32-thingsboard-mqtt-client
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// ThingsBoard MQTT Client low layer API
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+#include "esp_timer.h"
+
+#include "tbc_utils.h"
+#include "tbc_mqtt_protocol.h"
+
+#include "tbc_mqtt_ratelimit.h"
+
+const static char *TAG = "tbcm_ratelimit";
+
+void tbcm_ratelimit_init(tbcm_ratelimit_t *ratelimit)
+{
+    if (!ratelimit) {
+         TBC_LOGE("ratelimit is NULL!");
+         return;
+    }
+
+    memset(ratelimit, 0x00, sizeof(tbcm_ratelimit_t));
+    portMUX_INITIALIZE(&ratelimit->spinlock);
+}
+
+// Parse limits of ThingsBoard format, e.g. "10:1,300:60": 10 messages per 1 second and 300 messages per 60 seconds.
+// return count of buckets, -1 on error
+static int _ratelimit_parse(const char *limits, tbcm_token_bucket_t *buckets)
+{
+    int count = 0;
+    const char *ptr = limits;
+    while (*ptr) {
+        char *end;
+        unsigned long capacity = strtoul(ptr, &end, 10);
+        if (end == ptr || *end != ':') {
+            return -1;
+        }
+        ptr = end + 1;
+        unsigned long period_s = strtoul(ptr, &end, 10);
+        if (end == ptr || (*end != ',' && *end != '\0')) {
+            return -1;
+        }
+        ptr = (*end == ',') ? end + 1 : end;
+
+        if (capacity == 0 || period_s == 0) {
+            return -1;
+        }
+        if (count >= TBCM_RATELIMIT_BUCKET_MAX) {
+            TBC_LOGW("Too many windows in limits(%s), the rest are ignored!", limits);
+            break;
+        }
+        buckets[count].capacity = capacity;
+        buckets[count].period_ms = period_s * 1000;
+        count++;
+    }
+    return count;
+}
+
+// limits: ThingsBoard format, e.g. "10:1,300:60". NULL or "" for unlimited.
+bool tbcm_ratelimit_config(tbcm_ratelimit_t *ratelimit, tbcm_ratelimit_class_t cls,
+                           const char *limits, tbcm_ratelimit_policy_t policy, uint32_t max_wait_ms)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(ratelimit, false);
+    if (cls < 0 || cls >= TBCM_RATELIMIT_CLASS_MAX) {
+        TBC_LOGE("class(%d) is error!", cls);
+        return false;
+    }
+
+    tbcm_token_bucket_t buckets[TBCM_RATELIMIT_BUCKET_MAX];
+    memset(buckets, 0x00, sizeof(buckets));
+    int count = 0;
+    if (limits && *limits) {
+        count = _ratelimit_parse(limits, buckets);
+        if (count < 0) {
+            TBC_LOGE("limits(%s) is error!", limits);
+            return false;
+        }
+    }
+
+    // full buckets at the beginning
+    int64_t now_us = esp_timer_get_time();
+    int i;
+    for (i = 0; i < count; i++) {
+        buckets[i].tokens = buckets[i].capacity;
+        buckets[i].refill_us = now_us;
+    }
+
+    tbcm_ratelimit_budget_t *budget = &ratelimit->budgets[cls];
+    taskENTER_CRITICAL(&ratelimit->spinlock);
+    budget->count = count;
+    memcpy(budget->buckets, buckets, sizeof(buckets));
+    budget->policy = policy;
+    budget->max_wait_ms = max_wait_ms;
+    taskEXIT_CRITICAL(&ratelimit->spinlock);
+    return true;
+}
+
+// Which budget a publish message is charged to, besides TBCM_RATELIMIT_CLASS_ALL
+tbcm_ratelimit_class_t tbcm_ratelimit_classify(const char *topic)
+{
+    if (!topic) {
+        return TBCM_RATELIMIT_CLASS_ALL;
+    }
+    if (strcmp(topic, TB_MQTT_TOPIC_TELEMETRY_PUBLISH) == 0) {
+        return TBCM_RATELIMIT_CLASS_TELEMETRY;
+    }
+    if (strcmp(topic, TB_MQTT_TOPIC_CLIENT_ATTRIBUTES_PUBLISH) == 0
+        || strncmp(topic, TB_MQTT_TOPIC_ATTRIBUTES_REQUEST_PREFIX,
+                   strlen(TB_MQTT_TOPIC_ATTRIBUTES_REQUEST_PREFIX)) == 0) {
+        return TBCM_RATELIMIT_CLASS_ATTRIBUTES;
+    }
+    if (strncmp(topic, TB_MQTT_TOPIC_SERVERRPC_RESPONSE_PREFIX,
+                strlen(TB_MQTT_TOPIC_SERVERRPC_RESPONSE_PREFIX)) == 0
+        || strncmp(topic, TB_MQTT_TOPIC_CLIENTRPC_REQUEST_PREFIX,
+                   strlen(TB_MQTT_TOPIC_CLIENTRPC_REQUEST_PREFIX)) == 0) {
+        return TBCM_RATELIMIT_CLASS_RPC;
+    }
+    if (strncmp(topic, TB_MQTT_TOPIC_FW_REQUEST_PREFIX,
+                strlen(TB_MQTT_TOPIC_FW_REQUEST_PREFIX)) == 0) {
+        return TBCM_RATELIMIT_CLASS_OTA;
+    }
+    return TBCM_RATELIMIT_CLASS_ALL; // claiming device, provision...
+}
+
+// This function is in ratelimit->spinlock!!!
+static bool _ratelimit_budget_has_token(tbcm_ratelimit_budget_t *budget, int64_t now_us)
+{
+    int i;
+    bool has_token = true;
+    for (i = 0; i < budget->count; i++) {
+        tbcm_token_bucket_t *bucket = &budget->buckets[i];
+        // refill: capacity tokens per period
+        bucket->tokens += (double)(now_us - bucket->refill_us) * bucket->capacity
+                          / ((double)bucket->period_ms * 1000);
+        if (bucket->tokens > bucket->capacity) {
+            bucket->tokens = bucket->capacity;
+        }
+        bucket->refill_us = now_us;
+        if (bucket->tokens < 1) {
+            has_token = false;
+        }
+    }
+    return has_token;
+}
+
+// This function is in ratelimit->spinlock!!!
+static void _ratelimit_budget_consume(tbcm_ratelimit_budget_t *budget)
+{
+    int i;
+    for (i = 0; i < budget->count; i++) {
+        budget->buckets[i].tokens -= 1;
+    }
+}
+
+// This function is in ratelimit->spinlock!!!
+static void _ratelimit_budget_refund(tbcm_ratelimit_budget_t *budget)
+{
+    int i;
+    for (i = 0; i < budget->count; i++) {
+        tbcm_token_bucket_t *bucket = &budget->buckets[i];
+        bucket->tokens += 1;
+        if (bucket->tokens > bucket->capacity) {
+            bucket->tokens = bucket->capacity;
+        }
+    }
+}
+
+// Take a token from TBCM_RATELIMIT_CLASS_ALL and cls if both have one.
+// is_all_empty: set to true if TBCM_RATELIMIT_CLASS_ALL is empty
+static bool _ratelimit_take(tbcm_ratelimit_t *ratelimit, tbcm_ratelimit_class_t cls,
+                            bool *is_all_empty)
+{
+    tbcm_ratelimit_budget_t *all = &ratelimit->budgets[TBCM_RATELIMIT_CLASS_ALL];
+    tbcm_ratelimit_budget_t *budget = &ratelimit->budgets[cls];
+    bool is_acquired = false;
+
+    taskENTER_CRITICAL(&ratelimit->spinlock);
+    int64_t now_us = esp_timer_get_time();
+    *is_all_empty = !_ratelimit_budget_has_token(all, now_us);
+    bool is_class_empty = (budget != all) && !_ratelimit_budget_has_token(budget, now_us);
+    if (!*is_all_empty && !is_class_empty) {
+        _ratelimit_budget_consume(all);
+        if (budget != all) {
+            _ratelimit_budget_consume(budget);
+        }
+        is_acquired = true;
+    }
+    taskEXIT_CRITICAL(&ratelimit->spinlock);
+    return is_acquired;
+}
+
+// Take a token from TBCM_RATELIMIT_CLASS_ALL and cls, it never waits.
+// The message waits in TX queue for TBCM_RATELIMIT_POLICY_WAIT, see tbcm_ratelimit_get_max_wait().
+// return true if the message may be published, otherwise the rejection is counted
+bool tbcm_ratelimit_acquire(tbcm_ratelimit_t *ratelimit, tbcm_ratelimit_class_t cls)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(ratelimit, false);
+    if (cls < 0 || cls >= TBCM_RATELIMIT_CLASS_MAX) {
+        cls = TBCM_RATELIMIT_CLASS_ALL;
+    }
+
+    bool is_all_empty = false;
+    if (_ratelimit_take(ratelimit, cls, &is_all_empty)) {
+        return true;
+    }
+    tbcm_ratelimit_budget_t *budget = &ratelimit->budgets[cls];
+    taskENTER_CRITICAL(&ratelimit->spinlock);
+    (is_all_empty ? &ratelimit->budgets[TBCM_RATELIMIT_CLASS_ALL] : budget)->rejected_count++;
+    taskEXIT_CRITICAL(&ratelimit->spinlock);
+    return false;
+}
+
+// Same as tbcm_ratelimit_acquire(), but it never waits and doesn't count rejection,
+// e.g. the message is kept in TX queue and is tried again later.
+bool tbcm_ratelimit_try_acquire(tbcm_ratelimit_t *ratelimit, tbcm_ratelimit_class_t cls)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(ratelimit, false);
+    if (cls < 0 || cls >= TBCM_RATELIMIT_CLASS_MAX) {
+        cls = TBCM_RATELIMIT_CLASS_ALL;
+    }
+
+    bool is_all_empty = false;
+    return _ratelimit_take(ratelimit, cls, &is_all_empty);
+}
+
+// Give back the token of a message which fails to publish
+void tbcm_ratelimit_refund(tbcm_ratelimit_t *ratelimit, tbcm_ratelimit_class_t cls)
+{
+    TBC_CHECK_PTR(ratelimit);
+    if (cls < 0 || cls >= TBCM_RATELIMIT_CLASS_MAX) {
+        cls = TBCM_RATELIMIT_CLASS_ALL;
+    }
+
+    tbcm_ratelimit_budget_t *all = &ratelimit->budgets[TBCM_RATELIMIT_CLASS_ALL];
+    tbcm_ratelimit_budget_t *budget = &ratelimit->budgets[cls];
+    taskENTER_CRITICAL(&ratelimit->spinlock);
+    _ratelimit_budget_refund(all);
+    if (budget != all) {
+        _ratelimit_budget_refund(budget);
+    }
+    taskEXIT_CRITICAL(&ratelimit->spinlock);
+}
+
+// Count a message of TBCM_RATELIMIT_POLICY_WAIT which is dropped after waiting max_wait_ms
+void tbcm_ratelimit_reject(tbcm_ratelimit_t *ratelimit, tbcm_ratelimit_class_t cls)
+{
+    TBC_CHECK_PTR(ratelimit);
+    if (cls < 0 || cls >= TBCM_RATELIMIT_CLASS_MAX) {
+        cls = TBCM_RATELIMIT_CLASS_ALL;
+    }
+
+    taskENTER_CRITICAL(&ratelimit->spinlock);
+    ratelimit->budgets[cls].rejected_count++;
+    taskEXIT_CRITICAL(&ratelimit->spinlock);
+}
+
+// return max_wait_ms of cls if its policy is TBCM_RATELIMIT_POLICY_WAIT, otherwise 0
+uint32_t tbcm_ratelimit_get_max_wait(tbcm_ratelimit_t *ratelimit, tbcm_ratelimit_class_t cls)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(ratelimit, 0);
+    if (cls < 0 || cls >= TBCM_RATELIMIT_CLASS_MAX) {
+        cls = TBCM_RATELIMIT_CLASS_ALL;
+    }
+
+    tbcm_ratelimit_budget_t *budget = &ratelimit->budgets[cls];
+    return (budget->policy == TBCM_RATELIMIT_POLICY_WAIT) ? budget->max_wait_ms : 0;
+}
+
+uint32_t tbcm_ratelimit_get_rejected(tbcm_ratelimit_t *ratelimit, tbcm_ratelimit_class_t cls)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(ratelimit, 0);
+    if (cls < 0 || cls >= TBCM_RATELIMIT_CLASS_MAX) {
+        return 0;
+    }
+    return ratelimit->budgets[cls].rejected_count;
+}
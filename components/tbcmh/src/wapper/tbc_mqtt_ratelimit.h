@@ -0,0 +1,101 @@
+// Copyright 2022 liangzhuzhi2020@gmail.com, https://github.com/liang-zhu-zi/esp32-thingsboard-mqtt-client
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// ThingsBoard Client MQTT rate limiter API
+
+#ifndef _TBC_MQTT_RATELIMIT_H_
+#define _TBC_MQTT_RATELIMIT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TBCM_RATELIMIT_BUCKET_MAX (4)   /*!< max count of windows in a limit, e.g. "10:1,300:60" has 2 */
+
+/**
+ * Class of publish messages, each class has its own budget.
+ * TBCM_RATELIMIT_CLASS_ALL is consumed by every publish message.
+ */
+typedef enum
+{
+  TBCM_RATELIMIT_CLASS_ALL = 0,     /*!< all publish messages */
+  TBCM_RATELIMIT_CLASS_TELEMETRY,   /*!< telemetry */
+  TBCM_RATELIMIT_CLASS_ATTRIBUTES,  /*!< client-side attributes & attributes requests */
+  TBCM_RATELIMIT_CLASS_RPC,         /*!< server-side RPC responses & client-side RPC requests */
+  TBCM_RATELIMIT_CLASS_OTA,         /*!< F/W OTA chunk requests */
+  TBCM_RATELIMIT_CLASS_MAX
+} tbcm_ratelimit_class_t;
+
+/**
+ * What to do when the bucket is empty
+ */
+typedef enum
+{
+  TBCM_RATELIMIT_POLICY_FAIL_FAST = 0,  /*!< publish fails immediately */
+  TBCM_RATELIMIT_POLICY_WAIT            /*!< publish message waits in TX queue for a token, up to max_wait_ms */
+} tbcm_ratelimit_policy_t;
+
+/**
+ * Token bucket of a window, e.g. "10:1" is 10 messages per 1 second
+ */
+typedef struct tbcm_token_bucket
+{
+    uint32_t capacity;      /*!< max count of messages in the window */
+    uint32_t period_ms;     /*!< length of the window */
+    double tokens;          /*!< available tokens */
+    int64_t refill_us;      /*!< esp_timer_get_time() of last refill */
+} tbcm_token_bucket_t;
+
+/**
+ * Budget of a class
+ */
+typedef struct tbcm_ratelimit_budget
+{
+    int count;                                          /*!< count of buckets, 0 for unlimited */
+    tbcm_token_bucket_t buckets[TBCM_RATELIMIT_BUCKET_MAX];
+    tbcm_ratelimit_policy_t policy;                     /*!< what to do when a bucket is empty */
+    uint32_t max_wait_ms;                               /*!< for TBCM_RATELIMIT_POLICY_WAIT */
+    uint32_t rejected_count;                            /*!< count of publish messages rejected by this budget */
+} tbcm_ratelimit_budget_t;
+
+/**
+ * ThingsBoard Client MQTT rate limiter
+ */
+typedef struct tbcm_ratelimit
+{
+    portMUX_TYPE spinlock;
+    tbcm_ratelimit_budget_t budgets[TBCM_RATELIMIT_CLASS_MAX];
+} tbcm_ratelimit_t;
+
+void tbcm_ratelimit_init(tbcm_ratelimit_t *ratelimit);
+bool tbcm_ratelimit_config(tbcm_ratelimit_t *ratelimit, tbcm_ratelimit_class_t cls,
+                           const char *limits, tbcm_ratelimit_policy_t policy, uint32_t max_wait_ms);
+tbcm_ratelimit_class_t tbcm_ratelimit_classify(const char *topic);
+bool tbcm_ratelimit_acquire(tbcm_ratelimit_t *ratelimit, tbcm_ratelimit_class_t cls);
+bool tbcm_ratelimit_try_acquire(tbcm_ratelimit_t *ratelimit, tbcm_ratelimit_class_t cls);
+void tbcm_ratelimit_refund(tbcm_ratelimit_t *ratelimit, tbcm_ratelimit_class_t cls);
+void tbcm_ratelimit_reject(tbcm_ratelimit_t *ratelimit, tbcm_ratelimit_class_t cls);
+uint32_t tbcm_ratelimit_get_max_wait(tbcm_ratelimit_t *ratelimit, tbcm_ratelimit_class_t cls);
+uint32_t tbcm_ratelimit_get_rejected(tbcm_ratelimit_t *ratelimit, tbcm_ratelimit_class_t cls);
+
+#ifdef __cplusplus
+}
+#endif //__cplusplus
+
+#endif
@@ -0,0 +1,259 @@
+// Copyright 2022 liangzhuzhi2020@gmail.com, https://github.com/liang-zhu-zi/esp32-thingsboard-mqtt-client
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// ThingsBoard MQTT Client low layer API
+
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_err.h"
+
+#include "tbc_utils.h"
+#include "tbc_mqtt_protocol.h"
+
+#include "tbc_mqtt_txqueue.h"
+
+#define TBCM_TXQUEUE_MAX_SIZE_DEFAULT        (16*1024)
+#define TBCM_TXQUEUE_MAX_DRAIN_COUNT_DEFAULT (16)
+
+const static char *TAG = "tbcm_txqueue";
+
+static const int _txqueue_default_weights[TBCM_TXQUEUE_PRIORITY_MAX] = {8, 4, 2, 1};
+
+void tbcm_txqueue_init(tbcm_txqueue_t *txqueue)
+{
+    if (!txqueue) {
+         TBC_LOGE("txqueue is NULL!");
+         return;
+    }
+
+    memset(txqueue, 0x00, sizeof(tbcm_txqueue_t));
+    int i;
+    for (i = 0; i < TBCM_TXQUEUE_PRIORITY_MAX; i++) {
+        STAILQ_INIT(&txqueue->lists[i]);
+    }
+    tbcm_txqueue_config(txqueue, false, 0, NULL, 0);
+}
+
+// weights: NULL or 0 items for default weights 8,4,2,1
+void tbcm_txqueue_config(tbcm_txqueue_t *txqueue, bool is_enabled, int max_size,
+                         const int *weights, int max_drain_count)
+{
+    TBC_CHECK_PTR(txqueue);
+
+    txqueue->is_enabled = is_enabled;
+    txqueue->max_size = (max_size > 0) ? max_size : TBCM_TXQUEUE_MAX_SIZE_DEFAULT;
+    txqueue->max_drain_count = (max_drain_count > 0) ? max_drain_count : TBCM_TXQUEUE_MAX_DRAIN_COUNT_DEFAULT;
+    int i;
+    for (i = 0; i < TBCM_TXQUEUE_PRIORITY_MAX; i++) {
+        txqueue->weights[i] = (weights && weights[i] > 0) ? weights[i] : _txqueue_default_weights[i];
+        txqueue->credits[i] = txqueue->weights[i];
+    }
+}
+
+tbcm_txqueue_priority_t tbcm_txqueue_classify(const char *topic)
+{
+    if (!topic) {
+        return TBCM_TXQUEUE_PRIORITY_CONTROL;
+    }
+    if (strcmp(topic, TB_MQTT_TOPIC_TELEMETRY_PUBLISH) == 0) {
+        return TBCM_TXQUEUE_PRIORITY_TELEMETRY;
+    }
+    if (strcmp(topic, TB_MQTT_TOPIC_CLIENT_ATTRIBUTES_PUBLISH) == 0) {
+        return TBCM_TXQUEUE_PRIORITY_ATTRIBUTES;
+    }
+    if (strncmp(topic, TB_MQTT_TOPIC_FW_REQUEST_PREFIX,
+                strlen(TB_MQTT_TOPIC_FW_REQUEST_PREFIX)) == 0) {
+        return TBCM_TXQUEUE_PRIORITY_OTA;
+    }
+    return TBCM_TXQUEUE_PRIORITY_CONTROL; // RPC, attributes request, claiming device, provision...
+}
+
+// return true if messages of the same or higher priority are queued,
+// so a new message of this priority can't overtake them
+bool tbcm_txqueue_is_blocked(tbcm_txqueue_t *txqueue, tbcm_txqueue_priority_t priority)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(txqueue, false);
+
+    int i;
+    for (i = 0; i <= priority && i < TBCM_TXQUEUE_PRIORITY_MAX; i++) {
+        if (txqueue->counts[i] > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void _txqueue_msg_free(tbcm_txmsg_t *msg)
+{
+    TBC_FIELD_FREE(msg->topic);
+    TBC_FIELD_FREE(msg->payload);
+    TBC_FREE(msg);
+}
+
+// return false if the queue is full or no memory
+bool tbcm_txqueue_push(tbcm_txqueue_t *txqueue, tbcm_txqueue_priority_t priority,
+                       const char *topic, const char *payload, int len, int qos, int retain,
+                       int64_t expire_us)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(txqueue, false);
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(topic, false);
+
+    if (txqueue->size + len > txqueue->max_size) {
+        txqueue->dropped_count++;
+        TBC_LOGW("TX queue is full(%d+%d>%d), drop publish message! topic=%s",
+                 txqueue->size, len, txqueue->max_size, topic);
+        return false;
+    }
+
+    tbcm_txmsg_t *msg = TBC_MALLOC(sizeof(tbcm_txmsg_t));
+    if (!msg) {
+        TBC_LOGE("Unable to malloc memeory!");
+        return false;
+    }
+    memset(msg, 0x00, sizeof(tbcm_txmsg_t));
+    msg->topic = TBC_MALLOC(strlen(topic) + 1);
+    msg->payload = TBC_MALLOC(len + 1);
+    if (!msg->topic || !msg->payload) {
+        TBC_LOGE("Unable to malloc memeory!");
+        _txqueue_msg_free(msg);
+        return false;
+    }
+    strcpy(msg->topic, topic);
+    if (payload && len > 0) {
+        memcpy(msg->payload, payload, len);
+    }
+    msg->payload[len] = '\0';
+    msg->len = len;
+    msg->qos = qos;
+    msg->retain = retain;
+    msg->expire_us = expire_us;
+
+    STAILQ_INSERT_TAIL(&txqueue->lists[priority], msg, entry);
+    txqueue->counts[priority]++;
+    txqueue->size += len;
+    return true;
+}
+
+// Weighted round robin in priority order: each class sends at most its weight of messages
+// per round, then the next round begins when all non-empty classes used up their credits.
+// Classes in skipped (bit 1<<priority) are ignored, e.g. they are blocked by the rate limit.
+// return the next message to send, NULL if the queue is empty. It isn't removed from queue.
+tbcm_txmsg_t *tbcm_txqueue_peek(tbcm_txqueue_t *txqueue, uint32_t skipped,
+                                tbcm_txqueue_priority_t *priority)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(txqueue, NULL);
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(priority, NULL);
+
+    int round, i;
+    for (round = 0; round < 2; round++) {
+        for (i = 0; i < TBCM_TXQUEUE_PRIORITY_MAX; i++) {
+            if ((skipped & (1u << i)) == 0 && txqueue->counts[i] > 0 && txqueue->credits[i] > 0) {
+                *priority = i;
+                return STAILQ_FIRST(&txqueue->lists[i]);
+            }
+        }
+        // new round
+        for (i = 0; i < TBCM_TXQUEUE_PRIORITY_MAX; i++) {
+            txqueue->credits[i] = txqueue->weights[i];
+        }
+    }
+    return NULL;
+}
+
+// remove & free the message returned by tbcm_txqueue_peek() after it is sent
+void tbcm_txqueue_pop(tbcm_txqueue_t *txqueue, tbcm_txqueue_priority_t priority)
+{
+    TBC_CHECK_PTR(txqueue);
+
+    tbcm_txmsg_t *msg = STAILQ_FIRST(&txqueue->lists[priority]);
+    if (!msg) {
+        return;
+    }
+    STAILQ_REMOVE_HEAD(&txqueue->lists[priority], entry);
+    txqueue->counts[priority]--;
+    txqueue->size -= msg->len;
+    if (txqueue->credits[priority] > 0) {
+        txqueue->credits[priority]--;
+    }
+    _txqueue_msg_free(msg);
+}
+
+// remove & free the message returned by tbcm_txqueue_peek() without sending it, e.g. it is expired.
+// It is counted in lost_counts, so the publisher can send its values again.
+void tbcm_txqueue_drop(tbcm_txqueue_t *txqueue, tbcm_txqueue_priority_t priority)
+{
+    TBC_CHECK_PTR(txqueue);
+
+    tbcm_txmsg_t *msg = STAILQ_FIRST(&txqueue->lists[priority]);
+    if (!msg) {
+        return;
+    }
+    STAILQ_REMOVE_HEAD(&txqueue->lists[priority], entry);
+    txqueue->counts[priority]--;
+    txqueue->size -= msg->len;
+    txqueue->lost_counts[priority]++;
+    _txqueue_msg_free(msg);
+}
+
+// remove the oldest message of priority without sending it, e.g. it is kept somewhere else.
+// return its payload, which is freed by the caller with TBC_FREE(). NULL if there is none.
+char *tbcm_txqueue_take_payload(tbcm_txqueue_t *txqueue, tbcm_txqueue_priority_t priority, int *len)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(txqueue, NULL);
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(len, NULL);
+
+    tbcm_txmsg_t *msg = STAILQ_FIRST(&txqueue->lists[priority]);
+    if (!msg) {
+        return NULL;
+    }
+    STAILQ_REMOVE_HEAD(&txqueue->lists[priority], entry);
+    txqueue->counts[priority]--;
+    txqueue->size -= msg->len;
+
+    char *payload = msg->payload;
+    *len = msg->len;
+    msg->payload = NULL;
+    _txqueue_msg_free(msg);
+    return payload;
+}
+
+int tbcm_txqueue_get_count(tbcm_txqueue_t *txqueue)
+{
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(txqueue, 0);
+
+    int i, count = 0;
+    for (i = 0; i < TBCM_TXQUEUE_PRIORITY_MAX; i++) {
+        count += txqueue->counts[i];
+    }
+    return count;
+}
+
+void tbcm_txqueue_clear(tbcm_txqueue_t *txqueue)
+{
+    TBC_CHECK_PTR(txqueue);
+
+    int i;
+    for (i = 0; i < TBCM_TXQUEUE_PRIORITY_MAX; i++) {
+        tbcm_txmsg_t *msg;
+        while ((msg = STAILQ_FIRST(&txqueue->lists[i])) != NULL) {
+            STAILQ_REMOVE_HEAD(&txqueue->lists[i], entry);
+            _txqueue_msg_free(msg);
+        }
+        txqueue->lost_counts[i] += txqueue->counts[i];
+        txqueue->counts[i] = 0;
+        txqueue->credits[i] = txqueue->weights[i];
+    }
+    txqueue->size = 0;
+}
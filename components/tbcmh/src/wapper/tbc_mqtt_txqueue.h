@@ -0,0 +1,96 @@
+// Copyright 2022 liangzhuzhi2020@gmail.com, https://github.com/liang-zhu-zi/esp32-thingsboard-mqtt-client
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// ThingsBoard Client MQTT priority TX queue API
+
+#ifndef _TBC_MQTT_TXQUEUE_H_
+#define _TBC_MQTT_TXQUEUE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sys/queue.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Priority class of publish messages, a smaller value is a higher priority
+ */
+typedef enum
+{
+  TBCM_TXQUEUE_PRIORITY_CONTROL = 0, /*!< server-side RPC responses, client-side RPC requests, attributes requests, claiming, provision */
+  TBCM_TXQUEUE_PRIORITY_OTA,         /*!< F/W OTA chunk requests */
+  TBCM_TXQUEUE_PRIORITY_ATTRIBUTES,  /*!< client-side attributes */
+  TBCM_TXQUEUE_PRIORITY_TELEMETRY,   /*!< telemetry */
+  TBCM_TXQUEUE_PRIORITY_MAX
+} tbcm_txqueue_priority_t;
+
+/**
+ * A queued publish message
+ */
+typedef struct tbcm_txmsg
+{
+    char *topic;            /*!< copy of topic */
+    char *payload;          /*!< copy of payload */
+    int len;                /*!< length of payload */
+    int qos;                /*!< qos of publish message */
+    int retain;             /*!< retain flag */
+    int64_t expire_us;      /*!< esp_timer_get_time() to drop it if it isn't sent, 0 for never */
+    STAILQ_ENTRY(tbcm_txmsg) entry;
+} tbcm_txmsg_t;
+
+typedef STAILQ_HEAD(tbcm_txmsg_list, tbcm_txmsg) tbcm_txmsg_list_t;
+
+/**
+ * ThingsBoard Client MQTT priority TX queue.
+ * Messages are drained in priority order, each class sends at most its weight
+ * of messages per round, so lower classes are never starved.
+ */
+typedef struct tbcm_txqueue
+{
+    bool is_enabled;                                /*!< false: every message is published immediately */
+    int max_size;                                   /*!< max total size of queued payloads */
+    int max_drain_count;                            /*!< max count of messages sent per drain */
+    int weights[TBCM_TXQUEUE_PRIORITY_MAX];         /*!< messages per round of each class */
+    int credits[TBCM_TXQUEUE_PRIORITY_MAX];         /*!< messages left in this round of each class */
+    tbcm_txmsg_list_t lists[TBCM_TXQUEUE_PRIORITY_MAX]; /*!< FIFO of each class */
+    int counts[TBCM_TXQUEUE_PRIORITY_MAX];          /*!< count of queued messages of each class */
+    int size;                                       /*!< total size of queued payloads */
+    uint32_t dropped_count;                         /*!< count of messages dropped because the queue is full */
+    uint32_t lost_counts[TBCM_TXQUEUE_PRIORITY_MAX]; /*!< count of queued messages of each class dropped without being sent */
+} tbcm_txqueue_t;
+
+void tbcm_txqueue_init(tbcm_txqueue_t *txqueue);
+void tbcm_txqueue_config(tbcm_txqueue_t *txqueue, bool is_enabled, int max_size,
+                         const int *weights, int max_drain_count);
+tbcm_txqueue_priority_t tbcm_txqueue_classify(const char *topic);
+bool tbcm_txqueue_is_blocked(tbcm_txqueue_t *txqueue, tbcm_txqueue_priority_t priority);
+bool tbcm_txqueue_push(tbcm_txqueue_t *txqueue, tbcm_txqueue_priority_t priority,
+                       const char *topic, const char *payload, int len, int qos, int retain,
+                       int64_t expire_us);
+tbcm_txmsg_t *tbcm_txqueue_peek(tbcm_txqueue_t *txqueue, uint32_t skipped,
+                                tbcm_txqueue_priority_t *priority);
+void tbcm_txqueue_pop(tbcm_txqueue_t *txqueue, tbcm_txqueue_priority_t priority);
+void tbcm_txqueue_drop(tbcm_txqueue_t *txqueue, tbcm_txqueue_priority_t priority);
+char *tbcm_txqueue_take_payload(tbcm_txqueue_t *txqueue, tbcm_txqueue_priority_t priority, int *len);
+int tbcm_txqueue_get_count(tbcm_txqueue_t *txqueue);
+void tbcm_txqueue_clear(tbcm_txqueue_t *txqueue);
+
+#ifdef __cplusplus
+}
+#endif //__cplusplus
+
+#endif
@@ -21,6 +21,7 @@
 #include "freertos/FreeRTOS.h"
 #include "sys/queue.h"
 #include "esp_err.h"
+#include "esp_idf_version.h"
 #include "mqtt_client.h"
 
 #include "tbc_utils.h"
@@ -31,6 +32,9 @@
 #include "tbc_mqtt_wapper.h"
 
 #include "tbc_mqtt_payload_buffer.h"
+#include "tbc_mqtt_ratelimit.h"
+#include "tbc_mqtt_txqueue.h"
+#include "tbc_mqtt_linkstats.h"
 
 /**
  * ThingsBoard MQTT Client
@@ -48,6 +52,9 @@ typedef struct tbcm_client
     SemaphoreHandle_t lock;
 
     tbcm_payload_buffer_t buffer;       /*!< If payload may be into multiple packets, then multiple packages need to be merged, eg: F/W OTA! */
+    tbcm_ratelimit_t ratelimit;         /*!< token buckets in front of every publish */
+    tbcm_txqueue_t txqueue;             /*!< priority TX queue in front of every publish, protected by lock */
+    tbcm_linkstats_t linkstats;         /*!< publish-ACK latency */
     esp_timer_handle_t respone_timer;   /*!< timer for checking response timeout */
 } tbcm_t;
 
@@ -99,6 +106,8 @@ static bool __convert_data_event(tbcm_event_t *dst_event,
     dst_event->data.chunk_id    = data->chunk_id;   /*!< The second pararm in topic */
     dst_event->data.payload     = data->payload;    /*!< Payload associated with this event */
     dst_event->data.payload_len = data->payload_len;/*!< Length of the payload for this event */
+    dst_event->data.payload_offset    = data->payload_offset;   /*!< Offset of this fragment in the whole payload */
+    dst_event->data.total_payload_len = data->total_payload_len;/*!< Length of the whole payload */
 
     return true;
 }
@@ -303,6 +312,9 @@ tbcm_handle_t tbcm_init(void)
      client->lock = xSemaphoreCreateMutex();
 
      tbcm_payload_buffer_init(&client->buffer);
+     tbcm_ratelimit_init(&client->ratelimit);
+     tbcm_txqueue_init(&client->txqueue);
+     tbcm_linkstats_init(&client->linkstats);
      _response_timer_create(client);
      return client;
 }
@@ -316,6 +328,7 @@ void tbcm_destroy(tbcm_handle_t client)
           tbcm_disconnect(client);
           client->mqtt_handle = NULL;
      }
+     tbcm_txqueue_clear(&client->txqueue);
      if (client->lock) {
           vSemaphoreDelete(client->lock);
           client->lock = NULL;
@@ -478,6 +491,331 @@ int tbcm_unsubscribe(tbcm_handle_t client, const char *topic)
 }
 
 
+/**
+ * @brief Configure the budget of a class of publish messages
+ *
+ * Notes:
+ * - It may be called before the MQTT connection is established
+ * - TBCM_RATELIMIT_CLASS_ALL is charged by every publish message,
+ *   the policy of the other class is used when it is empty
+ * - With TBCM_RATELIMIT_POLICY_WAIT, publish doesn't block. The message waits in TX queue
+ *   up to max_wait_ms, it is sent by tbcm_txqueue_drain()
+ *
+ * @param cls           class of publish messages
+ * @param limits        ThingsBoard format, e.g. "10:1,300:60". NULL or "" for unlimited.
+ * @param policy        what to do when the bucket is empty
+ * @param max_wait_ms   max waiting time for TBCM_RATELIMIT_POLICY_WAIT
+ *
+ * @return true on success, false on error
+ */
+bool tbcm_ratelimit_set(tbcm_handle_t client, tbcm_ratelimit_class_t cls, const char *limits,
+                        tbcm_ratelimit_policy_t policy, uint32_t max_wait_ms)
+{
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(client, false);
+     return tbcm_ratelimit_config(&client->ratelimit, cls, limits, policy, max_wait_ms);
+}
+
+/**
+ * @brief Count of publish messages rejected by the budget of a class
+ */
+uint32_t tbcm_ratelimit_rejected(tbcm_handle_t client, tbcm_ratelimit_class_t cls)
+{
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(client, 0);
+     return tbcm_ratelimit_get_rejected(&client->ratelimit, cls);
+}
+
+/**
+ * @brief Enable or disable the priority TX queue
+ *
+ * Notes:
+ * - It may be called before the MQTT connection is established
+ * - If it is enabled, a publish message is queued when messages of the same or higher priority
+ *   are waiting or the rate limit is reached. Queued messages are sent by tbcm_txqueue_drain().
+ * - Messages of TBCM_RATELIMIT_POLICY_WAIT are queued even if it is disabled
+ * - Queued messages are dropped when it is disabled
+ *
+ * @param is_enabled        true to enable
+ * @param max_size          max total size of queued payloads, 0 for default
+ * @param weights           messages per round of each priority class, NULL for default
+ * @param max_drain_count   max count of messages sent per tbcm_txqueue_drain(), 0 for default
+ */
+void tbcm_txqueue_set(tbcm_handle_t client, bool is_enabled, int max_size,
+                      const int *weights, int max_drain_count)
+{
+     TBC_CHECK_PTR(client);
+
+     xSemaphoreTake(client->lock, portMAX_DELAY);
+     if (!is_enabled && tbcm_txqueue_get_count(&client->txqueue) > 0) {
+          TBC_LOGW("TX queue is disabled, drop %d queued messages!",
+                   tbcm_txqueue_get_count(&client->txqueue));
+          tbcm_txqueue_clear(&client->txqueue);
+     }
+     tbcm_txqueue_config(&client->txqueue, is_enabled, max_size, weights, max_drain_count);
+     xSemaphoreGive(client->lock);
+}
+
+/**
+ * @brief Count of messages in the priority TX queue
+ */
+int tbcm_txqueue_count(tbcm_handle_t client)
+{
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(client, 0);
+
+     xSemaphoreTake(client->lock, portMAX_DELAY);
+     int count = tbcm_txqueue_get_count(&client->txqueue);
+     xSemaphoreGive(client->lock);
+     return count;
+}
+
+/**
+ * @brief Count of queued messages of a priority class which are dropped without being sent,
+ *        i.e. they are expired or the TX queue is disabled
+ */
+uint32_t tbcm_txqueue_lost_count(tbcm_handle_t client, tbcm_txqueue_priority_t priority)
+{
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(client, 0);
+     if (priority < 0 || priority >= TBCM_TXQUEUE_PRIORITY_MAX) {
+          return 0;
+     }
+
+     xSemaphoreTake(client->lock, portMAX_DELAY);
+     uint32_t count = client->txqueue.lost_counts[priority];
+     xSemaphoreGive(client->lock);
+     return count;
+}
+
+/**
+ * @brief Publish-ACK latency in milliseconds, see tbcm_linkstats_get_ack_latency()
+ */
+uint32_t tbcm_ack_latency(tbcm_handle_t client)
+{
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(client, 0);
+     return tbcm_linkstats_get_ack_latency(&client->linkstats);
+}
+
+/**
+ * @brief Size of messages in the outbox of esp-mqtt, i.e. waiting to be sent or ACKed
+ *
+ * @return size in bytes, 0 if esp-mqtt doesn't report it
+ */
+int tbcm_outbox_size(tbcm_handle_t client)
+{
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(client, 0);
+     if (!client->mqtt_handle) {
+          return 0;
+     }
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(4, 4, 0)
+     return esp_mqtt_client_get_outbox_size(client->mqtt_handle);
+#else
+     return 0;
+#endif
+}
+
+/**
+ * @brief Take the oldest telemetry out of the priority TX queue without sending it,
+ *        e.g. it is appended to the store-and-forward log when the client is disconnected
+ *
+ * @param len       length of the returned payload
+ *
+ * @return payload of telemetry, it must be freed by TBC_FREE()
+ *         NULL if no telemetry is queued
+ */
+char *tbcm_txqueue_take_telemetry(tbcm_handle_t client, int *len)
+{
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(client, NULL);
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(len, NULL);
+
+     xSemaphoreTake(client->lock, portMAX_DELAY);
+     char *payload = tbcm_txqueue_take_payload(&client->txqueue, TBCM_TXQUEUE_PRIORITY_TELEMETRY, len);
+     xSemaphoreGive(client->lock);
+     return payload;
+}
+
+// Publish a message which has taken a token of the rate limit. The token is given back on failure.
+static int _tbcm_publish_acquired(tbcm_handle_t client, tbcm_ratelimit_class_t cls, const char *topic,
+                        const char *payload, int len, int qos, int retain)
+{
+     int64_t publish_us = esp_timer_get_time();
+     int msg_id = esp_mqtt_client_publish(client->mqtt_handle, topic, payload, len, qos, retain); ////return msg_id or -1(failure)
+     if (msg_id < 0) {
+          tbcm_ratelimit_refund(&client->ratelimit, cls);
+     }
+     tbcm_linkstats_on_publish(&client->linkstats, msg_id, qos, publish_us);
+     return msg_id;
+}
+
+/**
+ * @brief Send queued messages in priority order with weighted fair draining
+ *
+ * Notes:
+ * - It should be called periodically, e.g. in tbcmh_run()
+ * - A class is skipped for the rest of this drain when its head message has no token of
+ *   the rate limit or fails to publish, the other classes keep draining
+ * - A message of TBCM_RATELIMIT_POLICY_WAIT is dropped if it isn't sent in max_wait_ms
+ *
+ * @return count of sent messages
+ */
+int tbcm_txqueue_drain(tbcm_handle_t client)
+{
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(client, 0);
+     if (!client->mqtt_handle || !tbcm_is_connected(client)) {
+          return 0;
+     }
+
+     int sent = 0;
+     uint32_t skipped = 0; // classes whose head message can't be sent in this drain
+     xSemaphoreTake(client->lock, portMAX_DELAY);
+     while (sent < client->txqueue.max_drain_count) {
+          tbcm_txqueue_priority_t priority;
+          tbcm_txmsg_t *msg = tbcm_txqueue_peek(&client->txqueue, skipped, &priority);
+          if (!msg) {
+               break;
+          }
+          tbcm_ratelimit_class_t cls = tbcm_ratelimit_classify(msg->topic);
+          if (msg->expire_us > 0 && esp_timer_get_time() >= msg->expire_us) {
+               TBC_LOGW("Rate limit is exceeded for max_wait_ms, drop publish message! topic=%s", msg->topic);
+               tbcm_ratelimit_reject(&client->ratelimit, cls);
+               tbcm_txqueue_drop(&client->txqueue, priority);
+               continue;
+          }
+          if (!tbcm_ratelimit_try_acquire(&client->ratelimit, cls)) {
+               skipped |= 1u << priority;
+               continue;
+          }
+          int msg_id = _tbcm_publish_acquired(client, cls, msg->topic, msg->payload,
+                                              msg->len, msg->qos, msg->retain);
+          if (msg_id < 0) {
+               TBC_LOGW("Unable to send queued message, try again later! topic=%s", msg->topic);
+               skipped |= 1u << priority;
+               continue;
+          }
+          tbcm_txqueue_pop(&client->txqueue, priority);
+          sent++;
+     }
+     xSemaphoreGive(client->lock);
+     return sent;
+}
+
+/**
+ * @brief Client to send a publish message with a binary or text payload to the broker immediately
+ *
+ * @param topic     topic string
+ * @param payload   payload, it needn't to be null-terminated, e.g. protobuf
+ * @param len       length of payload
+ * @param qos       qos of publish message
+ * @param retain    ratain flag
+ *
+ * @return message_id of the subscribe message on success
+ *         0 if cannot publish
+ *        -1 if error, or it is rejected by the rate limiter
+ */
+static int _tbcm_publish_now(tbcm_handle_t client, const char *topic, const char *payload,
+                        int len, int qos /*= 1*/, int retain /*= 0*/)
+{
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(client, -1);
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(client->mqtt_handle, -1);
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(topic, -1);
+
+     tbcm_ratelimit_class_t cls = tbcm_ratelimit_classify(topic);
+     if (!tbcm_ratelimit_acquire(&client->ratelimit, cls)) {
+          TBC_LOGW("Rate limit is exceeded, drop publish message! topic=%s", topic);
+          return -1;
+     }
+
+     return _tbcm_publish_acquired(client, cls, topic, payload, len, qos, retain);
+}
+
+// Log a length-aware payload: JSON is printed, protobuf is binary and only its length is printed
+static void _tbcm_log_payload(tbcm_handle_t client, const char *prefix, const char *payload, int len)
+{
+     if (client->config.payload_type == TBC_TRANSPORT_PAYLOAD_TYPE_JSON) {
+          TBC_LOGI("%s %.*s", prefix, len, payload ? payload : "");
+     } else {
+          TBC_LOGI("%s protobuf payload_len=%d", prefix, len);
+     }
+}
+
+// Protobuf encoding of the requests sent by the wrapper, see ThingsBoard transport.proto:
+//   message AttributesRequest { string clientKeys = 1; string sharedKeys = 2; }
+//   message ToServerRpcRequestMsg { int32 requestId = 1; string methodName = 2; string params = 3; }
+#define TBCM_PB_WIRETYPE_VARINT            (0)
+#define TBCM_PB_WIRETYPE_LENGTH            (2)
+#define TBCM_PB_ATTRIBUTES_REQUEST_CLIENT  (1)
+#define TBCM_PB_ATTRIBUTES_REQUEST_SHARED  (2)
+#define TBCM_PB_CLIENTRPC_REQUEST_ID       (1)
+#define TBCM_PB_CLIENTRPC_REQUEST_METHOD   (2)
+#define TBCM_PB_CLIENTRPC_REQUEST_PARAMS   (3)
+#define TBCM_PB_FIELD_OVERHEAD             (1 + 10) /*!< max size of tag & varint length/value */
+
+// buf must have at least 10 bytes free. return the count of bytes written
+static int _tbcm_pb_put_varint(char *buf, uint64_t value)
+{
+     int len = 0;
+     do {
+          uint8_t byte = value & 0x7F;
+          value >>= 7;
+          buf[len++] = value ? (byte | 0x80) : byte;
+     } while (value);
+     return len;
+}
+
+// buf must have at least TBCM_PB_FIELD_OVERHEAD + len bytes free. return the count of bytes written
+static int _tbcm_pb_put_string(char *buf, uint32_t field_number, const char *value, int len)
+{
+     int pos = _tbcm_pb_put_varint(buf, (field_number << 3) | TBCM_PB_WIRETYPE_LENGTH);
+     pos += _tbcm_pb_put_varint(buf + pos, len);
+     memcpy(buf + pos, value, len);
+     return pos + len;
+}
+
+/**
+ * @brief Client to send a publish message with a binary or text payload to the broker
+ *
+ * Notes:
+ * - If the priority TX queue is enabled, the message may be queued, see tbcm_txqueue_set()
+ *
+ * @param topic     topic string
+ * @param payload   payload, it needn't to be null-terminated, e.g. protobuf
+ * @param len       length of payload
+ * @param qos       qos of publish message
+ * @param retain    ratain flag
+ *
+ * @return message_id of the subscribe message on success
+ *         TBCM_PUBLISH_QUEUED if it is queued
+ *         0 if cannot publish
+ *        -1 if error, or it is rejected by the rate limiter or the full TX queue
+ */
+static int _tbcm_publish_ex(tbcm_handle_t client, const char *topic, const char *payload,
+                        int len, int qos /*= 1*/, int retain /*= 0*/)
+{
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(client, -1);
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(client->mqtt_handle, -1);
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(topic, -1);
+
+     // The caller may hold its own lock, so TBCM_RATELIMIT_POLICY_WAIT never blocks here:
+     // the message waits in TX queue up to max_wait_ms, even if TX queue is disabled.
+     tbcm_ratelimit_class_t cls = tbcm_ratelimit_classify(topic);
+     uint32_t max_wait_ms = tbcm_ratelimit_get_max_wait(&client->ratelimit, cls);
+     if (!client->txqueue.is_enabled && max_wait_ms == 0) {
+          return _tbcm_publish_now(client, topic, payload, len, qos, retain);
+     }
+
+     // publish immediately if nothing of the same or higher priority is waiting, otherwise queue it
+     tbcm_txqueue_priority_t priority = tbcm_txqueue_classify(topic);
+     int64_t expire_us = (max_wait_ms > 0) ? esp_timer_get_time() + (int64_t)max_wait_ms * 1000 : 0;
+     int msg_id;
+     xSemaphoreTake(client->lock, portMAX_DELAY);
+     if (!tbcm_txqueue_is_blocked(&client->txqueue, priority)
+         && tbcm_ratelimit_try_acquire(&client->ratelimit, cls)) {
+          msg_id = _tbcm_publish_acquired(client, cls, topic, payload, len, qos, retain);
+     } else {
+          msg_id = tbcm_txqueue_push(&client->txqueue, priority, topic, payload, len, qos, retain,
+                                     expire_us) ? TBCM_PUBLISH_QUEUED : -1;
+     }
+     xSemaphoreGive(client->lock);
+     return msg_id;
+}
+
 /**
  * @brief Client to send a publish message to the broker
  *
@@ -492,18 +830,15 @@ int tbcm_unsubscribe(tbcm_handle_t client, const char *topic)
  * @param retain    ratain flag
  *
  * @return message_id of the subscribe message on success
+ *         TBCM_PUBLISH_QUEUED if it is queued
  *         0 if cannot publish
  *        -1 if error
  */
 static int _tbcm_publish(tbcm_handle_t client, const char *topic, const char *payload,
                         int qos /*= 1*/, int retain /*= 0*/)
 {
-     TBC_CHECK_PTR_WITH_RETURN_VALUE(client, -1);
-     TBC_CHECK_PTR_WITH_RETURN_VALUE(client->mqtt_handle, -1);
-     TBC_CHECK_PTR_WITH_RETURN_VALUE(topic, -1);
-
      int len = (payload == NULL) ? 0 : strlen(payload); //// +1
-     return esp_mqtt_client_publish(client->mqtt_handle, topic, payload, len, qos, retain); ////return msg_id or -1(failure)
+     return _tbcm_publish_ex(client, topic, payload, len, qos, retain);
 }
 
 /**
@@ -520,6 +855,7 @@ static int _tbcm_publish(tbcm_handle_t client, const char *topic, const char *pa
  * @param retain     ratain flag
  *
  * @return msg_id of the subscribe message on success
+ *         TBCM_PUBLISH_QUEUED if it is queued
  *         0 if cannot publish
  *        -1 if error
  */
@@ -550,6 +886,7 @@ int tbcm_telemetry_publish(tbcm_handle_t client, const char *telemetry,
  * @param retain        ratain flag
  *
  * @return message_id of the subscribe message on success
+ *         TBCM_PUBLISH_QUEUED if it is queued
  *         0 if cannot publish
  *        -1 if error
  */
@@ -566,6 +903,86 @@ int tbcm_clientattributes_publish(tbcm_handle_t client, const char *attributes,
      return message_id;
 }
 
+/**
+ * @brief Client to send a 'Telemetry' publish message with a length-aware payload to the broker
+ *
+ * Notes:
+ * - It is thread safe, please refer to `esp_mqtt_client_subscribe` for details
+ * - payload may be JSON or protobuf, it needn't to be null-terminated
+ *
+ * @param payload    payload
+ * @param len        length of payload
+ * @param qos        qos of publish message
+ * @param retain     ratain flag
+ *
+ * @return msg_id of the subscribe message on success
+ *         TBCM_PUBLISH_QUEUED if it is queued
+ *         0 if cannot publish
+ *        -1 if error
+ */
+int tbcm_telemetry_publish_ex(tbcm_handle_t client, const char *payload, int len,
+                              int qos /*= 1*/, int retain /*= 0*/)
+{
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(client, -1);
+
+     if (client->config.log_rxtx_package) {
+        _tbcm_log_payload(client, "[Telemetry][Tx]", payload, len);
+     }
+
+     return _tbcm_publish_ex(client, TB_MQTT_TOPIC_TELEMETRY_PUBLISH, payload, len, qos, retain);
+}
+
+/**
+ * @brief Same as tbcm_telemetry_publish_ex(), but it is never queued by the priority TX queue
+ *
+ * Notes:
+ * - It is used when msg_id must be tracked, e.g. replay of store-and-forward log
+ *
+ * @return msg_id of the subscribe message on success
+ *         0 if cannot publish
+ *        -1 if error, or it is rejected by the rate limiter
+ */
+int tbcm_telemetry_publish_now(tbcm_handle_t client, const char *payload, int len,
+                               int qos /*= 1*/, int retain /*= 0*/)
+{
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(client, -1);
+
+     if (client->config.log_rxtx_package) {
+        _tbcm_log_payload(client, "[Telemetry][Tx]", payload, len);
+     }
+
+     return _tbcm_publish_now(client, TB_MQTT_TOPIC_TELEMETRY_PUBLISH, payload, len, qos, retain);
+}
+
+/**
+ * @brief Client to send a 'Attributes' publish message with a length-aware payload to the broker
+ *
+ * Notes:
+ * - It is thread safe, please refer to `esp_mqtt_client_subscribe` for details
+ * - payload may be JSON or protobuf, it needn't to be null-terminated
+ *
+ * @param payload       payload
+ * @param len           length of payload
+ * @param qos           qos of publish message
+ * @param retain        ratain flag
+ *
+ * @return message_id of the subscribe message on success
+ *         TBCM_PUBLISH_QUEUED if it is queued
+ *         0 if cannot publish
+ *        -1 if error
+ */
+int tbcm_clientattributes_publish_ex(tbcm_handle_t client, const char *payload, int len,
+                                     int qos /*= 1*/, int retain /*= 0*/)
+{
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(client, -1);
+
+     if (client->config.log_rxtx_package) {
+        _tbcm_log_payload(client, "[Client-Side Attributes][Tx]", payload, len);
+     }
+
+     return _tbcm_publish_ex(client, TB_MQTT_TOPIC_CLIENT_ATTRIBUTES_PUBLISH, payload, len, qos, retain);
+}
+
 /**
  * @brief Client to send a 'Attributes Request' publish message to the broker
  *
@@ -611,6 +1028,45 @@ int tbcm_attributes_request(tbcm_handle_t client, const char *payload,
      return message_id;
 }
 
+// 'Attributes Request' with an AttributesRequest protobuf payload
+static int _tbcm_attributes_request_pb(tbcm_handle_t client,
+                                       const char *client_keys, int client_len,
+                                       const char *shared_keys, int shared_len,
+                                       uint32_t request_id, int qos, int retain)
+{
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(client->mqtt_handle, -1);
+
+     int topic_size = strlen(TB_MQTT_TOPIC_ATTRIBUTES_REQUEST_PREFIX) + 20;
+     int size = topic_size + 2 * TBCM_PB_FIELD_OVERHEAD + client_len + shared_len;
+     char *topic = TBC_MALLOC(size);
+     if (!topic) {
+          TBC_LOGE("Unable to malloc memory");
+          return -1;
+     }
+     memset(topic, 0x00, size);
+     snprintf(topic, topic_size - 1, TB_MQTT_TOPIC_ATTRIBUTES_REQUEST_PATTERN, request_id);
+
+     // payload follows topic in the same allocation
+     char *payload = topic + topic_size;
+     int len = 0;
+     if (client_len > 0) {
+          len += _tbcm_pb_put_string(payload + len, TBCM_PB_ATTRIBUTES_REQUEST_CLIENT, client_keys, client_len);
+     }
+     if (shared_len > 0) {
+          len += _tbcm_pb_put_string(payload + len, TBCM_PB_ATTRIBUTES_REQUEST_SHARED, shared_keys, shared_len);
+     }
+
+     if (client->config.log_rxtx_package) {
+        TBC_LOGI("[Attributes Request][Tx] request_id=%u clientKeys=%.*s sharedKeys=%.*s (protobuf)",
+            request_id, client_len, client_len > 0 ? client_keys : "",
+            shared_len, shared_len > 0 ? shared_keys : "");
+     }
+
+     int msg_id = _tbcm_publish_ex(client, topic, payload, len, qos, retain);
+     TBC_FREE(topic);
+     return msg_id;
+}
+
 /**
  * @brief Client to send a 'Attributes Request' publish message to the broker
  *
@@ -650,6 +1106,11 @@ int tbcm_attributes_request_ex(tbcm_handle_t client,
           return -1;
      }
 
+     if (client->config.payload_type == TBC_TRANSPORT_PAYLOAD_TYPE_PROTOBUF) {
+          return _tbcm_attributes_request_pb(client, client_keys, client_len,
+                                             shared_keys, shared_len, request_id, qos, retain);
+     }
+
      int size = strlen(TB_MQTT_KEY_ATTRIBUTES_REQUEST_CLIENTKEYS) + client_len 
                + strlen(TB_MQTT_KEY_ATTRIBUTES_REQUEST_SHAREDKEYS) + shared_len + 20;
      char *payload = TBC_MALLOC(size);
@@ -722,6 +1183,52 @@ int tbcm_serverrpc_response(tbcm_handle_t client,
      return message_id;
 }
 
+/**
+ * @brief Client to send a 'Server-Side RPC Response' publish message with a length-aware payload
+ *
+ * Notes:
+ * - It is thread safe, please refer to `esp_mqtt_client_subscribe` for details
+ * - payload may be JSON or protobuf, it needn't to be null-terminated
+ *
+ * @param request_id    request_id of server-side RPC request
+ * @param payload       payload
+ * @param len           length of payload
+ * @param qos           qos of publish message
+ * @param retain        ratain flag
+ *
+ * @return message_id of the subscribe message on success
+ *         0 if cannot publish
+ *        -1 if error
+ */
+int tbcm_serverrpc_response_ex(tbcm_handle_t client, uint32_t request_id,
+                               const char *payload, int len,
+                               int qos /*= 1*/, int retain /*= 0*/)
+{
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(client, -1);
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(client->mqtt_handle, -1);
+
+     int size = strlen(TB_MQTT_TOPIC_SERVERRPC_RESPONSE_PREFIX) + 20;
+     char *topic = TBC_MALLOC(size);
+     if (!topic) {
+          TBC_LOGE("Unable to malloc memory!");
+          return -1;
+     }
+     memset(topic, 0x00, size);
+     snprintf(topic, size - 1, TB_MQTT_TOPIC_SERVERRPC_RESPONSE_PATTERN, request_id);
+
+     if (client->config.log_rxtx_package) {
+        if (client->config.payload_type == TBC_TRANSPORT_PAYLOAD_TYPE_JSON) {
+             TBC_LOGI("[Server-Side RPC][Tx] request_id=%u Payload=%.*s", request_id, len, payload);
+        } else {
+             TBC_LOGI("[Server-Side RPC][Tx] request_id=%u protobuf payload_len=%d", request_id, len);
+        }
+     }
+
+     int message_id = _tbcm_publish_ex(client, topic, payload, len, qos, retain);
+     TBC_FREE(topic);
+     return message_id;
+}
+
 /**
  * @brief Client to send a 'Client-Side RPC Request' publish message to the broker
  *
@@ -768,6 +1275,41 @@ int tbcm_clientrpc_request(tbcm_handle_t client, const char *payload,
      return msg_id;
 }
 
+// 'Client-Side RPC Request' with a ToServerRpcRequestMsg protobuf payload, params is a JSON string
+static int _tbcm_clientrpc_request_pb(tbcm_handle_t client, const char *method, const char *params,
+                                      uint32_t request_id, int qos, int retain)
+{
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(client->mqtt_handle, -1);
+
+     int method_len = strlen(method);
+     int params_len = strlen(params);
+     int topic_size = strlen(TB_MQTT_TOPIC_CLIENTRPC_REQUEST_PREFIX) + 20;
+     int size = topic_size + 3 * TBCM_PB_FIELD_OVERHEAD + method_len + params_len;
+     char *topic = TBC_MALLOC(size);
+     if (!topic) {
+          TBC_LOGE("Unable to malloc memory");
+          return -1;
+     }
+     memset(topic, 0x00, size);
+     snprintf(topic, topic_size - 1, TB_MQTT_TOPIC_CLIENTRPC_REQUEST_PATTERN, request_id);
+
+     // payload follows topic in the same allocation
+     char *payload = topic + topic_size;
+     int len = _tbcm_pb_put_varint(payload, (TBCM_PB_CLIENTRPC_REQUEST_ID << 3) | TBCM_PB_WIRETYPE_VARINT);
+     len += _tbcm_pb_put_varint(payload + len, request_id);
+     len += _tbcm_pb_put_string(payload + len, TBCM_PB_CLIENTRPC_REQUEST_METHOD, method, method_len);
+     len += _tbcm_pb_put_string(payload + len, TBCM_PB_CLIENTRPC_REQUEST_PARAMS, params, params_len);
+
+     if (client->config.log_rxtx_package) {
+        TBC_LOGI("[Client-Side RPC][Tx] request_id=%u method=%s params=%s (protobuf)",
+              request_id, method, params);
+     }
+
+     int msg_id = _tbcm_publish_ex(client, topic, payload, len, qos, retain);
+     TBC_FREE(topic);
+     return msg_id;
+}
+
 /**
  * @brief Client to send a 'Client-Side RPC Request' publish message to the broker
  *
@@ -793,6 +1335,12 @@ int tbcm_clientrpc_request_ex(tbcm_handle_t client,
                               int qos /*= 1*/, int retain /*= 0*/)
 {
      TBC_CHECK_PTR_WITH_RETURN_VALUE(client, -1);
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(method, -1);
+     TBC_CHECK_PTR_WITH_RETURN_VALUE(params, -1);
+
+     if (client->config.payload_type == TBC_TRANSPORT_PAYLOAD_TYPE_PROTOBUF) {
+          return _tbcm_clientrpc_request_pb(client, method, params, request_id, qos, retain);
+     }
 
      int size = strlen(TB_MQTT_KEY_RPC_METHOD) + strlen(method) + strlen(TB_MQTT_KEY_RPC_PARAMS) + strlen(params) + 20;
      char *payload = TBC_MALLOC(size);
@@ -925,9 +1473,35 @@ int tbcm_otaupdate_chunk_request(tbcm_handle_t client,
      return msg_id;
 }
 
+// Large shared attributes & server-side RPC requests are parsed fragment by fragment, instead of being merged.
+static bool _on_mqtt_data_is_streamed(void *client_, const char *topic, int topic_len,
+                                      int total_payload_len)
+{
+    tbcm_t *client = (tbcm_t *)client_;
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(client, false);
+    TBC_CHECK_PTR_WITH_RETURN_VALUE(topic, false);
+
+    if (client->config.payload_type != TBC_TRANSPORT_PAYLOAD_TYPE_JSON ||
+        total_payload_len <= TBCM_RX_STREAM_THRESHOLD) {
+        return false;
+    }
+    // TB_MQTT_TOPIC_ATTRIBUTES_RESPONSE_PREFIX starts with TB_MQTT_TOPIC_SHARED_ATTRIBUTES
+    if (topic_len == strlen(TB_MQTT_TOPIC_SHARED_ATTRIBUTES) &&
+        strncmp(topic, TB_MQTT_TOPIC_SHARED_ATTRIBUTES, topic_len) == 0) {
+        return true;
+    }
+    if (topic_len > strlen(TB_MQTT_TOPIC_SERVERRPC_REQUEST_PREFIX) &&
+        strncmp(topic, TB_MQTT_TOPIC_SERVERRPC_REQUEST_PREFIX,
+                strlen(TB_MQTT_TOPIC_SERVERRPC_REQUEST_PREFIX)) == 0) {
+        return true;
+    }
+    return false;
+}
+
 static void _on_mqtt_data_handle(void *client_, esp_mqtt_event_handle_t src_event,
                                       char *topic, int topic_len,
-                                      char *payload, int payload_len)
+                                      char *payload, int payload_len,
+                                      int payload_offset, int total_payload_len)
 {
     tbcm_t *client = (tbcm_t *)client_;
     tbcm_event_t dst_event = {0};
@@ -940,6 +1514,8 @@ static void _on_mqtt_data_handle(void *client_, esp_mqtt_event_handle_t src_even
 
     memset(&dst_event, 0x00, sizeof(dst_event));
     memset(&publish_data, 0x00, sizeof(publish_data));
+    publish_data.payload_offset    = payload_offset;    /*!< Offset of this fragment in the whole payload */
+    publish_data.total_payload_len = total_payload_len; /*!< Length of the whole payload */
 
     if (strncmp(topic, TB_MQTT_TOPIC_ATTRIBUTES_RESPONSE_PREFIX,
                 strlen(TB_MQTT_TOPIC_ATTRIBUTES_RESPONSE_PREFIX)) == 0) {
@@ -1182,7 +1758,8 @@ static void _on_mqtt_event_handle(void *handler_args, esp_event_base_t base, int
           ////TBC_LOGI("DATA=%.*s", event->data_len, event->data);
           {
               // If payload may be into multiple packets, then multiple packages need to be merged, eg: F/W OTA!
-              tbcm_payload_buffer_pocess(&client->buffer, src_event, client, _on_mqtt_data_handle);
+              tbcm_payload_buffer_pocess(&client->buffer, src_event, client,
+                                         _on_mqtt_data_is_streamed, _on_mqtt_data_handle);
           }
           break;
 
@@ -1211,10 +1788,16 @@ static void _on_mqtt_event_handle(void *handler_args, esp_event_base_t base, int
         }
         break;
 
-    case MQTT_EVENT_SUBSCRIBED:
-    case MQTT_EVENT_UNSUBSCRIBED:
     case MQTT_EVENT_PUBLISHED:
     case MQTT_EVENT_DELETED:
+        if (src_event->event_id == MQTT_EVENT_PUBLISHED) {
+            tbcm_linkstats_on_published(&client->linkstats, src_event->msg_id);
+        } else {
+            tbcm_linkstats_on_deleted(&client->linkstats, src_event->msg_id);
+        }
+        // fall through
+    case MQTT_EVENT_SUBSCRIBED:
+    case MQTT_EVENT_UNSUBSCRIBED:
     case MQTT_EVENT_ERROR:
     case MQTT_EVENT_BEFORE_CONNECT:
     default:
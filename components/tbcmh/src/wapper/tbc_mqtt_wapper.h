@@ -24,6 +24,8 @@
 
 #include "tbc_mqtt_protocol.h"
 #include "tbc_transport_config.h"
+#include "tbc_mqtt_ratelimit.h"
+#include "tbc_mqtt_txqueue.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -39,6 +41,12 @@ typedef enum
   TBCM_STATE_CONNECTED
 } tbcm_state_t;
 
+/**
+ * Returned by publish functions instead of msg_id when the message is queued by TX queue,
+ * i.e. it isn't sent yet. MQTT msg_id is 1~65535, so it never conflicts with one.
+ */
+#define TBCM_PUBLISH_QUEUED (0x10000)
+
 /**
  * ThingsBoard Client MQTT handle
  */
@@ -100,6 +108,8 @@ typedef struct tbcm_publish_data{
     uint32_t   chunk_id;            /*!< The second pararm in topic */
     char *payload;                  /*!< Payload associated with this event */
     int   payload_len;              /*!< Length of the payload for this event */
+    int   payload_offset;           /*!< Offset of this fragment in the whole payload, 0 if payload is complete */
+    int   total_payload_len;        /*!< Length of the whole payload. Larger than payload_len if payload is a streamed fragment */
 } tbcm_publish_data_t;
 
 /**
@@ -131,6 +141,18 @@ bool tbcm_is_connecting(tbcm_handle_t client);
 bool tbcm_is_disconnected(tbcm_handle_t client);
 tbcm_state_t tbcm_get_state(tbcm_handle_t client);
 
+bool tbcm_ratelimit_set(tbcm_handle_t client, tbcm_ratelimit_class_t cls, const char *limits,
+                        tbcm_ratelimit_policy_t policy, uint32_t max_wait_ms);
+uint32_t tbcm_ratelimit_rejected(tbcm_handle_t client, tbcm_ratelimit_class_t cls);
+void tbcm_txqueue_set(tbcm_handle_t client, bool is_enabled, int max_size,
+                      const int *weights, int max_drain_count);
+int tbcm_txqueue_count(tbcm_handle_t client);
+uint32_t tbcm_txqueue_lost_count(tbcm_handle_t client, tbcm_txqueue_priority_t priority);
+int tbcm_txqueue_drain(tbcm_handle_t client);
+char *tbcm_txqueue_take_telemetry(tbcm_handle_t client, int *len);
+uint32_t tbcm_ack_latency(tbcm_handle_t client);
+int tbcm_outbox_size(tbcm_handle_t client);
+
 int tbcm_subscribe(tbcm_handle_t client, const char *topic, int qos /*=0*/);
 int tbcm_unsubscribe(tbcm_handle_t client, const char *topic);
 
@@ -138,6 +160,12 @@ int tbcm_telemetry_publish(tbcm_handle_t client, const char *telemetry,
                            int qos /*= 1*/, int retain /*= 0*/);
 int tbcm_clientattributes_publish(tbcm_handle_t client, const char *attributes,
                                   int qos /*= 1*/, int retain /*= 0*/);
+int tbcm_telemetry_publish_ex(tbcm_handle_t client, const char *payload, int len,
+                              int qos /*= 1*/, int retain /*= 0*/);
+int tbcm_telemetry_publish_now(tbcm_handle_t client, const char *payload, int len,
+                               int qos /*= 1*/, int retain /*= 0*/);
+int tbcm_clientattributes_publish_ex(tbcm_handle_t client, const char *payload, int len,
+                                     int qos /*= 1*/, int retain /*= 0*/);
 int tbcm_attributes_request(tbcm_handle_t client, const char *payload,
                             uint32_t request_id,
                             int qos /*= 1*/, int retain /*= 0*/);
@@ -146,6 +174,9 @@ int tbcm_attributes_request_ex(tbcm_handle_t client, const char *client_keys, co
                                int qos /*= 1*/, int retain /*= 0*/);
 int tbcm_serverrpc_response(tbcm_handle_t client, uint32_t request_id, const char *response,
                             int qos /*= 1*/, int retain /*= 0*/);
+int tbcm_serverrpc_response_ex(tbcm_handle_t client, uint32_t request_id,
+                               const char *payload, int len,
+                               int qos /*= 1*/, int retain /*= 0*/);
 int tbcm_clientrpc_request(tbcm_handle_t client, const char *payload,
                            uint32_t request_id,
                            int qos /*= 1*/, int retain /*= 0*/);
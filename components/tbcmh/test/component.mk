@@ -3,5 +3,6 @@
 #
 
 COMPONENT_SRCDIRS := .
+COMPONENT_PRIV_INCLUDEDIRS := ../src/transport ../src/wapper ../src/helper
 
 COMPONENT_ADD_LDFLAGS = -Wl,--whole-archive -l$(COMPONENT_NAME) -Wl,--no-whole-archive
\ No newline at end of file
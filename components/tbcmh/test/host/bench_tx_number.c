@@ -0,0 +1,176 @@
+// Copyright 2022 liangzhuzhi2020@gmail.com, https://github.com/liang-zhu-zi/esp32-thingsboard-mqtt-client
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Host benchmark of number formatting of TX writer, against cJSON print_number().
+//
+// cjson:    the algorithm of print_number() of cJSON 1.7.x, which is used by cJSON_Print*():
+//           "%d" for integers, else "%1.15g", sscanf() & compare_double(), else "%1.17g".
+//           It is a copy of the algorithm, so cJSON needn't be built for the host.
+// snprintf: the previous TX writer, fast path of exact decimals, else "%1.15g", strtod() & "%1.17g".
+// grisu2:   _tbcmh_txnumber_format(), fast path of exact decimals, else Grisu2.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <float.h>
+#include <math.h>
+
+#include "tx_number.h"
+#include "host_test.h"
+
+#define BENCH_COUNT   (200000)
+#define BENCH_ROUNDS  (5)
+
+static int _cjson_compare_double(double a, double b)
+{
+    double max_value = fabs(a) > fabs(b) ? fabs(a) : fabs(b);
+    return (fabs(a - b) <= max_value * DBL_EPSILON);
+}
+
+static int _cjson_print_number(char *out, double d)
+{
+    char number_buffer[26] = {0};
+    double test = 0.0;
+    int valueint = (d >= INT_MAX) ? INT_MAX : (d <= (double)INT_MIN) ? INT_MIN : (int)d; // cJSON_SetNumberHelper()
+    int length, i;
+
+    if (isnan(d) || isinf(d)) {
+        length = sprintf(number_buffer, "null");
+    } else if (d == (double)valueint) {
+        length = sprintf(number_buffer, "%d", valueint);
+    } else {
+        length = sprintf(number_buffer, "%1.15g", d);
+        if ((sscanf(number_buffer, "%lg", &test) != 1) || !_cjson_compare_double(test, d)) {
+            length = sprintf(number_buffer, "%1.17g", d);
+        }
+    }
+    for (i = 0; i < length; i++) {   // decimal point of locale is replaced by '.'
+        out[i] = number_buffer[i];
+    }
+    out[length] = '\0';
+    return length;
+}
+
+static const double _snprintf_pow10[TXNUMBER_MAX_DECIMALS + 1] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9
+};
+
+static int _snprintf_format(char *out, double value)
+{
+    if (isnan(value) || isinf(value)) {
+        memcpy(out, "null", 5);
+        return 4;
+    }
+    double magnitude = fabs(value);
+    if (magnitude == 0.0 || (magnitude >= 1.0e-4 && magnitude < 1.0e15)) {
+        int k;
+        for (k = 0; k <= TXNUMBER_MAX_DECIMALS; k++) {
+            double scaled = value * _snprintf_pow10[k];
+            if (fabs(scaled) >= 9007199254740992.0) {
+                break;
+            }
+            int64_t mantissa = (int64_t)llround(scaled);
+            if ((double)mantissa / _snprintf_pow10[k] == value) {
+                return _tbcmh_txnumber_format_fixed(out, mantissa, k, false);
+            }
+        }
+    }
+    int len = sprintf(out, "%1.15g", value);
+    if (strtod(out, NULL) != value) {
+        len = sprintf(out, "%1.17g", value);
+    }
+    return len;
+}
+
+typedef int (*bench_format_t)(char *out, double value);
+
+// Best of rounds, in ns per number. bytes is total length of output
+static double _bench(bench_format_t format, const double *values, int count, long *bytes)
+{
+    char out[32];
+    double best = 0;
+    int round, i;
+    for (round = 0; round < BENCH_ROUNDS; round++) {
+        long total = 0;
+        double start = host_test_now_ns();
+        for (i = 0; i < count; i++) {
+            total += format(out, values[i]);
+        }
+        double elapsed = (host_test_now_ns() - start) / count;
+        if (round == 0 || elapsed < best) {
+            best = elapsed;
+        }
+        *bytes = total;
+    }
+    return best;
+}
+
+static void _bench_corpus(const char *name, const double *values, int count)
+{
+    long cjson_bytes = 0, snprintf_bytes = 0, grisu2_bytes = 0;
+    double cjson = _bench(_cjson_print_number, values, count, &cjson_bytes);
+    double snprintf_ns = _bench(_snprintf_format, values, count, &snprintf_bytes);
+    double grisu2 = _bench(_tbcmh_txnumber_format, values, count, &grisu2_bytes);
+    printf("%-24s %9.1f %9.1f %9.1f   %6.2f %6.2f %6.2f   %5.1fx\n", name,
+           cjson, snprintf_ns, grisu2,
+           (double)cjson_bytes / count, (double)snprintf_bytes / count, (double)grisu2_bytes / count,
+           cjson / grisu2);
+}
+
+int main(void)
+{
+    double *values = malloc(BENCH_COUNT * sizeof(double));
+    if (!values) {
+        return 1;
+    }
+    uint64_t seed = 3;
+    int i;
+
+    printf("%-24s %9s %9s %9s   %6s %6s %6s   %6s\n", "corpus (ns/number)", "cjson", "snprintf", "grisu2",
+           "B/cj", "B/snp", "B/gr", "speedup");
+
+    for (i = 0; i < BENCH_COUNT; i++) {      // e.g. temperature 25.5, humidity 61.23
+        values[i] = (double)((int64_t)(host_test_rand(&seed) % 20000) - 5000) / 100;
+    }
+    _bench_corpus("sensor, 2 decimals", values, BENCH_COUNT);
+
+    for (i = 0; i < BENCH_COUNT; i++) {      // e.g. counters, timestamps in ms
+        values[i] = (double)(host_test_rand(&seed) % 2000000000000ULL);
+    }
+    _bench_corpus("integer < 2e12", values, BENCH_COUNT);
+
+    for (i = 0; i < BENCH_COUNT; i++) {      // e.g. ADC voltage 3.3 * raw / 4095
+        values[i] = 3.3 * (host_test_rand(&seed) % 4096) / 4095;
+    }
+    _bench_corpus("computed, 17 digits", values, BENCH_COUNT);
+
+    for (i = 0; i < BENCH_COUNT; i++) {      // uniform in [0, 1)
+        values[i] = (host_test_rand(&seed) >> 11) * (1.0 / 9007199254740992.0);
+    }
+    _bench_corpus("uniform [0, 1)", values, BENCH_COUNT);
+
+    for (i = 0; i < BENCH_COUNT; i++) {      // any finite double
+        uint64_t bits;
+        do {
+            bits = host_test_rand(&seed);
+            memcpy(&values[i], &bits, sizeof(double));
+        } while (isnan(values[i]) || isinf(values[i]));
+    }
+    _bench_corpus("random bits", values, BENCH_COUNT);
+
+    free(values);
+    return 0;
+}
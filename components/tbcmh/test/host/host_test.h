@@ -0,0 +1,77 @@
+// Copyright 2022 liangzhuzhi2020@gmail.com, https://github.com/liang-zhu-zi/esp32-thingsboard-mqtt-client
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Minimal assertions of host tests, they run without ESP-IDF & Unity.
+
+#ifndef _HOST_TEST_H_
+#define _HOST_TEST_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+static int host_test_failures __attribute__((unused)) = 0;
+static int host_test_failed __attribute__((unused)) = 0;
+
+#define HOST_TEST_ASSERT(condition) \
+    do { \
+        if (!(condition)) { \
+            printf("    %s:%d: %s is false\n", __FILE__, __LINE__, #condition); \
+            host_test_failed = 1; \
+            return; \
+        } \
+    } while (0)
+
+#define HOST_TEST_ASSERT_EQUAL_STRING(expected, actual) \
+    do { \
+        const char *_expected = (expected), *_actual = (actual); \
+        if (strcmp(_expected, _actual) != 0) { \
+            printf("    %s:%d: expected \"%s\", got \"%s\"\n", __FILE__, __LINE__, _expected, _actual); \
+            host_test_failed = 1; \
+            return; \
+        } \
+    } while (0)
+
+#define HOST_TEST_RUN(test) \
+    do { \
+        host_test_failed = 0; \
+        test(); \
+        printf("%s: %s\n", host_test_failed ? "FAIL" : "PASS", #test); \
+        host_test_failures += host_test_failed; \
+    } while (0)
+
+static inline int host_test_report(void)
+{
+    printf("%d failures\n", host_test_failures);
+    return host_test_failures ? 1 : 0;
+}
+
+// xorshift64*, deterministic across hosts
+static inline uint64_t host_test_rand(uint64_t *seed)
+{
+    *seed ^= *seed >> 12;
+    *seed ^= *seed << 25;
+    *seed ^= *seed >> 27;
+    return *seed * 0x2545F4914F6CDD1DULL;
+}
+
+static inline double host_test_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+#endif
@@ -0,0 +1,35 @@
+// Host shim of an ESP-IDF header for test/host, only what tbcmh headers & tx_writer.c use.
+
+#pragma once
+
+typedef int cJSON_bool;
+
+#define cJSON_False   (1 << 0)
+#define cJSON_True    (1 << 1)
+#define cJSON_NULL    (1 << 2)
+#define cJSON_Number  (1 << 3)
+#define cJSON_String  (1 << 4)
+#define cJSON_Array   (1 << 5)
+#define cJSON_Object  (1 << 6)
+#define cJSON_Raw     (1 << 7)
+
+typedef struct cJSON {
+    struct cJSON *next;
+    struct cJSON *prev;
+    struct cJSON *child;
+    int type;
+    char *valuestring;
+    int valueint;
+    double valuedouble;
+    char *string;
+} cJSON;
+
+cJSON_bool cJSON_IsFalse(const cJSON * const item);
+cJSON_bool cJSON_IsTrue(const cJSON * const item);
+cJSON_bool cJSON_IsNull(const cJSON * const item);
+cJSON_bool cJSON_IsNumber(const cJSON * const item);
+cJSON_bool cJSON_IsString(const cJSON * const item);
+cJSON_bool cJSON_IsRaw(const cJSON * const item);
+cJSON_bool cJSON_PrintPreallocated(cJSON *item, char *buffer, const int length, const cJSON_bool format);
+char *cJSON_PrintUnformatted(const cJSON *item);
+void cJSON_free(void *object);
@@ -0,0 +1,8 @@
+// Host shim of an ESP-IDF header for test/host, only what tbcmh headers & tx_writer.c use.
+
+#pragma once
+
+typedef int esp_err_t;
+
+#define ESP_OK          (0)
+#define ESP_FAIL        (-1)
@@ -0,0 +1,11 @@
+// Host shim of an ESP-IDF header for test/host, only what tbcmh headers & tx_writer.c use.
+
+#pragma once
+
+#include <stdio.h>
+
+#define ESP_LOGE(tag, format, ...)  printf("E (%s) " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...)  printf("W (%s) " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...)  printf("I (%s) " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...)  do { (void)(tag); } while (0)
+#define ESP_LOGV(tag, format, ...)  do { (void)(tag); } while (0)
@@ -0,0 +1,22 @@
+// Host shim of an ESP-IDF header for test/host, only what tbcmh headers & tx_writer.c use.
+
+#pragma once
+
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define pdTRUE              (1)
+#define pdFALSE             (0)
+#define pdPASS              (1)
+#define portMAX_DELAY       (0xFFFFFFFF)
+#define portTICK_PERIOD_MS  (1)
+#define pdMS_TO_TICKS(ms)   (ms)
+
+// Host tests are single-threaded
+typedef struct { int owner; int count; } portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED  {0, 0}
+#define taskENTER_CRITICAL(mux)       ((void)(mux))
+#define taskEXIT_CRITICAL(mux)        ((void)(mux))
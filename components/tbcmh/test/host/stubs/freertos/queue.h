@@ -0,0 +1,5 @@
+// Host shim of an ESP-IDF header for test/host, only what tbcmh headers & tx_writer.c use.
+
+#pragma once
+
+typedef void *QueueHandle_t;
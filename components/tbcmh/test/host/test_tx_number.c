@@ -0,0 +1,241 @@
+// Copyright 2022 liangzhuzhi2020@gmail.com, https://github.com/liang-zhu-zi/esp32-thingsboard-mqtt-client
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Host test of number formatting of TX writer: round trip, shortness & JSON syntax.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <float.h>
+#include <math.h>
+
+#include "tx_number.h"
+#include "host_test.h"
+
+// Digits of the shortest "%.*e" that is parsed back to value
+static int _shortest_digits(double value)
+{
+    char buffer[40];
+    int precision;
+    for (precision = 1; precision < 17; precision++) {
+        snprintf(buffer, sizeof(buffer), "%.*e", precision - 1, value);
+        if (strtod(buffer, NULL) == value) {
+            break;
+        }
+    }
+    return precision;
+}
+
+// Count of significant digits of a JSON number
+static int _count_digits(const char *number)
+{
+    const char *p = number;
+    int count = 0, zeros = 0;
+    bool leading = true;
+    for (; *p && *p != 'e'; p++) {
+        if (*p < '0' || *p > '9') {
+            continue;
+        }
+        if (leading && *p == '0') {
+            continue;
+        }
+        leading = false;
+        if (*p == '0') {
+            zeros++;   // trailing zeros of an integer aren't significant
+        } else {
+            count += zeros + 1;
+            zeros = 0;
+        }
+    }
+    return count;
+}
+
+// JSON number grammar: -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+static bool _is_json_number(const char *p)
+{
+    if (*p == '-') {
+        p++;
+    }
+    if (*p == '0') {
+        p++;
+    } else if (*p >= '1' && *p <= '9') {
+        while (*p >= '0' && *p <= '9') p++;
+    } else {
+        return false;
+    }
+    if (*p == '.') {
+        p++;
+        if (*p < '0' || *p > '9') return false;
+        while (*p >= '0' && *p <= '9') p++;
+    }
+    if (*p == 'e' || *p == 'E') {
+        p++;
+        if (*p == '+' || *p == '-') p++;
+        if (*p < '0' || *p > '9') return false;
+        while (*p >= '0' && *p <= '9') p++;
+    }
+    return *p == '\0';
+}
+
+// Format value, check its syntax, length & that it is parsed back to the same bits
+static bool _check_round_trip(double value, char *out)
+{
+    int len = _tbcmh_txnumber_format(out, value);
+    double parsed = strtod(out, NULL);
+    if (len != (int)strlen(out) || len >= TXNUMBER_MAX_LEN || !_is_json_number(out)
+        || memcmp(&parsed, &value, sizeof(value)) != 0) {
+        printf("    %.17g -> \"%s\" -> %.17g\n", value, out, parsed);
+        return false;
+    }
+    return true;
+}
+
+static void test_sensor_readings(void)
+{
+    // N/10^d with at most 15 significant digits, in 1e-4..1e15: exactly the printed decimals
+    char out[TXNUMBER_MAX_LEN], expected[64];
+    uint64_t seed = 1;
+    int d, i;
+    for (d = 0; d <= 9; d++) {
+        for (i = 0; i < 100000; i++) {
+            int digits = 1 + host_test_rand(&seed) % 15;
+            int64_t n = (int64_t)(host_test_rand(&seed) % (uint64_t)pow(10, digits));
+            double value = (double)n / pow(10, d) * ((i & 1) ? -1 : 1);
+            if (fabs(value) < 1e-4 || fabs(value) >= 1e15) {
+                continue;
+            }
+            snprintf(expected, sizeof(expected), "%.*f", d, value);
+            if (d > 0) {
+                char *end = expected + strlen(expected) - 1;
+                while (*end == '0') *end-- = '\0';
+                if (*end == '.') *end = '\0';
+            }
+            HOST_TEST_ASSERT(_check_round_trip(value, out));
+            HOST_TEST_ASSERT_EQUAL_STRING(expected, out);
+        }
+    }
+}
+
+static void test_near_2_53(void)
+{
+    char out[TXNUMBER_MAX_LEN], expected[64];
+    const double two53 = 9007199254740992.0;
+    double value;
+    int i;
+    for (i = -2000; i <= 2000; i++) {
+        value = two53 + i;
+        HOST_TEST_ASSERT(_check_round_trip(value, out));
+        HOST_TEST_ASSERT(_check_round_trip(-value, out));
+        snprintf(expected, sizeof(expected), "%.0f", value);
+        HOST_TEST_ASSERT_EQUAL_STRING(expected, (_tbcmh_txnumber_format(out, value), out));
+    }
+    for (i = -2000; i <= 2000; i++) {
+        value = two53 / 1024 + i + 0.5;     // fractions below 2^53
+        HOST_TEST_ASSERT(_check_round_trip(value, out));
+    }
+    value = two53;
+    for (i = 0; i < 1000; i++) {
+        value = nextafter(value, 0);
+        HOST_TEST_ASSERT(_check_round_trip(value, out));
+    }
+}
+
+static void test_special_values(void)
+{
+    char out[TXNUMBER_MAX_LEN];
+    double zero = 0.0, negative_zero = -0.0;
+    HOST_TEST_ASSERT(_check_round_trip(negative_zero, out));
+    HOST_TEST_ASSERT_EQUAL_STRING("-0", out);
+    HOST_TEST_ASSERT(_check_round_trip(zero, out));
+    HOST_TEST_ASSERT_EQUAL_STRING("0", out);
+
+    const double values[] = {DBL_MIN, DBL_MAX, -DBL_MAX, 5e-324, 2.2250738585072009e-308, 1e21, 1e22, 1e23,
+                             1e-5, 1e-7, 0.1 + 0.2, 1.0 / 3, 9007199254740993.0, 123456789012345678.0,
+                             1e15, 1e15 + 0.5, 0.0001, 0.00009999999999999999, 4.9406564584124654e-324};
+    int i;
+    for (i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+        HOST_TEST_ASSERT(_check_round_trip(values[i], out));
+    }
+
+    _tbcmh_txnumber_format(out, 0.1 + 0.2);
+    HOST_TEST_ASSERT_EQUAL_STRING("0.30000000000000004", out);
+    _tbcmh_txnumber_format(out, 1e21);
+    HOST_TEST_ASSERT_EQUAL_STRING("1e21", out);
+    _tbcmh_txnumber_format(out, 1e-7);
+    HOST_TEST_ASSERT_EQUAL_STRING("1e-7", out);
+    _tbcmh_txnumber_format(out, 1.5e-5);
+    HOST_TEST_ASSERT_EQUAL_STRING("0.000015", out);
+    _tbcmh_txnumber_format(out, -DBL_MAX);
+    HOST_TEST_ASSERT_EQUAL_STRING("-1.7976931348623157e308", out);
+    _tbcmh_txnumber_format(out, 5e-324);
+    HOST_TEST_ASSERT_EQUAL_STRING("5e-324", out);
+
+    _tbcmh_txnumber_format(out, NAN);
+    HOST_TEST_ASSERT_EQUAL_STRING("null", out);
+    _tbcmh_txnumber_format(out, -INFINITY);
+    HOST_TEST_ASSERT_EQUAL_STRING("null", out);
+}
+
+static void test_random_doubles(void)
+{
+    char out[TXNUMBER_MAX_LEN];
+    uint64_t seed = 2;
+    int i, longer = 0, count = 0;
+    for (i = 0; i < 1000000; i++) {
+        uint64_t bits = host_test_rand(&seed);
+        double value;
+        memcpy(&value, &bits, sizeof(value));
+        if (isnan(value) || isinf(value)) {
+            continue;
+        }
+        count++;
+        HOST_TEST_ASSERT(_check_round_trip(value, out));
+        int extra = _count_digits(out) - _shortest_digits(value);
+        HOST_TEST_ASSERT(extra >= 0);
+        longer += (extra > 0);
+    }
+    // Grisu2 isn't the shortest for about 0.1% of doubles
+    printf("    %d of %d random doubles are longer than the shortest\n", longer, count);
+    HOST_TEST_ASSERT(longer < count / 500);
+}
+
+static void test_fixed_decimals(void)
+{
+    char out[TXNUMBER_MAX_LEN];
+    _tbcmh_txnumber_format_rounded(out, 25.4996, 2);
+    HOST_TEST_ASSERT_EQUAL_STRING("25.5", out);
+    _tbcmh_txnumber_format_rounded(out, -0.005, 2);
+    HOST_TEST_ASSERT_EQUAL_STRING("-0.01", out);
+    _tbcmh_txnumber_format_rounded(out, 3.0, 9);
+    HOST_TEST_ASSERT_EQUAL_STRING("3", out);
+    _tbcmh_txnumber_format_rounded(out, 1e300, 2);     // not exact, shortest instead
+    HOST_TEST_ASSERT_EQUAL_STRING("1e300", out);
+    _tbcmh_txnumber_format_rounded(out, 0.1 + 0.2, 10); // out of range, shortest instead
+    HOST_TEST_ASSERT_EQUAL_STRING("0.30000000000000004", out);
+    _tbcmh_txnumber_format_fixed(out, -5, 3, false);
+    HOST_TEST_ASSERT_EQUAL_STRING("-0.005", out);
+    _tbcmh_txnumber_format_fixed(out, INT64_MIN, 0, false);
+    HOST_TEST_ASSERT_EQUAL_STRING("-9223372036854775808", out);
+}
+
+int main(void)
+{
+    HOST_TEST_RUN(test_sensor_readings);
+    HOST_TEST_RUN(test_near_2_53);
+    HOST_TEST_RUN(test_special_values);
+    HOST_TEST_RUN(test_random_doubles);
+    HOST_TEST_RUN(test_fixed_decimals);
+    return host_test_report();
+}
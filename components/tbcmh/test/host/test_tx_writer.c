@@ -0,0 +1,291 @@
+// Copyright 2022 liangzhuzhi2020@gmail.com, https://github.com/liang-zhu-zi/esp32-thingsboard-mqtt-client
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Host test of TX writer: buffer growth, max size, rollback of a key/value pair & escaping.
+// tx_writer.c is built against the ESP-IDF shims in stubs/, the rest of tbcmh is stubbed below.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "tbc_mqtt_helper_internal.h"
+#include "tx_writer.h"
+#include "pb_codec.h"
+#include "telemetry_upload.h"
+#include "attributes_mirror.h"
+#include "host_test.h"
+
+#define PAYLOAD_MAX_SIZE  (TBCMH_TX_BUFFER_MAX_SIZE)
+
+static tbcmh_t client;
+static char published[PAYLOAD_MAX_SIZE + 1];   // last payload passed to _tbcmh_telemetry_publish()
+static int published_len = -1;
+
+//==== Stubs of ESP-IDF & the other parts of tbcmh ===================================
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t semaphore, TickType_t ticks) { return pdTRUE; }
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t semaphore) { return pdTRUE; }
+
+cJSON_bool cJSON_IsFalse(const cJSON * const item) { return item && item->type == cJSON_False; }
+cJSON_bool cJSON_IsTrue(const cJSON * const item) { return item && item->type == cJSON_True; }
+cJSON_bool cJSON_IsNull(const cJSON * const item) { return item && item->type == cJSON_NULL; }
+cJSON_bool cJSON_IsNumber(const cJSON * const item) { return item && item->type == cJSON_Number; }
+cJSON_bool cJSON_IsString(const cJSON * const item) { return item && item->type == cJSON_String; }
+cJSON_bool cJSON_IsRaw(const cJSON * const item) { return item && item->type == cJSON_Raw; }
+cJSON_bool cJSON_PrintPreallocated(cJSON *item, char *buffer, const int length, const cJSON_bool format) { return false; }
+char *cJSON_PrintUnformatted(const cJSON *item) { return NULL; }
+void cJSON_free(void *object) { free(object); }
+
+bool _tbcmh_pbcodec_put_int(txwriter_t *txwriter, uint32_t field_number, int64_t value) { return false; }
+bool _tbcmh_pbcodec_put_double(txwriter_t *txwriter, uint32_t field_number, double value) { return false; }
+bool _tbcmh_pbcodec_put_float(txwriter_t *txwriter, uint32_t field_number, float value) { return false; }
+bool _tbcmh_pbcodec_put_bytes(txwriter_t *txwriter, uint32_t field_number, const char *value, int len) { return false; }
+
+void _tbcmh_attributemirror_on_publish(tbcmh_handle_t client, const cJSON *object) {}
+void _tbcmh_attributemirror_on_publish_payload(tbcmh_handle_t client, const char *payload, int len) {}
+int tbcm_clientattributes_publish_ex(tbcm_handle_t client, const char *payload, int len, int qos, int retain) { return -1; }
+int64_t tbcmh_timesync_now_ms(tbcmh_handle_t client) { return 1451649600512LL; }
+
+int _tbcmh_telemetry_publish(tbcmh_handle_t client, const char *payload, int len, int qos, int retain)
+{
+    if (len < 0 || len > PAYLOAD_MAX_SIZE) {
+        published_len = -1;
+        return -1;
+    }
+    memcpy(published, payload, len);
+    published[len] = '\0';
+    published_len = len;
+    return 1;
+}
+
+//==== Helpers =======================================================================
+
+static void _setup(void)
+{
+    memset(&client, 0x00, sizeof(client));
+    client._lock = (SemaphoreHandle_t)&client;
+    client.config.payload_type = TBC_TRANSPORT_PAYLOAD_TYPE_JSON;
+    _tbcmh_txwriter_on_create(&client);
+    published_len = -1;
+}
+
+static void _teardown(void)
+{
+    _tbcmh_txwriter_on_destroy(&client);
+}
+
+static char *_repeat(char c, int n)
+{
+    char *str = malloc(n + 1);
+    memset(str, c, n);
+    str[n] = '\0';
+    return str;
+}
+
+// Published payload is exactly the expected one, and '\0' fits into the TX buffer
+static bool _check_published(const char *expected)
+{
+    if (published_len != (int)strlen(expected) || strcmp(published, expected) != 0) {
+        printf("    published %d bytes, expected %d bytes\n", published_len, (int)strlen(expected));
+        return false;
+    }
+    return published_len + 1 <= client.txwriter.size && client.txwriter.size <= PAYLOAD_MAX_SIZE;
+}
+
+//==== Tests =========================================================================
+
+static void test_buffer_growth(void)
+{
+    // The TX buffer starts at 512 bytes and doubles up to 16 KiB, it never grows beyond it
+    char key[16];
+    char *value = _repeat('x', 200);
+    int i, last_size = 0, grows = 0;
+    _setup();
+    HOST_TEST_ASSERT(tbcmh_tx_begin(&client, TBCMH_TX_TELEMETRY) == ESP_OK);
+    HOST_TEST_ASSERT(client.txwriter.size == TBCMH_TX_BUFFER_INIT_SIZE);
+    for (i = 0; i < 200; i++) {
+        snprintf(key, sizeof(key), "k%03d", i);
+        if (tbcmh_tx_add_string(&client, key, value) != ESP_OK) {
+            break;
+        }
+        if (client.txwriter.size != last_size) {
+            HOST_TEST_ASSERT(last_size == 0 || client.txwriter.size == last_size * 2);
+            last_size = client.txwriter.size;
+            grows++;
+        }
+        HOST_TEST_ASSERT(client.txwriter.len + 2 <= client.txwriter.size);
+    }
+    HOST_TEST_ASSERT(i < 200);
+    HOST_TEST_ASSERT(grows == 6);   // 512, 1K, 2K, 4K, 8K, 16K
+    HOST_TEST_ASSERT(client.txwriter.size == PAYLOAD_MAX_SIZE);
+
+    // The buffer is kept between messages
+    HOST_TEST_ASSERT(tbcmh_tx_commit(&client, 1, 0) == 1);
+    HOST_TEST_ASSERT(published_len <= PAYLOAD_MAX_SIZE - 1);
+    HOST_TEST_ASSERT(tbcmh_tx_begin(&client, TBCMH_TX_TELEMETRY) == ESP_OK);
+    HOST_TEST_ASSERT(client.txwriter.size == PAYLOAD_MAX_SIZE);
+    tbcmh_tx_abort(&client);
+    free(value);
+    _teardown();
+}
+
+static void test_rollback_when_pair_does_not_fit(void)
+{
+    char key[16];
+    char *value = _repeat('v', 1000);
+    char *expected = malloc(PAYLOAD_MAX_SIZE * 2);
+    int i, len, count, pos;
+    _setup();
+
+    // Fill the buffer with 1 KB pairs until one doesn't fit
+    HOST_TEST_ASSERT(tbcmh_tx_begin(&client, TBCMH_TX_TELEMETRY) == ESP_OK);
+    pos = sprintf(expected, "{");
+    for (i = 0; ; i++) {
+        snprintf(key, sizeof(key), "k%02d", i);
+        len = client.txwriter.len;
+        count = client.txwriter.count;
+        if (tbcmh_tx_add_string(&client, key, value) != ESP_OK) {
+            break;
+        }
+        pos += sprintf(expected + pos, "%s\"%s\":\"%s\"", i ? "," : "", key, value);
+    }
+    HOST_TEST_ASSERT(i == 16);   // 16 pairs of 1009 bytes
+    // Nothing of the pair is left, neither ',' nor the key
+    HOST_TEST_ASSERT(client.txwriter.len == len);
+    HOST_TEST_ASSERT(client.txwriter.count == count);
+    HOST_TEST_ASSERT(memcmp(client.txwriter.buffer, expected, len) == 0);
+
+    // A smaller pair still fits into the rest of the buffer
+    HOST_TEST_ASSERT(tbcmh_tx_add_int(&client, "n", 1) == ESP_OK);
+    pos += sprintf(expected + pos, ",\"n\":1}");
+    HOST_TEST_ASSERT(tbcmh_tx_commit(&client, 1, 0) == 1);
+    HOST_TEST_ASSERT(_check_published(expected));
+
+    // Pair which is too big alone is rejected, and the message is still empty
+    char *huge = _repeat('h', PAYLOAD_MAX_SIZE);
+    HOST_TEST_ASSERT(tbcmh_tx_begin(&client, TBCMH_TX_TELEMETRY) == ESP_OK);
+    HOST_TEST_ASSERT(tbcmh_tx_add_string(&client, "huge", huge) == ESP_FAIL);
+    HOST_TEST_ASSERT(client.txwriter.len == 1 && client.txwriter.count == 0);
+    HOST_TEST_ASSERT(tbcmh_tx_add_bool(&client, "a", true) == ESP_OK);
+    HOST_TEST_ASSERT(tbcmh_tx_commit(&client, 1, 0) == 1);
+    HOST_TEST_ASSERT(_check_published("{\"a\":true}"));
+
+    free(huge);
+    free(expected);
+    free(value);
+    _teardown();
+}
+
+static void test_rollback_at_exact_limit(void)
+{
+    // Grow a pair byte by byte: the last one which fits leaves room for '}' & '\0' only
+    char *value = _repeat('e', PAYLOAD_MAX_SIZE);
+    int n;
+    _setup();
+    for (n = PAYLOAD_MAX_SIZE - 16; n < PAYLOAD_MAX_SIZE; n++) {
+        value[n] = '\0';
+        HOST_TEST_ASSERT(tbcmh_tx_begin(&client, TBCMH_TX_TELEMETRY) == ESP_OK);
+        if (tbcmh_tx_add_string(&client, "k", value) != ESP_OK) {
+            tbcmh_tx_abort(&client);
+            break;
+        }
+        HOST_TEST_ASSERT(tbcmh_tx_commit(&client, 1, 0) == 1);
+        value[n] = 'e';
+    }
+    // {"k":"..."} is 8 bytes + n, plus '\0'
+    HOST_TEST_ASSERT(n == PAYLOAD_MAX_SIZE - 8);
+    HOST_TEST_ASSERT(published_len == PAYLOAD_MAX_SIZE - 1);
+    HOST_TEST_ASSERT(published[published_len - 1] == '}');
+
+    // Same for a timestamped message, which keeps one more byte for '}' of "values"
+    const char *head = "{\"ts\":1451649600512,\"values\":{\"k\":\"";
+    int head_len = strlen(head);
+    memset(value, 'e', PAYLOAD_MAX_SIZE);
+    for (n = PAYLOAD_MAX_SIZE - 64; n < PAYLOAD_MAX_SIZE; n++) {
+        value[n] = '\0';
+        HOST_TEST_ASSERT(tbcmh_tx_begin_ts(&client, 0) == ESP_OK);
+        if (tbcmh_tx_add_string(&client, "k", value) != ESP_OK) {
+            HOST_TEST_ASSERT(client.txwriter.len == head_len - 5 && client.txwriter.count == 0);
+            tbcmh_tx_abort(&client);
+            break;
+        }
+        HOST_TEST_ASSERT(tbcmh_tx_commit(&client, 1, 0) == 1);
+        value[n] = 'e';
+    }
+    HOST_TEST_ASSERT(n == PAYLOAD_MAX_SIZE - head_len - 3);   // head + n + "}} + '\0'
+    HOST_TEST_ASSERT(published_len == PAYLOAD_MAX_SIZE - 1);
+    HOST_TEST_ASSERT(strncmp(published, head, head_len) == 0);
+    HOST_TEST_ASSERT(strcmp(published + published_len - 3, "\"}}") == 0);
+
+    free(value);
+    _teardown();
+}
+
+static void test_escaping(void)
+{
+    _setup();
+    HOST_TEST_ASSERT(tbcmh_tx_begin(&client, TBCMH_TX_TELEMETRY) == ESP_OK);
+    HOST_TEST_ASSERT(tbcmh_tx_add_string(&client, "q\"k", "a\"b\\c/\b\f\n\r\t\x01\x1f\x7f\xc3\xa9") == ESP_OK);
+    HOST_TEST_ASSERT(tbcmh_tx_add_string(&client, "null", NULL) == ESP_OK);
+    HOST_TEST_ASSERT(tbcmh_tx_commit(&client, 1, 0) == 1);
+    HOST_TEST_ASSERT(_check_published("{\"q\\\"k\":\"a\\\"b\\\\c/\\b\\f\\n\\r\\t\\u0001\\u001f\x7f\xc3\xa9\","
+                                      "\"null\":null}"));
+
+    // Escaping makes a pair 6 times longer: it is measured before the buffer grows
+    char *controls = _repeat('\x02', PAYLOAD_MAX_SIZE / 6);
+    HOST_TEST_ASSERT(tbcmh_tx_begin(&client, TBCMH_TX_TELEMETRY) == ESP_OK);
+    HOST_TEST_ASSERT(tbcmh_tx_add_int(&client, "a", -1) == ESP_OK);
+    HOST_TEST_ASSERT(tbcmh_tx_add_string(&client, "c", controls) == ESP_FAIL);
+    controls[PAYLOAD_MAX_SIZE / 6 - 8] = '\0';
+    HOST_TEST_ASSERT(tbcmh_tx_add_string(&client, "c", controls) == ESP_OK);
+    HOST_TEST_ASSERT(tbcmh_tx_commit(&client, 1, 0) == 1);
+    HOST_TEST_ASSERT(published_len == 15 + (PAYLOAD_MAX_SIZE / 6 - 8) * 6);
+    HOST_TEST_ASSERT(strncmp(published, "{\"a\":-1,\"c\":\"\\u0002", 18) == 0);
+    HOST_TEST_ASSERT(strcmp(published + published_len - 8, "\\u0002\"}") == 0);
+
+    free(controls);
+    _teardown();
+}
+
+static void test_abort(void)
+{
+    _setup();
+    HOST_TEST_ASSERT(tbcmh_tx_begin(&client, TBCMH_TX_TELEMETRY) == ESP_OK);
+    HOST_TEST_ASSERT(tbcmh_tx_add_float(&client, "t", 25.5) == ESP_OK);
+    tbcmh_tx_abort(&client);
+    HOST_TEST_ASSERT(!client.txwriter.is_begun && client.txwriter.len == 0);
+    HOST_TEST_ASSERT(tbcmh_tx_add_int(&client, "x", 1) == ESP_FAIL);   // not begun
+
+    // Nothing added: the message isn't published
+    HOST_TEST_ASSERT(tbcmh_tx_begin(&client, TBCMH_TX_TELEMETRY) == ESP_OK);
+    HOST_TEST_ASSERT(tbcmh_tx_commit(&client, 1, 0) == -1);
+    HOST_TEST_ASSERT(published_len == -1);
+
+    HOST_TEST_ASSERT(tbcmh_tx_begin(&client, TBCMH_TX_TELEMETRY) == ESP_OK);
+    HOST_TEST_ASSERT(tbcmh_tx_add_float_fixed(&client, "h", 61.2349, 2) == ESP_OK);
+    HOST_TEST_ASSERT(tbcmh_tx_commit(&client, 1, 0) == 1);
+    HOST_TEST_ASSERT(_check_published("{\"h\":61.23}"));
+    _teardown();
+}
+
+int main(void)
+{
+    HOST_TEST_RUN(test_buffer_growth);
+    HOST_TEST_RUN(test_rollback_when_pair_does_not_fit);
+    HOST_TEST_RUN(test_rollback_at_exact_limit);
+    HOST_TEST_RUN(test_escaping);
+    HOST_TEST_RUN(test_abort);
+    return host_test_report();
+}
@@ -1,7 +1,274 @@
-#if !CONFIG_FREERTOS_UNICORE
+// Copyright 2022 liangzhuzhi2020@gmail.com, https://github.com/liang-zhu-zi/esp32-thingsboard-mqtt-client
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
 
-#ifdef CONFIG_ESP_IPC_USES_CALLERS_PRIORITY
+// Unit tests of the parsers of received payloads. They are untrusted broker input.
 
-#endif /* CONFIG_ESP_IPC_USE_CALLERS_PRIORITY */
+#include <string.h>
 
-#endif /* !CONFIG_FREERTOS_UNICORE */
\ No newline at end of file
+#include "unity.h"
+
+#include "tbc_mqtt_helper_internal.h"
+
+//==== JSON scanner ===================================================================
+
+// Find key in json, then compare its string value with expected
+static bool _test_scanner_find_string(const char *json, const char *key, const char *expected)
+{
+    const char *value = NULL;
+    int value_len = 0;
+    const char *str = NULL;
+    int str_len = 0;
+    return _tbcmh_jsonscanner_find(json, strlen(json), key, &value, &value_len)
+           && _tbcmh_jsonscanner_get_string(value, value_len, &str, &str_len)
+           && _tbcmh_jsonscanner_equals(str, str_len, expected);
+}
+
+TEST_CASE("jsonscanner finds top-level members only", "[tbcmh][jsonscanner]")
+{
+    const char *json = "{\"params\":{\"method\":\"inner\"},\"method\":\"outer\",\"n\":[1,{\"a\":2}]}";
+    const char *value = NULL;
+    int value_len = 0;
+
+    TEST_ASSERT_TRUE(_test_scanner_find_string(json, "method", "outer"));
+    TEST_ASSERT_TRUE(_tbcmh_jsonscanner_find(json, strlen(json), "n", &value, &value_len));
+    TEST_ASSERT_EQUAL_INT(11, value_len);
+    TEST_ASSERT_EQUAL_STRING_LEN("[1,{\"a\":2}]", value, value_len);
+    TEST_ASSERT_FALSE(_tbcmh_jsonscanner_find(json, strlen(json), "a", &value, &value_len));
+    TEST_ASSERT_FALSE(_tbcmh_jsonscanner_find("[1,2]", 5, "a", &value, &value_len));
+}
+
+TEST_CASE("jsonscanner compares escaped keys", "[tbcmh][jsonscanner]")
+{
+    TEST_ASSERT_TRUE(_test_scanner_find_string("{\"k\":\"a\\\"b\\\\c\\/d\\n\"}", "k", "a\"b\\c/d\n"));
+    TEST_ASSERT_TRUE(_test_scanner_find_string("{\"k\":\"\\u0041\\u00e9\\u20AC\"}", "k", "A\xC3\xA9\xE2\x82\xAC"));
+    TEST_ASSERT_TRUE(_test_scanner_find_string("{\"\\u006b\":\"v\"}", "k", "v"));
+    TEST_ASSERT_FALSE(_test_scanner_find_string("{\"k\":\"\\q\"}", "k", "q"));
+    TEST_ASSERT_FALSE(_test_scanner_find_string("{\"k\":\"\\u00g0\"}", "k", ""));
+}
+
+TEST_CASE("jsonscanner decodes surrogate pairs and rejects lone surrogates", "[tbcmh][jsonscanner]")
+{
+    TEST_ASSERT_TRUE(_test_scanner_find_string("{\"k\":\"\\ud83d\\ude00\"}", "k", "\xF0\x9F\x98\x80"));
+    TEST_ASSERT_FALSE(_test_scanner_find_string("{\"k\":\"\\ud83d\"}", "k", ""));
+    TEST_ASSERT_FALSE(_test_scanner_find_string("{\"k\":\"\\ud83dx\"}", "k", "x"));
+    TEST_ASSERT_FALSE(_test_scanner_find_string("{\"k\":\"\\ud83d\\u0041\"}", "k", "A"));
+    TEST_ASSERT_FALSE(_test_scanner_find_string("{\"k\":\"\\ude00\"}", "k", "\xED\xB8\x80"));
+}
+
+TEST_CASE("jsonscanner doesn't read beyond a C string on \\u0000", "[tbcmh][jsonscanner]")
+{
+    // cstr is "a" followed by '\0' and 'b', "a\u0000b" must not match it
+    static const char cstr[] = { 'a', '\0', 'b', '\0' };
+    const char *str = "a\\u0000b";
+
+    TEST_ASSERT_FALSE(_tbcmh_jsonscanner_equals(str, strlen(str), cstr));
+    TEST_ASSERT_FALSE(_tbcmh_jsonscanner_equals(str, strlen(str), "a"));
+    TEST_ASSERT_FALSE(_tbcmh_jsonscanner_equals("a\\u0000", 7, "a"));
+    TEST_ASSERT_FALSE(_tbcmh_jsonscanner_equals("ab", 2, "a"));
+    TEST_ASSERT_FALSE(_tbcmh_jsonscanner_equals("a", 1, "ab"));
+    TEST_ASSERT_TRUE(_tbcmh_jsonscanner_equals("", 0, ""));
+}
+
+TEST_CASE("jsonscanner rejects truncated input", "[tbcmh][jsonscanner]")
+{
+    const char *json = "{\"method\":\"setValue\",\"params\":{\"a\":[1,2,\"x\"]}}";
+    const char *value = NULL;
+    int value_len = 0;
+    int len;
+
+    // Every prefix that cuts the value of params off must not find it
+    for (len = 0; len < strlen(json) - 1; len++) {
+        TEST_ASSERT_FALSE(_tbcmh_jsonscanner_find(json, len, "params", &value, &value_len));
+    }
+    TEST_ASSERT_TRUE(_tbcmh_jsonscanner_find(json, strlen(json), "params", &value, &value_len));
+
+    TEST_ASSERT_FALSE(_test_scanner_find_string("{\"k\":\"\\u00", "k", ""));
+    TEST_ASSERT_FALSE(_test_scanner_find_string("{\"k\":\"ab\\", "k", "ab"));
+}
+
+TEST_CASE("jsonscanner iterates elements of an array", "[tbcmh][jsonscanner]")
+{
+    const char *json = " [ {\"a\":\"],\"} , [1,[2]],\"x\" ,3 ]";
+    const char *value = NULL;
+    int value_len = 0;
+    jsonscanner_t scanner;
+
+    TEST_ASSERT_FALSE(_tbcmh_jsonscanner_init_array(&scanner, "{}", 2));
+    TEST_ASSERT_TRUE(_tbcmh_jsonscanner_init_array(&scanner, json, strlen(json)));
+    TEST_ASSERT_TRUE(_tbcmh_jsonscanner_next_element(&scanner, &value, &value_len));
+    TEST_ASSERT_EQUAL_INT(10, value_len);
+    TEST_ASSERT_EQUAL_INT(0, strncmp(value, "{\"a\":\"],\"}", value_len));
+    TEST_ASSERT_TRUE(_tbcmh_jsonscanner_next_element(&scanner, &value, &value_len));
+    TEST_ASSERT_EQUAL_INT(0, strncmp(value, "[1,[2]]", value_len));
+    TEST_ASSERT_TRUE(_tbcmh_jsonscanner_next_element(&scanner, &value, &value_len));
+    TEST_ASSERT_EQUAL_INT(0, strncmp(value, "\"x\"", value_len));
+    TEST_ASSERT_TRUE(_tbcmh_jsonscanner_next_element(&scanner, &value, &value_len));
+    TEST_ASSERT_EQUAL_INT(0, strncmp(value, "3", value_len));
+    TEST_ASSERT_FALSE(_tbcmh_jsonscanner_next_element(&scanner, &value, &value_len));
+
+    // a truncated element isn't returned
+    TEST_ASSERT_TRUE(_tbcmh_jsonscanner_init_array(&scanner, "[{\"a\":1", 7));
+    TEST_ASSERT_FALSE(_tbcmh_jsonscanner_next_element(&scanner, &value, &value_len));
+}
+
+//==== Streaming JSON parser ==========================================================
+
+typedef struct
+{
+    int count;           // count of events
+    int string_count;    // count of complete strings
+    char string[64];     // the last complete string, chunks are joined
+    int string_len;      // length of string
+    double number;       // the last number
+} test_sax_result_t;
+
+static bool _test_sax_on_event(void *context, const tbcmh_json_event_t *event)
+{
+    test_sax_result_t *result = (test_sax_result_t *)context;
+    result->count++;
+    if (event->type == TBCMH_JSON_EVENT_STRING) {
+        if (result->string_len + event->string_len < sizeof(result->string)) {
+            memcpy(result->string + result->string_len, event->string, event->string_len);
+            result->string_len += event->string_len;
+        }
+        if (!event->is_partial) {
+            result->string_count++;
+            result->string[result->string_len] = '\0';
+            result->string_len = 0;
+        }
+    } else if (event->type == TBCMH_JSON_EVENT_NUMBER) {
+        result->number = event->number;
+    }
+    return true;
+}
+
+// Feed json in fragments of step bytes, return true if a whole value is parsed
+static bool _test_sax_parse(const char *json, int step, test_sax_result_t *result)
+{
+    jsonsax_t *sax = TBC_MALLOC(sizeof(jsonsax_t));
+    if (!sax) {
+        return false;
+    }
+    memset(result, 0x00, sizeof(test_sax_result_t));
+    _tbcmh_jsonsax_init(sax, _test_sax_on_event);
+
+    int len = strlen(json);
+    int pos;
+    bool is_ok = true;
+    for (pos = 0; is_ok && pos < len; pos += step) {
+        is_ok = _tbcmh_jsonsax_feed(sax, json + pos, (len - pos < step) ? len - pos : step, result);
+    }
+    is_ok = is_ok && _tbcmh_jsonsax_is_done(sax);
+    TBC_FREE(sax);
+    return is_ok;
+}
+
+TEST_CASE("jsonsax gives the same events for any fragmentation", "[tbcmh][jsonsax]")
+{
+    const char *json = "{\"a\":{\"b\":[1,-2.5e1,true,null]},\"s\":\"x\\ty\\u00e9\\ud83d\\ude00\"}";
+    test_sax_result_t whole;
+    test_sax_result_t result;
+    int step;
+
+    TEST_ASSERT_TRUE(_test_sax_parse(json, strlen(json), &whole));
+    TEST_ASSERT_EQUAL_STRING("x\ty\xC3\xA9\xF0\x9F\x98\x80", whole.string);
+    TEST_ASSERT_EQUAL_INT(1, whole.string_count);
+    for (step = 1; step < 8; step++) {
+        TEST_ASSERT_TRUE(_test_sax_parse(json, step, &result));
+        TEST_ASSERT_EQUAL_INT(whole.count, result.count);
+        TEST_ASSERT_EQUAL_STRING(whole.string, result.string);
+    }
+}
+
+TEST_CASE("jsonsax splits long strings into chunks", "[tbcmh][jsonsax]")
+{
+    static char json[TBCMH_JSON_SAX_TOKEN_SIZE + 16];
+    test_sax_result_t result;
+
+    // A string longer than a token is delivered in chunks, they are joined to the first 63 bytes
+    strcpy(json, "{\"k\":\"");
+    memset(json + 6, 'x', TBCMH_JSON_SAX_TOKEN_SIZE + 4);
+    strcpy(json + 6 + TBCMH_JSON_SAX_TOKEN_SIZE + 4, "\"}");
+    TEST_ASSERT_TRUE(_test_sax_parse(json, 100, &result));
+    TEST_ASSERT_EQUAL_INT(1, result.string_count);
+
+    // A key isn't split
+    json[0] = '{';
+    json[1] = '\"';
+    memset(json + 2, 'k', TBCMH_JSON_SAX_TOKEN_SIZE + 1);
+    strcpy(json + 2 + TBCMH_JSON_SAX_TOKEN_SIZE + 1, "\":1}");
+    TEST_ASSERT_FALSE(_test_sax_parse(json, 100, &result));
+}
+
+TEST_CASE("jsonsax rejects lone surrogates", "[tbcmh][jsonsax]")
+{
+    test_sax_result_t result;
+
+    TEST_ASSERT_FALSE(_test_sax_parse("{\"k\":\"\\ud83d\"}", 1, &result));
+    TEST_ASSERT_FALSE(_test_sax_parse("{\"k\":\"\\ud83dx\"}", 1, &result));
+    TEST_ASSERT_FALSE(_test_sax_parse("{\"k\":\"\\ud83d\\n\"}", 1, &result));
+    TEST_ASSERT_FALSE(_test_sax_parse("{\"k\":\"\\ud83d\\u0041\"}", 1, &result));
+    TEST_ASSERT_FALSE(_test_sax_parse("{\"k\":\"\\ude00\"}", 1, &result));
+    TEST_ASSERT_FALSE(_test_sax_parse("{\"\\ud83d\":1}", 1, &result));
+    TEST_ASSERT_TRUE(_test_sax_parse("{\"k\":\"\\uD83D\\uDE00\"}", 1, &result));
+    TEST_ASSERT_EQUAL_STRING("\xF0\x9F\x98\x80", result.string);
+}
+
+TEST_CASE("jsonsax rejects truncated and malformed input", "[tbcmh][jsonsax]")
+{
+    const char *json = "{\"a\":[1,2,{\"b\":\"c\"}],\"d\":false}";
+    char truncated[64];
+    test_sax_result_t result;
+    int len;
+
+    for (len = 1; len < strlen(json); len++) {
+        memcpy(truncated, json, len);
+        truncated[len] = '\0';
+        TEST_ASSERT_FALSE(_test_sax_parse(truncated, 3, &result));
+    }
+    TEST_ASSERT_TRUE(_test_sax_parse(json, 3, &result));
+
+    TEST_ASSERT_FALSE(_test_sax_parse("{\"a\":1]", 1, &result));
+    TEST_ASSERT_FALSE(_test_sax_parse("{\"a\":tru}", 1, &result));
+    TEST_ASSERT_FALSE(_test_sax_parse("{\"a\":1-}", 1, &result));
+    TEST_ASSERT_FALSE(_test_sax_parse("{\"a\":\"\\x\"}", 1, &result));
+    TEST_ASSERT_FALSE(_test_sax_parse("{\"a\":\"\x01\"}", 1, &result));
+}
+
+//==== JSON arena =====================================================================
+
+TEST_CASE("jsonarena parses escapes and rejects malformed input", "[tbcmh][jsonarena]")
+{
+    tbcmh_handle_t client = tbcmh_init();
+    TEST_ASSERT_NOT_NULL(client);
+    TEST_ASSERT_TRUE(_tbcmh_jsonarena_begin(client));
+
+    const char *json = "{\"s\":\"a\\\"b\\u00e9\\ud83d\\ude00\",\"n\":[1.5,-2],\"t\":true}";
+    cJSON *object = _tbcmh_jsonarena_parse(client, json, strlen(json));
+    TEST_ASSERT_NOT_NULL(object);
+    TEST_ASSERT_EQUAL_STRING("a\"b\xC3\xA9\xF0\x9F\x98\x80",
+                             cJSON_GetObjectItem(object, "s")->valuestring);
+    TEST_ASSERT_EQUAL_INT(2, cJSON_GetArraySize(cJSON_GetObjectItem(object, "n")));
+    TEST_ASSERT_TRUE(cJSON_IsTrue(cJSON_GetObjectItem(object, "t")));
+    _tbcmh_jsonarena_delete(client, object);
+
+    // The arena parser & the cJSON fallback both reject them
+    TEST_ASSERT_NULL(_tbcmh_jsonarena_parse(client, "{\"s\":\"\\ud83d\"}", 14));
+    TEST_ASSERT_NULL(_tbcmh_jsonarena_parse(client, "{\"s\":\"\\ude00\"}", 14));
+    TEST_ASSERT_NULL(_tbcmh_jsonarena_parse(client, json, strlen(json) - 1));
+    TEST_ASSERT_NULL(_tbcmh_jsonarena_parse(client, json, 10));
+
+    _tbcmh_jsonarena_end(client);
+    tbcmh_destroy(client);
+}